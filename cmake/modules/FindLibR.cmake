@@ -13,6 +13,7 @@
 
 # LIBR_FOUND
 # LIBR_HOME
+# LIBR_EXECUTABLE
 # LIBR_INCLUDE_DIRS
 # LIBR_DOC_DIR
 # LIBR_LIBRARIES
@@ -25,6 +26,7 @@ if(APPLE)
       set(LIBR_HOME "${LIBR_LIBRARIES}/Resources" CACHE PATH "R home directory")
       set(LIBR_INCLUDE_DIRS "${LIBR_HOME}/include" CACHE PATH "R include directory")
       set(LIBR_DOC_DIR "${LIBR_HOME}/doc" CACHE PATH "R doc directory")
+      find_program(LIBR_EXECUTABLE R HINTS "${LIBR_HOME}/bin")
    endif()
 
 # detection for UNIX & Win32
@@ -101,6 +103,7 @@ else()
       # set other R paths based on home path
       set(LIBR_INCLUDE_DIRS "${LIBR_HOME}/include" CACHE PATH "R include directory")
       set(LIBR_DOC_DIR "${LIBR_HOME}/doc" CACHE PATH "R doc directory")
+      find_program(LIBR_EXECUTABLE R HINTS "${LIBR_HOME}/bin")
 
       # set library hint path based on whether  we are doing a special session 64 build
       if(LIBR_FIND_WINDOWS_64BIT)
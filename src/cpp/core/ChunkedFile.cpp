@@ -0,0 +1,739 @@
+/*
+ * ChunkedFile.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/ChunkedFile.hpp>
+
+#include <algorithm>
+#include <deque>
+#include <istream>
+#include <ostream>
+
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+
+#ifndef _WIN32
+#include <zlib.h>
+#endif
+
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+
+namespace core {
+namespace chunked_file {
+
+namespace {
+
+const char * const kMagic = "RSCHUNK1";
+const std::size_t kMagicSize = 8;
+
+// size of the blocks which are compressed independently
+const std::size_t kBlockSize = 4 * 1024 * 1024;
+
+// largest block we'll accept when reading (protects against corrupt files)
+const std::size_t kMaxBlockSize = 64 * 1024 * 1024;
+
+void put32(boost::uint32_t value, std::string* pBuffer)
+{
+   for (int i = 0; i < 4; i++)
+      pBuffer->push_back(static_cast<char>((value >> (i * 8)) & 0xFF));
+}
+
+boost::uint32_t get32(const char* pData)
+{
+   const unsigned char* p = reinterpret_cast<const unsigned char*>(pData);
+   return boost::uint32_t(p[0]) |
+          (boost::uint32_t(p[1]) << 8) |
+          (boost::uint32_t(p[2]) << 16) |
+          (boost::uint32_t(p[3]) << 24);
+}
+
+Error chunkFileError(const std::string& description,
+                     const FilePath& path,
+                     const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::io_error, location);
+   error.addProperty("description", description);
+   error.addProperty("path", path.absolutePath());
+   return error;
+}
+
+} // anonymous namespace
+
+// output file shared by all of the blocks of a chunk (the stream is only
+// touched by the writer thread once the chunk's header has been written)
+struct ChunkOutput
+{
+   ChunkInfo info;
+   boost::shared_ptr<std::ostream> pStream;
+};
+
+namespace {
+
+struct Block
+{
+   Block()
+      : codec(kCodecStore), level(1), rawSize(0), cost(0),
+        last(false), done(false)
+   {
+   }
+
+   boost::shared_ptr<ChunkOutput> pOutput;
+   Codec codec;
+   int level;
+   std::string input;
+   std::string output;
+   std::size_t rawSize;
+   std::size_t cost;
+   bool last;
+   bool done;
+   Error error;
+};
+
+typedef boost::shared_ptr<Block> BlockPtr;
+
+Error compressBlock(Block* pBlock)
+{
+   pBlock->rawSize = pBlock->input.size();
+   if (pBlock->codec == kCodecStore || pBlock->input.empty())
+   {
+      pBlock->output.swap(pBlock->input);
+      return Success();
+   }
+
+#ifndef _WIN32
+   uLongf destLen = ::compressBound(pBlock->input.size());
+   pBlock->output.resize(destLen);
+   int result = ::compress2(
+                  reinterpret_cast<Bytef*>(&(pBlock->output[0])),
+                  &destLen,
+                  reinterpret_cast<const Bytef*>(pBlock->input.data()),
+                  pBlock->input.size(),
+                  pBlock->level);
+   if (result != Z_OK)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("zlib-result", result);
+      return error;
+   }
+   pBlock->output.resize(destLen);
+   std::string().swap(pBlock->input);
+   return Success();
+#else
+   return systemError(boost::system::errc::not_supported, ERROR_LOCATION);
+#endif
+}
+
+Error decompressBlock(Block* pBlock)
+{
+   if (pBlock->codec == kCodecStore || pBlock->rawSize == 0)
+   {
+      pBlock->output.swap(pBlock->input);
+      return Success();
+   }
+
+#ifndef _WIN32
+   uLongf destLen = pBlock->rawSize;
+   pBlock->output.resize(destLen);
+   int result = ::uncompress(
+                  reinterpret_cast<Bytef*>(&(pBlock->output[0])),
+                  &destLen,
+                  reinterpret_cast<const Bytef*>(pBlock->input.data()),
+                  pBlock->input.size());
+   if (result != Z_OK || destLen != pBlock->rawSize)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("zlib-result", result);
+      return error;
+   }
+   std::string().swap(pBlock->input);
+   return Success();
+#else
+   return systemError(boost::system::errc::not_supported, ERROR_LOCATION);
+#endif
+}
+
+} // anonymous namespace
+
+
+// Blocks are submitted in order by a producer, transformed (compressed or
+// decompressed) by a pool of worker threads, and handed to a consumer in
+// their original order. One of the producer or consumer runs on a thread
+// owned by the pipeline (the "stage" thread) and the other on the caller's.
+class BlockPipeline : boost::noncopyable
+{
+public:
+   BlockPipeline(bool compress, std::size_t memoryLimit)
+      : compress_(compress),
+        memoryLimit_(memoryLimit),
+        inFlight_(0),
+        closed_(false),
+        stopped_(false)
+   {
+   }
+
+   virtual ~BlockPipeline()
+   {
+      try
+      {
+         stop();
+         join();
+      }
+      catch(...)
+      {
+      }
+   }
+
+   void start(int workers, const boost::function<void()>& stage)
+   {
+      try
+      {
+         for (int i = 0; i < std::max(workers, 1); i++)
+            threads_.create_thread(boost::bind(&BlockPipeline::work, this));
+         threads_.create_thread(stage);
+      }
+      catch(const boost::thread_resource_error& e)
+      {
+         setError(Error(boost::thread_error::ec_from_exception(e),
+                        ERROR_LOCATION));
+         stop();
+      }
+   }
+
+   // add a block (waits while the memory limit is exceeded). returns
+   // false if the pipeline has been stopped
+   bool submit(const BlockPtr& pBlock)
+   {
+      pBlock->cost = std::max(pBlock->input.size(), pBlock->rawSize);
+
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (!stopped_ &&
+             inFlight_ > 0 &&
+             (inFlight_ + pBlock->cost) > memoryLimit_)
+      {
+         condition_.wait(lock);
+      }
+      if (stopped_)
+         return false;
+
+      inFlight_ += pBlock->cost;
+      pending_.push_back(pBlock);
+      ordered_.push_back(pBlock);
+      lock.unlock();
+
+      condition_.notify_all();
+      return true;
+   }
+
+   // indicate that no more blocks will be submitted
+   void close()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         closed_ = true;
+      }
+      END_LOCK_MUTEX
+
+      condition_.notify_all();
+   }
+
+   // get the next block in order (waits for it to be transformed). returns
+   // false once the pipeline is closed and drained or if it was stopped
+   bool next(BlockPtr* pBlock)
+   {
+      boost::unique_lock<boost::mutex> lock(mutex_);
+      while (!stopped_ &&
+             (ordered_.empty() ? !closed_ : !ordered_.front()->done))
+      {
+         condition_.wait(lock);
+      }
+      if (stopped_ || ordered_.empty())
+         return false;
+
+      *pBlock = ordered_.front();
+      ordered_.pop_front();
+      inFlight_ -= (*pBlock)->cost;
+      lock.unlock();
+
+      condition_.notify_all();
+      return true;
+   }
+
+   // abandon any remaining blocks and release all waiting threads
+   void stop()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         stopped_ = true;
+      }
+      END_LOCK_MUTEX
+
+      condition_.notify_all();
+   }
+
+   void join()
+   {
+      threads_.join_all();
+   }
+
+   void setError(const Error& error)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         if (!error_)
+            error_ = error;
+      }
+      END_LOCK_MUTEX
+   }
+
+   Error error()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         return error_;
+      }
+      END_LOCK_MUTEX
+
+      // keep compiler happy
+      return Success();
+   }
+
+private:
+   void work()
+   {
+      while (true)
+      {
+         BlockPtr pBlock;
+         {
+            boost::unique_lock<boost::mutex> lock(mutex_);
+            while (!stopped_ && !closed_ && pending_.empty())
+               condition_.wait(lock);
+            if (stopped_ || pending_.empty())
+               return;
+
+            pBlock = pending_.front();
+            pending_.pop_front();
+         }
+
+         Error error = compress_ ? compressBlock(pBlock.get()) :
+                                   decompressBlock(pBlock.get());
+
+         LOCK_MUTEX(mutex_)
+         {
+            pBlock->error = error;
+            pBlock->done = true;
+         }
+         END_LOCK_MUTEX
+
+         condition_.notify_all();
+      }
+   }
+
+private:
+   bool compress_;
+   std::size_t memoryLimit_;
+   std::size_t inFlight_;
+   bool closed_;
+   bool stopped_;
+   Error error_;
+   std::deque<BlockPtr> pending_;
+   std::deque<BlockPtr> ordered_;
+   boost::mutex mutex_;
+   boost::condition condition_;
+   boost::thread_group threads_;
+};
+
+
+Codec defaultCodec()
+{
+#ifndef _WIN32
+   return kCodecDeflate;
+#else
+   // zlib isn't part of our win32 toolchain
+   return kCodecStore;
+#endif
+}
+
+std::string codecName(Codec codec)
+{
+   switch(codec)
+   {
+      case kCodecDeflate:
+         return "deflate";
+      case kCodecStore:
+      default:
+         return "store";
+   }
+}
+
+
+Writer::Writer(int threads,
+               std::size_t memoryLimit,
+               Codec codec,
+               int level)
+   : codec_(codec),
+     level_(level),
+     pPipeline_(new BlockPipeline(true, memoryLimit)),
+     inChunk_(false),
+     finished_(false)
+{
+   pPipeline_->start(threads, boost::bind(&Writer::writeBlocks, this));
+}
+
+Writer::~Writer()
+{
+   try
+   {
+      if (!finished_)
+      {
+         pPipeline_->stop();
+         pPipeline_->join();
+      }
+   }
+   catch(...)
+   {
+   }
+}
+
+Error Writer::beginChunk(const FilePath& path)
+{
+   endChunk();
+
+   boost::shared_ptr<ChunkOutput> pOutput(new ChunkOutput());
+   pOutput->info.path = path;
+   Error error = path.open_w(&(pOutput->pStream));
+   if (error)
+      return error;
+
+   // write the header (before any blocks are submitted)
+   std::string header(kMagic, kMagicSize);
+   header.push_back(static_cast<char>(codec_));
+   pOutput->pStream->write(header.data(), header.size());
+   if (!(*pOutput->pStream))
+      return chunkFileError("error writing header", path, ERROR_LOCATION);
+   pOutput->info.storedBytes = header.size();
+
+   outputs_.push_back(pOutput);
+   buffer_.reserve(kBlockSize);
+   inChunk_ = true;
+   return Success();
+}
+
+bool Writer::write(const char* data, std::size_t length)
+{
+   if (finished_ || !inChunk_)
+      return false;
+
+   while (length > 0)
+   {
+      std::size_t count = std::min(length, kBlockSize - buffer_.size());
+      buffer_.append(data, count);
+      data += count;
+      length -= count;
+
+      if (buffer_.size() == kBlockSize)
+      {
+         submitBlock(false);
+         buffer_.reserve(kBlockSize);
+      }
+   }
+
+   return !pPipeline_->error();
+}
+
+void Writer::endChunk()
+{
+   if (inChunk_)
+   {
+      submitBlock(true);
+      inChunk_ = false;
+   }
+}
+
+Error Writer::finish()
+{
+   if (finished_)
+      return pPipeline_->error();
+
+   endChunk();
+   pPipeline_->close();
+   pPipeline_->join();
+   finished_ = true;
+
+   chunks_.clear();
+   for (std::vector<boost::shared_ptr<ChunkOutput> >::const_iterator
+        it = outputs_.begin(); it != outputs_.end(); ++it)
+   {
+      // (streams are normally closed by the writer thread but may not be
+      // if an error occurred)
+      (*it)->pStream.reset();
+      chunks_.push_back((*it)->info);
+   }
+
+   return pPipeline_->error();
+}
+
+void Writer::submitBlock(bool last)
+{
+   BlockPtr pBlock(new Block());
+   pBlock->pOutput = outputs_.back();
+   pBlock->codec = codec_;
+   pBlock->level = level_;
+   pBlock->last = last;
+   pBlock->input.swap(buffer_);
+   pPipeline_->submit(pBlock);
+}
+
+void Writer::writeBlocks()
+{
+   BlockPtr pBlock;
+   while (pPipeline_->next(&pBlock))
+   {
+      ChunkOutput& output = *(pBlock->pOutput);
+
+      if (pBlock->error)
+      {
+         pBlock->error.addProperty("path", output.info.path.absolutePath());
+         pPipeline_->setError(pBlock->error);
+         pPipeline_->stop();
+         return;
+      }
+
+      std::string header;
+      if (pBlock->rawSize > 0)
+      {
+         put32(pBlock->rawSize, &header);
+         put32(pBlock->output.size(), &header);
+         output.pStream->write(header.data(), header.size());
+         output.pStream->write(pBlock->output.data(), pBlock->output.size());
+         output.info.rawBytes += pBlock->rawSize;
+         output.info.storedBytes += header.size() + pBlock->output.size();
+      }
+
+      if (pBlock->last)
+      {
+         header.clear();
+         put32(0, &header);
+         put32(0, &header);
+         output.pStream->write(header.data(), header.size());
+         output.pStream->flush();
+         output.info.storedBytes += header.size();
+      }
+
+      if (!(*output.pStream))
+      {
+         pPipeline_->setError(chunkFileError("error writing block",
+                                             output.info.path,
+                                             ERROR_LOCATION));
+         pPipeline_->stop();
+         return;
+      }
+
+      // close the file once its last block has been written
+      if (pBlock->last)
+         output.pStream.reset();
+   }
+}
+
+
+Reader::Reader(const std::vector<FilePath>& paths,
+               int threads,
+               std::size_t memoryLimit)
+   : pPipeline_(new BlockPipeline(false, memoryLimit)),
+     position_(0),
+     currentIsLast_(false),
+     finished_(false)
+{
+   pPipeline_->start(threads,
+                     boost::bind(&Reader::readBlocks, this, paths));
+}
+
+Reader::~Reader()
+{
+   try
+   {
+      if (!finished_)
+         finish();
+   }
+   catch(...)
+   {
+   }
+}
+
+bool Reader::read(char* buffer, std::size_t length)
+{
+   if (finished_)
+      return false;
+
+   while (length > 0)
+   {
+      if (position_ == current_.size())
+      {
+         if (currentIsLast_ || !nextBlock())
+            return false;
+      }
+
+      std::size_t count = std::min(length, current_.size() - position_);
+      std::copy(current_.data() + position_,
+                current_.data() + position_ + count,
+                buffer);
+      position_ += count;
+      buffer += count;
+      length -= count;
+   }
+
+   return true;
+}
+
+Error Reader::endChunk()
+{
+   while (!currentIsLast_ && !finished_)
+   {
+      if (!nextBlock())
+      {
+         Error error = pPipeline_->error();
+         if (!error)
+         {
+            error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+            error.addProperty("description", "no more chunks to read");
+         }
+         return error;
+      }
+   }
+
+   std::string().swap(current_);
+   position_ = 0;
+   currentIsLast_ = false;
+   return pPipeline_->error();
+}
+
+Error Reader::finish()
+{
+   if (!finished_)
+   {
+      finished_ = true;
+      pPipeline_->stop();
+      pPipeline_->join();
+   }
+   return pPipeline_->error();
+}
+
+bool Reader::nextBlock()
+{
+   BlockPtr pBlock;
+   if (!pPipeline_->next(&pBlock))
+      return false;
+
+   if (pBlock->error)
+   {
+      pPipeline_->setError(pBlock->error);
+      pPipeline_->stop();
+      return false;
+   }
+
+   current_.swap(pBlock->output);
+   position_ = 0;
+   currentIsLast_ = pBlock->last;
+   return true;
+}
+
+void Reader::readBlocks(const std::vector<FilePath>& paths)
+{
+   for (std::vector<FilePath>::const_iterator it = paths.begin();
+        it != paths.end(); ++it)
+   {
+      const FilePath& path = *it;
+
+      boost::shared_ptr<std::istream> pStream;
+      Error error = path.open_r(&pStream);
+      if (error)
+      {
+         pPipeline_->setError(error);
+         pPipeline_->stop();
+         return;
+      }
+
+      // read and validate the header
+      char header[kMagicSize + 1];
+      pStream->read(header, sizeof(header));
+      if (!(*pStream) || std::string(header, kMagicSize) != kMagic)
+      {
+         pPipeline_->setError(chunkFileError("invalid header",
+                                             path,
+                                             ERROR_LOCATION));
+         pPipeline_->stop();
+         return;
+      }
+      Codec codec = static_cast<Codec>(header[kMagicSize]);
+      if (codec != kCodecStore && codec != defaultCodec())
+      {
+         Error error = systemError(boost::system::errc::not_supported,
+                                   ERROR_LOCATION);
+         error.addProperty("path", path.absolutePath());
+         pPipeline_->setError(error);
+         pPipeline_->stop();
+         return;
+      }
+
+      // read blocks up to (and including) the terminating empty block
+      while (true)
+      {
+         char sizes[8];
+         pStream->read(sizes, sizeof(sizes));
+         boost::uint32_t rawSize = get32(sizes);
+         boost::uint32_t storedSize = get32(sizes + 4);
+         if (!(*pStream) ||
+             rawSize > kMaxBlockSize ||
+             storedSize > kMaxBlockSize ||
+             (codec == kCodecStore && rawSize != storedSize))
+         {
+            pPipeline_->setError(chunkFileError("invalid block",
+                                                path,
+                                                ERROR_LOCATION));
+            pPipeline_->stop();
+            return;
+         }
+
+         BlockPtr pBlock(new Block());
+         pBlock->codec = codec;
+         pBlock->rawSize = rawSize;
+         pBlock->last = (rawSize == 0);
+         pBlock->input.resize(storedSize);
+         if (storedSize > 0)
+         {
+            pStream->read(&(pBlock->input[0]), storedSize);
+            if (!(*pStream))
+            {
+               pPipeline_->setError(chunkFileError("truncated block",
+                                                   path,
+                                                   ERROR_LOCATION));
+               pPipeline_->stop();
+               return;
+            }
+         }
+
+         if (!pPipeline_->submit(pBlock))
+            return;
+
+         if (pBlock->last)
+            break;
+      }
+   }
+
+   pPipeline_->close();
+}
+
+} // namespace chunked_file
+} // namespace core
@@ -13,24 +13,48 @@
 
 #include <core/Exec.hpp>
 
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
 #include <core/Error.hpp>
 
 namespace core {
 
 ExecBlock& ExecBlock::add(Function function) 
 { 
-   functions_.push_back(function); 
-   return *this;
+   // unnamed functions are labeled by their position in the block
+   std::string name = "function " +
+                      boost::lexical_cast<std::string>(functions_.size() + 1);
+   return add(name, function);
 }   
+
+ExecBlock& ExecBlock::add(const std::string& name, Function function)
+{
+   functions_.push_back(std::make_pair(name, function));
+   return *this;
+}
    
 Error ExecBlock::execute() const
 {
-   for (std::vector<Function>::const_iterator
+   using namespace boost::posix_time;
+
+   for (std::vector<std::pair<std::string,Function> >::const_iterator
             it = functions_.begin(); it != functions_.end(); ++it)
    {
-      Error error = (*it)();
-      if (error)
-         return error ;
+      if (timingHandler_)
+      {
+         ptime start = microsec_clock::universal_time();
+         Error error = it->second();
+         timingHandler_(it->first, microsec_clock::universal_time() - start);
+         if (error)
+            return error;
+      }
+      else
+      {
+         Error error = it->second();
+         if (error)
+            return error ;
+      }
    }
    return Success();
 }
@@ -0,0 +1,307 @@
+/*
+ * Trace.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/Trace.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/Thread.hpp>
+#include <core/json/Json.hpp>
+
+namespace core {
+namespace trace {
+
+namespace detail {
+volatile bool s_enabled = false;
+} // namespace detail
+
+namespace {
+
+// spans kept per thread
+const std::size_t kSpansPerThread = 4096;
+
+// maximum length of span details
+const std::size_t kMaxDetail = 63;
+
+struct SpanRecord
+{
+   const char* category;
+   const char* name;
+   boost::int64_t start;
+   boost::int64_t duration;
+   char detail[kMaxDetail + 1];
+};
+
+// ring of spans written only by its thread. each slot has a sequence
+// number which is odd while the slot is being written so that readers
+// (writing a trace) can skip slots which are written while they read them
+struct ThreadSpans
+{
+   explicit ThreadSpans(int threadId)
+      : threadId(threadId), next(0), inUse(true)
+   {
+      std::fill(sequence, sequence + kSpansPerThread, 0);
+   }
+
+   int threadId;
+   volatile boost::uint32_t next;
+   volatile boost::uint32_t sequence[kSpansPerThread];
+   SpanRecord spans[kSpansPerThread];
+
+   // is a thread using these spans? (protected by s_mutex)
+   bool inUse;
+};
+
+inline void memoryBarrier()
+{
+   __sync_synchronize();
+}
+
+boost::mutex s_mutex;
+std::vector<boost::shared_ptr<ThreadSpans> > s_threadSpans;
+std::string s_processName;
+
+// when a thread exits its spans are kept (for writing) and reused by the
+// next thread which records a span
+void releaseThreadSpans(ThreadSpans* pSpans)
+{
+   LOCK_MUTEX(s_mutex)
+   {
+      pSpans->inUse = false;
+   }
+   END_LOCK_MUTEX
+}
+
+boost::thread_specific_ptr<ThreadSpans> s_pCurrentThreadSpans(
+                                                      releaseThreadSpans);
+
+ThreadSpans* currentThreadSpans()
+{
+   ThreadSpans* pSpans = s_pCurrentThreadSpans.get();
+   if (pSpans != NULL)
+      return pSpans;
+
+   LOCK_MUTEX(s_mutex)
+   {
+      for (std::size_t i = 0; i < s_threadSpans.size(); i++)
+      {
+         if (!s_threadSpans[i]->inUse)
+         {
+            pSpans = s_threadSpans[i].get();
+            pSpans->inUse = true;
+            break;
+         }
+      }
+
+      if (pSpans == NULL)
+      {
+         int threadId = static_cast<int>(s_threadSpans.size()) + 1;
+         s_threadSpans.push_back(boost::shared_ptr<ThreadSpans>(
+                                                new ThreadSpans(threadId)));
+         pSpans = s_threadSpans.back().get();
+      }
+   }
+   END_LOCK_MUTEX
+
+   s_pCurrentThreadSpans.reset(pSpans);
+   return pSpans;
+}
+
+int processId()
+{
+#ifdef _WIN32
+   return static_cast<int>(::GetCurrentProcessId());
+#else
+   return static_cast<int>(::getpid());
+#endif
+}
+
+json::Object metadataEvent(const std::string& name,
+                           int pid,
+                           int tid,
+                           const std::string& value)
+{
+   json::Object args;
+   args["name"] = value;
+
+   json::Object event;
+   event["name"] = name;
+   event["ph"] = "M";
+   event["pid"] = pid;
+   event["tid"] = tid;
+   event["args"] = args;
+   return event;
+}
+
+void addSpanEvents(const ThreadSpans& spans, int pid, json::Array* pEvents)
+{
+   std::string threadName = "thread " +
+                     boost::lexical_cast<std::string>(spans.threadId);
+   pEvents->push_back(metadataEvent("thread_name",
+                                    pid,
+                                    spans.threadId,
+                                    threadName));
+
+   for (std::size_t i = 0; i < kSpansPerThread; i++)
+   {
+      // copy the span (skipping it if it's written while we copy it)
+      boost::uint32_t sequence = spans.sequence[i];
+      memoryBarrier();
+      if (sequence == 0 || (sequence & 1))
+         continue;
+      SpanRecord span = spans.spans[i];
+      memoryBarrier();
+      if (spans.sequence[i] != sequence)
+         continue;
+
+      json::Object event;
+      event["name"] = span.name;
+      event["cat"] = span.category;
+      event["ph"] = "X";
+      event["ts"] = span.start;
+      event["dur"] = span.duration;
+      event["pid"] = pid;
+      event["tid"] = spans.threadId;
+      if (span.detail[0] != '\0')
+      {
+         json::Object args;
+         args["detail"] = std::string(span.detail);
+         event["args"] = args;
+      }
+      pEvents->push_back(event);
+   }
+}
+
+} // anonymous namespace
+
+void setEnabled(bool enabled)
+{
+   detail::s_enabled = enabled;
+}
+
+void setProcessName(const std::string& name)
+{
+   LOCK_MUTEX(s_mutex)
+   {
+      s_processName = name;
+   }
+   END_LOCK_MUTEX
+}
+
+boost::int64_t now()
+{
+#ifdef _WIN32
+   using namespace boost::posix_time;
+   static const ptime epoch(boost::gregorian::date(1970, 1, 1));
+   return (microsec_clock::universal_time() - epoch).total_microseconds();
+#else
+   struct timeval tv;
+   ::gettimeofday(&tv, NULL);
+   return static_cast<boost::int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+#endif
+}
+
+void end(const char* category,
+         const char* name,
+         boost::int64_t start,
+         const std::string& detail)
+{
+   if (start == 0)
+      return;
+
+   boost::int64_t duration = now() - start;
+
+   ThreadSpans* pSpans = currentThreadSpans();
+   std::size_t slot = pSpans->next % kSpansPerThread;
+
+   pSpans->sequence[slot]++;
+   memoryBarrier();
+
+   SpanRecord& span = pSpans->spans[slot];
+   span.category = category;
+   span.name = name;
+   span.start = start;
+   span.duration = duration;
+   std::size_t length = std::min(detail.size(), kMaxDetail);
+   detail.copy(span.detail, length);
+   span.detail[length] = '\0';
+
+   memoryBarrier();
+   pSpans->sequence[slot]++;
+   pSpans->next++;
+}
+
+void writeChromeTrace(std::ostream& os)
+{
+   int pid = processId();
+   json::Array events;
+
+   LOCK_MUTEX(s_mutex)
+   {
+      if (!s_processName.empty())
+         events.push_back(metadataEvent("process_name", pid, 0, s_processName));
+
+      for (std::size_t i = 0; i < s_threadSpans.size(); i++)
+         addSpanEvents(*s_threadSpans[i], pid, &events);
+   }
+   END_LOCK_MUTEX
+
+   json::Object trace;
+   trace["traceEvents"] = events;
+   trace["displayTimeUnit"] = "ms";
+   json::write(trace, os);
+}
+
+Error writeChromeTrace(const FilePath& filePath)
+{
+   boost::shared_ptr<std::ostream> pOfs;
+   Error error = filePath.open_w(&pOfs);
+   if (error)
+      return error;
+
+   try
+   {
+      pOfs->exceptions(std::ostream::failbit | std::ostream::badbit);
+      writeChromeTrace(*pOfs);
+      pOfs->flush();
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
+
+   return Success();
+}
+
+} // namespace trace
+} // namespace core
@@ -0,0 +1,656 @@
+/*
+ * ZipWriter.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/ZipWriter.hpp>
+
+#include <ctime>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#ifndef _WIN32
+#include <zlib.h>
+#else
+#include <boost/crc.hpp>
+#endif
+
+#include <core/Error.hpp>
+#include <core/BoostErrors.hpp>
+#include <core/FilePath.hpp>
+
+namespace core {
+
+namespace {
+
+// signatures
+const boost::uint32_t kLocalHeaderSignature = 0x04034b50;
+const boost::uint32_t kDataDescriptorSignature = 0x08074b50;
+const boost::uint32_t kCentralHeaderSignature = 0x02014b50;
+const boost::uint32_t kZip64EndOfCentralDirSignature = 0x06064b50;
+const boost::uint32_t kZip64EndOfCentralDirLocatorSignature = 0x07064b50;
+const boost::uint32_t kEndOfCentralDirSignature = 0x06054b50;
+
+// versions (made by unix, needing 2.0 or 4.5 for zip64)
+const boost::uint16_t kVersionMadeBy = (3 << 8) | 45;
+const boost::uint16_t kVersionNeeded = 20;
+const boost::uint16_t kVersionNeededZip64 = 45;
+
+// flags and methods
+const boost::uint16_t kFlagDataDescriptor = 0x0008;
+const boost::uint16_t kFlagUtf8 = 0x0800;
+const boost::uint16_t kMethodStore = 0;
+const boost::uint16_t kMethodDeflate = 8;
+
+// zip64 thresholds (we leave some headroom for files which turn out
+// to be incompressible or which grow while we are reading them)
+const boost::uint64_t kMax32 = 0xFFFFFFFFULL;
+const boost::uint64_t kMax16 = 0xFFFFULL;
+const boost::uint64_t kZip64EntryThreshold = 0xFF000000ULL;
+
+// size of blocks read from input files (and deflated independently)
+const std::size_t kBlockSize = 256 * 1024;
+
+// size of deflate window (used to prime each block with its predecessor)
+const std::size_t kDictionarySize = 32 * 1024;
+
+void put16(boost::uint16_t value, std::string* pBuffer)
+{
+   pBuffer->push_back(static_cast<char>(value & 0xFF));
+   pBuffer->push_back(static_cast<char>((value >> 8) & 0xFF));
+}
+
+void put32(boost::uint32_t value, std::string* pBuffer)
+{
+   put16(static_cast<boost::uint16_t>(value & 0xFFFF), pBuffer);
+   put16(static_cast<boost::uint16_t>((value >> 16) & 0xFFFF), pBuffer);
+}
+
+void put64(boost::uint64_t value, std::string* pBuffer)
+{
+   put32(static_cast<boost::uint32_t>(value & kMax32), pBuffer);
+   put32(static_cast<boost::uint32_t>(value >> 32), pBuffer);
+}
+
+boost::uint32_t clamp32(boost::uint64_t value)
+{
+   return static_cast<boost::uint32_t>(std::min(value, kMax32));
+}
+
+boost::uint32_t updateCrc(boost::uint32_t crc, const std::string& data)
+{
+   if (data.empty())
+      return crc;
+
+#ifndef _WIN32
+   return ::crc32(crc,
+                  reinterpret_cast<const Bytef*>(data.data()),
+                  data.size());
+#else
+   boost::crc_32_type crcCalc;
+   crcCalc.reset(crc ^ 0xFFFFFFFF);
+   crcCalc.process_bytes(data.data(), data.size());
+   return crcCalc.checksum();
+#endif
+}
+
+void toDosTime(std::time_t time,
+               boost::uint16_t* pDosTime,
+               boost::uint16_t* pDosDate)
+{
+   std::tm tm;
+#ifndef _WIN32
+   ::localtime_r(&time, &tm);
+#else
+   tm = *std::localtime(&time);
+#endif
+
+   // dos dates can't represent anything before 1980
+   if (tm.tm_year < 80)
+   {
+      *pDosTime = 0;
+      *pDosDate = (1 << 5) | 1;
+      return;
+   }
+
+   *pDosTime = static_cast<boost::uint16_t>(
+            (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+   *pDosDate = static_cast<boost::uint16_t>(
+            ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+}
+
+Error readBlock(std::istream& is, std::string* pBlock)
+{
+   pBlock->resize(kBlockSize);
+   is.read(&((*pBlock)[0]), kBlockSize);
+   if (is.bad())
+      return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+   pBlock->resize(static_cast<std::size_t>(is.gcount()));
+   return Success();
+}
+
+#ifndef _WIN32
+
+struct DeflateJob
+{
+   DeflateJob()
+      : pInput(NULL), pDictionary(NULL), last(false), level(1), result(Z_OK)
+   {
+   }
+
+   const std::string* pInput;
+   const std::string* pDictionary;
+   bool last;
+   int level;
+   std::string output;
+   int result;
+};
+
+// deflate a single block as a raw deflate fragment. blocks other than the
+// last end with a sync flush so that the fragments can be concatenated
+void deflateBlock(DeflateJob* pJob)
+{
+   z_stream strm;
+   std::memset(&strm, 0, sizeof(strm));
+   int result = ::deflateInit2(&strm,
+                               pJob->level,
+                               Z_DEFLATED,
+                               -MAX_WBITS,
+                               8,
+                               Z_DEFAULT_STRATEGY);
+   if (result != Z_OK)
+   {
+      pJob->result = result;
+      return;
+   }
+
+   // prime with the tail of the previous block
+   if (pJob->pDictionary != NULL && !pJob->pDictionary->empty())
+   {
+      const std::string& dict = *(pJob->pDictionary);
+      std::size_t dictSize = std::min(dict.size(), kDictionarySize);
+      result = ::deflateSetDictionary(
+         &strm,
+         reinterpret_cast<const Bytef*>(dict.data() + dict.size() - dictSize),
+         dictSize);
+      if (result != Z_OK)
+      {
+         ::deflateEnd(&strm);
+         pJob->result = result;
+         return;
+      }
+   }
+
+   const std::string& input = *(pJob->pInput);
+   pJob->output.resize(::deflateBound(&strm, input.size()) + 64);
+   strm.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+   strm.avail_in = input.size();
+
+   int flush = pJob->last ? Z_FINISH : Z_SYNC_FLUSH;
+   while (true)
+   {
+      strm.next_out = reinterpret_cast<Bytef*>(
+                                 &(pJob->output[0]) + strm.total_out);
+      strm.avail_out = pJob->output.size() - strm.total_out;
+
+      result = ::deflate(&strm, flush);
+      if (result == Z_STREAM_END)
+         break;
+      if (result != Z_OK && result != Z_BUF_ERROR)
+         break;
+
+      // done with a sync flush when there was room left over
+      if (!pJob->last && strm.avail_out > 0)
+         break;
+
+      // otherwise grow the output buffer and continue
+      pJob->output.resize(pJob->output.size() * 2);
+   }
+
+   pJob->output.resize(strm.total_out);
+   pJob->result = (result == Z_STREAM_END || result == Z_OK) ? Z_OK : result;
+   ::deflateEnd(&strm);
+}
+
+#endif
+
+} // anonymous namespace
+
+
+ZipWriter::ZipWriter(std::ostream& os, int compressionLevel, int threads)
+   : os_(os),
+     compressionLevel_(compressionLevel),
+     threads_(std::max(threads, 1)),
+     offset_(0),
+     bytesRead_(0),
+     finished_(false)
+{
+#ifdef _WIN32
+   // zlib isn't part of our win32 toolchain so always store
+   compressionLevel_ = 0;
+#endif
+}
+
+Error ZipWriter::addFile(const FilePath& filePath, const std::string& entryName)
+{
+   // open the file
+   boost::shared_ptr<std::istream> pIfs;
+   Error error = filePath.open_r(&pIfs);
+   if (error)
+      return error;
+
+   // initialize entry
+   Entry entry;
+   entry.name = entryName;
+   entry.method = compressionLevel_ > 0 ? kMethodDeflate : kMethodStore;
+   entry.flags = kFlagDataDescriptor | kFlagUtf8;
+   toDosTime(filePath.lastWriteTime(), &entry.dosTime, &entry.dosDate);
+   entry.crc = 0;
+   entry.compressedSize = 0;
+   entry.uncompressedSize = 0;
+   entry.offset = offset_;
+   entry.externalAttributes = (0100644 << 16);
+   entry.zip64 = filePath.size() >= kZip64EntryThreshold;
+
+   // header
+   error = writeLocalHeader(entry);
+   if (error)
+      return error;
+
+   // data
+   if (entry.method == kMethodDeflate)
+      error = writeDeflated(*pIfs, &entry);
+   else
+      error = writeStored(*pIfs, &entry);
+   if (error)
+   {
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
+
+   // if the file grew past what a non-zip64 entry can describe then
+   // the archive can't be completed correctly
+   if (!entry.zip64 && (entry.uncompressedSize >= kMax32 ||
+                        entry.compressedSize >= kMax32))
+   {
+      Error error = systemError(boost::system::errc::file_too_large,
+                                ERROR_LOCATION);
+      error.addProperty("path", filePath.absolutePath());
+      return error;
+   }
+
+   // trailing descriptor
+   error = writeDataDescriptor(entry);
+   if (error)
+      return error;
+
+   entries_.push_back(entry);
+   return Success();
+}
+
+Error ZipWriter::addDirectory(const FilePath& dirPath,
+                              const std::string& entryName)
+{
+   // directory entry
+   Entry entry;
+   entry.name = entryName;
+   if (entry.name.empty() || entry.name[entry.name.size() - 1] != '/')
+      entry.name.append("/");
+   entry.method = kMethodStore;
+   entry.flags = kFlagUtf8;
+   toDosTime(dirPath.lastWriteTime(), &entry.dosTime, &entry.dosDate);
+   entry.crc = 0;
+   entry.compressedSize = 0;
+   entry.uncompressedSize = 0;
+   entry.offset = offset_;
+   entry.externalAttributes = (040755 << 16) | 0x10;
+   entry.zip64 = false;
+
+   Error error = writeLocalHeader(entry);
+   if (error)
+      return error;
+   entries_.push_back(entry);
+
+   // contents
+   std::vector<FilePath> children;
+   error = dirPath.children(&children);
+   if (error)
+      return error;
+   std::sort(children.begin(), children.end());
+
+   for (std::vector<FilePath>::const_iterator it = children.begin();
+        it != children.end();
+        ++it)
+   {
+      std::string childName = entry.name + it->filename();
+      if (it->isDirectory())
+      {
+         // don't follow directory links (they can create cycles)
+         if (it->isSymlink())
+            continue;
+
+         error = addDirectory(*it, childName);
+      }
+      else
+      {
+         error = addFile(*it, childName);
+      }
+
+      if (error)
+         return error;
+   }
+
+   return Success();
+}
+
+Error ZipWriter::finish()
+{
+   if (finished_)
+      return Success();
+
+   // central directory
+   boost::uint64_t centralDirOffset = offset_;
+   for (std::vector<Entry>::const_iterator it = entries_.begin();
+        it != entries_.end();
+        ++it)
+   {
+      const Entry& entry = *it;
+
+      // build zip64 extra field if required
+      std::string extra;
+      bool zip64Sizes = entry.zip64 ||
+                        entry.uncompressedSize >= kMax32 ||
+                        entry.compressedSize >= kMax32;
+      bool zip64Offset = entry.offset >= kMax32;
+      if (zip64Sizes || zip64Offset)
+      {
+         std::string fields;
+         if (zip64Sizes)
+         {
+            put64(entry.uncompressedSize, &fields);
+            put64(entry.compressedSize, &fields);
+         }
+         if (zip64Offset)
+            put64(entry.offset, &fields);
+
+         put16(0x0001, &extra);
+         put16(static_cast<boost::uint16_t>(fields.size()), &extra);
+         extra.append(fields);
+      }
+
+      std::string header;
+      put32(kCentralHeaderSignature, &header);
+      put16(kVersionMadeBy, &header);
+      put16(extra.empty() ? kVersionNeeded : kVersionNeededZip64, &header);
+      put16(entry.flags, &header);
+      put16(entry.method, &header);
+      put16(entry.dosTime, &header);
+      put16(entry.dosDate, &header);
+      put32(entry.crc, &header);
+      put32(zip64Sizes ? kMax32 : clamp32(entry.compressedSize), &header);
+      put32(zip64Sizes ? kMax32 : clamp32(entry.uncompressedSize), &header);
+      put16(static_cast<boost::uint16_t>(entry.name.size()), &header);
+      put16(static_cast<boost::uint16_t>(extra.size()), &header);
+      put16(0, &header); // comment length
+      put16(0, &header); // disk number start
+      put16(0, &header); // internal attributes
+      put32(entry.externalAttributes, &header);
+      put32(zip64Offset ? kMax32 : clamp32(entry.offset), &header);
+      header.append(entry.name);
+      header.append(extra);
+
+      Error error = write(header);
+      if (error)
+         return error;
+   }
+   boost::uint64_t centralDirSize = offset_ - centralDirOffset;
+   boost::uint64_t entryCount = entries_.size();
+
+   // zip64 end of central directory record and locator if required
+   std::string trailer;
+   if (entryCount >= kMax16 ||
+       centralDirSize >= kMax32 ||
+       centralDirOffset >= kMax32)
+   {
+      boost::uint64_t zip64EndOffset = offset_;
+
+      put32(kZip64EndOfCentralDirSignature, &trailer);
+      put64(44, &trailer); // size of remaining record
+      put16(kVersionMadeBy, &trailer);
+      put16(kVersionNeededZip64, &trailer);
+      put32(0, &trailer); // this disk
+      put32(0, &trailer); // disk with central directory
+      put64(entryCount, &trailer);
+      put64(entryCount, &trailer);
+      put64(centralDirSize, &trailer);
+      put64(centralDirOffset, &trailer);
+
+      put32(kZip64EndOfCentralDirLocatorSignature, &trailer);
+      put32(0, &trailer); // disk with zip64 end of central directory
+      put64(zip64EndOffset, &trailer);
+      put32(1, &trailer); // total disks
+   }
+
+   // end of central directory record
+   boost::uint16_t entryCount16 =
+         static_cast<boost::uint16_t>(std::min(entryCount, kMax16));
+   put32(kEndOfCentralDirSignature, &trailer);
+   put16(0, &trailer); // this disk
+   put16(0, &trailer); // disk with central directory
+   put16(entryCount16, &trailer);
+   put16(entryCount16, &trailer);
+   put32(clamp32(centralDirSize), &trailer);
+   put32(clamp32(centralDirOffset), &trailer);
+   put16(0, &trailer); // comment length
+
+   Error error = write(trailer);
+   if (error)
+      return error;
+
+   os_.flush();
+   if (os_.fail())
+      return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+
+   finished_ = true;
+   return Success();
+}
+
+Error ZipWriter::writeLocalHeader(const Entry& entry)
+{
+   std::string extra;
+   if (entry.zip64)
+   {
+      // actual sizes follow in the (zip64) data descriptor
+      put16(0x0001, &extra);
+      put16(16, &extra);
+      put64(0, &extra);
+      put64(0, &extra);
+   }
+
+   std::string header;
+   put32(kLocalHeaderSignature, &header);
+   put16(entry.zip64 ? kVersionNeededZip64 : kVersionNeeded, &header);
+   put16(entry.flags, &header);
+   put16(entry.method, &header);
+   put16(entry.dosTime, &header);
+   put16(entry.dosDate, &header);
+   put32(0, &header); // crc (in descriptor)
+   put32(entry.zip64 ? kMax32 : 0, &header);
+   put32(entry.zip64 ? kMax32 : 0, &header);
+   put16(static_cast<boost::uint16_t>(entry.name.size()), &header);
+   put16(static_cast<boost::uint16_t>(extra.size()), &header);
+   header.append(entry.name);
+   header.append(extra);
+
+   return write(header);
+}
+
+Error ZipWriter::writeDataDescriptor(const Entry& entry)
+{
+   std::string descriptor;
+   put32(kDataDescriptorSignature, &descriptor);
+   put32(entry.crc, &descriptor);
+   if (entry.zip64)
+   {
+      put64(entry.compressedSize, &descriptor);
+      put64(entry.uncompressedSize, &descriptor);
+   }
+   else
+   {
+      put32(clamp32(entry.compressedSize), &descriptor);
+      put32(clamp32(entry.uncompressedSize), &descriptor);
+   }
+   return write(descriptor);
+}
+
+Error ZipWriter::writeStored(std::istream& is, Entry* pEntry)
+{
+   std::string block;
+   while (true)
+   {
+      Error error = readBlock(is, &block);
+      if (error)
+         return error;
+      if (block.empty())
+         break;
+
+      pEntry->crc = updateCrc(pEntry->crc, block);
+      pEntry->uncompressedSize += block.size();
+      pEntry->compressedSize += block.size();
+      bytesRead_ += block.size();
+
+      error = write(block);
+      if (error)
+         return error;
+   }
+
+   return Success();
+}
+
+Error ZipWriter::writeDeflated(std::istream& is, Entry* pEntry)
+{
+#ifndef _WIN32
+   // read one block ahead so we know which block is the last one
+   std::string nextBlock;
+   Error error = readBlock(is, &nextBlock);
+   if (error)
+      return error;
+
+   // the empty file still needs a (final) deflate block
+   if (nextBlock.empty())
+   {
+      DeflateJob job;
+      job.pInput = &nextBlock;
+      job.last = true;
+      job.level = compressionLevel_;
+      deflateBlock(&job);
+      if (job.result != Z_OK)
+         return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+      pEntry->compressedSize = job.output.size();
+      return write(job.output);
+   }
+
+   std::string previousTail;
+   std::vector<std::string> batch;
+   while (!nextBlock.empty())
+   {
+      // gather a batch of blocks (one per thread)
+      batch.clear();
+      while (static_cast<int>(batch.size()) < threads_ && !nextBlock.empty())
+      {
+         batch.push_back(std::string());
+         batch.back().swap(nextBlock);
+         error = readBlock(is, &nextBlock);
+         if (error)
+            return error;
+      }
+      bool finalBatch = nextBlock.empty();
+
+      // setup jobs
+      std::vector<DeflateJob> jobs(batch.size());
+      for (std::size_t i = 0; i < batch.size(); i++)
+      {
+         jobs[i].pInput = &batch[i];
+         jobs[i].pDictionary = (i == 0) ? &previousTail : &batch[i-1];
+         jobs[i].last = finalBatch && (i == batch.size() - 1);
+         jobs[i].level = compressionLevel_;
+      }
+
+      // compress (first job on this thread, the rest in parallel)
+      try
+      {
+         boost::thread_group threads;
+         for (std::size_t i = 1; i < jobs.size(); i++)
+            threads.create_thread(boost::bind(deflateBlock, &jobs[i]));
+         deflateBlock(&jobs[0]);
+         threads.join_all();
+      }
+      catch(const boost::thread_resource_error& e)
+      {
+         return Error(boost::thread_error::ec_from_exception(e),
+                      ERROR_LOCATION);
+      }
+
+      // write output in order
+      for (std::size_t i = 0; i < jobs.size(); i++)
+      {
+         if (jobs[i].result != Z_OK)
+         {
+            Error error = systemError(boost::system::errc::io_error,
+                                      ERROR_LOCATION);
+            error.addProperty("zlib-result", jobs[i].result);
+            return error;
+         }
+
+         pEntry->crc = updateCrc(pEntry->crc, batch[i]);
+         pEntry->uncompressedSize += batch[i].size();
+         pEntry->compressedSize += jobs[i].output.size();
+         bytesRead_ += batch[i].size();
+
+         error = write(jobs[i].output);
+         if (error)
+            return error;
+      }
+
+      // retain the tail of this batch to prime the next one
+      const std::string& lastBlock = batch.back();
+      std::size_t tailSize = std::min(lastBlock.size(), kDictionarySize);
+      previousTail.assign(lastBlock, lastBlock.size() - tailSize, tailSize);
+   }
+
+   return Success();
+#else
+   return writeStored(is, pEntry);
+#endif
+}
+
+Error ZipWriter::write(const char* data, std::size_t length)
+{
+   os_.write(data, length);
+   if (os_.fail())
+      return systemError(boost::system::errc::io_error, ERROR_LOCATION);
+
+   offset_ += length;
+   return Success();
+}
+
+Error ZipWriter::write(const std::string& data)
+{
+   return write(data.data(), data.length());
+}
+
+} // namespace core
+
@@ -0,0 +1,166 @@
+/*
+ * Benchmark.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "Benchmark.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/json/Json.hpp>
+
+namespace core {
+namespace dev {
+
+namespace {
+
+// nearest rank percentile of sorted samples
+double percentile(const std::vector<double>& samples, double p)
+{
+   if (samples.empty())
+      return 0;
+
+   std::size_t rank = static_cast<std::size_t>(
+                                    std::ceil(p / 100.0 * samples.size()));
+   rank = std::min(std::max<std::size_t>(rank, 1), samples.size());
+   return samples[rank - 1];
+}
+
+} // anonymous namespace
+
+Error runBenchmark(const Benchmark& benchmark,
+                   const BenchmarkOptions& options,
+                   BenchmarkResult* pResult)
+{
+   if (benchmark.setup)
+   {
+      Error error = benchmark.setup();
+      if (error)
+         return error;
+   }
+
+   for (int i = 0; i < options.warmups; i++)
+      benchmark.run();
+
+   using namespace boost::posix_time;
+   std::vector<double> samples;
+   samples.reserve(options.iterations);
+   for (int i = 0; i < options.iterations; i++)
+   {
+      ptime start = microsec_clock::universal_time();
+      benchmark.run();
+      time_duration elapsed = microsec_clock::universal_time() - start;
+      samples.push_back(static_cast<double>(elapsed.total_microseconds()));
+   }
+   std::sort(samples.begin(), samples.end());
+
+   pResult->name = benchmark.name;
+   pResult->iterations = static_cast<int>(samples.size());
+   if (!samples.empty())
+   {
+      pResult->mean = std::accumulate(samples.begin(), samples.end(), 0.0) /
+                      samples.size();
+      pResult->min = samples.front();
+      pResult->p50 = percentile(samples, 50);
+      pResult->p90 = percentile(samples, 90);
+      pResult->p99 = percentile(samples, 99);
+      pResult->max = samples.back();
+   }
+
+   return Success();
+}
+
+void writeBenchmarkHeader(const BenchmarkOptions& options, std::ostream& os)
+{
+   if (options.json)
+      return;
+
+   os << std::left << std::setw(28) << "benchmark" << std::right
+      << std::setw(8) << "iters"
+      << std::setw(12) << "mean us"
+      << std::setw(12) << "min us"
+      << std::setw(12) << "p50 us"
+      << std::setw(12) << "p90 us"
+      << std::setw(12) << "p99 us"
+      << std::setw(12) << "max us" << std::endl;
+}
+
+void writeBenchmarkResult(const BenchmarkResult& result,
+                          const BenchmarkOptions& options,
+                          std::ostream& os)
+{
+   if (options.json)
+   {
+      json::Object resultJson;
+      resultJson["name"] = result.name;
+      resultJson["iterations"] = result.iterations;
+      resultJson["mean_us"] = result.mean;
+      resultJson["min_us"] = result.min;
+      resultJson["p50_us"] = result.p50;
+      resultJson["p90_us"] = result.p90;
+      resultJson["p99_us"] = result.p99;
+      resultJson["max_us"] = result.max;
+      json::write(resultJson, os);
+      os << std::endl;
+   }
+   else
+   {
+      os << std::left << std::setw(28) << result.name << std::right
+         << std::setw(8) << result.iterations << std::fixed
+         << std::setprecision(1)
+         << std::setw(12) << result.mean
+         << std::setw(12) << result.min
+         << std::setw(12) << result.p50
+         << std::setw(12) << result.p90
+         << std::setw(12) << result.p99
+         << std::setw(12) << result.max << std::endl;
+   }
+}
+
+bool runBenchmarks(const std::vector<Benchmark>& benchmarks,
+                   const BenchmarkOptions& options,
+                   std::ostream& os)
+{
+   bool succeeded = true;
+
+   writeBenchmarkHeader(options, os);
+   for (std::size_t i = 0; i < benchmarks.size(); i++)
+   {
+      const Benchmark& benchmark = benchmarks[i];
+      if (benchmark.name.find(options.filter) == std::string::npos)
+         continue;
+
+      BenchmarkResult result;
+      Error error = runBenchmark(benchmark, options, &result);
+      if (error)
+      {
+         error.addProperty("benchmark", benchmark.name);
+         LOG_ERROR(error);
+         succeeded = false;
+         continue;
+      }
+
+      writeBenchmarkResult(result, options, os);
+   }
+
+   return succeeded;
+}
+
+} // namespace dev
+} // namespace core
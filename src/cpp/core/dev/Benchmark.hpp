@@ -0,0 +1,105 @@
+/*
+ * Benchmark.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_DEV_BENCHMARK_HPP
+#define CORE_DEV_BENCHMARK_HPP
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+namespace core {
+
+class Error;
+
+namespace dev {
+
+// A named operation to time. setup (optional) is called once before the
+// benchmark is run (and only if it is selected) and run is called for each
+// warmup and timed iteration
+struct Benchmark
+{
+   Benchmark(const std::string& name,
+             const boost::function<void()>& run,
+             const boost::function<core::Error()>& setup =
+                                          boost::function<core::Error()>())
+      : name(name), run(run), setup(setup)
+   {
+   }
+
+   std::string name;
+   boost::function<void()> run;
+   boost::function<core::Error()> setup;
+};
+
+struct BenchmarkOptions
+{
+   BenchmarkOptions()
+      : warmups(3), iterations(50), json(false)
+   {
+   }
+
+   // untimed runs before the timed iterations
+   int warmups;
+
+   // timed runs
+   int iterations;
+
+   // run only benchmarks whose names contain this
+   std::string filter;
+
+   // write a json object per benchmark (one per line) rather than a table
+   bool json;
+};
+
+// timings of a benchmark (in microseconds)
+struct BenchmarkResult
+{
+   BenchmarkResult()
+      : iterations(0), mean(0), min(0), p50(0), p90(0), p99(0), max(0)
+   {
+   }
+
+   std::string name;
+   int iterations;
+   double mean;
+   double min;
+   double p50;
+   double p90;
+   double p99;
+   double max;
+};
+
+// run a benchmark and compute its timings
+core::Error runBenchmark(const Benchmark& benchmark,
+                         const BenchmarkOptions& options,
+                         BenchmarkResult* pResult);
+
+// write a result (as a table row or a line of json)
+void writeBenchmarkHeader(const BenchmarkOptions& options, std::ostream& os);
+void writeBenchmarkResult(const BenchmarkResult& result,
+                          const BenchmarkOptions& options,
+                          std::ostream& os);
+
+// run the selected benchmarks writing their results as they complete
+// (returns false if any of them failed to setup)
+bool runBenchmarks(const std::vector<Benchmark>& benchmarks,
+                   const BenchmarkOptions& options,
+                   std::ostream& os);
+
+} // namespace dev
+} // namespace core
+
+#endif // CORE_DEV_BENCHMARK_HPP
@@ -0,0 +1,1044 @@
+/*
+ * CoreBenchmarks.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "CoreBenchmarks.hpp"
+
+#include <set>
+#include <sstream>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#endif
+
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/asio/io_service.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/device/null.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/FileInfo.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/GitGraph.hpp>
+#include <core/Log.hpp>
+#include <core/StringUtils.hpp>
+#include <core/ZipWriter.hpp>
+
+#include <core/collection/Tree.hpp>
+
+#include <core/http/Request.hpp>
+#include <core/http/RequestParser.hpp>
+#include <core/http/Response.hpp>
+#include <core/http/Util.hpp>
+#include <core/http/ValidatedCookieCache.hpp>
+#ifndef _WIN32
+#include <core/http/StreamPump.hpp>
+#endif
+
+#include <core/json/Json.hpp>
+
+#include <core/r_util/RSourceIndex.hpp>
+#include <core/r_util/RSourceSymbolTable.hpp>
+#include <core/r_util/RTokenizer.hpp>
+
+#include <core/system/FileChangeEvent.hpp>
+#ifndef _WIN32
+#include <core/system/Crypto.hpp>
+#endif
+#include <core/system/FileScanner.hpp>
+
+#include <core/text/TextSearch.hpp>
+#include <core/text/UnifiedDiff.hpp>
+
+namespace core {
+namespace dev {
+
+namespace {
+
+// deterministic pseudo random numbers (so inputs are the same everywhere)
+class Random
+{
+public:
+   Random() : state_(42) {}
+
+   unsigned int next(unsigned int limit)
+   {
+      state_ = state_ * 1103515245 + 12345;
+      return ((state_ >> 16) & 0x7FFF) % limit;
+   }
+
+private:
+   unsigned int state_;
+};
+
+std::string toString(unsigned int value)
+{
+   return boost::lexical_cast<std::string>(value);
+}
+
+// http request parsing
+
+std::string requestText(const std::string& method, const std::string& body)
+{
+   std::string text =
+      method + " /rpc/list_files HTTP/1.1\r\n"
+      "Host: localhost:8787\r\n"
+      "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/535.2 "
+         "(KHTML, like Gecko) Chrome/15.0.874.106 Safari/535.2\r\n"
+      "Accept: */*\r\n"
+      "Accept-Encoding: gzip,deflate,sdch\r\n"
+      "Accept-Language: en-US,en;q=0.8\r\n"
+      "Cookie: user-id=jjallaire|Thu%2C%2003%20Nov%202011%2019%3A43%3A21"
+         "%20GMT|B1c2K7UBx%2BnnFIFZtmhwITxhPKEWPv2kkKUPzNzQbgo%3D; "
+         "csrf-token=0b5fa5ae-d7a0-4b4a-9c16-c0b5a7e23d6c\r\n"
+      "Referer: http://localhost:8787/\r\n"
+      "Content-Type: application/json\r\n";
+   if (!body.empty())
+      text += "Content-Length: " + toString(body.size()) + "\r\n";
+   text += "\r\n" + body;
+   return text;
+}
+
+Error checkRequest(const std::string* pText)
+{
+   http::Request request;
+   http::RequestParser parser;
+   if (parser.parse(request, pText->begin(), pText->end()) !=
+       http::RequestParser::complete)
+   {
+      return systemError(boost::system::errc::protocol_error,
+                         ERROR_LOCATION);
+   }
+   return Success();
+}
+
+void parseRequest(const std::string* pText)
+{
+   http::Request request;
+   http::RequestParser parser;
+   parser.parse(request, pText->begin(), pText->end());
+}
+
+// json
+
+std::string jsonText(int objects)
+{
+   Random random;
+   json::Array array;
+   for (int i = 0; i < objects; i++)
+   {
+      json::Object object;
+      object["path"] = "~/projects/analysis/R/file" + toString(i) + ".R";
+      object["size"] = static_cast<int>(random.next(100000));
+      object["mtime"] = 1.32e12 + random.next(10000) * 1000.0;
+      object["is_directory"] = random.next(10) == 0;
+      object["name"] = std::string("file \"") + toString(i) + "\"\t\xc3\xa9";
+      json::Array tags;
+      for (int j = 0; j < 4; j++)
+         tags.push_back(static_cast<int>(random.next(1000)));
+      object["tags"] = tags;
+      array.push_back(object);
+   }
+
+   std::ostringstream ostr;
+   json::write(array, ostr);
+   return ostr.str();
+}
+
+Error checkJson(const std::string* pText, json::Value* pValue)
+{
+   if (!json::parse(*pText, pValue))
+      return systemError(boost::system::errc::bad_message, ERROR_LOCATION);
+   return Success();
+}
+
+void parseJson(const std::string* pText)
+{
+   json::Value value;
+   json::parse(*pText, &value);
+}
+
+void writeJson(const json::Value* pValue)
+{
+   std::ostringstream ostr;
+   json::write(*pValue, ostr);
+}
+
+// r tokenizer and source index
+
+std::string rCode(int functions)
+{
+   std::string code;
+   boost::format fmt(
+      "# compute the %1%th statistic (see ?summary)\n"
+      "stat_%1% <- function(x, y = 2, ..., na.rm = TRUE) {\n"
+      "   z <- x + y * 3.5e-2 - 0x1F\n"
+      "   if (z > 10 && !is.na(z)) \"big\" else 'small'\n"
+      "   lapply(seq_len(%1%L), function(i) x[[i]] %%in%% y)\n"
+      "}\n"
+      "setMethod(\"show\", \"Stat%1%\", function(object) cat(object@name))\n"
+      "\n");
+   for (int i = 0; i < functions; i++)
+      code += boost::str(fmt % i);
+   return code;
+}
+
+void tokenize(const std::wstring* pCode)
+{
+   r_util::RTokens tokens(*pCode);
+}
+
+void indexSource(const std::string* pCode)
+{
+   r_util::RSourceIndex index("~/projects/analysis/R/stats.R", *pCode);
+}
+
+// symbol table (of synthetic function names, e.g. plot_model_123)
+
+typedef std::vector<boost::shared_ptr<r_util::RSourceIndex> > SourceIndexes;
+
+void createSymbolIndexes(int symbols, SourceIndexes* pIndexes)
+{
+   const int kItemsPerIndex = 100;
+   const char* words[] = { "get", "set", "plot", "model", "data", "fit",
+                           "summary", "read", "write", "table", "frame",
+                           "print", "check", "update", "compute", "render" };
+   const int kWords = sizeof(words) / sizeof(words[0]);
+
+   Random random;
+   std::vector<r_util::RSourceItem> items;
+   for (int i = 0; i < symbols; i++)
+   {
+      std::string name = std::string(words[random.next(kWords)]) + "_" +
+                         words[random.next(kWords)] + "_" +
+                         toString(random.next(100000));
+      items.push_back(r_util::RSourceItem(
+                              r_util::RSourceItem::Function,
+                              name,
+                              std::vector<r_util::RS4MethodParam>(),
+                              0,
+                              i % kItemsPerIndex,
+                              1));
+
+      if (items.size() == kItemsPerIndex || i == symbols - 1)
+      {
+         std::string context = "~/project/R/file" +
+                               toString(pIndexes->size()) + ".R";
+         pIndexes->push_back(boost::shared_ptr<r_util::RSourceIndex>(
+                              new r_util::RSourceIndex(context, items)));
+         items.clear();
+      }
+   }
+}
+
+void buildSymbolTable(const SourceIndexes* pIndexes)
+{
+   r_util::RSourceSymbolTable table;
+   for (std::size_t i = 0; i < pIndexes->size(); i++)
+      table.add((*pIndexes)[i]);
+   table.merge();
+}
+
+void searchSymbols(r_util::RSourceSymbolTable* pTable,
+                   const char* term,
+                   bool prefixOnly)
+{
+   std::set<std::string> excludeContexts;
+   std::vector<r_util::RSourceItem> items;
+   pTable->search(term, prefixOnly, excludeContexts, 50, &items);
+}
+
+void findGlobalFunction(r_util::RSourceSymbolTable* pTable)
+{
+   std::set<std::string> excludeContexts;
+   r_util::RSourceItem item;
+   pTable->findGlobalFunction("plot_model_123", excludeContexts, &item);
+}
+
+void updateSymbolIndex(r_util::RSourceSymbolTable* pTable,
+                       const SourceIndexes* pIndexes)
+{
+   pTable->add(pIndexes->front());
+   pTable->merge();
+}
+
+// search every index (as done before the symbol table)
+void searchIndexes(const SourceIndexes* pIndexes,
+                   const char* term,
+                   bool prefixOnly)
+{
+   std::vector<r_util::RSourceItem> items;
+   for (std::size_t i = 0; i < pIndexes->size() && items.size() < 50; i++)
+      (*pIndexes)[i]->search(term, prefixOnly, false, std::back_inserter(items));
+}
+
+// file scanning and change detection
+
+Error createScanFiles(const FilePath& rootPath, int dirs, int filesPerDir)
+{
+   if (rootPath.exists())
+      return Success();
+
+   for (int d = 0; d < dirs; d++)
+   {
+      FilePath dirPath = rootPath.complete("dir" + toString(d));
+      Error error = dirPath.ensureDirectory();
+      if (error)
+         return error;
+
+      for (int f = 0; f < filesPerDir; f++)
+      {
+         error = writeStringToFile(dirPath.complete("file" + toString(f) + ".R"),
+                                   "x <- " + toString(f) + "\n");
+         if (error)
+            return error;
+      }
+   }
+
+   return Success();
+}
+
+Error createCodeFiles(const FilePath& rootPath,
+                     int files,
+                     const std::string& code)
+{
+   if (rootPath.exists())
+      return Success();
+
+   Error error = rootPath.ensureDirectory();
+   if (error)
+      return error;
+
+   for (int f = 0; f < files; f++)
+   {
+      error = writeStringToFile(rootPath.complete("stats" + toString(f) + ".R"),
+                                code);
+      if (error)
+         return error;
+   }
+
+   return Success();
+}
+
+void addFile(int, const FilePath& filePath, std::vector<FilePath>* pFiles)
+{
+   if (!filePath.isDirectory())
+      pFiles->push_back(filePath);
+}
+
+// list a directory using a FilePath per entry (as the files pane used to)
+void listChildren(const FilePath* pDirPath)
+{
+   std::vector<FilePath> children;
+   Error error = pDirPath->children(&children);
+   if (error)
+      LOG_ERROR(error);
+
+   std::vector<FileInfo> fileInfos;
+   for (std::size_t i = 0; i < children.size(); i++)
+   {
+      if (children[i].exists())
+         fileInfos.push_back(FileInfo(children[i]));
+   }
+}
+
+// list a directory in a single pass
+void listEntries(const FilePath* pDirPath)
+{
+   core::system::DirectoryListing listing;
+   Error error = core::system::listDirectory(pDirPath->absolutePath(),
+                                             &listing);
+   if (error)
+      LOG_ERROR(error);
+}
+
+void scanTree(const FilePath* pRootPath)
+{
+   core::system::FileScannerOptions options;
+   options.recursive = true;
+   tree<FileInfo> files;
+   Error error = core::system::scanFiles(FileInfo(*pRootPath), options, &files);
+   if (error)
+      LOG_ERROR(error);
+}
+
+struct FileSnapshots
+{
+   std::vector<FileInfo> previous;
+   std::vector<FileInfo> current;
+};
+
+// snapshots which differ by about 1% modified, 1% removed and 1% added
+void createSnapshots(int files, FileSnapshots* pSnapshots)
+{
+   Random random;
+   for (int i = 0; i < files; i++)
+   {
+      std::string path = "/home/user/project/dir" + toString(i % 100) +
+                         "/file" + toString(i) + ".R";
+      FileInfo fileInfo(path, false, random.next(100000), 1320000000 + i);
+      pSnapshots->previous.push_back(fileInfo);
+
+      unsigned int change = random.next(100);
+      if (change == 0)
+      {
+         pSnapshots->current.push_back(FileInfo(path, false,
+                                                fileInfo.size(),
+                                                fileInfo.lastWriteTime() + 1));
+      }
+      else if (change == 1)
+      {
+         pSnapshots->current.push_back(FileInfo(path + ".new", false));
+      }
+      else if (change != 2)
+      {
+         pSnapshots->current.push_back(fileInfo);
+      }
+   }
+}
+
+void collectChanges(const FileSnapshots* pSnapshots)
+{
+   std::vector<core::system::FileChangeEvent> events;
+   core::system::collectFileChangeEvents(pSnapshots->previous.begin(),
+                                         pSnapshots->previous.end(),
+                                         pSnapshots->current.begin(),
+                                         pSnapshots->current.end(),
+                                         &events);
+}
+
+// git graph
+
+typedef std::pair<std::string,std::vector<std::string> > Commit;
+
+std::string commitId(char branch, int i)
+{
+   // (ids are the same length as git's)
+   std::string id = branch + toString(i);
+   return id + std::string(40 - id.size(), '0');
+}
+
+// history (newest first) of a main line with a two commit topic branch
+// merged every 20 commits
+void createHistory(int commits, std::vector<Commit>* pHistory)
+{
+   for (int i = 0; i < commits; i++)
+   {
+      std::vector<std::string> parents;
+      if (i + 1 < commits)
+         parents.push_back(commitId('c', i + 1));
+      if (i % 20 == 0 && i + 5 < commits)
+         parents.push_back(commitId('b', i));
+      pHistory->push_back(Commit(commitId('c', i), parents));
+
+      // topic branch commits
+      int merge = i - 2;
+      if (merge >= 0 && merge % 20 == 0 && merge + 5 < commits)
+      {
+         pHistory->push_back(Commit(
+               commitId('b', merge),
+               std::vector<std::string>(1, commitId('t', merge))));
+         pHistory->push_back(Commit(
+               commitId('t', merge),
+               std::vector<std::string>(1, commitId('c', merge + 5))));
+      }
+   }
+}
+
+void buildGraph(const std::vector<Commit>* pHistory)
+{
+   gitgraph::GitGraph graph;
+   for (std::size_t i = 0; i < pHistory->size(); i++)
+      graph.addCommit((*pHistory)[i].first, (*pHistory)[i].second);
+}
+
+// text search
+
+bool ignoreMatches(const FilePath&, const std::vector<text::LineMatch>&)
+{
+   return true;
+}
+
+void searchText(const std::vector<FilePath>* pFiles,
+                const text::TextMatcher* pMatcher)
+{
+   text::searchFiles(*pFiles,
+                     *pMatcher,
+                     static_cast<std::size_t>(-1),
+                     4,
+                     ignoreMatches);
+}
+
+// zip archives
+
+void zipDirectory(const FilePath* pDirPath, int level, int threads)
+{
+   // (written to a null device so only reading and compression are timed)
+   boost::iostreams::stream<boost::iostreams::null_sink> os(
+                                          (boost::iostreams::null_sink()));
+   ZipWriter zipWriter(os, level, threads);
+   Error error = zipWriter.addDirectory(*pDirPath, pDirPath->filename());
+   if (!error)
+      error = zipWriter.finish();
+   if (error)
+      LOG_ERROR(error);
+}
+
+// unified diffs
+
+std::string diffText(int hunks, const std::string& code)
+{
+   std::string diff = "diff --git a/generated.R b/generated.R\n"
+                      "index 3b18e51..a7c2d19 100644\n"
+                      "--- a/generated.R\n"
+                      "+++ b/generated.R\n";
+
+   std::istringstream codeStream(code);
+   std::string line;
+   Random random;
+   int oldLine = 1, newLine = 1;
+   for (int h = 0; h < hunks; h++)
+   {
+      // 20 lines of context, 10 deleted and 10 added
+      diff += boost::str(boost::format("@@ -%1%,30 +%2%,30 @@\n") %
+                         oldLine % newLine);
+      for (int i = 0; i < 40; i++)
+      {
+         if (!std::getline(codeStream, line))
+         {
+            codeStream.clear();
+            codeStream.seekg(0);
+            std::getline(codeStream, line);
+         }
+
+         if (i >= 20)
+            diff += (i < 30 ? "-" : "+") + line + "\n";
+         else
+            diff += " " + line + "\n";
+      }
+      oldLine += 30 + random.next(100);
+      newLine = oldLine;
+   }
+
+   return diff;
+}
+
+void parseDiff(const std::string* pText)
+{
+   text::UnifiedDiff diff;
+   diff.parse(*pText);
+}
+
+// gzip responses
+
+void gzipResponse(const std::string* pContent)
+{
+   http::Response response;
+   response.setContentEncoding(http::kGzipEncoding);
+   Error error = response.setBody(*pContent);
+   if (error)
+      LOG_ERROR(error);
+}
+
+#ifndef _WIN32
+
+// proxying large responses (a thread writing the content plays the part
+// of the session and a thread reading it the part of the browser)
+
+const std::size_t kProxyContentSize = 16 * 1024 * 1024;
+
+void writeContent(int fd)
+{
+   std::vector<char> chunk(65536, 'x');
+   std::size_t remaining = kProxyContentSize;
+   while (remaining > 0)
+   {
+      ssize_t written = ::write(fd, &chunk[0],
+                                std::min(remaining, chunk.size()));
+      if (written <= 0)
+         break;
+      remaining -= written;
+   }
+   ::close(fd);
+}
+
+void readContent(int fd)
+{
+   std::vector<char> chunk(65536);
+   while (::read(fd, &chunk[0], chunk.size()) > 0)
+   {
+   }
+   ::close(fd);
+}
+
+void handlePumpComplete(const Error& error)
+{
+   if (error)
+      LOG_ERROR(error);
+}
+
+// store and forward: read the whole response then write it
+void bufferContent(int sourceFd, int destFd)
+{
+   std::string content;
+   std::vector<char> chunk(65536);
+   ssize_t bytesRead;
+   while ((bytesRead = ::read(sourceFd, &chunk[0], chunk.size())) > 0)
+      content.append(&chunk[0], bytesRead);
+
+   std::size_t offset = 0;
+   while (offset < content.size())
+   {
+      ssize_t written = ::write(destFd,
+                                content.data() + offset,
+                                content.size() - offset);
+      if (written <= 0)
+         break;
+      offset += written;
+   }
+}
+
+void proxyContent(bool stream)
+{
+   int source[2], dest[2];
+   if (::socketpair(AF_UNIX, SOCK_STREAM, 0, source) == -1)
+   {
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      return;
+   }
+   if (::socketpair(AF_UNIX, SOCK_STREAM, 0, dest) == -1)
+   {
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      ::close(source[0]);
+      ::close(source[1]);
+      return;
+   }
+
+   boost::thread writer(boost::bind(writeContent, source[0]));
+   boost::thread reader(boost::bind(readContent, dest[1]));
+
+   if (stream)
+   {
+      boost::asio::io_service ioService;
+      boost::shared_ptr<http::StreamPump> pPump;
+      Error error = http::StreamPump::create(ioService,
+                                             source[1],
+                                             dest[0],
+                                             &pPump);
+      if (error)
+      {
+         LOG_ERROR(error);
+      }
+      else
+      {
+         pPump->start(handlePumpComplete);
+         pPump.reset();
+         ioService.run();
+      }
+   }
+   else
+   {
+      bufferContent(source[1], dest[0]);
+   }
+
+   ::close(source[1]);
+   ::close(dest[0]);
+   writer.join();
+   reader.join();
+}
+
+// authenticating requests (validating the signed user-id cookie which
+// each of them presents, as rserver does) either by computing the hmac
+// of the cookie or by finding it in a cache of validated cookies
+
+const int kAuthRequests = 1000;
+const char * const kAuthCookieKey = "0b1e6a52-3c4f-4d8e-9a7b-5f2c8d1e6a90";
+
+std::string authCookieHmac(const std::string& value, const std::string& expires)
+{
+   std::vector<unsigned char> hmac;
+   std::string encoded;
+   Error error = system::crypto::HMAC_SHA1(value + expires,
+                                           kAuthCookieKey,
+                                           &hmac);
+   if (!error)
+      error = system::crypto::base64Encode(hmac, &encoded);
+   if (error)
+      LOG_ERROR(error);
+   return encoded;
+}
+
+std::string signAuthCookie(const std::string& value,
+                           const boost::posix_time::ptime& expiresTime)
+{
+   std::string expires = http::util::httpDate(expiresTime);
+   return http::util::urlEncode(value) + "|" +
+          http::util::urlEncode(expires) + "|" +
+          http::util::urlEncode(authCookieHmac(value, expires));
+}
+
+std::string validateAuthCookie(const std::string& signedCookie,
+                               const boost::posix_time::ptime& now,
+                               boost::posix_time::ptime* pExpiresTime)
+{
+   std::vector<std::string> fields;
+   boost::algorithm::split(fields, signedCookie, boost::algorithm::is_any_of("|"));
+   if (fields.size() != 3)
+      return std::string();
+
+   std::string value = http::util::urlDecode(fields[0]);
+   std::string expires = http::util::urlDecode(fields[1]);
+   std::string hmac = http::util::urlDecode(fields[2]);
+   if (!system::crypto::constantTimeEquals(hmac, authCookieHmac(value, expires)))
+      return std::string();
+
+   *pExpiresTime = http::util::parseHttpDate(expires);
+   if (pExpiresTime->is_not_a_date_time() || *pExpiresTime <= now)
+      return std::string();
+
+   return value;
+}
+
+void authenticateRequests(const http::Request* pRequest,
+                          http::ValidatedCookieCache* pCache)
+{
+   using namespace boost::posix_time;
+   for (int i = 0; i < kAuthRequests; i++)
+   {
+      std::string signedCookie = pRequest->cookieValue("user-id");
+      ptime now = second_clock::universal_time();
+      std::string value;
+      if (pCache == NULL || !pCache->find(signedCookie, now, &value))
+      {
+         ptime expiresTime;
+         value = validateAuthCookie(signedCookie, now, &expiresTime);
+         if (value.empty())
+            LOG_WARNING_MESSAGE("Invalid cookie: " + signedCookie);
+         else if (pCache != NULL)
+            pCache->insert(signedCookie, value, expiresTime);
+      }
+   }
+}
+
+#endif
+
+// inputs shared by the benchmarks (created by their setup functions)
+struct Inputs
+{
+   std::string getRequest;
+   std::string postRequest;
+   std::string jsonText;
+   json::Value jsonValue;
+   std::string rCode;
+   std::wstring rCodeWide;
+   SourceIndexes symbolIndexes;
+   r_util::RSourceSymbolTable symbolTable;
+   FilePath scanPath;
+   FilePath listPath;
+   FilePath codePath;
+   std::vector<FilePath> codeFiles;
+   std::vector<FilePath> scanFiles;
+   text::TextMatcher literalMatcher;
+   text::TextMatcher regexMatcher;
+   FileSnapshots snapshots;
+   std::vector<Commit> history;
+   std::string responseContent;
+   std::string diffText;
+   http::Request authRequest;
+   http::ValidatedCookieCache authCookies;
+};
+
+Error setupRequests(Inputs* pInputs)
+{
+   pInputs->getRequest = requestText("GET", std::string());
+   pInputs->postRequest = requestText("POST", jsonText(20));
+   Error error = checkRequest(&pInputs->getRequest);
+   if (error)
+      return error;
+   return checkRequest(&pInputs->postRequest);
+}
+
+Error setupJson(Inputs* pInputs)
+{
+   if (pInputs->jsonText.empty())
+      pInputs->jsonText = jsonText(2000);
+   return checkJson(&pInputs->jsonText, &pInputs->jsonValue);
+}
+
+Error setupRCode(Inputs* pInputs)
+{
+   if (pInputs->rCode.empty())
+   {
+      pInputs->rCode = rCode(500);
+      pInputs->rCodeWide = string_utils::utf8ToWide(pInputs->rCode);
+   }
+   return Success();
+}
+
+Error setupSymbols(Inputs* pInputs)
+{
+   if (pInputs->symbolIndexes.empty())
+   {
+      createSymbolIndexes(100000, &pInputs->symbolIndexes);
+      for (std::size_t i = 0; i < pInputs->symbolIndexes.size(); i++)
+         pInputs->symbolTable.add(pInputs->symbolIndexes[i]);
+      pInputs->symbolTable.merge();
+   }
+   return Success();
+}
+
+Error setupScan(Inputs* pInputs)
+{
+   return createScanFiles(pInputs->scanPath, 20, 100);
+}
+
+Error setupList(Inputs* pInputs)
+{
+   // (the directory listed is the single directory created)
+   return createScanFiles(pInputs->listPath.parent(), 1, 1000);
+}
+
+Error setupCode(Inputs* pInputs)
+{
+   Error error = setupRCode(pInputs);
+   if (error)
+      return error;
+
+   return createCodeFiles(pInputs->codePath, 20, pInputs->rCode);
+}
+
+Error setupSearch(Inputs* pInputs)
+{
+   Error error = setupCode(pInputs);
+   if (!error)
+      error = setupScan(pInputs);
+   if (!error)
+      error = pInputs->literalMatcher.initialize("stat_499 <-", false, false);
+   if (!error)
+      error = pInputs->regexMatcher.initialize("x\\[\\[[a-z]+\\]\\]",
+                                               true,
+                                               false);
+   if (error)
+      return error;
+
+   // (files are listed here as the session lists them using the file
+   // monitor's tree)
+   pInputs->codeFiles.clear();
+   pInputs->scanFiles.clear();
+   error = pInputs->codePath.childrenRecursive(
+                        boost::bind(addFile, _1, _2, &pInputs->codeFiles));
+   if (!error)
+      error = pInputs->scanPath.childrenRecursive(
+                        boost::bind(addFile, _1, _2, &pInputs->scanFiles));
+   return error;
+}
+
+Error setupSnapshots(Inputs* pInputs)
+{
+   if (pInputs->snapshots.previous.empty())
+      createSnapshots(50000, &pInputs->snapshots);
+   return Success();
+}
+
+Error setupHistory(Inputs* pInputs)
+{
+   if (pInputs->history.empty())
+      createHistory(5000, &pInputs->history);
+   return Success();
+}
+
+Error setupResponse(Inputs* pInputs)
+{
+   Error error = setupRCode(pInputs);
+   if (error)
+      return error;
+
+   while (pInputs->responseContent.size() < 256 * 1024)
+      pInputs->responseContent += pInputs->rCode;
+   return Success();
+}
+
+Error setupDiff(Inputs* pInputs)
+{
+   Error error = setupRCode(pInputs);
+   if (error)
+      return error;
+
+   if (pInputs->diffText.empty())
+      pInputs->diffText = diffText(2000, pInputs->rCode);
+   return Success();
+}
+
+#ifndef _WIN32
+Error setupAuth(Inputs* pInputs)
+{
+   if (!pInputs->authRequest.headers().empty())
+      return Success();
+
+   using namespace boost::posix_time;
+   std::string signedCookie = signAuthCookie(
+                  "jjallaire", second_clock::universal_time() + hours(24 * 30));
+   std::string text =
+      "POST /rpc/get_events HTTP/1.1\r\n"
+      "Host: localhost:8787\r\n"
+      "Accept: */*\r\n"
+      "Cookie: user-id=" + signedCookie + "; "
+         "csrf-token=0b5fa5ae-d7a0-4b4a-9c16-c0b5a7e23d6c\r\n"
+      "Content-Type: application/json\r\n"
+      "Content-Length: 2\r\n"
+      "\r\n"
+      "{}";
+
+   http::RequestParser parser;
+   if (parser.parse(pInputs->authRequest, text.begin(), text.end()) !=
+       http::RequestParser::complete)
+   {
+      return systemError(boost::system::errc::protocol_error,
+                         ERROR_LOCATION);
+   }
+   return Success();
+}
+#endif
+
+} // anonymous namespace
+
+void addCoreBenchmarks(const FilePath& scratchPath,
+                       std::vector<Benchmark>* pBenchmarks)
+{
+   // (the inputs live as long as the benchmarks which refer to them)
+   static Inputs s_inputs;
+   Inputs* pInputs = &s_inputs;
+   pInputs->scanPath = scratchPath.complete("scan");
+   pInputs->listPath = scratchPath.complete("list").complete("dir0");
+   pInputs->codePath = scratchPath.complete("code");
+
+   using boost::bind;
+   std::vector<Benchmark>& benchmarks = *pBenchmarks;
+   benchmarks.push_back(Benchmark("http.parse-get",
+                                  bind(parseRequest, &pInputs->getRequest),
+                                  bind(setupRequests, pInputs)));
+   benchmarks.push_back(Benchmark("http.parse-post",
+                                  bind(parseRequest, &pInputs->postRequest),
+                                  bind(setupRequests, pInputs)));
+   benchmarks.push_back(Benchmark("http.gzip-response",
+                                  bind(gzipResponse, &pInputs->responseContent),
+                                  bind(setupResponse, pInputs)));
+#ifndef _WIN32
+   benchmarks.push_back(Benchmark("http.proxy-buffered",
+                                  bind(proxyContent, false)));
+   benchmarks.push_back(Benchmark("http.proxy-stream",
+                                  bind(proxyContent, true)));
+   benchmarks.push_back(Benchmark("http.auth-hmac",
+                                  bind(authenticateRequests,
+                                       &pInputs->authRequest,
+                                       (http::ValidatedCookieCache*)NULL),
+                                  bind(setupAuth, pInputs)));
+   benchmarks.push_back(Benchmark("http.auth-cached",
+                                  bind(authenticateRequests,
+                                       &pInputs->authRequest,
+                                       &pInputs->authCookies),
+                                  bind(setupAuth, pInputs)));
+#endif
+   benchmarks.push_back(Benchmark("json.parse",
+                                  bind(parseJson, &pInputs->jsonText),
+                                  bind(setupJson, pInputs)));
+   benchmarks.push_back(Benchmark("json.write",
+                                  bind(writeJson, &pInputs->jsonValue),
+                                  bind(setupJson, pInputs)));
+   benchmarks.push_back(Benchmark("r.tokenize",
+                                  bind(tokenize, &pInputs->rCodeWide),
+                                  bind(setupRCode, pInputs)));
+   benchmarks.push_back(Benchmark("r.source-index",
+                                  bind(indexSource, &pInputs->rCode),
+                                  bind(setupRCode, pInputs)));
+   benchmarks.push_back(Benchmark("r.symbols-build",
+                                  bind(buildSymbolTable,
+                                       &pInputs->symbolIndexes),
+                                  bind(setupSymbols, pInputs)));
+   benchmarks.push_back(Benchmark("r.symbols-prefix",
+                                  bind(searchSymbols, &pInputs->symbolTable,
+                                       "plot_m", true),
+                                  bind(setupSymbols, pInputs)));
+   benchmarks.push_back(Benchmark("r.symbols-contains",
+                                  bind(searchSymbols, &pInputs->symbolTable,
+                                       "model_9", false),
+                                  bind(setupSymbols, pInputs)));
+   benchmarks.push_back(Benchmark("r.symbols-wildcard",
+                                  bind(searchSymbols, &pInputs->symbolTable,
+                                       "*fit*99", false),
+                                  bind(setupSymbols, pInputs)));
+   benchmarks.push_back(Benchmark("r.symbols-global-function",
+                                  bind(findGlobalFunction,
+                                       &pInputs->symbolTable),
+                                  bind(setupSymbols, pInputs)));
+   benchmarks.push_back(Benchmark("r.symbols-update",
+                                  bind(updateSymbolIndex,
+                                       &pInputs->symbolTable,
+                                       &pInputs->symbolIndexes),
+                                  bind(setupSymbols, pInputs)));
+   benchmarks.push_back(Benchmark("r.symbols-linear-contains",
+                                  bind(searchIndexes, &pInputs->symbolIndexes,
+                                       "zzz", false),
+                                  bind(setupSymbols, pInputs)));
+   benchmarks.push_back(Benchmark("text.diff-parse",
+                                  bind(parseDiff, &pInputs->diffText),
+                                  bind(setupDiff, pInputs)));
+   benchmarks.push_back(Benchmark("text.search-literal",
+                                  bind(searchText, &pInputs->codeFiles,
+                                       &pInputs->literalMatcher),
+                                  bind(setupSearch, pInputs)));
+   benchmarks.push_back(Benchmark("text.search-regex",
+                                  bind(searchText, &pInputs->codeFiles,
+                                       &pInputs->regexMatcher),
+                                  bind(setupSearch, pInputs)));
+   benchmarks.push_back(Benchmark("text.search-many-files",
+                                  bind(searchText, &pInputs->scanFiles,
+                                       &pInputs->literalMatcher),
+                                  bind(setupSearch, pInputs)));
+   benchmarks.push_back(Benchmark("zip.level1",
+                                  bind(zipDirectory, &pInputs->codePath, 1, 1),
+                                  bind(setupCode, pInputs)));
+   benchmarks.push_back(Benchmark("zip.level6",
+                                  bind(zipDirectory, &pInputs->codePath, 6, 1),
+                                  bind(setupCode, pInputs)));
+   benchmarks.push_back(Benchmark("zip.level1-threads4",
+                                  bind(zipDirectory, &pInputs->codePath, 1, 4),
+                                  bind(setupCode, pInputs)));
+   benchmarks.push_back(Benchmark("files.list-children",
+                                  bind(listChildren, &pInputs->listPath),
+                                  bind(setupList, pInputs)));
+   benchmarks.push_back(Benchmark("files.list-directory",
+                                  bind(listEntries, &pInputs->listPath),
+                                  bind(setupList, pInputs)));
+   benchmarks.push_back(Benchmark("files.scan",
+                                  bind(scanTree, &pInputs->scanPath),
+                                  bind(setupScan, pInputs)));
+   benchmarks.push_back(Benchmark("files.change-events",
+                                  bind(collectChanges, &pInputs->snapshots),
+                                  bind(setupSnapshots, pInputs)));
+   benchmarks.push_back(Benchmark("git.graph",
+                                  bind(buildGraph, &pInputs->history),
+                                  bind(setupHistory, pInputs)));
+}
+
+} // namespace dev
+} // namespace core
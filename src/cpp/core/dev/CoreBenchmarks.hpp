@@ -0,0 +1,38 @@
+/*
+ * CoreBenchmarks.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_DEV_CORE_BENCHMARKS_HPP
+#define CORE_DEV_CORE_BENCHMARKS_HPP
+
+#include <vector>
+
+#include "Benchmark.hpp"
+
+namespace core {
+
+class FilePath;
+
+namespace dev {
+
+// benchmarks of the http parser, json, the r tokenizer and source index,
+// diff parsing, the file scanner, file change detection, the git graph,
+// gzip responses, proxying of large responses and authentication of
+// requests. all of their inputs are synthesized
+// (deterministically) and files are written beneath scratchPath
+void addCoreBenchmarks(const core::FilePath& scratchPath,
+                       std::vector<Benchmark>* pBenchmarks);
+
+} // namespace dev
+} // namespace core
+
+#endif // CORE_DEV_CORE_BENCHMARKS_HPP
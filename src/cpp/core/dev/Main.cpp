@@ -11,17 +11,88 @@
  *
  */
 
+#include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/lexical_cast.hpp>
 
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
 #include <core/Log.hpp>
 
+#include <core/system/Environment.hpp>
 #include <core/system/System.hpp>
 
+#include "Benchmark.hpp"
+#include "CoreBenchmarks.hpp"
+
 
 using namespace core ;
 
+namespace {
+
+bool parseOption(const std::string& arg,
+                 const std::string& name,
+                 std::string* pValue)
+{
+   std::string prefix = "--" + name + "=";
+   if (arg.compare(0, prefix.size(), prefix) != 0)
+      return false;
+   *pValue = arg.substr(prefix.size());
+   return true;
+}
+
+// coredev bench [--filter=<text>] [--iterations=<n>] [--warmups=<n>]
+//               [--json] [--scratch=<dir>]
+int bench(int argc, char * const argv[])
+{
+   dev::BenchmarkOptions options;
+   std::string scratchDir;
+   for (int i = 2; i < argc; i++)
+   {
+      std::string arg(argv[i]), value;
+      if (parseOption(arg, "filter", &value))
+         options.filter = value;
+      else if (parseOption(arg, "iterations", &value))
+         options.iterations = boost::lexical_cast<int>(value);
+      else if (parseOption(arg, "warmups", &value))
+         options.warmups = boost::lexical_cast<int>(value);
+      else if (parseOption(arg, "scratch", &value))
+         scratchDir = value;
+      else if (arg == "--json")
+         options.json = true;
+      else
+      {
+         std::cerr << "usage: coredev bench [--filter=<text>] "
+                   << "[--iterations=<n>] [--warmups=<n>] [--json] "
+                   << "[--scratch=<dir>]" << std::endl;
+         return EXIT_FAILURE;
+      }
+   }
+
+   // files created by the benchmarks are kept in the scratch directory
+   // between runs (so they aren't recreated every time)
+   if (scratchDir.empty())
+   {
+      scratchDir = core::system::getenv("TMPDIR");
+      if (scratchDir.empty())
+         scratchDir = "/tmp";
+      scratchDir += "/coredev-bench";
+   }
+
+   std::vector<dev::Benchmark> benchmarks;
+   dev::addCoreBenchmarks(FilePath(scratchDir), &benchmarks);
+
+   if (!dev::runBenchmarks(benchmarks, options, std::cout))
+      return EXIT_FAILURE;
+
+   return EXIT_SUCCESS;
+}
+
+} // anonymous namespace
+
 int main(int argc, char * const argv[]) 
 {
    try
@@ -29,9 +100,10 @@ int main(int argc, char * const argv[])
       // initialize log
       initializeSystemLog("coredev", core::system::kLogLevelWarning);
 
-     
-   
-     
+      std::string command = argc > 1 ? argv[1] : "";
+      if (command == "bench")
+         return bench(argc, argv);
+
       return EXIT_SUCCESS;
    }
    CATCH_UNEXPECTED_EXCEPTION
@@ -0,0 +1,372 @@
+/*
+ * MultipartFormParser.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/MultipartFormParser.hpp>
+
+#include <sstream>
+#include <ostream>
+
+#include <boost/regex.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/http/Header.hpp>
+#include <core/system/System.hpp>
+
+namespace core {
+namespace http {
+
+namespace {
+
+// guard against unterminated part headers and oversized form fields (these
+// are always held in memory so need to be bounded independent of the
+// file size limit)
+const std::size_t kMaxPartHeaderBytes = 16 * 1024;
+const std::size_t kMaxFieldBytes = 1024 * 1024;
+
+const char * const kHeaderTerminator = "\r\n\r\n";
+
+} // anonymous namespace
+
+MultipartFormParser::MultipartFormParser(const std::string& contentType,
+                                         const FilePath& spoolDir,
+                                         boost::uintmax_t maxFileBytes,
+                                         const ProgressHandler& onProgress)
+   : state_(preamble),
+     spoolDir_(spoolDir),
+     maxFileBytes_(maxFileBytes),
+     onProgress_(onProgress),
+     bytesConsumed_(0),
+     limitExceeded_(false),
+     filesReleased_(false),
+     partIsFile_(false),
+     partBytes_(0)
+{
+   // get the boundary token
+   std::string boundaryPrefix("boundary=");
+   std::string boundary;
+   size_t prefixLoc = contentType.find(boundaryPrefix);
+   if (prefixLoc != std::string::npos)
+   {
+      boundary = contentType.substr(prefixLoc+boundaryPrefix.size(),
+                                    std::string::npos);
+      boost::algorithm::trim(boundary);
+   }
+
+   // every boundary (after the first) is preceded by a CRLF which belongs
+   // to the boundary rather than the part. we seed the buffer with a CRLF
+   // so that the first boundary can be found with the same delimiter
+   delimiter_ = "\r\n--" + boundary;
+   buffer_ = "\r\n";
+}
+
+MultipartFormParser::~MultipartFormParser()
+{
+   try
+   {
+      pPartStream_.reset();
+
+      if (!filesReleased_)
+         removeSpooledFiles();
+   }
+   catch(...)
+   {
+   }
+}
+
+MultipartFormParser::status MultipartFormParser::parse(const char* begin,
+                                                       const char* end)
+{
+   if (state_ == epilogue)
+   {
+      bytesConsumed_ += (end - begin);
+      return complete;
+   }
+
+   // a boundary of "\r\n--" means there was no boundary in the content type
+   if (delimiter_.length() <= 4)
+      return error;
+
+   buffer_.append(begin, end);
+   bytesConsumed_ += (end - begin);
+
+   status result = processBuffer();
+
+   if (onProgress_)
+      onProgress_(bytesConsumed_);
+
+   return result;
+}
+
+MultipartFormParser::status MultipartFormParser::processBuffer()
+{
+   while (true)
+   {
+      switch (state_)
+      {
+      case preamble:
+      {
+         std::string::size_type pos = buffer_.find(delimiter_);
+         if (pos == std::string::npos)
+         {
+            // discard preamble (retaining enough to match a split delimiter)
+            if (buffer_.size() >= delimiter_.size())
+               buffer_.erase(0, buffer_.size() - delimiter_.size() + 1);
+            return incomplete;
+         }
+
+         buffer_.erase(0, pos + delimiter_.size());
+         state_ = after_boundary;
+         break;
+      }
+
+      case after_boundary:
+      {
+         if (buffer_.size() < 2)
+            return incomplete;
+
+         if (buffer_.compare(0, 2, "--") == 0)
+         {
+            buffer_.clear();
+            state_ = epilogue;
+            return complete;
+         }
+         else if (buffer_.compare(0, 2, "\r\n") == 0)
+         {
+            buffer_.erase(0, 2);
+            state_ = part_headers;
+            break;
+         }
+         else
+         {
+            return error;
+         }
+      }
+
+      case part_headers:
+      {
+         // the header block is empty when the boundary CRLF is immediately
+         // followed by the blank line
+         std::string::size_type pos;
+         std::size_t terminatorSize;
+         if (buffer_.compare(0, 2, "\r\n") == 0)
+         {
+            pos = 0;
+            terminatorSize = 2;
+         }
+         else
+         {
+            pos = buffer_.find(kHeaderTerminator);
+            terminatorSize = 4;
+         }
+
+         if (pos == std::string::npos)
+         {
+            if (buffer_.size() > kMaxPartHeaderBytes)
+               return error;
+            else
+               return incomplete;
+         }
+
+         std::string headers = buffer_.substr(0, pos + terminatorSize);
+         buffer_.erase(0, pos + terminatorSize);
+         if (!beginPart(headers))
+            return error;
+
+         state_ = part_body;
+         break;
+      }
+
+      case part_body:
+      {
+         std::string::size_type pos = buffer_.find(delimiter_);
+         if (pos == std::string::npos)
+         {
+            // write everything which can't be the start of a delimiter
+            if (buffer_.size() >= delimiter_.size())
+            {
+               std::size_t safeBytes = buffer_.size() - delimiter_.size() + 1;
+               if (!writePartData(buffer_.data(), buffer_.data() + safeBytes))
+                  return error;
+               buffer_.erase(0, safeBytes);
+            }
+            return incomplete;
+         }
+
+         if (!writePartData(buffer_.data(), buffer_.data() + pos))
+            return error;
+         buffer_.erase(0, pos + delimiter_.size());
+         endPart();
+
+         state_ = after_boundary;
+         break;
+      }
+
+      case epilogue:
+         return complete;
+
+      default:
+         return error;
+      }
+   }
+}
+
+bool MultipartFormParser::beginPart(const std::string& headerText)
+{
+   // reset part state
+   partName_.clear();
+   partIsFile_ = false;
+   partFile_ = File();
+   partValue_.clear();
+   partBytes_ = 0;
+   pPartStream_.reset();
+
+   // read the headers
+   std::istringstream headerStream(headerText);
+   Headers headers;
+   http::parseHeaders(headerStream, &headers);
+
+   // check for content-disposition (parts without one are skipped)
+   std::string cDisp = http::headerValue(headers, "Content-Disposition");
+   if (cDisp.empty())
+      return true;
+
+   // parse values out of content disposition
+   std::string nameRegex("form-data; name=\"(.*)\"");
+   std::string filenameRegex(nameRegex + "; filename=\"(.*)\"");
+   boost::smatch fileMatch, nameMatch;
+   if (regex_match(cDisp, fileMatch, boost::regex(filenameRegex)))
+   {
+      partName_ = fileMatch[1];
+      partIsFile_ = true;
+      partFile_.name = fileMatch[2];
+      partFile_.contentType = http::headerValue(headers, "Content-Type");
+      if (partFile_.contentType.empty())
+         partFile_.contentType = "application/octet-stream";
+
+      // open the spool file
+      Error error = spoolDir_.ensureDirectory();
+      if (error)
+      {
+         LOG_ERROR(error);
+         return false;
+      }
+      partFile_.spoolPath = spoolDir_.complete(
+                                 "upload-" + core::system::generateUuid(false));
+      error = partFile_.spoolPath.open_w(&pPartStream_);
+      if (error)
+      {
+         LOG_ERROR(error);
+         partFile_.spoolPath = FilePath();
+         return false;
+      }
+   }
+   else if (regex_match(cDisp, nameMatch, boost::regex(nameRegex)))
+   {
+      partName_ = nameMatch[1];
+   }
+
+   return true;
+}
+
+bool MultipartFormParser::writePartData(const char* begin, const char* end)
+{
+   std::size_t length = end - begin;
+   if (length == 0 || partName_.empty())
+      return true;
+
+   partBytes_ += length;
+
+   if (partIsFile_)
+   {
+      // enforce the file size limit as we go rather than after the fact
+      if (maxFileBytes_ > 0 && partBytes_ > maxFileBytes_)
+      {
+         limitExceeded_ = true;
+         pPartStream_.reset();
+         Error error = partFile_.spoolPath.removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+         return false;
+      }
+
+      pPartStream_->write(begin, length);
+      if (pPartStream_->fail())
+      {
+         LOG_ERROR_MESSAGE("Error writing upload to " +
+                           partFile_.spoolPath.absolutePath());
+         return false;
+      }
+   }
+   else
+   {
+      if (partBytes_ > kMaxFieldBytes)
+         return false;
+
+      partValue_.append(begin, length);
+   }
+
+   return true;
+}
+
+void MultipartFormParser::endPart()
+{
+   if (partName_.empty())
+      return;
+
+   if (partIsFile_)
+   {
+      pPartStream_->flush();
+      pPartStream_.reset();
+      partFile_.spoolSize = partBytes_;
+
+      // (the first of several parts with the same name is kept)
+      if (!files_.insert(std::make_pair(partName_, partFile_)).second)
+      {
+         Error error = partFile_.spoolPath.removeIfExists();
+         if (error)
+            LOG_ERROR(error);
+      }
+      partFile_ = File();
+   }
+   else
+   {
+      boost::algorithm::trim(partValue_);
+      fields_.push_back(std::make_pair(partName_, partValue_));
+   }
+
+   partName_.clear();
+}
+
+void MultipartFormParser::removeSpooledFiles()
+{
+   // partially written file
+   if (partIsFile_ && !partFile_.spoolPath.empty())
+   {
+      Error error = partFile_.spoolPath.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   // completed files
+   for (Files::const_iterator it = files_.begin(); it != files_.end(); ++it)
+   {
+      Error error = it->second.spoolPath.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
+} // namespace http
+} // namespace core
@@ -175,6 +175,8 @@ void Request::resetMembers()
    cookies_.clear() ;
    parsedFormFields_ = false ;
    formFields_.clear() ;
+   files_.clear();
+   pFormParser_.reset();
    parsedQueryParams_ = false;
    queryParams_.clear();
 }
@@ -23,7 +23,8 @@ RequestParser::RequestParser()
   : state_(method_start), 
     content_length_(0), 
     parsing_content_length_(false), 
-    parsing_body_(false)
+    parsing_body_(false),
+    body_bytes_read_(0)
 {
 }
 
@@ -33,6 +34,39 @@ void RequestParser::reset()
   content_length_ = 0 ;
   parsing_content_length_ = false ;
   parsing_body_ = false ;
+  body_bytes_read_ = 0 ;
+  pFormParser_.reset();
+}
+
+void RequestParser::beginBody(const Request& req)
+{
+  body_bytes_read_ = 0;
+  pFormParser_.reset();
+
+  if (formParserFactory_ &&
+      req.headerValue("Content-Type").find("multipart/form-data") == 0)
+  {
+    pFormParser_ = formParserFactory_(req);
+  }
+}
+
+RequestParser::status RequestParser::endBody(
+                                 Request& req,
+                                 MultipartFormParser::status formStatus)
+{
+  // the body ended before the closing boundary
+  if (formStatus != MultipartFormParser::complete)
+    return error;
+
+  // hand the parsed fields and spooled files to the request (it keeps
+  // the parser so spooled files which handlers don't move elsewhere are
+  // removed along with the request)
+  req.formFields_ = pFormParser_->fields();
+  req.files_ = pFormParser_->files();
+  req.parsedFormFields_ = true;
+  req.pFormParser_ = pFormParser_;
+
+  return complete;
 }
 
 RequestParser::status RequestParser::consume(Request& req, char input)
@@ -285,7 +319,8 @@ RequestParser::status RequestParser::consume(Request& req, char input)
       // if this header was Content-Length then save it
       if (parsing_content_length_)
       {
-         content_length_ = boost::lexical_cast<int>(req.headers_.back().value);
+         content_length_ = boost::lexical_cast<std::size_t>(
+                                          req.headers_.back().value);
          parsing_content_length_ = false ;
       }
 
@@ -133,6 +133,14 @@ void Response::setDynamicHtml(const std::string& html,
    setBody(html);
 }
    
+void Response::setStreamingBody(const BodyWriter& bodyWriter)
+{
+   removeHeader("Content-Encoding");
+   removeHeader("Content-Length");
+   body_.clear();
+   streamingBody_ = bodyWriter;
+}
+
 void Response::setBodyUnencoded(const std::string& body)
 {
    removeHeader("Content-Encoding");
@@ -173,6 +181,7 @@ void Response::resetMembers()
 	statusCode_ = status::Ok ;
 	statusCodeStr_.clear() ;
 	statusMessage_.clear() ;
+	streamingBody_.clear() ;
 }
    
 void Response::removeCachingHeaders()
@@ -0,0 +1,306 @@
+/*
+ * StreamPump.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/StreamPump.hpp>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <boost/bind.hpp>
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/write.hpp>
+#include <boost/asio/placeholders.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+
+#include "config.h"
+
+namespace core {
+namespace http {
+
+namespace {
+
+// bytes moved per splice() or read (the default capacity of a pipe)
+const std::size_t kChunkSize = 65536;
+
+Error duplicateNonBlocking(int fd, int* pNewFd)
+{
+   int newFd = ::dup(fd);
+   if (newFd == -1)
+      return systemError(errno, ERROR_LOCATION);
+
+   int flags = ::fcntl(newFd, F_GETFL);
+   if (flags == -1 || ::fcntl(newFd, F_SETFL, flags | O_NONBLOCK) == -1)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      ::close(newFd);
+      return error;
+   }
+
+   *pNewFd = newFd;
+   return Success();
+}
+
+#ifdef HAVE_SPLICE
+ssize_t spliceNonBlocking(int fromFd, int toFd, std::size_t length)
+{
+   ssize_t result;
+   do
+   {
+      result = ::splice(fromFd, NULL, toFd, NULL, length,
+                        SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+   }
+   while (result == -1 && errno == EINTR);
+   return result;
+}
+#endif
+
+} // anonymous namespace
+
+Error StreamPump::create(boost::asio::io_service& ioService,
+                         int sourceFd,
+                         int destFd,
+                         boost::shared_ptr<StreamPump>* pPump)
+{
+   boost::shared_ptr<StreamPump> pNewPump(new StreamPump(ioService));
+
+   int fd = -1;
+   Error error = duplicateNonBlocking(sourceFd, &fd);
+   if (error)
+      return error;
+   boost::system::error_code ec;
+   pNewPump->source_.assign(fd, ec);
+   if (ec)
+   {
+      ::close(fd);
+      return Error(ec, ERROR_LOCATION);
+   }
+
+   error = duplicateNonBlocking(destFd, &fd);
+   if (error)
+      return error;
+   pNewPump->dest_.assign(fd, ec);
+   if (ec)
+   {
+      ::close(fd);
+      return Error(ec, ERROR_LOCATION);
+   }
+
+#ifdef HAVE_SPLICE
+   // if we can't create a pipe we can still copy using a buffer
+   if (::pipe(pNewPump->pipe_) == -1)
+   {
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      pNewPump->pipe_[0] = pNewPump->pipe_[1] = -1;
+   }
+#endif
+
+   *pPump = pNewPump;
+   return Success();
+}
+
+StreamPump::StreamPump(boost::asio::io_service& ioService)
+   : source_(ioService),
+     dest_(ioService),
+     pipeBytes_(0),
+     bytesPumped_(0)
+{
+   pipe_[0] = pipe_[1] = -1;
+}
+
+StreamPump::~StreamPump()
+{
+   try
+   {
+      closePipe();
+   }
+   catch(...)
+   {
+   }
+}
+
+void StreamPump::start(const CompletionHandler& completionHandler)
+{
+   completionHandler_ = completionHandler;
+
+   if (pipe_[0] != -1)
+      waitForSource();
+   else
+      readSome();
+}
+
+void StreamPump::waitForSource()
+{
+   source_.async_read_some(
+         boost::asio::null_buffers(),
+         boost::bind(&StreamPump::handleSourceReadable,
+                     shared_from_this(),
+                     boost::asio::placeholders::error));
+}
+
+void StreamPump::handleSourceReadable(const boost::system::error_code& ec)
+{
+#ifdef HAVE_SPLICE
+   if (ec)
+   {
+      complete(Error(ec, ERROR_LOCATION));
+      return;
+   }
+
+   ssize_t result = spliceNonBlocking(source_.native(), pipe_[1], kChunkSize);
+   if (result > 0)
+   {
+      pipeBytes_ = result;
+      writePending();
+   }
+   else if (result == 0)
+   {
+      complete(Success());
+   }
+   else if (errno == EAGAIN)
+   {
+      waitForSource();
+   }
+   else if (errno == EINVAL && bytesPumped_ == 0)
+   {
+      // the descriptors don't support splice so copy using a buffer
+      closePipe();
+      readSome();
+   }
+   else
+   {
+      complete(systemError(errno, ERROR_LOCATION));
+   }
+#endif
+}
+
+void StreamPump::writePending()
+{
+#ifdef HAVE_SPLICE
+   while (pipeBytes_ > 0)
+   {
+      ssize_t result = spliceNonBlocking(pipe_[0], dest_.native(), pipeBytes_);
+      if (result > 0)
+      {
+         pipeBytes_ -= result;
+         bytesPumped_ += result;
+      }
+      else if (result == -1 && errno == EAGAIN)
+      {
+         // the destination is full; wait until it can take more (we won't
+         // read from the source in the meantime)
+         dest_.async_write_some(
+               boost::asio::null_buffers(),
+               boost::bind(&StreamPump::handleDestWritable,
+                           shared_from_this(),
+                           boost::asio::placeholders::error));
+         return;
+      }
+      else
+      {
+         complete(systemError(result == -1 ? errno : EPIPE, ERROR_LOCATION));
+         return;
+      }
+   }
+
+   // everything read has been written, read some more
+   waitForSource();
+#endif
+}
+
+void StreamPump::handleDestWritable(const boost::system::error_code& ec)
+{
+   if (ec)
+      complete(Error(ec, ERROR_LOCATION));
+   else
+      writePending();
+}
+
+void StreamPump::readSome()
+{
+   if (buffer_.empty())
+      buffer_.resize(kChunkSize);
+
+   source_.async_read_some(
+         boost::asio::buffer(buffer_),
+         boost::bind(&StreamPump::handleRead,
+                     shared_from_this(),
+                     boost::asio::placeholders::error,
+                     boost::asio::placeholders::bytes_transferred));
+}
+
+void StreamPump::handleRead(const boost::system::error_code& ec,
+                            std::size_t bytesRead)
+{
+   if (ec == boost::asio::error::eof)
+   {
+      complete(Success());
+   }
+   else if (ec)
+   {
+      complete(Error(ec, ERROR_LOCATION));
+   }
+   else
+   {
+      boost::asio::async_write(
+            dest_,
+            boost::asio::buffer(buffer_, bytesRead),
+            boost::bind(&StreamPump::handleWrite,
+                        shared_from_this(),
+                        boost::asio::placeholders::error,
+                        boost::asio::placeholders::bytes_transferred));
+   }
+}
+
+void StreamPump::handleWrite(const boost::system::error_code& ec,
+                             std::size_t bytesWritten)
+{
+   bytesPumped_ += bytesWritten;
+
+   if (ec)
+      complete(Error(ec, ERROR_LOCATION));
+   else
+      readSome();
+}
+
+void StreamPump::closePipe()
+{
+   for (int i = 0; i < 2; i++)
+   {
+      if (pipe_[i] != -1)
+      {
+         ::close(pipe_[i]);
+         pipe_[i] = -1;
+      }
+   }
+}
+
+void StreamPump::complete(const Error& error)
+{
+   boost::system::error_code ec;
+   source_.close(ec);
+   dest_.close(ec);
+   closePipe();
+
+   if (completionHandler_)
+   {
+      CompletionHandler completionHandler = completionHandler_;
+      completionHandler_.clear();
+      completionHandler(error);
+   }
+}
+
+} // namespace http
+} // namespace core
@@ -0,0 +1,172 @@
+/*
+ * ValidatedCookieCache.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/http/ValidatedCookieCache.hpp>
+
+#include <algorithm>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+
+#include <core/system/Crypto.hpp>
+
+namespace core {
+namespace http {
+
+ValidatedCookieCache::ValidatedCookieCache(std::size_t capacity)
+   : capacity_(std::max(capacity, static_cast<std::size_t>(1))),
+     nextSequence_(0)
+{
+}
+
+void ValidatedCookieCache::split(const std::string& signedCookie,
+                                 std::string* pFields,
+                                 std::string* pSignature)
+{
+   std::string::size_type delim = signedCookie.rfind('|');
+   if (delim == std::string::npos)
+   {
+      *pFields = signedCookie;
+      pSignature->clear();
+   }
+   else
+   {
+      *pFields = signedCookie.substr(0, delim);
+      *pSignature = signedCookie.substr(delim + 1);
+   }
+}
+
+bool ValidatedCookieCache::find(const std::string& signedCookie,
+                                const boost::posix_time::ptime& now,
+                                std::string* pValue)
+{
+   std::string fields, signature;
+   split(signedCookie, &fields, &signature);
+
+   LOCK_MUTEX(mutex_)
+   {
+      std::map<std::string,Entry>::iterator it = entries_.find(fields);
+      if (it == entries_.end())
+         return false;
+
+      if (!core::system::crypto::constantTimeEquals(signature,
+                                                    it->second.signature))
+      {
+         return false;
+      }
+
+      if (it->second.expires <= now)
+      {
+         entries_.erase(it);
+         return false;
+      }
+
+      *pValue = it->second.value;
+      return true;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+void ValidatedCookieCache::insert(const std::string& signedCookie,
+                                  const std::string& value,
+                                  const boost::posix_time::ptime& expires)
+{
+   std::string fields, signature;
+   split(signedCookie, &fields, &signature);
+
+   LOCK_MUTEX(mutex_)
+   {
+      // (a cookie with the same fields but another signature replaces the
+      // existing entry since only the signature most recently validated
+      // can be current)
+      std::map<std::string,Entry>::iterator existing = entries_.find(fields);
+      if (existing != entries_.end())
+      {
+         existing->second.signature = signature;
+         existing->second.value = value;
+         existing->second.expires = expires;
+         return;
+      }
+
+      // evict the oldest entries to make room (also discarding the order
+      // of entries which were removed once it's grown well beyond the
+      // number of entries)
+      while (!order_.empty() &&
+             (entries_.size() >= capacity_ || order_.size() > 2 * capacity_))
+      {
+         std::map<std::string,Entry>::iterator it =
+                                          entries_.find(order_.front().second);
+         if (it != entries_.end() &&
+             it->second.sequence == order_.front().first)
+         {
+            entries_.erase(it);
+         }
+         order_.pop_front();
+      }
+
+      Entry entry;
+      entry.signature = signature;
+      entry.value = value;
+      entry.expires = expires;
+      entry.sequence = nextSequence_++;
+      entries_.insert(std::make_pair(fields, entry));
+      order_.push_back(std::make_pair(entry.sequence, fields));
+   }
+   END_LOCK_MUTEX
+}
+
+void ValidatedCookieCache::remove(const std::string& signedCookie)
+{
+   std::string fields, signature;
+   split(signedCookie, &fields, &signature);
+
+   LOCK_MUTEX(mutex_)
+   {
+      // (only the holder of a validated cookie can remove it)
+      std::map<std::string,Entry>::iterator it = entries_.find(fields);
+      if (it != entries_.end() &&
+          core::system::crypto::constantTimeEquals(signature,
+                                                   it->second.signature))
+      {
+         entries_.erase(it);
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+void ValidatedCookieCache::clear()
+{
+   LOCK_MUTEX(mutex_)
+   {
+      entries_.clear();
+      order_.clear();
+   }
+   END_LOCK_MUTEX
+}
+
+std::size_t ValidatedCookieCache::size() const
+{
+   LOCK_MUTEX(mutex_)
+   {
+      return entries_.size();
+   }
+   END_LOCK_MUTEX
+
+   return 0;
+}
+
+} // namespace http
+} // namespace core
@@ -0,0 +1,148 @@
+/*
+ * ChunkedFile.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_CHUNKED_FILE_HPP
+#define CORE_CHUNKED_FILE_HPP
+
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+
+namespace core {
+namespace chunked_file {
+
+// Chunk files hold a stream of bytes as a sequence of independently
+// compressed blocks:
+//
+//    header:  "RSCHUNK1" <codec:uint8>
+//    blocks:  <rawSize:uint32> <storedSize:uint32> <data>
+//    end:     <0:uint32> <0:uint32>
+//
+// (integers are little endian). Because each block stands alone they can
+// be compressed and decompressed concurrently. The writer and reader below
+// stream many chunks through a shared pool of threads so that producing
+// (or consuming) the data overlaps with compression, and a memory limit
+// bounds the number of blocks in flight.
+
+enum Codec
+{
+   kCodecStore = 0,
+   kCodecDeflate = 1
+};
+
+// codec used for new files (deflate unless zlib is unavailable)
+Codec defaultCodec();
+
+// name of codec (for manifests, logging, etc.)
+std::string codecName(Codec codec);
+
+struct ChunkInfo
+{
+   ChunkInfo() : rawBytes(0), storedBytes(0) {}
+   FilePath path;
+   boost::uint64_t rawBytes;
+   boost::uint64_t storedBytes;
+};
+
+class BlockPipeline;
+struct ChunkOutput;
+
+class Writer : boost::noncopyable
+{
+public:
+   // level is a zlib compression level (1 favors speed)
+   Writer(int threads,
+          std::size_t memoryLimit,
+          Codec codec = defaultCodec(),
+          int level = 1);
+   virtual ~Writer();
+   // COPYING: boost::noncopyable
+
+public:
+   // start writing a new chunk file (ends the current chunk if necessary)
+   Error beginChunk(const FilePath& path);
+
+   // append data to the current chunk. never throws and may block if the
+   // memory limit has been reached. returns false if an error has occurred
+   // (in which case the error is returned by finish)
+   bool write(const char* data, std::size_t length);
+
+   // end the current chunk
+   void endChunk();
+
+   // wait for all chunks to be written and return the first error (if any)
+   Error finish();
+
+   // information on the chunks written (valid after finish)
+   const std::vector<ChunkInfo>& chunks() const { return chunks_; }
+
+private:
+   void submitBlock(bool last);
+   void writeBlocks();
+
+private:
+   Codec codec_;
+   int level_;
+   boost::shared_ptr<BlockPipeline> pPipeline_;
+   std::vector<boost::shared_ptr<ChunkOutput> > outputs_;
+   std::vector<ChunkInfo> chunks_;
+   std::string buffer_;
+   bool inChunk_;
+   bool finished_;
+};
+
+class Reader : boost::noncopyable
+{
+public:
+   // read the passed chunk files (in order)
+   Reader(const std::vector<FilePath>& paths,
+          int threads,
+          std::size_t memoryLimit);
+   virtual ~Reader();
+   // COPYING: boost::noncopyable
+
+public:
+   // read exactly length bytes from the current chunk. never throws and
+   // returns false if the chunk doesn't contain enough data or an error
+   // occurred (in which case the error is returned by endChunk/finish)
+   bool read(char* buffer, std::size_t length);
+
+   // skip any unread data in the current chunk and move to the next one
+   Error endChunk();
+
+   // stop reading and return the first error (if any)
+   Error finish();
+
+private:
+   bool nextBlock();
+   void readBlocks(const std::vector<FilePath>& paths);
+
+private:
+   boost::shared_ptr<BlockPipeline> pPipeline_;
+   std::string current_;
+   std::size_t position_;
+   bool currentIsLast_;
+   bool finished_;
+};
+
+} // namespace chunked_file
+} // namespace core
+
+#endif // CORE_CHUNKED_FILE_HPP
@@ -14,9 +14,12 @@
 #ifndef CORE_EXEC_HPP
 #define CORE_EXEC_HPP
 
+#include <string>
 #include <vector>
+#include <utility>
 
 #include <boost/function.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
 
 namespace core {
 
@@ -27,6 +30,12 @@ class ExecBlock
 public:
    typedef boost::function<core::Error()> Function ; 
 
+   // called after each function is executed with its name and how long
+   // it took (used to profile initialization)
+   typedef boost::function<void(const std::string&,
+                                const boost::posix_time::time_duration&)>
+                                                         TimingHandler;
+
 public:
    ExecBlock() {}
   
@@ -34,6 +43,13 @@ public:
    
    // add to the block
    ExecBlock& add(Function function) ;
+   ExecBlock& add(const std::string& name, Function function);
+
+   // time the execution of each function
+   void setTimingHandler(const TimingHandler& timingHandler)
+   {
+      timingHandler_ = timingHandler;
+   }
    
    // easy init style (based on idiom in boost::program_options)
    class EasyInit;
@@ -56,11 +72,17 @@ public:
          pExecBlock_->add(function);
          return *this;
       }
+      EasyInit& operator()(const std::string& name, Function function)
+      {
+         pExecBlock_->add(name, function);
+         return *this;
+      }
    private:
       ExecBlock* pExecBlock_ ;
    };
 private:
-   std::vector<Function> functions_ ;
+   std::vector<std::pair<std::string,Function> > functions_ ;
+   TimingHandler timingHandler_;
 };
    
 
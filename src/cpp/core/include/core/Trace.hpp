@@ -0,0 +1,110 @@
+/*
+ * Trace.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_TRACE_HPP
+#define CORE_TRACE_HPP
+
+#include <iosfwd>
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/utility.hpp>
+#include <boost/preprocessor/cat.hpp>
+
+namespace core {
+
+class Error;
+class FilePath;
+
+// Tracing of spans (named intervals) on hot paths. Spans are recorded into
+// a fixed size ring buffer per thread (so only the most recent spans of
+// each thread are kept) without taking any locks. When tracing is disabled
+// a span costs only a check of the enabled flag.
+//
+// The recorded spans can be written as Chrome trace event json (viewable
+// using chrome://tracing). Times are wall clock microseconds so traces
+// from several processes (e.g. rserver and rsession) can be combined.
+namespace trace {
+
+namespace detail {
+extern volatile bool s_enabled;
+} // namespace detail
+
+inline bool isEnabled()
+{
+   return detail::s_enabled;
+}
+
+void setEnabled(bool enabled);
+
+// name of the process in written traces
+void setProcessName(const std::string& name);
+
+// current time in microseconds
+boost::int64_t now();
+
+// start time for a span which ends in another scope (0 if disabled)
+inline boost::int64_t begin()
+{
+   return isEnabled() ? now() : 0;
+}
+
+// record a span which started at start (ignored if start is 0). category
+// and name must be string literals (they aren't copied). detail (e.g. a
+// uri or method name) is copied and truncated if it's long
+void end(const char* category,
+         const char* name,
+         boost::int64_t start,
+         const std::string& detail = std::string());
+
+// write the recorded spans as chrome trace event json
+void writeChromeTrace(std::ostream& os);
+core::Error writeChromeTrace(const core::FilePath& filePath);
+
+// span covering the rest of the enclosing scope (detail must outlive it)
+class Span : boost::noncopyable
+{
+public:
+   Span(const char* category, const char* name)
+      : category_(category), name_(name), pDetail_(NULL), start_(begin())
+   {
+   }
+
+   Span(const char* category, const char* name, const std::string& detail)
+      : category_(category), name_(name), pDetail_(&detail), start_(begin())
+   {
+   }
+
+   ~Span()
+   {
+      if (start_ != 0)
+         end(category_, name_, start_, pDetail_ ? *pDetail_ : std::string());
+   }
+
+private:
+   const char* category_;
+   const char* name_;
+   const std::string* pDetail_;
+   boost::int64_t start_;
+};
+
+} // namespace trace
+} // namespace core
+
+#define TRACE_SPAN(category, name) \
+   core::trace::Span BOOST_PP_CAT(traceSpan, __LINE__)(category, name)
+
+#define TRACE_SPAN_DETAIL(category, name, detail) \
+   core::trace::Span BOOST_PP_CAT(traceSpan, __LINE__)(category, name, detail)
+
+#endif // CORE_TRACE_HPP
@@ -0,0 +1,99 @@
+/*
+ * ZipWriter.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_ZIP_WRITER_HPP
+#define CORE_ZIP_WRITER_HPP
+
+#include <string>
+#include <vector>
+#include <iosfwd>
+
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+
+namespace core {
+
+class Error;
+class FilePath;
+
+// Writes a zip archive to a (non-seekable) output stream. Entries are
+// written one after another using data descriptors so nothing needs to be
+// buffered beyond the block currently being compressed, and zip64
+// extensions are used automatically for large files and archives.
+//
+// When compressing with more than one thread each entry is split into
+// fixed size blocks which are deflated concurrently (each primed with the
+// tail of the previous block) and then concatenated into a single deflate
+// stream, so the output remains readable by any unzip implementation.
+class ZipWriter : boost::noncopyable
+{
+public:
+   // compressionLevel is a zlib level (0 to store entries uncompressed)
+   explicit ZipWriter(std::ostream& os,
+                      int compressionLevel = 1,
+                      int threads = 1);
+   virtual ~ZipWriter() {}
+   // COPYING: boost::noncopyable
+
+public:
+   // add a file (entryName is the '/' delimited path within the archive)
+   Error addFile(const FilePath& filePath, const std::string& entryName);
+
+   // add a directory and (recursively) all of its contents
+   Error addDirectory(const FilePath& dirPath, const std::string& entryName);
+
+   // write the central directory (no entries may be added after this)
+   Error finish();
+
+   // total bytes written to the output stream
+   boost::uintmax_t bytesWritten() const { return offset_; }
+
+   // total uncompressed bytes added
+   boost::uintmax_t bytesRead() const { return bytesRead_; }
+
+private:
+   struct Entry
+   {
+      std::string name;
+      boost::uint16_t method;
+      boost::uint16_t flags;
+      boost::uint16_t dosTime;
+      boost::uint16_t dosDate;
+      boost::uint32_t crc;
+      boost::uint64_t compressedSize;
+      boost::uint64_t uncompressedSize;
+      boost::uint64_t offset;
+      boost::uint32_t externalAttributes;
+      bool zip64;
+   };
+
+   Error writeLocalHeader(const Entry& entry);
+   Error writeDataDescriptor(const Entry& entry);
+   Error writeStored(std::istream& is, Entry* pEntry);
+   Error writeDeflated(std::istream& is, Entry* pEntry);
+   Error write(const char* data, std::size_t length);
+   Error write(const std::string& data);
+
+private:
+   std::ostream& os_;
+   int compressionLevel_;
+   int threads_;
+   boost::uint64_t offset_;
+   boost::uint64_t bytesRead_;
+   std::vector<Entry> entries_;
+   bool finished_;
+};
+
+} // namespace core
+
+#endif // CORE_ZIP_WRITER_HPP
@@ -63,7 +63,8 @@ class AsyncClient :
 public:
    AsyncClient(boost::asio::io_service& ioService)
       : ioService_(ioService),
-        connectionRetryContext_(ioService)
+        connectionRetryContext_(ioService),
+        streamResponse_(false)
    {
    }
 
@@ -95,6 +96,25 @@ public:
       connectAndWriteRequest();
    }
 
+   // execute the async client, calling the response handler as soon as
+   // the response headers have been read rather than once the whole
+   // response has been read. the body of the response passed to the
+   // handler is whatever content was read along with the headers and the
+   // handler is responsible for reading the rest of the content directly
+   // from nativeSocket (then calling close). as the content is read from
+   // the raw socket this is not suitable for ssl clients.
+   void executeStreaming(const ResponseHandler& headersHandler,
+                         const ErrorHandler& errorHandler)
+   {
+      streamResponse_ = true;
+      execute(headersHandler, errorHandler);
+   }
+
+   int nativeSocket()
+   {
+      return socket().lowest_layer().native();
+   }
+
    void close()
    {
       Error error = closeSocket(socket().lowest_layer());
@@ -324,8 +344,17 @@ private:
             if (responseBuffer_.size() > 0)
                ResponseParser::appendToBody(&responseBuffer_, &response_);
 
-            // start reading content
-            readSomeContent();
+            // if we are streaming then the handler reads the content,
+            // otherwise start reading content
+            if (streamResponse_)
+            {
+               if (responseHandler_)
+                  responseHandler_(response_);
+            }
+            else
+            {
+               readSomeContent();
+            }
          }
          else
          {
@@ -382,6 +411,7 @@ private:
    ConnectionRetryContext connectionRetryContext_;
    ResponseHandler responseHandler_;
    ErrorHandler errorHandler_;
+   bool streamResponse_;
    http::Request request_;
    boost::asio::streambuf responseBuffer_;
    http::Response response_;
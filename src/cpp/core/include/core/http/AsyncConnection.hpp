@@ -15,6 +15,7 @@
 #define CORE_HTTP_ASYNC_CONNECTION_HPP
 
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
 #include <boost/asio/io_service.hpp>
 
 namespace core {
@@ -29,6 +30,9 @@ class Response;
 // abstract base (insulate clients from knowledge of protocol-specifics)
 class AsyncConnection
 {
+public:
+   typedef boost::function<void(const core::Error&)> HeadersWrittenHandler;
+
 public:
    virtual ~AsyncConnection() {}
 
@@ -45,6 +49,15 @@ public:
    // simple wrappers for writing an existing response or error
    virtual void writeResponse(const http::Response& response) = 0;
    virtual void writeError(const Error& error) = 0;
+
+   // streaming responses: write the headers of the response (and any body
+   // content it already has) then call the handler rather than closing the
+   // connection. the rest of the content is then written directly to the
+   // native socket (e.g. by an http::StreamPump) and the connection is
+   // closed once it is destroyed
+   virtual void writeResponseHeaders(const http::Response& response,
+                                     const HeadersWrittenHandler& handler) = 0;
+   virtual int nativeSocket() = 0;
 };
 
 } // namespace http
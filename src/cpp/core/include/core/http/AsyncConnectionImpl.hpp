@@ -25,6 +25,7 @@
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
+#include <core/Trace.hpp>
 
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
@@ -55,8 +56,9 @@ public:
       : ioService_(ioService),
         socket_(ioService),
         handler_(handler),
-        responseFilter_(responseFilter)
-        
+        responseFilter_(responseFilter),
+        traceStart_(0),
+        traceWriteStart_(0)
    {
    }
    
@@ -67,6 +69,7 @@ public:
 
    void startReading()
    {
+      traceStart_ = trace::begin();
       readSome();
    }
 
@@ -88,14 +91,10 @@ public:
    virtual void writeResponse()
    {
       // add extra response headers
-      response_.setHeader("Date", util::httpDate());
-      response_.setHeader("Connection", "close");
-
-      // call the response filter if we have one
-      if (responseFilter_)
-         responseFilter_(&response_);
+      addResponseHeaders();
 
       // write
+      traceWriteStart_ = trace::begin();
       boost::asio::async_write(
           socket_,
           response_.toBuffers(),
@@ -117,8 +116,41 @@ public:
       response_.setError(error);
       writeResponse();
    }
+
+   virtual void writeResponseHeaders(const http::Response& response,
+                                     const HeadersWrittenHandler& handler)
+   {
+      response_.assign(response);
+      addResponseHeaders();
+
+      traceWriteStart_ = trace::begin();
+      boost::asio::async_write(
+          socket_,
+          response_.toBuffers(),
+          boost::bind(
+               &AsyncConnectionImpl<ProtocolType>::handleWriteHeaders,
+               AsyncConnectionImpl<ProtocolType>::shared_from_this(),
+               boost::asio::placeholders::error,
+               handler)
+      );
+   }
+
+   virtual int nativeSocket()
+   {
+      return socket_.native();
+   }
    
 private:
+
+   void addResponseHeaders()
+   {
+      response_.setHeader("Date", util::httpDate());
+      response_.setHeader("Connection", "close");
+
+      // call the response filter if we have one
+      if (responseFilter_)
+         responseFilter_(&response_);
+   }
    
    void handleRead(const boost::system::error_code& e,
                    std::size_t bytesTransferred)
@@ -128,10 +160,12 @@ private:
          if (!e)
          {
             // parse next chunk
+            boost::int64_t traceParseStart = trace::begin();
             RequestParser::status status = requestParser_.parse(
                                              request_,
                                              buffer_.data(), 
                                              buffer_.data() + bytesTransferred);
+            trace::end("http", "parse", traceParseStart);
             
             // error - return bad request
             if (status == RequestParser::error)
@@ -179,6 +213,9 @@ private:
    {
       try
       {
+         trace::end("http", "write", traceWriteStart_);
+         trace::end("http", "request", traceStart_, request_.uri());
+
          if (e)
          {
             // log the error if it wasn't connection terminated
@@ -200,6 +237,22 @@ private:
       CATCH_UNEXPECTED_EXCEPTION
    }
    
+   void handleWriteHeaders(const boost::system::error_code& e,
+                           const HeadersWrittenHandler& handler)
+   {
+      try
+      {
+         trace::end("http", "write-headers", traceWriteStart_);
+         trace::end("http", "request", traceStart_, request_.uri());
+
+         if (e)
+            handler(Error(e, ERROR_LOCATION));
+         else
+            handler(Success());
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
    void readSome()
    {
       socket_.async_read_some(
@@ -221,6 +274,8 @@ private:
    RequestParser requestParser_ ;
    http::Request request_;
    http::Response response_;
+   boost::int64_t traceStart_;
+   boost::int64_t traceWriteStart_;
 };
    
 
@@ -27,6 +27,7 @@
 #include <core/Error.hpp>
 #include <core/BoostErrors.hpp>
 #include <core/Log.hpp>
+#include <core/Trace.hpp>
 #include <core/system/System.hpp>
 
 #include <core/http/Request.hpp>
@@ -186,6 +187,8 @@ private:
    
    void handleAccept(const boost::system::error_code& ec) 
    {
+      TRACE_SPAN("http", "accept");
+
       try
       {
          if (!ec) 
@@ -0,0 +1,121 @@
+/*
+ * MultipartFormParser.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_MULTIPART_FORM_PARSER_HPP
+#define CORE_HTTP_MULTIPART_FORM_PARSER_HPP
+
+#include <string>
+#include <iosfwd>
+
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/cstdint.hpp>
+
+#include <core/FilePath.hpp>
+#include <core/http/Util.hpp>
+
+namespace core {
+namespace http {
+
+class Request;
+
+// Incremental parser for multipart/form-data request bodies. Regular form
+// fields are accumulated in memory however file parts are spooled to disk
+// (within spoolDir) as their bytes arrive, so the size of an upload is
+// never bounded by available memory.
+class MultipartFormParser : boost::noncopyable
+{
+public:
+   // called with the number of body bytes consumed so far
+   typedef boost::function<void(boost::uintmax_t)> ProgressHandler;
+
+   MultipartFormParser(const std::string& contentType,
+                       const FilePath& spoolDir,
+                       boost::uintmax_t maxFileBytes = 0,
+                       const ProgressHandler& onProgress = ProgressHandler());
+   virtual ~MultipartFormParser();
+   // COPYING: boost::noncopyable
+
+public:
+   enum status
+   {
+      incomplete,
+      complete,
+      error
+   };
+
+   // consume the next chunk of the body
+   status parse(const char* begin, const char* end);
+
+   // results (valid once parse returns complete)
+   const Fields& fields() const { return fields_; }
+   const Files& files() const { return files_; }
+
+   // transfer ownership of spooled files to the caller (otherwise they
+   // are removed when the parser is destroyed)
+   void releaseFiles() { filesReleased_ = true; }
+
+   // error introspection
+   bool limitExceeded() const { return limitExceeded_; }
+   boost::uintmax_t bytesConsumed() const { return bytesConsumed_; }
+
+private:
+   status processBuffer();
+   bool beginPart(const std::string& headers);
+   bool writePartData(const char* begin, const char* end);
+   void endPart();
+   void removeSpooledFiles();
+
+private:
+   enum state
+   {
+      preamble,
+      after_boundary,
+      part_headers,
+      part_body,
+      epilogue
+   } state_;
+
+   std::string delimiter_;
+   FilePath spoolDir_;
+   boost::uintmax_t maxFileBytes_;
+   ProgressHandler onProgress_;
+
+   std::string buffer_;
+   boost::uintmax_t bytesConsumed_;
+   bool limitExceeded_;
+   bool filesReleased_;
+
+   // current part
+   std::string partName_;
+   bool partIsFile_;
+   File partFile_;
+   std::string partValue_;
+   boost::uintmax_t partBytes_;
+   boost::shared_ptr<std::ostream> pPartStream_;
+
+   Fields fields_;
+   Files files_;
+};
+
+// hook used by request parsers to decide whether a multipart/form-data
+// request body should be streamed through a MultipartFormParser (a null
+// return value indicates the body should be read into memory as usual)
+typedef boost::function<boost::shared_ptr<MultipartFormParser>(
+                                    const Request&)> MultipartFormParserFactory;
+
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_MULTIPART_FORM_PARSER_HPP
@@ -16,6 +16,7 @@
 
 #include "Message.hpp"
 
+#include <boost/shared_ptr.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include "Util.hpp"
@@ -23,6 +24,8 @@
 namespace core {
 namespace http {
 
+class MultipartFormParser;
+
 class Request : public Message
 {
 public:
@@ -41,6 +44,7 @@ public:
       parsedFormFields_ = request.parsedFormFields_;
       formFields_ = request.formFields_;
       files_ = request.files_;
+      pFormParser_ = request.pFormParser_;
       emptyFile_ = request.emptyFile_;
       parsedQueryParams_ = request.parsedQueryParams_;
       queryParams_ = request.queryParams_;
@@ -143,6 +147,10 @@ private:
    mutable Fields formFields_;
    mutable Files files_;
    File emptyFile_;
+
+   // parser which spooled files_ to disk (it removes any which are left
+   // when the last request referring to it is destroyed)
+   boost::shared_ptr<MultipartFormParser> pFormParser_;
    mutable bool parsedQueryParams_;
    mutable Fields queryParams_;
 
@@ -15,7 +15,14 @@
 #ifndef CORE_HTTP_REQUEST_PARSER_HPP
 #define CORE_HTTP_REQUEST_PARSER_HPP
 
+#include <algorithm>
+#include <iterator>
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+
 #include <core/http/Request.hpp>
+#include <core/http/MultipartFormParser.hpp>
 
 namespace core {
 namespace http {
@@ -30,6 +37,20 @@ public:
   /// Reset to initial parser state.
   void reset();
 
+  /// Stream multipart/form-data bodies through parsers created by the
+  /// specified factory rather than accumulating them in the request body.
+  void setMultipartFormParserFactory(
+                           const MultipartFormParserFactory& factory)
+  {
+     formParserFactory_ = factory;
+  }
+
+  /// Did the last parse fail because a streamed upload exceeded its limit?
+  bool bodyLimitExceeded() const
+  {
+     return pFormParser_ && pFormParser_->limitExceeded();
+  }
+
   // enum for parse results
   enum status
   {
@@ -57,6 +78,7 @@ public:
             if (content_length_ > 0)
             {
                parsing_body_ = true ;
+               beginBody(req);
                continue ;
             }
             else
@@ -65,6 +87,29 @@ public:
             }
          }
       }
+      // streamed multipart/form-data body parsing
+      else if (pFormParser_)
+      {
+         // take whatever is available (up to the end of the body)
+         std::size_t available = std::min(
+                     static_cast<std::size_t>(std::distance(begin, end)),
+                     content_length_ - body_bytes_read_);
+         InputIterator chunkEnd = begin;
+         std::advance(chunkEnd, available);
+         std::string chunk;
+         chunk.append(begin, chunkEnd);
+         begin = chunkEnd;
+         body_bytes_read_ += chunk.size();
+
+         MultipartFormParser::status st = pFormParser_->parse(
+                                          chunk.data(),
+                                          chunk.data() + chunk.size());
+         if (st == MultipartFormParser::error)
+            return error;
+
+         if (body_bytes_read_ == content_length_)
+            return endBody(req, st);
+      }
       // body parsing
       else
       {
@@ -80,6 +125,12 @@ private:
   /// Handle the next character of input.
   status consume(Request& req, char input);
 
+  /// Prepare to read the request body (headers have been fully parsed).
+  void beginBody(const Request& req);
+
+  /// Complete reading of a streamed multipart/form-data body.
+  status endBody(Request& req, MultipartFormParser::status formStatus);
+
   /// Check if a byte is an HTTP character.
   static bool is_char(int c);
 
@@ -121,6 +172,10 @@ private:
   std::size_t content_length_ ;
   bool parsing_content_length_ ;
   bool parsing_body_ ;
+
+  std::size_t body_bytes_read_ ;
+  MultipartFormParserFactory formParserFactory_ ;
+  boost::shared_ptr<MultipartFormParser> pFormParser_ ;
 };
 
 } // namespace http
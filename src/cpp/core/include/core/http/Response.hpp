@@ -16,6 +16,7 @@
 
 #include <iostream>
 #include <sstream>
+#include <boost/function.hpp>
 #include <boost/type_traits/is_same.hpp>
 #include <boost/iostreams/copy.hpp>
 #include <boost/iostreams/concepts.hpp>
@@ -88,6 +89,7 @@ public:
       statusCode_ = response.statusCode_;
       statusCodeStr_ = response.statusCodeStr_;
       statusMessage_ = response.statusMessage_;
+      streamingBody_ = response.streamingBody_;
    }
 
 public:   
@@ -304,6 +306,16 @@ public:
       }
    }
    
+   // write the body directly to the connection when the response is sent
+   // rather than holding it in memory. the end of the body is indicated by
+   // closing the connection (so there is no Content-Length) and the writer
+   // may be invoked on a background thread so must not call into R. note
+   // that only session http connections currently support this.
+   typedef boost::function<Error(std::ostream&)> BodyWriter;
+   void setStreamingBody(const BodyWriter& bodyWriter);
+   bool hasStreamingBody() const { return !streamingBody_.empty(); }
+   const BodyWriter& streamingBody() const { return streamingBody_; }
+
    // these calls do no stream io or encoding so don't return errors
    void setBodyUnencoded(const std::string& body);
    void setError(int statusCode, const std::string& message);
@@ -336,6 +348,9 @@ private:
 
    // string storage for integer members (need for toBuffers)
    mutable std::string statusCodeStr_ ;
+
+   // optional writer for bodies streamed at send time
+   BodyWriter streamingBody_ ;
 };
 
 std::ostream& operator << (std::ostream& stream, const Response& r) ;
@@ -0,0 +1,102 @@
+/*
+ * StreamPump.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_STREAM_PUMP_HPP
+#define CORE_HTTP_STREAM_PUMP_HPP
+
+#include <vector>
+
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+
+#include <boost/asio/io_service.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+namespace core {
+
+class Error;
+
+namespace http {
+
+// Asynchronously copies everything read from one socket (the source) to
+// another (the destination) until the source reaches eof. On linux the
+// bytes are moved using splice() through a pipe so they never pass
+// through user space; elsewhere (or for descriptors which don't support
+// splice) a fixed size buffer is used.
+//
+// Nothing more is read from the source until everything previously read
+// has been written to the destination, so a slow destination applies
+// backpressure to the source (via its socket buffers) rather than having
+// content accumulate in memory.
+//
+// Writes to a closed destination can raise SIGPIPE so the pump should run
+// on threads which block it (as the threads of http::AsyncServer do).
+class StreamPump : public boost::enable_shared_from_this<StreamPump>,
+                   boost::noncopyable
+{
+public:
+   typedef boost::function<void(const core::Error&)> CompletionHandler;
+
+   // create a pump between the passed descriptors. the descriptors are
+   // duplicated (so callers retain ownership of them) and the duplicates
+   // are closed when the pump completes
+   static core::Error create(boost::asio::io_service& ioService,
+                             int sourceFd,
+                             int destFd,
+                             boost::shared_ptr<StreamPump>* pPump);
+
+   virtual ~StreamPump();
+
+   // start pumping. the handler is called once the source reaches eof
+   // (with Success) or when reading or writing fails
+   void start(const CompletionHandler& completionHandler);
+
+   // total bytes written to the destination
+   boost::uint64_t bytesPumped() const { return bytesPumped_; }
+
+private:
+   explicit StreamPump(boost::asio::io_service& ioService);
+
+   // splice() through a pipe
+   void waitForSource();
+   void handleSourceReadable(const boost::system::error_code& ec);
+   void writePending();
+   void handleDestWritable(const boost::system::error_code& ec);
+
+   // buffered copying
+   void readSome();
+   void handleRead(const boost::system::error_code& ec,
+                   std::size_t bytesRead);
+   void handleWrite(const boost::system::error_code& ec,
+                    std::size_t bytesWritten);
+
+   void closePipe();
+   void complete(const core::Error& error);
+
+private:
+   boost::asio::posix::stream_descriptor source_;
+   boost::asio::posix::stream_descriptor dest_;
+   int pipe_[2];
+   std::size_t pipeBytes_;
+   std::vector<char> buffer_;
+   boost::uint64_t bytesPumped_;
+   CompletionHandler completionHandler_;
+};
+
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_STREAM_PUMP_HPP
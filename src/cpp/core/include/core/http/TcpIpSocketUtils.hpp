@@ -14,6 +14,11 @@
 #ifndef CORE_HTTP_TCP_IP_SOCKET_UTILS_HPP
 #define CORE_HTTP_TCP_IP_SOCKET_UTILS_HPP
 
+#include <errno.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
 #include <boost/asio/ip/tcp.hpp>
 
 #include <core/Error.hpp>
@@ -66,10 +71,13 @@ Error connect(boost::asio::io_service& ioService,
 }
                      
 
+// reusePort allows several processes to listen on the same port (the
+// kernel balances connections between them). it requires SO_REUSEPORT
 inline Error initTcpIpAcceptor(
             SocketAcceptorService<boost::asio::ip::tcp>& acceptorService,
             const std::string& address,
-            const std::string& port)
+            const std::string& port,
+            bool reusePort = false)
 {
    using boost::asio::ip::tcp;
    
@@ -94,6 +102,20 @@ inline Error initTcpIpAcceptor(
    acceptor.set_option(tcp::no_delay(true), ec) ;
    if (ec)
       return Error(ec, ERROR_LOCATION) ;
+
+   if (reusePort)
+   {
+#ifdef SO_REUSEPORT
+      int reuse = 1;
+      if (::setsockopt(acceptor.native(), SOL_SOCKET, SO_REUSEPORT,
+                       &reuse, sizeof(reuse)) == -1)
+      {
+         return systemError(errno, ERROR_LOCATION);
+      }
+#else
+      return systemError(boost::system::errc::not_supported, ERROR_LOCATION);
+#endif
+   }
    
    acceptor.bind(endpoint, ec) ;
    if (ec)
@@ -21,6 +21,8 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
+#include <core/FilePath.hpp>
+
 namespace core {
    
 class Error;
@@ -51,6 +53,19 @@ struct File
    std::string name;
    std::string contentType;
    std::string contents;   
+
+   // when the file was spooled to disk during parsing (see
+   // MultipartFormParser) contents is empty and the data lives here
+   FilePath spoolPath;
+   boost::uintmax_t spoolSize;
+
+   File() : spoolSize(0) {}
+
+   bool isSpooled() const { return !spoolPath.empty(); }
+   boost::uintmax_t size() const
+   {
+      return isSpooled() ? spoolSize : contents.size();
+   }
 };
 
 typedef std::map<std::string,File> Files;
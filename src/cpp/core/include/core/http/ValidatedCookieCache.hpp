@@ -0,0 +1,87 @@
+/*
+ * ValidatedCookieCache.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_HTTP_VALIDATED_COOKIE_CACHE_HPP
+#define CORE_HTTP_VALIDATED_COOKIE_CACHE_HPP
+
+#include <deque>
+#include <map>
+#include <string>
+
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+namespace core {
+namespace http {
+
+// Thread safe cache of signed cookies which have been validated so that
+// requests presenting the same cookie needn't verify its signature again.
+// Signed cookies are of the form <fields>|<signature>. Entries are looked
+// up by the fields (which aren't secret) and then the signature presented
+// is compared with the one which was validated in constant time, so the
+// time taken by a lookup reveals nothing about a forged signature. The
+// cache holds at most capacity entries (the oldest are evicted to make
+// room for new ones) and entries aren't returned once they expire.
+class ValidatedCookieCache : boost::noncopyable
+{
+public:
+   explicit ValidatedCookieCache(std::size_t capacity = 4096);
+
+   // find the value of a validated cookie (returns false if the cookie
+   // isn't in the cache or expired before now)
+   bool find(const std::string& signedCookie,
+             const boost::posix_time::ptime& now,
+             std::string* pValue);
+
+   void insert(const std::string& signedCookie,
+               const std::string& value,
+               const boost::posix_time::ptime& expires);
+
+   // remove a cookie (e.g. when the user signs out)
+   void remove(const std::string& signedCookie);
+
+   void clear();
+
+   std::size_t size() const;
+
+private:
+   struct Entry
+   {
+      std::string signature;
+      std::string value;
+      boost::posix_time::ptime expires;
+      boost::uint64_t sequence;
+   };
+
+   // split a signed cookie into its fields and signature
+   static void split(const std::string& signedCookie,
+                     std::string* pFields,
+                     std::string* pSignature);
+
+   std::size_t capacity_;
+   mutable boost::mutex mutex_;
+   std::map<std::string,Entry> entries_;
+
+   // insertion order of entries (with the sequence numbers of the entries
+   // so that those which were removed and then inserted again aren't
+   // evicted early)
+   std::deque<std::pair<boost::uint64_t,std::string> > order_;
+   boost::uint64_t nextSequence_;
+};
+
+} // namespace http
+} // namespace core
+
+#endif // CORE_HTTP_VALIDATED_COOKIE_CACHE_HPP
@@ -36,6 +36,17 @@ bool detectREnvironment(const FilePath& whichRScript,
                         EnvironmentVars* pVars,
                         std::string* pErrMsg);
 
+// variation which caches the detected locations of R in the specified
+// file (which can be shared by several processes). the cache is used until
+// the R installation it describes changes (so R needn't be run to detect
+// its locations each time)
+bool detectREnvironment(const FilePath& whichRScript,
+                        const FilePath& ldPathsScript,
+                        const std::string& ldLibraryPath,
+                        const FilePath& cacheFilePath,
+                        EnvironmentVars* pVars,
+                        std::string* pErrMsg);
+
 void setREnvironmentVars(const EnvironmentVars& vars);
 
 } // namespace r_util
@@ -0,0 +1,132 @@
+/*
+ * RSerialization.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_R_UTIL_R_SERIALIZATION_HPP
+#define CORE_R_UTIL_R_SERIALIZATION_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+
+#include <core/FilePath.hpp>
+
+namespace core {
+
+class Error;
+
+namespace r_util {
+
+// Reader for R's (xdr) serialization format and lazy-load databases (e.g.
+// the Rd databases installed with each package). This doesn't call into R
+// so can be used from background threads. Only the subset of object types
+// required to inspect plain data (vectors, lists, pairlists and their
+// attributes) is retained: environments, closures, etc. are read past
+// and represented as empty objects.
+
+// serialized object types (these mirror the corresponding SEXPTYPEs)
+enum SerializedType
+{
+   kNilType = 0,
+   kSymbolType = 1,
+   kPairListType = 2,
+   kCharType = 9,
+   kLogicalType = 10,
+   kIntegerType = 13,
+   kRealType = 14,
+   kStringType = 16,
+   kListType = 19,
+   kExpressionType = 20,
+   kRawType = 24,
+   kOtherType = -1
+};
+
+class SerializedObject;
+typedef boost::shared_ptr<SerializedObject> SerializedObjectPtr;
+
+class SerializedObject
+{
+public:
+   SerializedObject() : type(kNilType) {}
+
+   int type;
+
+   // string, char, and symbol values (NA strings are empty)
+   std::vector<std::string> strings;
+
+   // integer and logical values
+   std::vector<int> integers;
+
+   // real values
+   std::vector<double> reals;
+
+   // list and expression elements, pairlist values
+   std::vector<SerializedObjectPtr> elements;
+
+   // pairlist tags (parallel to elements)
+   std::vector<std::string> tags;
+
+   // attributes (a pairlist, or null if there are none)
+   SerializedObjectPtr attributes;
+
+public:
+   bool isNull() const { return type == kNilType; }
+
+   // first string value (or empty string if there is none)
+   std::string asString() const;
+
+   // get an attribute (returns null if it doesn't exist)
+   SerializedObjectPtr attribute(const std::string& name) const;
+
+   // get the first string value of an attribute
+   std::string stringAttribute(const std::string& name) const;
+
+   // get an element of a pairlist or named list by name
+   SerializedObjectPtr element(const std::string& name) const;
+};
+
+// unserialize an object from a buffer
+Error unserialize(const std::string& buffer, SerializedObjectPtr* pObject);
+
+// read an object saved with saveRDS (gzip compressed or uncompressed)
+Error readRDS(const FilePath& filePath, SerializedObjectPtr* pObject);
+
+
+// lazy-load database (<base>.rdx index and <base>.rdb values)
+class LazyLoadDB
+{
+public:
+   LazyLoadDB() : compression_(0) {}
+
+   // read the index of the database
+   Error open(const FilePath& basePath);
+
+   // names of the values in the database
+   std::vector<std::string> names() const;
+
+   // read and unserialize a value
+   Error read(const std::string& name, SerializedObjectPtr* pObject) const;
+
+private:
+   FilePath rdbPath_;
+   int compression_;
+   std::map<std::string, std::pair<int,int> > index_;
+};
+
+} // namespace r_util
+} // namespace core
+
+
+#endif // CORE_R_UTIL_R_SERIALIZATION_HPP
+
@@ -0,0 +1,71 @@
+/*
+ * RSourceIndexCache.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_R_UTIL_R_SOURCE_INDEX_CACHE_HPP
+#define CORE_R_UTIL_R_SOURCE_INDEX_CACHE_HPP
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include <core/FileInfo.hpp>
+
+#include <core/r_util/RSourceIndex.hpp>
+
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace r_util {
+
+// Persistent cache of source indexes. Each index is stored along with the
+// size and last write time of the file it was created from so that it
+// can be reused as long as the file is unchanged.
+
+struct CachedSourceIndex
+{
+   CachedSourceIndex() {}
+
+   CachedSourceIndex(const FileInfo& fileInfo,
+                     boost::shared_ptr<RSourceIndex> pIndex)
+      : fileInfo(fileInfo), pIndex(pIndex)
+   {
+   }
+
+   // is the cached index for the current version of fileInfo?
+   bool isCurrent(const FileInfo& currentFileInfo) const
+   {
+      return fileInfo.absolutePath() == currentFileInfo.absolutePath() &&
+             fileInfo.size() == currentFileInfo.size() &&
+             fileInfo.lastWriteTime() == currentFileInfo.lastWriteTime();
+   }
+
+   FileInfo fileInfo;
+   boost::shared_ptr<RSourceIndex> pIndex;
+};
+
+Error readSourceIndexCache(const FilePath& cachePath,
+                           std::vector<CachedSourceIndex>* pIndexes);
+
+// (written to a temporary file which is then moved into place so that a
+// partially written cache is never read)
+Error writeSourceIndexCache(const FilePath& cachePath,
+                            const std::vector<CachedSourceIndex>& indexes);
+
+} // namespace r_util
+} // namespace core
+
+
+#endif // CORE_R_UTIL_R_SOURCE_INDEX_CACHE_HPP
+
@@ -0,0 +1,163 @@
+/*
+ * RSourceSymbolTable.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_R_UTIL_R_SOURCE_SYMBOL_TABLE_HPP
+#define CORE_R_UTIL_R_SOURCE_SYMBOL_TABLE_HPP
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+#include <boost/function.hpp>
+#include <boost/regex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/utility.hpp>
+
+#include <core/r_util/RSourceIndex.hpp>
+
+namespace core {
+namespace r_util {
+
+// Table of the items of a set of source indexes which can be searched
+// without visiting every item:
+//
+//   - prefix searches use a sorted array of case-folded names (items
+//     added since the array was last sorted are kept in a small unsorted
+//     array which is merged into it once it grows large enough)
+//
+//   - contains searches use the posting list of the least common trigram
+//     of the term to find candidate items
+//
+//   - global functions are found using a hash of their names
+//
+// Removing an index marks its items as removed. They are dropped from the
+// table once they account for half of its items.
+//
+class RSourceSymbolTable : boost::noncopyable
+{
+public:
+   RSourceSymbolTable();
+
+   // add the items of an index (replacing any index with the same context)
+   void add(boost::shared_ptr<RSourceIndex> pIndex);
+
+   // remove the items of the index with the specified context
+   void remove(const std::string& context);
+
+   void clear();
+
+   // merge recently added items into the sorted array (searches do this
+   // as required but calling it after adding many indexes, e.g. when idle,
+   // avoids delaying the next search)
+   void merge();
+
+   // number of (non-removed) items in the table
+   std::size_t size() const { return liveItems_; }
+
+   // search for items whose names start with or contain term (which can
+   // include '*' wildcards). searches are case insensitive and items from
+   // indexes with excluded contexts aren't returned
+   void search(const std::string& term,
+               bool prefixOnly,
+               const std::set<std::string>& excludeContexts,
+               std::size_t maxResults,
+               std::vector<RSourceItem>* pItems);
+
+   // find a function or method defined at the top level
+   bool findGlobalFunction(const std::string& name,
+                           const std::set<std::string>& excludeContexts,
+                           RSourceItem* pItem) const;
+
+private:
+   // reference to an item (its index and its offset within that index)
+   struct Symbol
+   {
+      Symbol(boost::uint32_t index, boost::uint32_t item)
+         : index(index), item(item)
+      {
+      }
+      boost::uint32_t index;
+      boost::uint32_t item;
+   };
+
+   struct IndexEntry
+   {
+      explicit IndexEntry(boost::shared_ptr<RSourceIndex> pIndex)
+         : pIndex(pIndex), removed(false)
+      {
+      }
+      boost::shared_ptr<RSourceIndex> pIndex;
+      bool removed;
+   };
+
+   typedef std::vector<boost::uint32_t> PostingList;
+
+   bool isLive(boost::uint32_t symbol) const;
+   const RSourceItem& itemOf(boost::uint32_t symbol) const;
+   bool addResult(boost::uint32_t symbol,
+                  const std::set<std::string>& excludeContexts,
+                  std::size_t maxResults,
+                  std::vector<RSourceItem>* pItems) const;
+   void mergeRecent();
+   void compact();
+
+   bool searchPrefix(const std::string& prefix,
+                     const boost::function<bool(boost::uint32_t)>& matches,
+                     const std::set<std::string>& excludeContexts,
+                     std::size_t maxResults,
+                     std::vector<RSourceItem>* pItems);
+   bool searchTrigrams(const std::string& literal,
+                       const boost::function<bool(boost::uint32_t)>& matches,
+                       const std::set<std::string>& excludeContexts,
+                       std::size_t maxResults,
+                       std::vector<RSourceItem>* pItems);
+   void searchAll(const boost::function<bool(boost::uint32_t)>& matches,
+                  const std::set<std::string>& excludeContexts,
+                  std::size_t maxResults,
+                  std::vector<RSourceItem>* pItems);
+
+   bool nameHasPrefix(boost::uint32_t symbol, const std::string& prefix) const;
+   bool nameContains(boost::uint32_t symbol, const std::string& term) const;
+   bool nameMatches(boost::uint32_t symbol,
+                    const boost::regex& regex,
+                    bool prefixOnly) const;
+
+   struct FoldedNameLess;
+
+private:
+   // indexes and their items (symbols_ and foldedNames_ are parallel)
+   std::vector<IndexEntry> indexes_;
+   boost::unordered_map<std::string,boost::uint32_t> indexByContext_;
+   std::vector<Symbol> symbols_;
+   std::vector<std::string> foldedNames_;
+   std::size_t liveItems_;
+
+   // symbols sorted by folded name and symbols not yet merged into them
+   std::vector<boost::uint32_t> sorted_;
+   std::vector<boost::uint32_t> recent_;
+
+   // symbols by trigram of their folded name
+   boost::unordered_map<boost::uint32_t,PostingList> trigrams_;
+
+   // top level functions and methods by name
+   boost::unordered_multimap<std::string,boost::uint32_t> globalFunctions_;
+};
+
+} // namespace r_util
+} // namespace core
+
+
+#endif // CORE_R_UTIL_R_SOURCE_SYMBOL_TABLE_HPP
+
@@ -33,6 +33,11 @@ core::Error HMAC_SHA1(const std::string& data,
                       const std::vector<unsigned char>& key,
                       std::vector<unsigned char>* pHMAC);   
    
+// compare strings in time which depends only on their length (so that
+// comparing a computed signature with one which was presented reveals
+// nothing about how much of the presented signature was correct)
+bool constantTimeEquals(const std::string& lhs, const std::string& rhs);
+
 core::Error base64Encode(const std::vector<unsigned char>& data, 
                          std::string* pEncoded);   
    
@@ -19,6 +19,7 @@
 #include <vector>
 
 #include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <core/FilePath.hpp>
 #include <core/collection/Tree.hpp>
@@ -34,6 +35,9 @@
 
 namespace core {   
 namespace system {
+
+struct DirectoryListing;
+
 namespace file_monitor {
 
 // initialize the file monitoring service (creates a background thread
@@ -113,10 +117,18 @@ struct Callbacks
 // guarantee that the deletion of your shared_ptr object is invoked on the same
 // thread that called registerMonitor you should also bind a function to
 // onUnregistered (otherwise the delete will occur on the file monitoring thread)
+//
+// callers which have just listed the root directory can pass the listing
+// so that the monitor's initial scan can use it rather than listing the
+// directory again (the listing is only used if the directory hasn't
+// changed since it was listed)
 void registerMonitor(const core::FilePath& filePath,
                      bool recursive,
                      const boost::function<bool(const FileInfo&)>& filter,
-                     const Callbacks& callbacks);
+                     const Callbacks& callbacks,
+                     const boost::shared_ptr<const DirectoryListing>&
+                           pRootListing =
+                              boost::shared_ptr<const DirectoryListing>());
 
 // unregister a file monitor. note that file monitors can be automatically
 // unregistered in the case of errors or a call to global file_monitor::stop,
@@ -15,7 +15,12 @@
 #ifndef CORE_SYSTEM_FILE_SCANNER_HPP
 #define CORE_SYSTEM_FILE_SCANNER_HPP
 
+#include <string>
+#include <vector>
+
+#include <boost/cstdint.hpp>
 #include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
 
 #include <core/Error.hpp>
 #include <core/FileInfo.hpp>
@@ -33,6 +38,33 @@ namespace core {
 
 namespace system {  
 
+// the entries of a single directory (excluding . and ..) sorted by name.
+// symlinks are reported with the type, size, and modification time of
+// their target (or of the link itself if the target doesn't exist)
+struct DirectoryListing
+{
+   DirectoryListing() : stamp(0) {}
+
+   // path of the directory
+   std::string path;
+
+   // modification time of the directory when it was listed (in nanoseconds)
+   // or 0 if the listing can't be validated (e.g. because the directory was
+   // modified too recently for its modification time to be reliable)
+   boost::int64_t stamp;
+
+   std::vector<FileInfo> entries;
+};
+
+// list a directory. on posix systems this is a single readdir pass which
+// stats each entry relative to the directory (rather than creating and
+// querying a FilePath per entry)
+Error listDirectory(const std::string& dirPath, DirectoryListing* pListing);
+
+// has the directory had entries added, removed, or renamed since it was
+// listed? (changes to the contents of existing entries aren't detected)
+bool isListingCurrent(const DirectoryListing& listing);
+
 struct FileScannerOptions
 {
    FileScannerOptions()
@@ -44,6 +76,10 @@ struct FileScannerOptions
    bool yield;
    boost::function<bool(const FileInfo&)> filter;
    boost::function<Error(const FileInfo&)> onBeforeScanDir;
+
+   // existing listing of the root directory (used in place of listing the
+   // root again if it is still current)
+   boost::shared_ptr<const DirectoryListing> pRootListing;
 };
 
 Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
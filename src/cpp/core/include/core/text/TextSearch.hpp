@@ -0,0 +1,104 @@
+/*
+ * TextSearch.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_TEXT_TEXT_SEARCH_HPP
+#define CORE_TEXT_TEXT_SEARCH_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/regex.hpp>
+
+namespace core {
+
+class Error;
+class FilePath;
+
+namespace text {
+
+// Matches a literal (using Boyer-Moore-Horspool) or a regular expression
+// against text. Case insensitive matching folds ASCII characters only.
+class TextMatcher
+{
+public:
+   TextMatcher() : isRegex_(false), ignoreCase_(false) {}
+
+   // COPYING: via compiler (copyable members)
+
+   core::Error initialize(const std::string& pattern,
+                          bool isRegex,
+                          bool ignoreCase);
+
+   // find the matches within a line (returned as byte offsets of the start
+   // and end of each match relative to begin)
+   void findInLine(const char* begin,
+                   const char* end,
+                   std::vector<std::size_t>* pMatchOn,
+                   std::vector<std::size_t>* pMatchOff) const;
+
+   // find the first line in [begin,end) which contains a match (returns
+   // the start of the line or end if there are no matches)
+   const char* findLine(const char* begin, const char* end) const;
+
+private:
+   const char* findLiteral(const char* begin, const char* end) const;
+
+private:
+   bool isRegex_;
+   bool ignoreCase_;
+   std::string literal_;
+   std::vector<std::size_t> skip_;
+   boost::regex regex_;
+};
+
+struct LineMatch
+{
+   // 1-based line number
+   int line;
+
+   // text of the line (truncated if very long)
+   std::string lineText;
+
+   // character (not byte) offsets of the matches within lineText
+   std::vector<int> matchOn;
+   std::vector<int> matchOff;
+};
+
+// search the contents of a file (large files are memory mapped rather than
+// read). binary files (files which contain a NUL within their first 8K)
+// are skipped
+core::Error searchFile(const FilePath& filePath,
+                       const TextMatcher& matcher,
+                       std::size_t maxMatches,
+                       std::vector<LineMatch>* pMatches);
+
+// search files using a pool of threads. onMatches is called (from the
+// search threads, so it must be thread safe) for each file which has
+// matches and returns false to stop the search. isCancelled (if provided)
+// is also called from the search threads before each file and returns
+// true to stop the search. returns once all of the threads have finished
+void searchFiles(
+      const std::vector<FilePath>& files,
+      const TextMatcher& matcher,
+      std::size_t maxMatchesPerFile,
+      int threads,
+      const boost::function<bool(const FilePath&,
+                                 const std::vector<LineMatch>&)>& onMatches,
+      const boost::function<bool()>& isCancelled = boost::function<bool()>());
+
+} // namespace text
+} // namespace core
+
+#endif // CORE_TEXT_TEXT_SEARCH_HPP
+
@@ -0,0 +1,139 @@
+/*
+ * UnifiedDiff.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef CORE_TEXT_UNIFIED_DIFF_HPP
+#define CORE_TEXT_UNIFIED_DIFF_HPP
+
+#include <string>
+#include <vector>
+
+namespace core {
+namespace text {
+
+enum DiffLineType
+{
+   DiffLineContext,
+   DiffLineAdded,
+   DiffLineDeleted,
+   DiffLineComment     // e.g. "\ No newline at end of file"
+};
+
+// a line within a hunk. line numbers are 1-based (and 0 for lines which
+// aren't in the old or new file). the text (excluding the leading +, -
+// or space) is held by the UnifiedDiff
+struct DiffLine
+{
+   DiffLineType type;
+   int oldLine;
+   int newLine;
+   std::size_t textOffset;
+   std::size_t textLength;
+};
+
+struct DiffHunk
+{
+   std::size_t file;       // index of the file within the diff
+   int oldStart;
+   int oldCount;
+   int newStart;
+   int newCount;
+   std::string header;     // the @@ line
+   std::size_t firstLine;  // index of the first line within the diff
+   std::size_t lineCount;
+};
+
+struct DiffFile
+{
+   DiffFile() : binary(false), firstHunk(0), hunkCount(0) {}
+
+   // lines preceding the hunks (diff, index, ---, +++, etc.)
+   std::vector<std::string> headerLines;
+
+   // paths from the --- and +++ lines (e.g. a/foo.R and b/foo.R)
+   std::string oldPath;
+   std::string newPath;
+
+   bool binary;
+
+   std::size_t firstHunk;
+   std::size_t hunkCount;
+};
+
+// Parses unified diffs (e.g. the output of git diff or svn diff) into
+// files, hunks and lines in a single pass. Input can be passed in pieces
+// of any size (e.g. as it's read from a process) so the whole diff never
+// needs to be held as a single string. Text which isn't part of a hunk is
+// kept as header lines of the file it precedes so the diff can be
+// reproduced (or rendered) from the parsed structure alone.
+class UnifiedDiff
+{
+public:
+   UnifiedDiff();
+
+   // COPYING: via compiler (copyable members)
+
+   // parse the next piece of the diff
+   void parse(const char* begin, const char* end);
+
+   // finish parsing (handles a last line without a trailing newline)
+   void finish();
+
+   // parse a complete diff
+   void parse(const std::string& diff)
+   {
+      parse(diff.data(), diff.data() + diff.size());
+      finish();
+   }
+
+   const std::vector<DiffFile>& files() const { return files_; }
+   const std::vector<DiffHunk>& hunks() const { return hunks_; }
+   const std::vector<DiffLine>& lines() const { return lines_; }
+
+   std::string lineText(const DiffLine& line) const
+   {
+      return text_.substr(line.textOffset, line.textLength);
+   }
+
+   // text of all the lines (which the offsets of lines refer to)
+   const std::string& linesText() const { return text_; }
+
+   // bytes of diff parsed
+   std::size_t size() const { return size_; }
+
+private:
+   void parseLine(const char* begin, const char* end);
+   bool parseHunkLine(const char* begin, const char* end);
+   bool beginHunk(const char* begin, const char* end);
+   void addHeaderLine(const char* begin, const char* end);
+   void addLine(DiffLineType type, const char* begin, const char* end);
+
+private:
+   std::vector<DiffFile> files_;
+   std::vector<DiffHunk> hunks_;
+   std::vector<DiffLine> lines_;
+   std::string text_;
+   std::string partialLine_;
+   std::size_t size_;
+
+   // position within the current hunk
+   bool inHunk_;
+   int oldLine_;
+   int newLine_;
+   int oldRemaining_;
+   int newRemaining_;
+};
+
+} // namespace text
+} // namespace core
+
+#endif // CORE_TEXT_UNIFIED_DIFF_HPP
@@ -14,13 +14,23 @@
 #include <core/r_util/REnvironment.hpp>
 
 #include <algorithm>
+#include <cstring>
+#include <map>
+
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <boost/tokenizer.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/algorithm/string/trim.hpp>
 #include <boost/algorithm/string/replace.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
 #include <core/Error.hpp>
+#include <core/Log.hpp>
 #include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
 #include <core/ConfigUtils.hpp>
 #include <core/system/System.hpp>
 #include <core/system/Process.hpp>
@@ -86,6 +96,13 @@ FilePath systemDefaultRScript(std::string* pErrMsg)
    return scanForRScript(rScriptPaths, pErrMsg);
 }
 
+// the system default R script (without running any processes)
+FilePath cachedDefaultRScript()
+{
+   std::string errMsg;
+   return systemDefaultRScript(&errMsg);
+}
+
 bool getLibPathFromRHome(const FilePath& rHomePath,
                          std::string* pRLibPath,
                          std::string* pErrMsg)
@@ -234,6 +251,27 @@ FilePath systemDefaultRScript(std::string* pErrMsg)
    return FilePath(whichR);
 }
 
+// the system default R script (without running any processes). this is
+// the first R on the path, which is what `which R` finds
+FilePath cachedDefaultRScript()
+{
+   std::string path = core::system::getenv("PATH");
+   boost::char_separator<char> sep(":");
+   boost::tokenizer<boost::char_separator<char> > dirs(path, sep);
+   for (boost::tokenizer<boost::char_separator<char> >::iterator
+         it = dirs.begin(); it != dirs.end(); ++it)
+   {
+      FilePath rScriptPath = FilePath(*it).complete("R");
+      if (::access(rScriptPath.absolutePath().c_str(), X_OK) == 0 &&
+          !rScriptPath.isDirectory())
+      {
+         return rScriptPath;
+      }
+   }
+
+   return FilePath();
+}
+
 bool getRHomeAndLibPath(const FilePath& rScriptPath,
                         const config_utils::Variables& scriptVars,
                         std::string* pRHome,
@@ -544,25 +582,23 @@ bool detectRLocationsUsingR(const std::string& rScriptPath,
    return true;
 }
 
-} // anonymous namespace
-
-
-bool detectREnvironment(const FilePath& ldPathsScript,
-                        EnvironmentVars* pVars,
-                        std::string* pErrMsg)
+// locations detected for an installation of R (everything other than the
+// library path, which also depends on the environment)
+struct RLocations
 {
-   return detectREnvironment(FilePath(),
-                             ldPathsScript,
-                             std::string(),
-                             pVars,
-                             pErrMsg);
-}
-
-bool detectREnvironment(const FilePath& whichRScript,
-                        const FilePath& ldPathsScript,
-                        const std::string& ldLibraryPath,
-                        EnvironmentVars* pVars,
-                        std::string* pErrMsg)
+   std::string rScriptPath;
+   FilePath homePath;
+   std::string sharePath;
+   std::string includePath;
+   std::string docPath;
+   FilePath libPath;
+   std::string extraLibraryPaths;
+};
+
+bool detectRLocations(const FilePath& whichRScript,
+                      const FilePath& ldPathsScript,
+                      RLocations* pLocations,
+                      std::string* pErrMsg)
 {
    // if there is a which R script override then validate it
    std::string rScriptPath;
@@ -640,20 +676,253 @@ bool detectREnvironment(const FilePath& whichRScript,
    }
 #endif
 
+   pLocations->rScriptPath = rScriptPath;
+   pLocations->homePath = rHomePath;
+   pLocations->sharePath = resolveRPath(rHomePath, scriptVars["R_SHARE_DIR"]);
+   pLocations->includePath = resolveRPath(rHomePath,
+                                          scriptVars["R_INCLUDE_DIR"]);
+   pLocations->docPath = resolveRPath(rHomePath, scriptVars["R_DOC_DIR"]);
+   pLocations->libPath = rLibPath;
+   pLocations->extraLibraryPaths = extraLibraryPaths(ldPathsScript,
+                                                     rHomePath.absolutePath());
+   return true;
+}
+
+// Detection runs R (and the ldpaths script) which can take a long time
+// (e.g. when R is on a network file system) so the detected locations are
+// cached in a file. The cache is valid for the same R script override and
+// ldpaths script so long as the R script still resolves to the same file
+// (which is checked without running `which R`) and none of the files the
+// locations were detected from have been modified since.
+
+const char * const kCacheVersion = "1";
+const char * const kMTimePrefix = "mtime:";
+
+std::string modificationTime(const FilePath& filePath)
+{
+   if (filePath.exists())
+      return boost::lexical_cast<std::string>(filePath.lastWriteTime());
+   else
+      return "-1";
+}
+
+std::string realPathOf(const std::string& path)
+{
+   FilePath realPath;
+   Error error = core::system::realPath(path, &realPath);
+   if (error)
+      return std::string();
+   else
+      return realPath.absolutePath();
+}
+
+// the cache determines what the server runs so it's only used if nobody
+// else could have written it (both it and its directory must belong to us
+// and not be writable by anyone else)
+bool isPrivatePath(const FilePath& filePath, bool isDirectory)
+{
+   struct stat st;
+   if (::lstat(filePath.absolutePath().c_str(), &st) == -1)
+      return false;
+
+   bool isType = isDirectory ? S_ISDIR(st.st_mode) : S_ISREG(st.st_mode);
+   return isType &&
+          st.st_uid == ::geteuid() &&
+          (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+bool readCachedRLocations(const FilePath& cacheFilePath,
+                          const FilePath& whichRScript,
+                          const FilePath& ldPathsScript,
+                          RLocations* pLocations)
+{
+   if (!cacheFilePath.exists())
+      return false;
+
+   if (!isPrivatePath(cacheFilePath.parent(), true) ||
+       !isPrivatePath(cacheFilePath, false))
+   {
+      LOG_WARNING_MESSAGE("Ignoring R environment cache " +
+                          cacheFilePath.absolutePath() +
+                          " (it could have been written by another user)");
+      return false;
+   }
+
+   std::map<std::string,std::string> cache;
+   Error error = readStringMapFromFile(cacheFilePath, &cache);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return false;
+   }
+
+   // check that the cache is for the same R script and ldpaths script
+   if (cache["version"] != kCacheVersion ||
+       cache["which-r"] != whichRScript.absolutePath() ||
+       cache["ldpaths-script"] != ldPathsScript.absolutePath())
+   {
+      return false;
+   }
+
+   // check that the R script resolves to the same file
+   std::string rScriptPath = cache["r-script"];
+   if (whichRScript.empty() &&
+       cachedDefaultRScript().absolutePath() != rScriptPath)
+   {
+      return false;
+   }
+   if (realPathOf(rScriptPath) != cache["r-script-real"])
+      return false;
+
+   // check that none of the files have been modified
+   bool haveModificationTimes = false;
+   for (std::map<std::string,std::string>::const_iterator it = cache.begin();
+        it != cache.end();
+        ++it)
+   {
+      if (boost::algorithm::starts_with(it->first, kMTimePrefix))
+      {
+         FilePath filePath(it->first.substr(std::strlen(kMTimePrefix)));
+         if (modificationTime(filePath) != it->second)
+            return false;
+         haveModificationTimes = true;
+      }
+   }
+   if (!haveModificationTimes)
+      return false;
+
+   pLocations->rScriptPath = rScriptPath;
+   pLocations->homePath = FilePath(cache["R_HOME"]);
+   pLocations->sharePath = cache["R_SHARE_DIR"];
+   pLocations->includePath = cache["R_INCLUDE_DIR"];
+   pLocations->docPath = cache["R_DOC_DIR"];
+   pLocations->libPath = FilePath(cache["r-lib-path"]);
+   pLocations->extraLibraryPaths = cache["extra-library-paths"];
+   return true;
+}
+
+void writeCachedRLocations(const FilePath& cacheFilePath,
+                           const FilePath& whichRScript,
+                           const FilePath& ldPathsScript,
+                           const RLocations& locations)
+{
+   std::map<std::string,std::string> cache;
+   cache["version"] = kCacheVersion;
+   cache["which-r"] = whichRScript.absolutePath();
+   cache["ldpaths-script"] = ldPathsScript.absolutePath();
+   cache["r-script"] = locations.rScriptPath;
+   cache["r-script-real"] = realPathOf(locations.rScriptPath);
+   cache["R_HOME"] = locations.homePath.absolutePath();
+   cache["R_SHARE_DIR"] = locations.sharePath;
+   cache["R_INCLUDE_DIR"] = locations.includePath;
+   cache["R_DOC_DIR"] = locations.docPath;
+   cache["r-lib-path"] = locations.libPath.absolutePath();
+   cache["extra-library-paths"] = locations.extraLibraryPaths;
+
+   // the files the locations were detected from
+   std::vector<FilePath> files;
+   files.push_back(FilePath(cache["r-script-real"]));
+   files.push_back(locations.libPath.complete(kLibRFileName));
+   files.push_back(locations.homePath.complete("etc/ldpaths"));
+   if (!ldPathsScript.empty())
+      files.push_back(ldPathsScript);
+   for (std::vector<FilePath>::const_iterator it = files.begin();
+        it != files.end();
+        ++it)
+   {
+      cache[kMTimePrefix + it->absolutePath()] = modificationTime(*it);
+   }
+
+   // the cache directory is created private to us (and we don't write to
+   // one which isn't since the cache would be ignored when read)
+   FilePath cacheDirPath = cacheFilePath.parent();
+   if (::mkdir(cacheDirPath.absolutePath().c_str(), S_IRWXU) == -1 &&
+       errno != EEXIST)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", cacheDirPath.absolutePath());
+      LOG_ERROR(error);
+      return;
+   }
+   if (!isPrivatePath(cacheDirPath, true))
+   {
+      LOG_WARNING_MESSAGE("Not writing R environment cache to " +
+                          cacheDirPath.absolutePath() +
+                          " (it is writable by other users)");
+      return;
+   }
+
+   // write to a temporary file then rename it over the cache so that other
+   // processes never read a partially written cache
+   FilePath tempFilePath = cacheFilePath.parent().complete(
+         cacheFilePath.filename() + "." +
+         boost::lexical_cast<std::string>(::getpid()));
+   Error error = writeStringMapToFile(tempFilePath, cache);
+   if (!error)
+      error = tempFilePath.move(cacheFilePath);
+   if (error)
+   {
+      LOG_ERROR(error);
+      tempFilePath.removeIfExists();
+   }
+}
+
+} // anonymous namespace
+
+
+bool detectREnvironment(const FilePath& ldPathsScript,
+                        EnvironmentVars* pVars,
+                        std::string* pErrMsg)
+{
+   return detectREnvironment(FilePath(),
+                             ldPathsScript,
+                             std::string(),
+                             pVars,
+                             pErrMsg);
+}
+
+bool detectREnvironment(const FilePath& whichRScript,
+                        const FilePath& ldPathsScript,
+                        const std::string& ldLibraryPath,
+                        EnvironmentVars* pVars,
+                        std::string* pErrMsg)
+{
+   return detectREnvironment(whichRScript,
+                             ldPathsScript,
+                             ldLibraryPath,
+                             FilePath(),
+                             pVars,
+                             pErrMsg);
+}
+
+bool detectREnvironment(const FilePath& whichRScript,
+                        const FilePath& ldPathsScript,
+                        const std::string& ldLibraryPath,
+                        const FilePath& cacheFilePath,
+                        EnvironmentVars* pVars,
+                        std::string* pErrMsg)
+{
+   // use the cached locations if we can, otherwise detect them
+   RLocations locations;
+   bool cached = !cacheFilePath.empty() &&
+                 readCachedRLocations(cacheFilePath,
+                                      whichRScript,
+                                      ldPathsScript,
+                                      &locations);
+   if (!cached)
+   {
+      if (!detectRLocations(whichRScript, ldPathsScript, &locations, pErrMsg))
+         return false;
+   }
 
    // set R home path
-   pVars->push_back(std::make_pair("R_HOME", rHomePath.absolutePath()));
+   pVars->push_back(std::make_pair("R_HOME",
+                                   locations.homePath.absolutePath()));
 
    // set other environment values
-   pVars->push_back(std::make_pair("R_SHARE_DIR",
-                                   resolveRPath(rHomePath,
-                                                scriptVars["R_SHARE_DIR"])));
-   pVars->push_back(std::make_pair("R_INCLUDE_DIR",
-                                   resolveRPath(rHomePath,
-                                                scriptVars["R_INCLUDE_DIR"])));
-   pVars->push_back(std::make_pair("R_DOC_DIR",
-                                   resolveRPath(rHomePath,
-                                                scriptVars["R_DOC_DIR"])));
+   pVars->push_back(std::make_pair("R_SHARE_DIR", locations.sharePath));
+   pVars->push_back(std::make_pair("R_INCLUDE_DIR", locations.includePath));
+   pVars->push_back(std::make_pair("R_DOC_DIR", locations.docPath));
 
    // determine library path (existing + r lib dir + r extra lib dirs)
    std::string libraryPath = core::system::getenv(kLibraryPathEnvVariable);
@@ -662,14 +931,24 @@ bool detectREnvironment(const FilePath& whichRScript,
    libraryPath.append(ldLibraryPath);
    if (!libraryPath.empty())
       libraryPath.append(":");
-   libraryPath.append(rLibPath.absolutePath());
-   std::string extraPaths = extraLibraryPaths(ldPathsScript,
-                                              rHomePath.absolutePath());
-   if (!extraPaths.empty())
-      libraryPath.append(":" + extraPaths);
+   libraryPath.append(locations.libPath.absolutePath());
+   if (!locations.extraLibraryPaths.empty())
+      libraryPath.append(":" + locations.extraLibraryPaths);
    pVars->push_back(std::make_pair(kLibraryPathEnvVariable, libraryPath));
 
-   return validateREnvironment(*pVars, rLibPath, pErrMsg);
+   if (!validateREnvironment(*pVars, locations.libPath, pErrMsg))
+      return false;
+
+   // cache newly detected (valid) locations
+   if (!cached && !cacheFilePath.empty())
+   {
+      writeCachedRLocations(cacheFilePath,
+                            whichRScript,
+                            ldPathsScript,
+                            locations);
+   }
+
+   return true;
 }
 
 
@@ -0,0 +1,680 @@
+/*
+ * RSerialization.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RSerialization.hpp>
+
+#include <istream>
+#include <cstring>
+
+#include <boost/cstdint.hpp>
+
+#ifndef _WIN32
+#include <zlib.h>
+#endif
+
+#include <core/Error.hpp>
+#include <core/FileSerializer.hpp>
+
+namespace core {
+namespace r_util {
+
+namespace {
+
+// special serialization codes (see serialize.c)
+const int kRefSxp = 255;
+const int kNilValueSxp = 254;
+const int kGlobalEnvSxp = 253;
+const int kUnboundValueSxp = 252;
+const int kMissingArgSxp = 251;
+const int kBaseNamespaceSxp = 250;
+const int kNamespaceSxp = 249;
+const int kPackageSxp = 248;
+const int kPersistSxp = 247;
+const int kEmptyEnvSxp = 242;
+const int kBaseEnvSxp = 241;
+const int kAltrepSxp = 238;
+
+// types which are read differently from plain vectors
+const int kClosSxp = 3;
+const int kEnvSxp = 4;
+const int kPromSxp = 5;
+const int kLangSxp = 6;
+const int kSpecialSxp = 7;
+const int kBuiltinSxp = 8;
+const int kCplxSxp = 15;
+const int kDotSxp = 17;
+const int kExtPtrSxp = 22;
+const int kWeakRefSxp = 23;
+const int kS4Sxp = 25;
+
+// flag bits
+const int kHasAttributesFlag = 1 << 9;
+const int kHasTagFlag = 1 << 10;
+
+struct FormatError {};
+
+bool isPairListType(int type)
+{
+   return type == kPairListType ||
+          type == kLangSxp ||
+          type == kClosSxp ||
+          type == kPromSxp ||
+          type == kDotSxp;
+}
+
+class Unserializer
+{
+public:
+   explicit Unserializer(const std::string& buffer)
+      : pos_(buffer.data()), end_(buffer.data() + buffer.size())
+   {
+   }
+
+   SerializedObjectPtr read()
+   {
+      // format (only xdr is supported)
+      requireBytes(2);
+      if (pos_[0] != 'X' || pos_[1] != '\n')
+         throw FormatError();
+      pos_ += 2;
+
+      // version, writer version, minimum reader version
+      int version = readInt();
+      readInt();
+      readInt();
+      if (version == 3)
+      {
+         // native encoding
+         int length = readInt();
+         skipBytes(length);
+      }
+      else if (version != 2)
+      {
+         throw FormatError();
+      }
+
+      return readItem();
+   }
+
+private:
+   SerializedObjectPtr readItem()
+   {
+      return readItem(readInt());
+   }
+
+   SerializedObjectPtr readItem(int flags)
+   {
+      int type = flags & 0xFF;
+      bool hasAttributes = (flags & kHasAttributesFlag) != 0;
+      bool hasTag = (flags & kHasTagFlag) != 0;
+
+      SerializedObjectPtr pObject(new SerializedObject());
+
+      switch(type)
+      {
+      case kNilValueSxp:
+         return pObject;
+
+      case kGlobalEnvSxp:
+      case kUnboundValueSxp:
+      case kMissingArgSxp:
+      case kBaseNamespaceSxp:
+      case kEmptyEnvSxp:
+      case kBaseEnvSxp:
+         pObject->type = kOtherType;
+         return pObject;
+
+      case kRefSxp:
+      {
+         int index = flags >> 8;
+         if (index == 0)
+            index = readInt();
+         if (index < 1 || index > static_cast<int>(refs_.size()))
+            throw FormatError();
+         return refs_[index - 1];
+      }
+
+      case kPersistSxp:
+      case kNamespaceSxp:
+      case kPackageSxp:
+      {
+         pObject->type = kOtherType;
+         readStringVector(pObject.get());
+         refs_.push_back(pObject);
+         return pObject;
+      }
+
+      case kSymbolType:
+      {
+         pObject->type = kSymbolType;
+         refs_.push_back(pObject);
+         pObject->strings.push_back(readItem()->asString());
+         return pObject;
+      }
+
+      case kEnvSxp:
+      {
+         pObject->type = kOtherType;
+         readInt(); // locked
+         refs_.push_back(pObject);
+         readItem(); // enclosure
+         readItem(); // frame
+         readItem(); // hash table
+         readItem(); // attributes
+         return pObject;
+      }
+
+      case kAltrepSxp:
+      {
+         pObject->type = kOtherType;
+         readItem(); // class info
+         readItem(); // state
+         readItem(); // attributes
+         return pObject;
+      }
+
+      default:
+         break;
+      }
+
+      if (isPairListType(type))
+      {
+         // read pairlists iteratively (they may be long)
+         pObject->type = kPairListType;
+         while (true)
+         {
+            SerializedObjectPtr pAttributes;
+            if (hasAttributes)
+               pAttributes = readItem();
+            if (!pObject->attributes)
+               pObject->attributes = pAttributes;
+
+            std::string tag;
+            if (hasTag)
+               tag = readItem()->asString();
+
+            pObject->tags.push_back(tag);
+            pObject->elements.push_back(readItem());
+
+            // continue with the next cell if this is a pairlist
+            flags = readInt();
+            type = flags & 0xFF;
+            hasAttributes = (flags & kHasAttributesFlag) != 0;
+            hasTag = (flags & kHasTagFlag) != 0;
+            if (!isPairListType(type))
+            {
+               readItem(flags);
+               break;
+            }
+         }
+         return pObject;
+      }
+
+      switch(type)
+      {
+      case kExtPtrSxp:
+         pObject->type = kOtherType;
+         refs_.push_back(pObject);
+         readItem(); // protected value
+         readItem(); // tag
+         break;
+
+      case kWeakRefSxp:
+         pObject->type = kOtherType;
+         refs_.push_back(pObject);
+         break;
+
+      case kSpecialSxp:
+      case kBuiltinSxp:
+      {
+         pObject->type = kOtherType;
+         int length = readInt();
+         skipBytes(length);
+         break;
+      }
+
+      case kCharType:
+      {
+         pObject->type = kCharType;
+         int length = readInt();
+         if (length == -1) // NA_STRING
+         {
+            pObject->strings.push_back(std::string());
+         }
+         else
+         {
+            requireBytes(length);
+            pObject->strings.push_back(std::string(pos_, length));
+            pos_ += length;
+         }
+         break;
+      }
+
+      case kLogicalType:
+      case kIntegerType:
+      {
+         pObject->type = type;
+         std::size_t length = readLength(4);
+         pObject->integers.reserve(length);
+         for (std::size_t i = 0; i < length; i++)
+            pObject->integers.push_back(readInt());
+         break;
+      }
+
+      case kRealType:
+      {
+         pObject->type = type;
+         std::size_t length = readLength(8);
+         pObject->reals.reserve(length);
+         for (std::size_t i = 0; i < length; i++)
+            pObject->reals.push_back(readDouble());
+         break;
+      }
+
+      case kCplxSxp:
+         pObject->type = kOtherType;
+         skipBytes(readLength(16) * 16);
+         break;
+
+      case kRawType:
+         pObject->type = type;
+         skipBytes(readLength(1));
+         break;
+
+      case kStringType:
+      {
+         pObject->type = type;
+         std::size_t length = readLength(4);
+         pObject->strings.reserve(length);
+         for (std::size_t i = 0; i < length; i++)
+            pObject->strings.push_back(readItem()->asString());
+         break;
+      }
+
+      case kListType:
+      case kExpressionType:
+      {
+         pObject->type = type;
+         std::size_t length = readLength(4);
+         pObject->elements.reserve(length);
+         for (std::size_t i = 0; i < length; i++)
+            pObject->elements.push_back(readItem());
+         break;
+      }
+
+      case kS4Sxp:
+         pObject->type = kOtherType;
+         break;
+
+      default:
+         // byte code, class references, etc.
+         throw FormatError();
+      }
+
+      if (hasAttributes)
+         pObject->attributes = readItem();
+
+      return pObject;
+   }
+
+   void readStringVector(SerializedObject* pObject)
+   {
+      if (readInt() != 0)
+         throw FormatError();
+      int length = readInt();
+      for (int i = 0; i < length; i++)
+         pObject->strings.push_back(readItem()->asString());
+   }
+
+   std::size_t readLength(std::size_t elementSize)
+   {
+      boost::int64_t length = readInt();
+      if (length == -1)
+      {
+         boost::uint64_t upper = static_cast<boost::uint32_t>(readInt());
+         boost::uint64_t lower = static_cast<boost::uint32_t>(readInt());
+         length = static_cast<boost::int64_t>((upper << 32) + lower);
+      }
+
+      // every element occupies at least elementSize bytes so we can
+      // validate the length before allocating anything
+      if (length < 0 ||
+          static_cast<boost::uint64_t>(length) >
+                     static_cast<std::size_t>(end_ - pos_) / elementSize)
+      {
+         throw FormatError();
+      }
+
+      return static_cast<std::size_t>(length);
+   }
+
+   int readInt()
+   {
+      requireBytes(4);
+      const unsigned char* p = reinterpret_cast<const unsigned char*>(pos_);
+      boost::uint32_t value = (boost::uint32_t(p[0]) << 24) |
+                              (boost::uint32_t(p[1]) << 16) |
+                              (boost::uint32_t(p[2]) << 8) |
+                              boost::uint32_t(p[3]);
+      pos_ += 4;
+      return static_cast<int>(value);
+   }
+
+   double readDouble()
+   {
+      boost::uint64_t upper = static_cast<boost::uint32_t>(readInt());
+      boost::uint64_t lower = static_cast<boost::uint32_t>(readInt());
+      boost::uint64_t bits = (upper << 32) | lower;
+      double value;
+      std::memcpy(&value, &bits, sizeof(value));
+      return value;
+   }
+
+   void skipBytes(std::size_t count)
+   {
+      requireBytes(count);
+      pos_ += count;
+   }
+
+   void requireBytes(std::size_t count)
+   {
+      if (count > static_cast<std::size_t>(end_ - pos_))
+         throw FormatError();
+   }
+
+private:
+   const char* pos_;
+   const char* end_;
+   std::vector<SerializedObjectPtr> refs_;
+};
+
+Error formatError(const ErrorLocation& location)
+{
+   return systemError(boost::system::errc::illegal_byte_sequence, location);
+}
+
+Error notSupportedError(const ErrorLocation& location)
+{
+   return systemError(boost::system::errc::not_supported, location);
+}
+
+#ifndef _WIN32
+
+// decompress a zlib or gzip stream of unknown size
+Error inflateBuffer(const char* data,
+                    std::size_t length,
+                    bool gzip,
+                    std::string* pOutput)
+{
+   z_stream stream;
+   stream.zalloc = Z_NULL;
+   stream.zfree = Z_NULL;
+   stream.opaque = Z_NULL;
+   stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+   stream.avail_in = length;
+   if (::inflateInit2(&stream, gzip ? (16 + MAX_WBITS) : MAX_WBITS) != Z_OK)
+      return systemError(boost::system::errc::not_enough_memory,
+                         ERROR_LOCATION);
+
+   char buffer[65536];
+   int result = Z_OK;
+   while (result == Z_OK)
+   {
+      stream.next_out = reinterpret_cast<Bytef*>(buffer);
+      stream.avail_out = sizeof(buffer);
+      result = ::inflate(&stream, Z_NO_FLUSH);
+      if (result == Z_OK || result == Z_STREAM_END)
+         pOutput->append(buffer, sizeof(buffer) - stream.avail_out);
+
+      // guard against truncated input
+      if (result == Z_OK && stream.avail_in == 0 && stream.avail_out != 0)
+         result = Z_DATA_ERROR;
+   }
+   ::inflateEnd(&stream);
+
+   if (result != Z_STREAM_END)
+      return formatError(ERROR_LOCATION);
+   else
+      return Success();
+}
+
+#else
+
+Error inflateBuffer(const char* data,
+                    std::size_t length,
+                    bool gzip,
+                    std::string* pOutput)
+{
+   return notSupportedError(ERROR_LOCATION);
+}
+
+#endif
+
+} // anonymous namespace
+
+std::string SerializedObject::asString() const
+{
+   if (!strings.empty())
+      return strings[0];
+   else
+      return std::string();
+}
+
+SerializedObjectPtr SerializedObject::attribute(const std::string& name) const
+{
+   if (attributes)
+      return attributes->element(name);
+   else
+      return SerializedObjectPtr();
+}
+
+std::string SerializedObject::stringAttribute(const std::string& name) const
+{
+   SerializedObjectPtr pAttrib = attribute(name);
+   if (pAttrib)
+      return pAttrib->asString();
+   else
+      return std::string();
+}
+
+SerializedObjectPtr SerializedObject::element(const std::string& name) const
+{
+   // pairlists are tagged directly, lists via their names attribute
+   if (type == kPairListType)
+   {
+      for (std::size_t i = 0; i < tags.size() && i < elements.size(); i++)
+      {
+         if (tags[i] == name)
+            return elements[i];
+      }
+   }
+   else if (type == kListType || type == kExpressionType)
+   {
+      SerializedObjectPtr pNames = attribute("names");
+      if (pNames)
+      {
+         for (std::size_t i = 0;
+              i < pNames->strings.size() && i < elements.size();
+              i++)
+         {
+            if (pNames->strings[i] == name)
+               return elements[i];
+         }
+      }
+   }
+
+   return SerializedObjectPtr();
+}
+
+Error unserialize(const std::string& buffer, SerializedObjectPtr* pObject)
+{
+   try
+   {
+      Unserializer unserializer(buffer);
+      *pObject = unserializer.read();
+      return Success();
+   }
+   catch(const FormatError&)
+   {
+      return formatError(ERROR_LOCATION);
+   }
+}
+
+Error readRDS(const FilePath& filePath, SerializedObjectPtr* pObject)
+{
+   std::string contents;
+   Error error = readStringFromFile(filePath, &contents);
+   if (error)
+      return error;
+
+   // gzip compressed (the default for saveRDS)
+   if (contents.size() > 2 &&
+       contents[0] == '\x1f' && contents[1] == '\x8b')
+   {
+      std::string uncompressed;
+      error = inflateBuffer(contents.data(), contents.size(), true,
+                            &uncompressed);
+      if (error)
+      {
+         error.addProperty("path", filePath);
+         return error;
+      }
+      contents.swap(uncompressed);
+   }
+
+   error = unserialize(contents, pObject);
+   if (error)
+      error.addProperty("path", filePath);
+   return error;
+}
+
+Error LazyLoadDB::open(const FilePath& basePath)
+{
+   FilePath rdxPath(basePath.absolutePath() + ".rdx");
+   rdbPath_ = FilePath(basePath.absolutePath() + ".rdb");
+   index_.clear();
+
+   // the index is a list of variables (offset and length of each value
+   // within the rdb file) and a flag indicating the type of compression
+   SerializedObjectPtr pIndex;
+   Error error = readRDS(rdxPath, &pIndex);
+   if (error)
+      return error;
+
+   SerializedObjectPtr pVariables = pIndex->element("variables");
+   SerializedObjectPtr pCompressed = pIndex->element("compressed");
+   if (!pVariables || !pCompressed)
+      return formatError(ERROR_LOCATION);
+
+   // compressed is TRUE (zlib), 2 (bzip2) or 3 (xz) however the latter
+   // two also support zlib and uncompressed values on a per-value basis
+   if (!pCompressed->integers.empty())
+      compression_ = pCompressed->integers[0];
+   else if (!pCompressed->reals.empty())
+      compression_ = static_cast<int>(pCompressed->reals[0]);
+   else
+      return formatError(ERROR_LOCATION);
+
+   SerializedObjectPtr pNames = pVariables->attribute("names");
+   if (!pNames)
+      return formatError(ERROR_LOCATION);
+   for (std::size_t i = 0;
+        i < pNames->strings.size() && i < pVariables->elements.size();
+        i++)
+   {
+      const std::vector<int>& location = pVariables->elements[i]->integers;
+      if (location.size() == 2)
+      {
+         index_[pNames->strings[i]] = std::make_pair(location[0],
+                                                     location[1]);
+      }
+   }
+
+   return Success();
+}
+
+std::vector<std::string> LazyLoadDB::names() const
+{
+   std::vector<std::string> names;
+   for (std::map<std::string, std::pair<int,int> >::const_iterator it =
+         index_.begin(); it != index_.end(); ++it)
+   {
+      names.push_back(it->first);
+   }
+   return names;
+}
+
+Error LazyLoadDB::read(const std::string& name,
+                       SerializedObjectPtr* pObject) const
+{
+   std::map<std::string, std::pair<int,int> >::const_iterator it =
+                                                         index_.find(name);
+   if (it == index_.end())
+      return systemError(boost::system::errc::invalid_argument,
+                         ERROR_LOCATION);
+
+   // read the value's bytes
+   boost::shared_ptr<std::istream> pStream;
+   Error error = rdbPath_.open_r(&pStream);
+   if (error)
+      return error;
+
+   int offset = it->second.first;
+   int length = it->second.second;
+   if (offset < 0 || length < 4)
+      return formatError(ERROR_LOCATION);
+
+   std::string value(length, '\0');
+   pStream->seekg(offset);
+   pStream->read(&(value[0]), length);
+   if (pStream->gcount() != length)
+      return formatError(ERROR_LOCATION);
+
+   // values are prefixed with their (big endian) uncompressed length
+   // followed (for bzip2 and xz databases) by a compression type byte
+   std::string::size_type dataOffset = 4;
+   bool compressed = compression_ != 0;
+   if (compression_ == 2 || compression_ == 3)
+   {
+      if (value.size() < 5)
+         return formatError(ERROR_LOCATION);
+
+      char type = value[4];
+      dataOffset = 5;
+      if (type == '0')
+         compressed = false;
+      else if (type != 'Z')
+         return notSupportedError(ERROR_LOCATION);
+   }
+
+   std::string buffer;
+   if (compressed)
+   {
+      error = inflateBuffer(value.data() + dataOffset,
+                            value.size() - dataOffset,
+                            false,
+                            &buffer);
+      if (error)
+         return error;
+   }
+   else
+   {
+      buffer = value.substr(dataOffset);
+   }
+
+   return unserialize(buffer, pObject);
+}
+
+} // namespace r_util
+} // namespace core
+
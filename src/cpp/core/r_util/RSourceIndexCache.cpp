@@ -0,0 +1,260 @@
+/*
+ * RSourceIndexCache.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RSourceIndexCache.hpp>
+
+#include <iostream>
+
+#include <boost/cstdint.hpp>
+#include <boost/foreach.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+
+namespace core {
+namespace r_util {
+
+namespace {
+
+// the cache is a binary file consisting of a header followed by each
+// index's file info, context, and items. note that integers are written
+// in native byte order (the cache is never shared between machines)
+const char * const kCacheMagic = "RSIC";
+const boost::uint32_t kCacheVersion = 1;
+
+// upper bound on string lengths (guards against reading a corrupt cache)
+const boost::uint32_t kMaxStringLength = 1024 * 1024;
+
+class CacheWriter
+{
+public:
+   explicit CacheWriter(std::ostream& ostr) : ostr_(ostr) {}
+
+   void writeUInt(boost::uint32_t value)
+   {
+      ostr_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+   }
+
+   void writeInt64(boost::int64_t value)
+   {
+      ostr_.write(reinterpret_cast<const char*>(&value), sizeof(value));
+   }
+
+   void writeString(const std::string& value)
+   {
+      writeUInt(value.size());
+      ostr_.write(value.data(), value.size());
+   }
+
+   void writeItem(const RSourceItem& item)
+   {
+      writeUInt(item.type());
+      writeString(item.name());
+      writeUInt(item.braceLevel());
+      writeUInt(item.line());
+      writeUInt(item.column());
+      writeUInt(item.signature().size());
+      BOOST_FOREACH(const RS4MethodParam& param, item.signature())
+      {
+         writeString(param.name());
+         writeString(param.type());
+      }
+   }
+
+private:
+   std::ostream& ostr_;
+};
+
+class CacheReader
+{
+public:
+   explicit CacheReader(std::istream& istr) : istr_(istr) {}
+
+   bool good() const { return istr_.good(); }
+
+   boost::uint32_t readUInt()
+   {
+      boost::uint32_t value = 0;
+      istr_.read(reinterpret_cast<char*>(&value), sizeof(value));
+      return value;
+   }
+
+   boost::int64_t readInt64()
+   {
+      boost::int64_t value = 0;
+      istr_.read(reinterpret_cast<char*>(&value), sizeof(value));
+      return value;
+   }
+
+   std::string readString()
+   {
+      boost::uint32_t length = readUInt();
+      if (!good() || length > kMaxStringLength)
+      {
+         istr_.setstate(std::ios::failbit);
+         return std::string();
+      }
+
+      std::string value(length, '\0');
+      if (length > 0)
+         istr_.read(&value[0], length);
+      return value;
+   }
+
+   RSourceItem readItem()
+   {
+      int type = readUInt();
+      std::string name = readString();
+      int braceLevel = readUInt();
+      std::size_t line = readUInt();
+      std::size_t column = readUInt();
+
+      std::vector<RS4MethodParam> signature;
+      boost::uint32_t params = readUInt();
+      for (boost::uint32_t i = 0; i<params && good(); i++)
+      {
+         std::string name = readString();
+         std::string type = readString();
+         signature.push_back(RS4MethodParam(name, type));
+      }
+
+      return RSourceItem(type, name, signature, braceLevel, line, column);
+   }
+
+private:
+   std::istream& istr_;
+};
+
+Error cacheFormatError(const FilePath& cachePath, const ErrorLocation& location)
+{
+   Error error = systemError(boost::system::errc::illegal_byte_sequence,
+                             location);
+   error.addProperty("path", cachePath);
+   return error;
+}
+
+} // anonymous namespace
+
+Error readSourceIndexCache(const FilePath& cachePath,
+                           std::vector<CachedSourceIndex>* pIndexes)
+{
+   boost::shared_ptr<std::istream> pStream;
+   Error error = cachePath.open_r(&pStream);
+   if (error)
+      return error;
+
+   try
+   {
+      pStream->exceptions(std::istream::badbit);
+
+      // check the header (caches from other versions are simply ignored)
+      char magic[4];
+      pStream->read(magic, sizeof(magic));
+      CacheReader reader(*pStream);
+      if (!reader.good() ||
+          std::string(magic, sizeof(magic)) != kCacheMagic ||
+          reader.readUInt() != kCacheVersion)
+      {
+         return cacheFormatError(cachePath, ERROR_LOCATION);
+      }
+
+      boost::uint32_t count = reader.readUInt();
+      std::vector<CachedSourceIndex> indexes;
+      for (boost::uint32_t i = 0; i<count && reader.good(); i++)
+      {
+         std::string path = reader.readString();
+         uintmax_t size = reader.readInt64();
+         std::time_t lastWriteTime = reader.readInt64();
+         std::string context = reader.readString();
+
+         std::vector<RSourceItem> items;
+         boost::uint32_t itemCount = reader.readUInt();
+         for (boost::uint32_t j = 0; j<itemCount && reader.good(); j++)
+            items.push_back(reader.readItem());
+
+         boost::shared_ptr<RSourceIndex> pIndex(
+                                       new RSourceIndex(context, items));
+         indexes.push_back(
+               CachedSourceIndex(FileInfo(path, false, size, lastWriteTime),
+                                 pIndex));
+      }
+
+      if (!reader.good())
+         return cacheFormatError(cachePath, ERROR_LOCATION);
+
+      pIndexes->swap(indexes);
+   }
+   catch(const std::exception& e)
+   {
+      Error error = systemError(boost::system::errc::io_error,
+                                ERROR_LOCATION);
+      error.addProperty("what", e.what());
+      error.addProperty("path", cachePath);
+      return error;
+   }
+
+   return Success();
+}
+
+Error writeSourceIndexCache(const FilePath& cachePath,
+                            const std::vector<CachedSourceIndex>& indexes)
+{
+   FilePath tempPath(cachePath.absolutePath() + ".tmp");
+
+   {
+      boost::shared_ptr<std::ostream> pStream;
+      Error error = tempPath.open_w(&pStream);
+      if (error)
+         return error;
+
+      try
+      {
+         pStream->exceptions(std::ostream::failbit | std::ostream::badbit);
+
+         pStream->write(kCacheMagic, 4);
+         CacheWriter writer(*pStream);
+         writer.writeUInt(kCacheVersion);
+         writer.writeUInt(indexes.size());
+         BOOST_FOREACH(const CachedSourceIndex& index, indexes)
+         {
+            writer.writeString(index.fileInfo.absolutePath());
+            writer.writeInt64(index.fileInfo.size());
+            writer.writeInt64(index.fileInfo.lastWriteTime());
+            writer.writeString(index.pIndex->context());
+
+            const std::vector<RSourceItem>& items = index.pIndex->items();
+            writer.writeUInt(items.size());
+            BOOST_FOREACH(const RSourceItem& item, items)
+            {
+               writer.writeItem(item);
+            }
+         }
+
+         pStream->flush();
+      }
+      catch(const std::exception& e)
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         error.addProperty("what", e.what());
+         error.addProperty("path", tempPath);
+         return error;
+      }
+   }
+
+   return tempPath.move(cachePath);
+}
+
+} // namespace r_util
+} // namespace core
+
@@ -0,0 +1,521 @@
+/*
+ * RSourceSymbolTable.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/r_util/RSourceSymbolTable.hpp>
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#include <core/RegexUtils.hpp>
+#include <core/StringUtils.hpp>
+
+namespace core {
+namespace r_util {
+
+namespace {
+
+// maximum number of recently added symbols to keep outside of the sorted
+// array (these are searched linearly)
+const std::size_t kMaxRecentSymbols = 4096;
+
+// length of the n-grams in the contains index
+const std::size_t kTrigramLength = 3;
+
+boost::uint32_t trigramAt(const std::string& str, std::size_t pos)
+{
+   return (static_cast<unsigned char>(str[pos]) << 16) |
+          (static_cast<unsigned char>(str[pos+1]) << 8) |
+          static_cast<unsigned char>(str[pos+2]);
+}
+
+// distinct trigrams of str
+void trigramsOf(const std::string& str, std::vector<boost::uint32_t>* pTrigrams)
+{
+   pTrigrams->clear();
+   if (str.size() < kTrigramLength)
+      return;
+
+   for (std::size_t i = 0; i <= str.size() - kTrigramLength; i++)
+      pTrigrams->push_back(trigramAt(str, i));
+
+   std::sort(pTrigrams->begin(), pTrigrams->end());
+   pTrigrams->erase(std::unique(pTrigrams->begin(), pTrigrams->end()),
+                    pTrigrams->end());
+}
+
+bool isGlobalFunction(const RSourceItem& item)
+{
+   return item.braceLevel() == 0 &&
+          (item.type() == RSourceItem::Function ||
+           item.type() == RSourceItem::Method);
+}
+
+// longest component of a wildcard pattern
+std::string longestLiteral(const std::string& pattern)
+{
+   std::string longest;
+   std::size_t begin = 0;
+   while (begin <= pattern.size())
+   {
+      std::size_t end = pattern.find('*', begin);
+      if (end == std::string::npos)
+         end = pattern.size();
+      if (end - begin > longest.size())
+         longest = pattern.substr(begin, end - begin);
+      begin = end + 1;
+   }
+   return longest;
+}
+
+// key for sorting by name (8 bytes of the name from offset in big-endian
+// order, so that most comparisons needn't touch the names themselves)
+boost::uint64_t sortKeyOf(const std::string& name, std::size_t offset)
+{
+   boost::uint64_t key = 0;
+   for (std::size_t i = offset; i < offset + 8; i++)
+   {
+      key <<= 8;
+      if (i < name.size())
+         key |= static_cast<unsigned char>(name[i]);
+   }
+   return key;
+}
+
+} // anonymous namespace
+
+struct RSourceSymbolTable::FoldedNameLess
+{
+   explicit FoldedNameLess(const std::vector<std::string>& names)
+      : names(names)
+   {
+   }
+
+   bool operator()(boost::uint32_t a, boost::uint32_t b) const
+   {
+      return names[a] < names[b];
+   }
+
+   // symbol with the first 16 bytes of its name
+   struct KeyedSymbol
+   {
+      KeyedSymbol(boost::uint32_t symbol, const std::string& name)
+         : key1(sortKeyOf(name, 0)), key2(sortKeyOf(name, 8)), symbol(symbol)
+      {
+      }
+      boost::uint64_t key1;
+      boost::uint64_t key2;
+      boost::uint32_t symbol;
+   };
+
+   bool operator()(const KeyedSymbol& a, const KeyedSymbol& b) const
+   {
+      if (a.key1 != b.key1)
+         return a.key1 < b.key1;
+      else if (a.key2 != b.key2)
+         return a.key2 < b.key2;
+      else
+         return names[a.symbol] < names[b.symbol];
+   }
+
+   bool operator()(boost::uint32_t a, const std::string& b) const
+   {
+      return names[a] < b;
+   }
+
+   bool operator()(const std::string& a, boost::uint32_t b) const
+   {
+      return a < names[b];
+   }
+
+   const std::vector<std::string>& names;
+};
+
+RSourceSymbolTable::RSourceSymbolTable()
+   : liveItems_(0)
+{
+}
+
+void RSourceSymbolTable::add(boost::shared_ptr<RSourceIndex> pIndex)
+{
+   remove(pIndex->context());
+
+   boost::uint32_t index = indexes_.size();
+   indexes_.push_back(IndexEntry(pIndex));
+   indexByContext_[pIndex->context()] = index;
+
+   std::vector<boost::uint32_t> trigrams;
+   const std::vector<RSourceItem>& items = pIndex->items();
+   for (std::size_t i = 0; i < items.size(); i++)
+   {
+      boost::uint32_t symbol = symbols_.size();
+      symbols_.push_back(Symbol(index, i));
+      foldedNames_.push_back(string_utils::toLower(items[i].name()));
+      recent_.push_back(symbol);
+
+      trigramsOf(foldedNames_.back(), &trigrams);
+      for (std::size_t j = 0; j < trigrams.size(); j++)
+         trigrams_[trigrams[j]].push_back(symbol);
+
+      if (isGlobalFunction(items[i]))
+         globalFunctions_.insert(std::make_pair(items[i].name(), symbol));
+   }
+
+   liveItems_ += items.size();
+}
+
+void RSourceSymbolTable::remove(const std::string& context)
+{
+   boost::unordered_map<std::string,boost::uint32_t>::iterator it =
+                                             indexByContext_.find(context);
+   if (it == indexByContext_.end())
+      return;
+
+   boost::uint32_t index = it->second;
+   indexByContext_.erase(it);
+
+   // mark the items as removed (they are skipped by searches)
+   IndexEntry& entry = indexes_[index];
+   entry.removed = true;
+   const std::vector<RSourceItem>& items = entry.pIndex->items();
+   liveItems_ -= items.size();
+
+   // (global functions are removed right away so lookups stay O(1))
+   for (std::size_t i = 0; i < items.size(); i++)
+   {
+      if (!isGlobalFunction(items[i]))
+         continue;
+
+      typedef boost::unordered_multimap<std::string,boost::uint32_t>::iterator
+                                                                  Iterator;
+      std::pair<Iterator,Iterator> range =
+                              globalFunctions_.equal_range(items[i].name());
+      for (Iterator fit = range.first; fit != range.second; )
+      {
+         if (symbols_[fit->second].index == index)
+            fit = globalFunctions_.erase(fit);
+         else
+            ++fit;
+      }
+   }
+
+   // drop the removed items once they make up half of the table
+   if (symbols_.size() - liveItems_ > liveItems_)
+      compact();
+}
+
+void RSourceSymbolTable::clear()
+{
+   indexes_.clear();
+   indexByContext_.clear();
+   symbols_.clear();
+   foldedNames_.clear();
+   liveItems_ = 0;
+   sorted_.clear();
+   recent_.clear();
+   trigrams_.clear();
+   globalFunctions_.clear();
+}
+
+void RSourceSymbolTable::search(const std::string& term,
+                                bool prefixOnly,
+                                const std::set<std::string>& excludeContexts,
+                                std::size_t maxResults,
+                                std::vector<RSourceItem>* pItems)
+{
+   if (maxResults == 0)
+      return;
+
+   std::string foldedTerm = string_utils::toLower(term);
+
+   // wildcard search (use the pattern's literal components to find
+   // candidates and then match them against the pattern)
+   if (foldedTerm.find('*') != std::string::npos)
+   {
+      boost::regex pattern = regex_utils::wildcardPatternToRegex(foldedTerm);
+      boost::function<bool(boost::uint32_t)> matches =
+         boost::bind(&RSourceSymbolTable::nameMatches,
+                     this, _1, pattern, prefixOnly);
+
+      // (prefer the prefix unless it is short and there is a longer
+      // literal to look up in the contains index)
+      std::string prefix = foldedTerm.substr(0, foldedTerm.find('*'));
+      std::string literal = longestLiteral(foldedTerm);
+      if (prefixOnly && !prefix.empty() &&
+          (prefix.size() >= kTrigramLength || literal.size() < kTrigramLength))
+      {
+         searchPrefix(prefix, matches, excludeContexts, maxResults, pItems);
+      }
+      else if (literal.size() >= kTrigramLength)
+         searchTrigrams(literal, matches, excludeContexts, maxResults, pItems);
+      else
+         searchAll(matches, excludeContexts, maxResults, pItems);
+   }
+   else if (prefixOnly)
+   {
+      searchPrefix(foldedTerm,
+                   boost::function<bool(boost::uint32_t)>(),
+                   excludeContexts,
+                   maxResults,
+                   pItems);
+   }
+   else
+   {
+      boost::function<bool(boost::uint32_t)> matches =
+         boost::bind(&RSourceSymbolTable::nameContains, this, _1, foldedTerm);
+
+      if (foldedTerm.size() >= kTrigramLength)
+      {
+         searchTrigrams(foldedTerm,
+                        matches,
+                        excludeContexts,
+                        maxResults,
+                        pItems);
+      }
+      else
+      {
+         searchAll(matches, excludeContexts, maxResults, pItems);
+      }
+   }
+}
+
+bool RSourceSymbolTable::findGlobalFunction(
+                              const std::string& name,
+                              const std::set<std::string>& excludeContexts,
+                              RSourceItem* pItem) const
+{
+   // when several indexes define the function use the one with the lowest
+   // context (i.e. path) so that results don't depend on hash order
+   typedef boost::unordered_multimap<std::string,boost::uint32_t>::const_iterator
+                                                                  Iterator;
+   std::pair<Iterator,Iterator> range = globalFunctions_.equal_range(name);
+   const RSourceIndex* pFoundIndex = NULL;
+   boost::uint32_t found = 0;
+   for (Iterator it = range.first; it != range.second; ++it)
+   {
+      const RSourceIndex* pIndex =
+                     indexes_[symbols_[it->second].index].pIndex.get();
+      if (excludeContexts.find(pIndex->context()) != excludeContexts.end())
+         continue;
+
+      if (pFoundIndex == NULL ||
+          pIndex->context() < pFoundIndex->context() ||
+          (pIndex == pFoundIndex && it->second < found))
+      {
+         pFoundIndex = pIndex;
+         found = it->second;
+      }
+   }
+
+   if (pFoundIndex == NULL)
+      return false;
+
+   *pItem = itemOf(found).withContext(pFoundIndex->context());
+   return true;
+}
+
+bool RSourceSymbolTable::isLive(boost::uint32_t symbol) const
+{
+   return !indexes_[symbols_[symbol].index].removed;
+}
+
+const RSourceItem& RSourceSymbolTable::itemOf(boost::uint32_t symbol) const
+{
+   const Symbol& sym = symbols_[symbol];
+   return indexes_[sym.index].pIndex->items()[sym.item];
+}
+
+// add a result (returns true once maxResults have been found)
+bool RSourceSymbolTable::addResult(
+                           boost::uint32_t symbol,
+                           const std::set<std::string>& excludeContexts,
+                           std::size_t maxResults,
+                           std::vector<RSourceItem>* pItems) const
+{
+   const std::string& context =
+                     indexes_[symbols_[symbol].index].pIndex->context();
+   if (excludeContexts.find(context) == excludeContexts.end())
+      pItems->push_back(itemOf(symbol).withContext(context));
+
+   return pItems->size() >= maxResults;
+}
+
+void RSourceSymbolTable::merge()
+{
+   mergeRecent();
+}
+
+void RSourceSymbolTable::mergeRecent()
+{
+   if (recent_.empty())
+      return;
+
+   FoldedNameLess less(foldedNames_);
+
+   // sort the symbols which haven't been removed
+   std::vector<FoldedNameLess::KeyedSymbol> keyed;
+   keyed.reserve(recent_.size());
+   for (std::size_t i = 0; i < recent_.size(); i++)
+   {
+      if (isLive(recent_[i]))
+      {
+         keyed.push_back(FoldedNameLess::KeyedSymbol(
+                                    recent_[i], foldedNames_[recent_[i]]));
+      }
+   }
+   std::sort(keyed.begin(), keyed.end(), less);
+   recent_.clear();
+   for (std::size_t i = 0; i < keyed.size(); i++)
+      recent_.push_back(keyed[i].symbol);
+
+   // merge into the sorted symbols
+   std::size_t middle = sorted_.size();
+   sorted_.insert(sorted_.end(), recent_.begin(), recent_.end());
+   std::inplace_merge(sorted_.begin(),
+                      sorted_.begin() + middle,
+                      sorted_.end(),
+                      less);
+   recent_.clear();
+}
+
+void RSourceSymbolTable::compact()
+{
+   std::vector<boost::shared_ptr<RSourceIndex> > liveIndexes;
+   for (std::size_t i = 0; i < indexes_.size(); i++)
+   {
+      if (!indexes_[i].removed)
+         liveIndexes.push_back(indexes_[i].pIndex);
+   }
+
+   clear();
+   std::for_each(liveIndexes.begin(),
+                 liveIndexes.end(),
+                 boost::bind(&RSourceSymbolTable::add, this, _1));
+}
+
+bool RSourceSymbolTable::searchPrefix(
+                  const std::string& prefix,
+                  const boost::function<bool(boost::uint32_t)>& matches,
+                  const std::set<std::string>& excludeContexts,
+                  std::size_t maxResults,
+                  std::vector<RSourceItem>* pItems)
+{
+   if (recent_.size() > kMaxRecentSymbols)
+      mergeRecent();
+
+   // symbols with the prefix are contiguous within the sorted symbols
+   std::vector<boost::uint32_t>::const_iterator it =
+      std::lower_bound(sorted_.begin(),
+                       sorted_.end(),
+                       prefix,
+                       FoldedNameLess(foldedNames_));
+   for ( ; it != sorted_.end() && nameHasPrefix(*it, prefix); ++it)
+   {
+      if (isLive(*it) && (!matches || matches(*it)))
+      {
+         if (addResult(*it, excludeContexts, maxResults, pItems))
+            return true;
+      }
+   }
+
+   for (it = recent_.begin(); it != recent_.end(); ++it)
+   {
+      if (isLive(*it) &&
+          nameHasPrefix(*it, prefix) &&
+          (!matches || matches(*it)))
+      {
+         if (addResult(*it, excludeContexts, maxResults, pItems))
+            return true;
+      }
+   }
+
+   return false;
+}
+
+bool RSourceSymbolTable::searchTrigrams(
+                  const std::string& literal,
+                  const boost::function<bool(boost::uint32_t)>& matches,
+                  const std::set<std::string>& excludeContexts,
+                  std::size_t maxResults,
+                  std::vector<RSourceItem>* pItems)
+{
+   // candidates are the symbols containing the literal's least common
+   // trigram (if any of its trigrams are absent nothing can match)
+   std::vector<boost::uint32_t> trigrams;
+   trigramsOf(literal, &trigrams);
+   const PostingList* pCandidates = NULL;
+   for (std::size_t i = 0; i < trigrams.size(); i++)
+   {
+      boost::unordered_map<boost::uint32_t,PostingList>::const_iterator it =
+                                                trigrams_.find(trigrams[i]);
+      if (it == trigrams_.end())
+         return false;
+
+      if (pCandidates == NULL || it->second.size() < pCandidates->size())
+         pCandidates = &(it->second);
+   }
+
+   for (PostingList::const_iterator it = pCandidates->begin();
+        it != pCandidates->end(); ++it)
+   {
+      if (isLive(*it) && matches(*it))
+      {
+         if (addResult(*it, excludeContexts, maxResults, pItems))
+            return true;
+      }
+   }
+
+   return false;
+}
+
+void RSourceSymbolTable::searchAll(
+                  const boost::function<bool(boost::uint32_t)>& matches,
+                  const std::set<std::string>& excludeContexts,
+                  std::size_t maxResults,
+                  std::vector<RSourceItem>* pItems)
+{
+   for (boost::uint32_t symbol = 0; symbol < symbols_.size(); symbol++)
+   {
+      if (isLive(symbol) && matches(symbol))
+      {
+         if (addResult(symbol, excludeContexts, maxResults, pItems))
+            return;
+      }
+   }
+}
+
+bool RSourceSymbolTable::nameHasPrefix(boost::uint32_t symbol,
+                                       const std::string& prefix) const
+{
+   return foldedNames_[symbol].compare(0, prefix.size(), prefix) == 0;
+}
+
+bool RSourceSymbolTable::nameContains(boost::uint32_t symbol,
+                                      const std::string& term) const
+{
+   return foldedNames_[symbol].find(term) != std::string::npos;
+}
+
+bool RSourceSymbolTable::nameMatches(boost::uint32_t symbol,
+                                     const boost::regex& regex,
+                                     bool prefixOnly) const
+{
+   return regex_utils::textMatches(foldedNames_[symbol],
+                                   regex,
+                                   prefixOnly,
+                                   true);
+}
+
+} // namespace r_util
+} // namespace core
+
@@ -140,6 +140,17 @@ Error HMAC_SHA1(const std::string& data,
    }
 }
 
+bool constantTimeEquals(const std::string& lhs, const std::string& rhs)
+{
+   if (lhs.size() != rhs.size())
+      return false;
+
+   volatile unsigned char difference = 0;
+   for (std::size_t i = 0; i < lhs.size(); i++)
+      difference |= static_cast<unsigned char>(lhs[i] ^ rhs[i]);
+   return difference == 0;
+}
+
 Error base64Encode(const std::vector<unsigned char>& data, 
                    std::string* pEncoded)
 {
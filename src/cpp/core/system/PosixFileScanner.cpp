@@ -14,8 +14,13 @@
 #include <core/system/FileScanner.hpp>
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+
 #include <boost/foreach.hpp>
 
 #include <core/Error.hpp>
@@ -27,55 +32,179 @@ namespace core {
 namespace system {
 
 namespace {
+
+// number of seconds a directory must have been unmodified before its
+// modification time is used to validate a listing of it (to allow for
+// file systems with coarse timestamps)
+const std::time_t kMinListingStampAge = 2;
+
+boost::int64_t modificationStamp(const struct stat& st)
+{
 #ifdef __APPLE__
-int entryFilter(struct dirent *entry)
+   return boost::int64_t(st.st_mtimespec.tv_sec) * 1000000000 +
+          st.st_mtimespec.tv_nsec;
 #else
-int entryFilter(const struct dirent *entry)
+   return boost::int64_t(st.st_mtim.tv_sec) * 1000000000 +
+          st.st_mtim.tv_nsec;
 #endif
+}
+
+std::time_t modificationTime(const struct stat& st)
 {
-   if (::strcmp(entry->d_name, ".") == 0 || ::strcmp(entry->d_name, "..") == 0)
-      return 0;
-   else
-      return 1;
+#ifdef __APPLE__
+   return st.st_mtimespec.tv_sec;
+#else
+   return st.st_mtime;
+#endif
 }
 
-// wrapper for scandir api
-Error scanDir(const std::string& dirPath, std::vector<std::string>* pNames)
+struct DirectoryEntry
 {
-   // read directory contents into namelist
-   struct dirent **namelist;
-   int entries = ::scandir(dirPath.c_str(),
-                           &namelist,
-                           entryFilter,
-                           ::alphasort);
-   if (entries == -1)
+   std::string name;
+   struct stat st;
+   bool isSymlink;
+};
+
+// sort using strcoll (for compatibility with alphasort, which we used
+// when we listed directories using scandir)
+bool entryNameLessThan(const DirectoryEntry* pA, const DirectoryEntry* pB)
+{
+   return ::strcoll(pA->name.c_str(), pB->name.c_str()) < 0;
+}
+
+// stat an entry relative to its directory (no following symlinks)
+int statEntry(int dirFd,
+              const std::string& dirPath,
+              const char* name,
+              struct stat* pSt)
+{
+#ifdef AT_SYMLINK_NOFOLLOW
+   return ::fstatat(dirFd, name, pSt, AT_SYMLINK_NOFOLLOW);
+#else
+   std::string path = dirPath + "/" + name;
+   return ::lstat(path.c_str(), pSt);
+#endif
+}
+
+// stat the target of a symlink relative to its directory
+int statLinkTarget(int dirFd,
+                   const std::string& dirPath,
+                   const char* name,
+                   struct stat* pSt)
+{
+#ifdef AT_SYMLINK_NOFOLLOW
+   return ::fstatat(dirFd, name, pSt, 0);
+#else
+   std::string path = dirPath + "/" + name;
+   return ::stat(path.c_str(), pSt);
+#endif
+}
+
+} // anonymous namespace
+
+Error listDirectory(const std::string& dirPath, DirectoryListing* pListing)
+{
+   pListing->path = dirPath;
+   pListing->stamp = 0;
+   pListing->entries.clear();
+
+   DIR* pDir = ::opendir(dirPath.c_str());
+   if (pDir == NULL)
    {
       Error error = systemError(errno, ERROR_LOCATION);
       error.addProperty("path", dirPath);
       return error;
    }
+   int dirFd = ::dirfd(pDir);
 
-   // extract the namelist then free it
-   for(int i=0; i<entries; i++)
+   // stamp the listing with the directory's modification time (provided it
+   // isn't so recent that it could change again within the same tick)
+   struct stat dirSt;
+   if (::fstat(dirFd, &dirSt) == 0 &&
+       modificationTime(dirSt) + kMinListingStampAge < ::time(NULL))
    {
-      // get the name (then free it)
-      std::string name(namelist[i]->d_name,
-#ifdef __APPLE__
-                       namelist[i]->d_namlen);
-#else
-                       namelist[i]->d_reclen);
-#endif
-      ::free(namelist[i]);
+      pListing->stamp = modificationStamp(dirSt);
+   }
+
+   // read the entries
+   std::vector<DirectoryEntry> entries;
+   DirectoryEntry entry;
+   for (struct dirent* pEntry = ::readdir(pDir);
+        pEntry != NULL;
+        pEntry = ::readdir(pDir))
+   {
+      const char* name = pEntry->d_name;
+      if (::strcmp(name, ".") == 0 || ::strcmp(name, "..") == 0)
+         continue;
+
+      if (statEntry(dirFd, dirPath, name, &entry.st) == -1)
+      {
+         // (entries can be removed while we list)
+         if (errno != ENOENT)
+         {
+            Error error = systemError(errno, ERROR_LOCATION);
+            error.addProperty("path", dirPath + "/" + name);
+            LOG_ERROR(error);
+         }
+         continue;
+      }
 
-      // add to the vector
-      pNames->push_back(name);
+      entry.isSymlink = S_ISLNK(entry.st.st_mode);
+      if (entry.isSymlink)
+      {
+         struct stat targetSt;
+         if (statLinkTarget(dirFd, dirPath, name, &targetSt) == 0)
+            entry.st = targetSt;
+      }
+
+      entry.name = name;
+      entries.push_back(entry);
+   }
+   ::closedir(pDir);
+
+   // sort the entries then create their FileInfos
+   std::vector<const DirectoryEntry*> sorted;
+   sorted.reserve(entries.size());
+   for (std::size_t i = 0; i < entries.size(); i++)
+      sorted.push_back(&entries[i]);
+   std::sort(sorted.begin(), sorted.end(), entryNameLessThan);
+
+   std::string prefix = dirPath;
+   if (prefix.empty() || prefix[prefix.size() - 1] != '/')
+      prefix.push_back('/');
+
+   pListing->entries.reserve(sorted.size());
+   BOOST_FOREACH(const DirectoryEntry* pEntry, sorted)
+   {
+      std::string path = prefix + pEntry->name;
+      if (S_ISDIR(pEntry->st.st_mode))
+      {
+         pListing->entries.push_back(FileInfo(path, true, pEntry->isSymlink));
+      }
+      else
+      {
+         pListing->entries.push_back(FileInfo(path,
+                                              false,
+                                              pEntry->st.st_size,
+                                              modificationTime(pEntry->st),
+                                              pEntry->isSymlink));
+      }
    }
-   ::free(namelist);
 
    return Success();
 }
 
-} // anonymous namespace
+bool isListingCurrent(const DirectoryListing& listing)
+{
+   if (listing.stamp == 0)
+      return false;
+
+   struct stat st;
+   if (::stat(listing.path.c_str(), &st) == -1)
+      return false;
+
+   return modificationStamp(st) == listing.stamp;
+}
 
 Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
                 const FileScannerOptions& options,
@@ -84,9 +213,6 @@ Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
    // clear all existing
    pTree->erase_children(fromNode);
 
-   // create FilePath for root
-   FilePath rootPath(fromNode->absolutePath());
-
    // yield if requested (only applies to recursive scans)
    if (options.recursive && options.yield)
       boost::this_thread::yield();
@@ -99,49 +225,28 @@ Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
          return error;
    }
 
-   // read directory contents
-   std::vector<std::string> names;
-   Error error = scanDir(fromNode->absolutePath(), &names);
-   if (error)
-      return error;
-
-   // iterate over the names
-   BOOST_FOREACH(const std::string& name, names)
+   // read directory contents (using the existing listing of the root if
+   // it's still current -- note we check this after onBeforeScanDir so
+   // that changes after the check are seen by file monitors)
+   std::string dirPath = fromNode->absolutePath();
+   DirectoryListing listing;
+   const DirectoryListing* pListing = &listing;
+   if (options.pRootListing &&
+       options.pRootListing->path == dirPath &&
+       isListingCurrent(*options.pRootListing))
    {
-      // compute the path
-      std::string path = rootPath.childPath(name).absolutePath();
-
-      // get the attributes
-      struct stat st;
-      int res = ::lstat(path.c_str(), &st);
-      if (res == -1)
-      {
-         Error error = systemError(errno, ERROR_LOCATION);
-         error.addProperty("path", path);
-         LOG_ERROR(error);
-         continue;
-      }
-
-      // create the FileInfo
-      FileInfo fileInfo;
-      bool isSymlink = S_ISLNK(st.st_mode);
-      if (S_ISDIR(st.st_mode))
-      {
-         fileInfo = FileInfo(path, true, isSymlink);
-      }
-      else
-      {
-         fileInfo = FileInfo(path,
-                             false,
-                             st.st_size,
-#ifdef __APPLE__
-                             st.st_mtimespec.tv_sec,
-#else
-                             st.st_mtime,
-#endif
-                             isSymlink);
-      }
+      pListing = options.pRootListing.get();
+   }
+   else
+   {
+      Error error = listDirectory(dirPath, &listing);
+      if (error)
+         return error;
+   }
 
+   // iterate over the entries
+   BOOST_FOREACH(const FileInfo& fileInfo, pListing->entries)
+   {
       // apply the filter (if any)
       if (!options.filter || options.filter(fileInfo))
       {
@@ -55,9 +55,49 @@ FileInfo convertToFileInfo(const FilePath& filePath, bool yield, int *pCount)
    }
 }
 
+Error listDirectory(const std::string& dirPath,
+                    bool yield,
+                    DirectoryListing* pListing)
+{
+   pListing->path = dirPath;
+   pListing->stamp = 0;
+   pListing->entries.clear();
+
+   // read directory entries
+   std::vector<FilePath> children;
+   Error error = FilePath(dirPath).children(&children);
+   if (error)
+      return error;
+
+   // convert to FileInfo and sort using alphasort equivilant (for
+   // compatability with scandir, which is what is used in our
+   // posix-specific implementation
+   int count = 0;
+   std::transform(children.begin(),
+                  children.end(),
+                  std::back_inserter(pListing->entries),
+                  boost::bind(convertToFileInfo, _1, yield, &count));
+   std::sort(pListing->entries.begin(),
+             pListing->entries.end(),
+             fileInfoPathLessThan);
+
+   return Success();
+}
+
 } // anonymous namespace
 
 
+Error listDirectory(const std::string& dirPath, DirectoryListing* pListing)
+{
+   return listDirectory(dirPath, false, pListing);
+}
+
+// (listings aren't stamped on windows so are never current)
+bool isListingCurrent(const DirectoryListing&)
+{
+   return false;
+}
+
 // NOTE: we bail with an error if the top level directory can't be
 // enumerated however we merely log errors for children. this reflects
 // the notion that a top-level failure will report major problems
@@ -73,9 +113,6 @@ Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
    // clear all existing
    pTree->erase_children(fromNode);
 
-   // create FilePath for root
-   FilePath rootPath(fromNode->absolutePath());
-
    // yield if requested (only applies to recursive scans)
    if (options.recursive && options.yield)
       boost::this_thread::yield();
@@ -89,23 +126,13 @@ Error scanFiles(const tree<FileInfo>::iterator_base& fromNode,
    }
 
    // read directory entries
-   std::vector<FilePath> children;
-   Error error = rootPath.children(&children);
+   DirectoryListing listing;
+   Error error = listDirectory(fromNode->absolutePath(),
+                               options.yield,
+                               &listing);
    if (error)
       return error;
-
-   // convert to FileInfo and sort using alphasort equivilant (for
-   // compatability with scandir, which is what is used in our
-   // posix-specific implementation
-   int count = 0;
-   std::vector<FileInfo> childrenFileInfo;
-   std::transform(children.begin(),
-                  children.end(),
-                  std::back_inserter(childrenFileInfo),
-                  boost::bind(convertToFileInfo, _1, options.yield, &count));
-   std::sort(childrenFileInfo.begin(),
-             childrenFileInfo.end(),
-             fileInfoPathLessThan);
+   const std::vector<FileInfo>& childrenFileInfo = listing.entries;
 
    // iterate over entries
    BOOST_FOREACH(const FileInfo& childFileInfo, childrenFileInfo)
@@ -387,7 +387,8 @@ void run(const boost::function<void()>& checkForInput);
 Handle registerMonitor(const core::FilePath& filePath,
                        bool recursive,
                        const boost::function<bool(const FileInfo&)>& filter,
-                       const Callbacks& callbacks);
+                       const Callbacks& callbacks,
+                       boost::shared_ptr<const DirectoryListing> pRootListing);
 
 // unregister a file monitor
 void unregisterMonitor(Handle handle);
@@ -415,12 +416,14 @@ public:
    RegistrationCommand(const core::FilePath& filePath,
                        bool recursive,
                        const boost::function<bool(const FileInfo&)>& filter,
-                       const Callbacks& callbacks)
+                       const Callbacks& callbacks,
+                       boost::shared_ptr<const DirectoryListing> pRootListing)
       : type_(Register),
         filePath_(filePath),
         recursive_(recursive),
         filter_(filter),
-        callbacks_(callbacks)
+        callbacks_(callbacks),
+        pRootListing_(pRootListing)
    {
    }
 
@@ -438,6 +441,10 @@ public:
       return filter_;
    }
    const Callbacks& callbacks() const { return callbacks_; }
+   boost::shared_ptr<const DirectoryListing> rootListing() const
+   {
+      return pRootListing_;
+   }
 
    Handle handle() const
    {
@@ -453,6 +460,7 @@ private:
    bool recursive_;
    boost::function<bool(const FileInfo&)> filter_;
    Callbacks callbacks_;
+   boost::shared_ptr<const DirectoryListing> pRootListing_;
 
    // unregister command data
    Handle handle_;
@@ -491,7 +499,8 @@ void checkForInput()
          Handle handle = detail::registerMonitor(command.filePath(),
                                                  command.recursive(),
                                                  command.filter(),
-                                                 command.callbacks());
+                                                 command.callbacks(),
+                                                 command.rootListing());
          if (!handle.empty())
             s_activeHandles.push_back(handle);
          break;
@@ -633,7 +642,9 @@ void stop()
 void registerMonitor(const FilePath& filePath,
                      bool recursive,
                      const boost::function<bool(const FileInfo&)>& filter,
-                     const Callbacks& callbacks)
+                     const Callbacks& callbacks,
+                     const boost::shared_ptr<const DirectoryListing>&
+                                                               pRootListing)
 {
    // bind a new version of the callbacks that puts them on the callback queue
    Callbacks qCallbacks;
@@ -651,7 +662,8 @@ void registerMonitor(const FilePath& filePath,
    registrationCommandQueue().enque(RegistrationCommand(filePath,
                                                         recursive,
                                                         filter,
-                                                        qCallbacks));
+                                                        qCallbacks,
+                                                        pRootListing));
 }
 
 void unregisterMonitor(Handle handle)
@@ -425,7 +425,8 @@ namespace detail {
 Handle registerMonitor(const core::FilePath& filePath,
                        bool recursive,
                        const boost::function<bool(const FileInfo&)>& filter,
-                       const Callbacks& callbacks)
+                       const Callbacks& callbacks,
+                       boost::shared_ptr<const DirectoryListing> pRootListing)
 {
    // create and allocate FileEventContext (create auto-ptr in case we
    // return early, we'll call release later before returning)
@@ -466,6 +467,7 @@ Handle registerMonitor(const core::FilePath& filePath,
    options.recursive = recursive;
    options.yield = true;
    options.filter = filter;
+   options.pRootListing = pRootListing;
    options.onBeforeScanDir = addWatchFunction(pContext, true);
    Error error = scanFiles(FileInfo(filePath), options, &pContext->fileTree);
    if (error)
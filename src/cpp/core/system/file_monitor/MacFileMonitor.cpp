@@ -160,7 +160,8 @@ namespace detail {
 Handle registerMonitor(const FilePath& filePath,
                        bool recursive,
                        const boost::function<bool(const FileInfo&)>& filter,
-                       const Callbacks& callbacks)
+                       const Callbacks& callbacks,
+                       boost::shared_ptr<const DirectoryListing> pRootListing)
 {
    // allocate file path
    CFStringRef filePathRef = ::CFStringCreateWithCString(
@@ -244,6 +245,7 @@ Handle registerMonitor(const FilePath& filePath,
    options.recursive = recursive;
    options.yield = true;
    options.filter = filter;
+   options.pRootListing = pRootListing;
    Error error = scanFiles(FileInfo(filePath), options, &pContext->fileTree);
    if (error)
    {
@@ -0,0 +1,440 @@
+/*
+ * TextSearch.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/TextSearch.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <boost/bind.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/Log.hpp>
+#include <core/Thread.hpp>
+
+namespace core {
+namespace text {
+
+namespace {
+
+// files with a NUL within this many bytes are considered binary
+const std::size_t kBinaryCheckBytes = 8192;
+
+// files larger than this are memory mapped rather than read
+const std::size_t kMaxReadBytes = 64 * 1024;
+
+// maximum length of the line text returned with a match
+const std::size_t kMaxLineText = 300;
+
+inline char foldCase(char ch)
+{
+   return (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+}
+
+inline char unfoldCase(char ch)
+{
+   return (ch >= 'a' && ch <= 'z') ? ch - ('a' - 'A') : ch;
+}
+
+const char* lineStart(const char* begin, const char* pos)
+{
+   while (pos > begin && *(pos - 1) != '\n')
+      --pos;
+   return pos;
+}
+
+const char* lineEnd(const char* pos, const char* end)
+{
+   const char* newline = static_cast<const char*>(
+                                 std::memchr(pos, '\n', end - pos));
+   return newline != NULL ? newline : end;
+}
+
+// number of UTF-8 characters in [begin,end)
+int charCount(const char* begin, const char* end)
+{
+   int count = 0;
+   for (const char* it = begin; it < end; ++it)
+   {
+      if ((static_cast<unsigned char>(*it) & 0xC0) != 0x80)
+         count++;
+   }
+   return count;
+}
+
+Error searchFile(const FilePath& filePath,
+                 const TextMatcher& matcher,
+                 std::size_t maxMatches,
+                 std::vector<char>* pBuffer,
+                 std::vector<LineMatch>* pMatches)
+{
+   // read small files into the buffer (which is reused between files) and
+   // map larger ones (reading is cheaper than mapping for small files)
+   std::FILE* pFile = std::fopen(filePath.absolutePath().c_str(), "rb");
+   if (pFile == NULL)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", filePath);
+      return error;
+   }
+   pBuffer->resize(kMaxReadBytes + 1);
+   std::size_t bytesRead = std::fread(&(*pBuffer)[0], 1, pBuffer->size(),
+                                      pFile);
+   std::fclose(pFile);
+
+   boost::iostreams::mapped_file_source file;
+   const char* begin = &(*pBuffer)[0];
+   const char* end = begin + bytesRead;
+   if (bytesRead > kMaxReadBytes)
+   {
+      try
+      {
+         file.open(filePath.absolutePath());
+      }
+      catch(const std::exception& e)
+      {
+         Error error = systemError(boost::system::errc::io_error,
+                                   ERROR_LOCATION);
+         error.addProperty("path", filePath);
+         error.addProperty("what", e.what());
+         return error;
+      }
+
+      begin = file.data();
+      end = begin + file.size();
+   }
+
+   // skip binary files
+   if (std::memchr(begin, '\0', std::min<std::size_t>(end - begin,
+                                                      kBinaryCheckBytes)))
+      return Success();
+
+   int lineNumber = 1;
+   const char* counted = begin;
+   std::vector<std::size_t> matchOn, matchOff;
+   for (const char* pos = begin;
+        pos < end && pMatches->size() < maxMatches; )
+   {
+      const char* line = matcher.findLine(pos, end);
+      if (line == end)
+         break;
+
+      const char* eol = lineEnd(line, end);
+      lineNumber += std::count(counted, line, '\n');
+      counted = line;
+
+      matchOn.clear();
+      matchOff.clear();
+      matcher.findInLine(line, eol, &matchOn, &matchOff);
+
+      // trim the line (and the matches to the trimmed line)
+      const char* textEnd = eol;
+      if (textEnd > line && *(textEnd - 1) == '\r')
+         --textEnd;
+      if (static_cast<std::size_t>(textEnd - line) > kMaxLineText)
+      {
+         textEnd = line + kMaxLineText;
+         while (textEnd > line &&
+                (static_cast<unsigned char>(*textEnd) & 0xC0) == 0x80)
+            --textEnd;
+      }
+
+      LineMatch lineMatch;
+      lineMatch.line = lineNumber;
+      lineMatch.lineText.assign(line, textEnd);
+      for (std::size_t i = 0; i < matchOn.size(); i++)
+      {
+         if (line + matchOn[i] >= textEnd)
+            break;
+         const char* off = std::min(line + matchOff[i], textEnd);
+         lineMatch.matchOn.push_back(charCount(line, line + matchOn[i]));
+         lineMatch.matchOff.push_back(charCount(line, off));
+      }
+      if (!matchOn.empty())
+         pMatches->push_back(lineMatch);
+
+      pos = eol + 1;
+   }
+
+   return Success();
+}
+
+// state shared by the threads of a search
+struct SearchState
+{
+   SearchState(const std::vector<FilePath>& files,
+               const TextMatcher& matcher,
+               std::size_t maxMatchesPerFile,
+               const boost::function<bool(const FilePath&,
+                                     const std::vector<LineMatch>&)>& onMatches,
+               const boost::function<bool()>& isCancelled)
+      : files(files),
+        matcher(matcher),
+        maxMatchesPerFile(maxMatchesPerFile),
+        onMatches(onMatches),
+        isCancelled(isCancelled),
+        nextFile(0),
+        stopped(false)
+   {
+   }
+
+   const std::vector<FilePath>& files;
+   const TextMatcher& matcher;
+   std::size_t maxMatchesPerFile;
+   boost::function<bool(const FilePath&,
+                        const std::vector<LineMatch>&)> onMatches;
+   boost::function<bool()> isCancelled;
+
+   boost::mutex mutex;
+   std::size_t nextFile;
+   bool stopped;
+};
+
+void stopSearch(SearchState* pState)
+{
+   LOCK_MUTEX(pState->mutex)
+   {
+      pState->stopped = true;
+   }
+   END_LOCK_MUTEX
+}
+
+bool nextFile(SearchState* pState, std::size_t* pFile)
+{
+   // (cancellation is checked without our lock held as the predicate may
+   // take locks of its own)
+   if (pState->isCancelled && pState->isCancelled())
+      stopSearch(pState);
+
+   LOCK_MUTEX(pState->mutex)
+   {
+      if (pState->stopped || pState->nextFile >= pState->files.size())
+         return false;
+
+      *pFile = pState->nextFile++;
+      return true;
+   }
+   END_LOCK_MUTEX
+
+   return false;
+}
+
+void searchThreadMain(SearchState* pState)
+{
+   try
+   {
+      std::size_t file;
+      std::vector<char> buffer;
+      std::vector<LineMatch> matches;
+      while (nextFile(pState, &file))
+      {
+         const FilePath& filePath = pState->files[file];
+
+         matches.clear();
+         Error error = searchFile(filePath,
+                                  pState->matcher,
+                                  pState->maxMatchesPerFile,
+                                  &buffer,
+                                  &matches);
+         if (error)
+         {
+            // (files can be removed while we search)
+            if (error.code() != boost::system::errc::no_such_file_or_directory)
+               LOG_ERROR(error);
+            continue;
+         }
+
+         if (!matches.empty() && !pState->onMatches(filePath, matches))
+            stopSearch(pState);
+      }
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+} // anonymous namespace
+
+Error TextMatcher::initialize(const std::string& pattern,
+                              bool isRegex,
+                              bool ignoreCase)
+{
+   if (pattern.empty())
+      return systemError(boost::system::errc::invalid_argument,
+                         ERROR_LOCATION);
+
+   isRegex_ = isRegex;
+   ignoreCase_ = ignoreCase;
+
+   if (isRegex)
+   {
+      try
+      {
+         boost::regex::flag_type flags = boost::regex::ECMAScript;
+         if (ignoreCase)
+            flags |= boost::regex::icase;
+         regex_.assign(pattern, flags);
+      }
+      catch(const boost::regex_error& e)
+      {
+         Error error = systemError(boost::system::errc::invalid_argument,
+                                   ERROR_LOCATION);
+         error.addProperty("pattern", pattern);
+         error.addProperty("what", e.what());
+         return error;
+      }
+   }
+   else
+   {
+      // build the Boyer-Moore-Horspool skip table
+      literal_ = pattern;
+      if (ignoreCase)
+         std::transform(literal_.begin(), literal_.end(),
+                        literal_.begin(), foldCase);
+
+      std::size_t n = literal_.size();
+      skip_.assign(256, n);
+      for (std::size_t i = 0; i + 1 < n; i++)
+      {
+         skip_[static_cast<unsigned char>(literal_[i])] = n - 1 - i;
+         if (ignoreCase)
+            skip_[static_cast<unsigned char>(unfoldCase(literal_[i]))] =
+                                                                  n - 1 - i;
+      }
+   }
+
+   return Success();
+}
+
+const char* TextMatcher::findLiteral(const char* begin, const char* end) const
+{
+   std::size_t n = literal_.size();
+   if (static_cast<std::size_t>(end - begin) < n)
+      return end;
+
+   const char* last = end - n;
+   for (const char* pos = begin; pos <= last; )
+   {
+      std::size_t i = n - 1;
+      while ((ignoreCase_ ? foldCase(pos[i]) : pos[i]) == literal_[i])
+      {
+         if (i == 0)
+            return pos;
+         --i;
+      }
+
+      pos += skip_[static_cast<unsigned char>(pos[n - 1])];
+   }
+
+   return end;
+}
+
+const char* TextMatcher::findLine(const char* begin, const char* end) const
+{
+   if (isRegex_)
+   {
+      // (a match can span lines so the line is checked by findInLine)
+      boost::cmatch match;
+      if (boost::regex_search(begin, end, match, regex_,
+                              boost::match_not_dot_newline))
+         return lineStart(begin, match[0].first);
+      else
+         return end;
+   }
+   else
+   {
+      const char* match = findLiteral(begin, end);
+      if (match == end)
+         return end;
+      else
+         return lineStart(begin, match);
+   }
+}
+
+void TextMatcher::findInLine(const char* begin,
+                             const char* end,
+                             std::vector<std::size_t>* pMatchOn,
+                             std::vector<std::size_t>* pMatchOff) const
+{
+   if (isRegex_)
+   {
+      boost::cregex_iterator it(begin, end, regex_,
+                                boost::match_not_dot_newline);
+      boost::cregex_iterator itEnd;
+      for ( ; it != itEnd; ++it)
+      {
+         std::size_t on = (*it)[0].first - begin;
+         pMatchOn->push_back(on);
+         pMatchOff->push_back(on + (*it)[0].length());
+      }
+   }
+   else
+   {
+      for (const char* pos = begin; pos < end; )
+      {
+         const char* match = findLiteral(pos, end);
+         if (match == end)
+            break;
+
+         pMatchOn->push_back(match - begin);
+         pMatchOff->push_back(match - begin + literal_.size());
+         pos = match + literal_.size();
+      }
+   }
+}
+
+Error searchFile(const FilePath& filePath,
+                 const TextMatcher& matcher,
+                 std::size_t maxMatches,
+                 std::vector<LineMatch>* pMatches)
+{
+   std::vector<char> buffer;
+   return searchFile(filePath, matcher, maxMatches, &buffer, pMatches);
+}
+
+void searchFiles(
+      const std::vector<FilePath>& files,
+      const TextMatcher& matcher,
+      std::size_t maxMatchesPerFile,
+      int threads,
+      const boost::function<bool(const FilePath&,
+                                 const std::vector<LineMatch>&)>& onMatches,
+      const boost::function<bool()>& isCancelled)
+{
+   SearchState state(files, matcher, maxMatchesPerFile, onMatches, isCancelled);
+
+   // start the additional threads (the calling thread also searches)
+   std::vector<boost::shared_ptr<boost::thread> > pool;
+   for (int i = 1; i < threads; i++)
+   {
+      boost::shared_ptr<boost::thread> pThread(new boost::thread());
+      core::thread::safeLaunchThread(boost::bind(searchThreadMain, &state),
+                                     pThread.get());
+      pool.push_back(pThread);
+   }
+
+   searchThreadMain(&state);
+
+   for (std::size_t i = 0; i < pool.size(); i++)
+   {
+      if (pool[i]->joinable())
+         pool[i]->join();
+   }
+}
+
+} // namespace text
+} // namespace core
+
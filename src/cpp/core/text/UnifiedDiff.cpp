@@ -0,0 +1,282 @@
+/*
+ * UnifiedDiff.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include <core/text/UnifiedDiff.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+namespace core {
+namespace text {
+
+namespace {
+
+bool startsWith(const char* begin, const char* end, const char* prefix)
+{
+   std::size_t length = std::strlen(prefix);
+   return static_cast<std::size_t>(end - begin) >= length &&
+          std::equal(prefix, prefix + length, begin);
+}
+
+const char* skipSpaces(const char* pos, const char* end)
+{
+   while (pos < end && *pos == ' ')
+      ++pos;
+   return pos;
+}
+
+bool parseNumber(const char** pPos, const char* end, int* pNumber)
+{
+   const char* pos = *pPos;
+   if (pos == end || *pos < '0' || *pos > '9')
+      return false;
+
+   int number = 0;
+   while (pos < end && *pos >= '0' && *pos <= '9')
+   {
+      number = (number * 10) + (*pos - '0');
+      ++pos;
+   }
+
+   *pNumber = number;
+   *pPos = pos;
+   return true;
+}
+
+// parse a hunk range (e.g. "12,7" or "12", which has a count of 1)
+bool parseRange(const char** pPos, const char* end, int* pStart, int* pCount)
+{
+   if (!parseNumber(pPos, end, pStart))
+      return false;
+
+   *pCount = 1;
+   if (*pPos < end && **pPos == ',')
+   {
+      ++(*pPos);
+      if (!parseNumber(pPos, end, pCount))
+         return false;
+   }
+
+   return true;
+}
+
+// path from a --- or +++ line (svn appends a tab and a revision)
+std::string headerPath(const char* begin, const char* end)
+{
+   begin += 4;
+   return std::string(begin, std::find(begin, end, '\t'));
+}
+
+} // anonymous namespace
+
+UnifiedDiff::UnifiedDiff()
+   : size_(0),
+     inHunk_(false),
+     oldLine_(0),
+     newLine_(0),
+     oldRemaining_(0),
+     newRemaining_(0)
+{
+}
+
+void UnifiedDiff::parse(const char* begin, const char* end)
+{
+   size_ += end - begin;
+
+   const char* pos = begin;
+   while (pos < end)
+   {
+      const char* eol = std::find(pos, end, '\n');
+      if (eol == end)
+      {
+         // wait for the rest of the line
+         partialLine_.append(pos, end);
+         break;
+      }
+
+      if (partialLine_.empty())
+      {
+         parseLine(pos, eol);
+      }
+      else
+      {
+         partialLine_.append(pos, eol);
+         parseLine(partialLine_.data(),
+                   partialLine_.data() + partialLine_.size());
+         partialLine_.clear();
+      }
+
+      pos = eol + 1;
+   }
+}
+
+void UnifiedDiff::finish()
+{
+   if (!partialLine_.empty())
+   {
+      parseLine(partialLine_.data(),
+                partialLine_.data() + partialLine_.size());
+      partialLine_.clear();
+   }
+
+   inHunk_ = false;
+}
+
+void UnifiedDiff::parseLine(const char* begin, const char* end)
+{
+   if (end > begin && *(end - 1) == '\r')
+      --end;
+
+   if (inHunk_ && parseHunkLine(begin, end))
+      return;
+   inHunk_ = false;
+
+   if (startsWith(begin, end, "@@ ") && beginHunk(begin, end))
+      return;
+
+   addHeaderLine(begin, end);
+}
+
+bool UnifiedDiff::parseHunkLine(const char* begin, const char* end)
+{
+   // comments can follow the last line of a hunk
+   if (begin < end && *begin == '\\')
+   {
+      addLine(DiffLineComment, begin + 1, end);
+      return true;
+   }
+
+   if (oldRemaining_ <= 0 && newRemaining_ <= 0)
+      return false;
+
+   // (some tools strip the trailing space from empty context lines)
+   char directive = (begin < end) ? *begin : ' ';
+   const char* text = (begin < end) ? begin + 1 : end;
+   switch (directive)
+   {
+      case ' ':
+         addLine(DiffLineContext, text, end);
+         return true;
+      case '+':
+         addLine(DiffLineAdded, text, end);
+         return true;
+      case '-':
+         addLine(DiffLineDeleted, text, end);
+         return true;
+      default:
+         return false;
+   }
+}
+
+bool UnifiedDiff::beginHunk(const char* begin, const char* end)
+{
+   // parse e.g. "@@ -12,7 +12,8 @@ function(x)" (combined diffs, which
+   // start with @@@, aren't parsed and are kept as header lines)
+   DiffHunk hunk;
+   const char* pos = skipSpaces(begin + 2, end);
+   if (pos == end || *pos++ != '-')
+      return false;
+   if (!parseRange(&pos, end, &hunk.oldStart, &hunk.oldCount))
+      return false;
+   pos = skipSpaces(pos, end);
+   if (pos == end || *pos++ != '+')
+      return false;
+   if (!parseRange(&pos, end, &hunk.newStart, &hunk.newCount))
+      return false;
+   pos = skipSpaces(pos, end);
+   if (!startsWith(pos, end, "@@"))
+      return false;
+
+   if (files_.empty())
+      files_.push_back(DiffFile());
+   DiffFile& file = files_.back();
+   if (file.hunkCount == 0)
+      file.firstHunk = hunks_.size();
+   file.hunkCount++;
+
+   hunk.file = files_.size() - 1;
+   hunk.header.assign(begin, end);
+   hunk.firstLine = lines_.size();
+   hunk.lineCount = 0;
+   hunks_.push_back(hunk);
+
+   inHunk_ = true;
+   oldLine_ = hunk.oldStart;
+   newLine_ = hunk.newStart;
+   oldRemaining_ = hunk.oldCount;
+   newRemaining_ = hunk.newCount;
+   return true;
+}
+
+void UnifiedDiff::addHeaderLine(const char* begin, const char* end)
+{
+   // lines after the hunks of a file start the next file, as does a
+   // second diff or Index line
+   bool startsFile = startsWith(begin, end, "diff ") ||
+                     startsWith(begin, end, "Index: ");
+   if (files_.empty() ||
+       files_.back().hunkCount > 0 ||
+       (startsFile && !files_.back().headerLines.empty()))
+   {
+      files_.push_back(DiffFile());
+   }
+
+   DiffFile& file = files_.back();
+   file.headerLines.push_back(std::string(begin, end));
+
+   if (startsWith(begin, end, "--- "))
+      file.oldPath = headerPath(begin, end);
+   else if (startsWith(begin, end, "+++ "))
+      file.newPath = headerPath(begin, end);
+   else if (startsWith(begin, end, "Binary files ") ||
+            startsWith(begin, end, "GIT binary patch") ||
+            startsWith(begin, end, "Cannot display: file marked as a binary"))
+      file.binary = true;
+}
+
+void UnifiedDiff::addLine(DiffLineType type, const char* begin, const char* end)
+{
+   DiffLine line;
+   line.type = type;
+   line.oldLine = 0;
+   line.newLine = 0;
+   line.textOffset = text_.size();
+   line.textLength = end - begin;
+
+   switch (type)
+   {
+      case DiffLineContext:
+         line.oldLine = oldLine_++;
+         line.newLine = newLine_++;
+         oldRemaining_--;
+         newRemaining_--;
+         break;
+      case DiffLineDeleted:
+         line.oldLine = oldLine_++;
+         oldRemaining_--;
+         break;
+      case DiffLineAdded:
+         line.newLine = newLine_++;
+         newRemaining_--;
+         break;
+      case DiffLineComment:
+         break;
+   }
+
+   text_.append(begin, end);
+   lines_.push_back(line);
+   hunks_.back().lineCount++;
+}
+
+} // namespace text
+} // namespace core
@@ -59,12 +59,18 @@ bool prepareEnvironment(Options& options)
    if (!rLdScriptPath.exists())
       rLdScriptPath = supportingFilePath.complete("session/r-ldpath");
 
+   // cache the detected R environment (so launches needn't run R)
+   FilePath cacheFilePath = core::system::userSettingsPath(
+         core::system::userHomePath("R_USER|HOME"),
+         "RStudio-Desktop").childPath("r-environment");
+
    // attempt to detect R environment
    std::string errMsg;
    r_util::EnvironmentVars rEnvVars;
    bool success = r_util::detectREnvironment(rWhichRPath,
                                              rLdScriptPath,
                                              std::string(),
+                                             cacheFilePath,
                                              &rEnvVars,
                                              &errMsg);
    if (!success)
@@ -14,8 +14,12 @@
 #define R_INTERNAL_FUNCTIONS
 #include <r/RExec.hpp>
 
+#include <boost/unordered_map.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
 #include <core/FilePath.hpp>
 #include <core/Log.hpp>
+#include <core/Trace.hpp>
 
 #include <r/RErrorCategory.hpp>
 #include <r/RSourceManager.hpp>
@@ -55,11 +59,11 @@ public:
       : didDisable_(false),
         previousErrorHandlerSEXP_(R_NilValue)
    {
-      previousErrorHandlerSEXP_ = r::options::getOption("error");
+      previousErrorHandlerSEXP_ = Rf_GetOption(errorSymbol(), R_BaseEnv);
       if (previousErrorHandlerSEXP_ != R_NilValue)
       {
          rProtect_.add(previousErrorHandlerSEXP_);
-         r::options::setOption(Rf_install("error"), R_NilValue);
+         r::options::setOption(errorSymbol(), R_NilValue);
          didDisable_ = true;
       }
    }
@@ -68,19 +72,142 @@ public:
       try
       {
          if (didDisable_)
-            r::options::setOption(Rf_install("error"), previousErrorHandlerSEXP_);
+            r::options::setOption(errorSymbol(), previousErrorHandlerSEXP_);
       }
       catch(...)
       {
       }
    }
 
+private:
+   // (symbols are never collected so it's safe to keep this)
+   static SEXP errorSymbol()
+   {
+      static SEXP errorSEXP = Rf_install("error");
+      return errorSEXP;
+   }
+
 private:
    bool didDisable_;
    r::sexp::Protect rProtect_;
    SEXP previousErrorHandlerSEXP_;
 };
 
+// cache of resolved functions. only functions whose bindings can be
+// cheaply validated are cached: namespace qualified functions and
+// rstudio tools (".rs." functions bound in the tools:rstudio environment).
+// entries record the frame the function was found in and are validated
+// each time they are used by checking that it is still bound there (and
+// that the namespace is still loaded or the tool isn't masked by a
+// function in the global environment)
+struct CachedFunction
+{
+   SEXP symbolSEXP;
+   SEXP nsSymbolSEXP;
+   SEXP envSEXP;
+   SEXP frameSEXP;
+   SEXP functionSEXP;
+};
+typedef boost::unordered_map<std::string,CachedFunction> FunctionCache;
+FunctionCache s_functionCache;
+
+SEXP bindingValue(SEXP frameSEXP, SEXP symbolSEXP)
+{
+   SEXP valueSEXP = Rf_findVarInFrame(frameSEXP, symbolSEXP);
+   if (TYPEOF(valueSEXP) == PROMSXP)
+      valueSEXP = PRVALUE(valueSEXP);
+   return valueSEXP;
+}
+
+SEXP findBindingFrame(SEXP envSEXP, SEXP symbolSEXP)
+{
+   for ( ; envSEXP != R_EmptyEnv; envSEXP = ENCLOS(envSEXP))
+   {
+      if (Rf_findVarInFrame(envSEXP, symbolSEXP) != R_UnboundValue)
+         return envSEXP;
+   }
+   return R_EmptyEnv;
+}
+
+bool isCurrent(const CachedFunction& cached)
+{
+   if (cached.nsSymbolSEXP != R_NilValue)
+   {
+      if (Rf_findVarInFrame(R_NamespaceRegistry, cached.nsSymbolSEXP) !=
+          cached.envSEXP)
+         return false;
+   }
+   else if (Rf_findVarInFrame(R_GlobalEnv, cached.symbolSEXP) !=
+            R_UnboundValue)
+   {
+      return false;
+   }
+
+   return bindingValue(cached.frameSEXP, cached.symbolSEXP) ==
+          cached.functionSEXP;
+}
+
+void releaseCachedFunction(const CachedFunction& cached)
+{
+   ::R_ReleaseObject(cached.functionSEXP);
+   ::R_ReleaseObject(cached.frameSEXP);
+   ::R_ReleaseObject(cached.envSEXP);
+}
+
+SEXP resolveFunction(const std::string& functionName,
+                     const std::string& name,
+                     const std::string& ns)
+{
+   if (ns.empty() && !boost::algorithm::starts_with(name, ".rs."))
+      return sexp::findFunction(name, ns);
+
+   // check the cache
+   FunctionCache::iterator it = s_functionCache.find(functionName);
+   if (it != s_functionCache.end())
+   {
+      if (isCurrent(it->second))
+         return it->second.functionSEXP;
+
+      releaseCachedFunction(it->second);
+      s_functionCache.erase(it);
+   }
+
+   // lookup the function
+   SEXP functionSEXP = sexp::findFunction(name, ns);
+   if (functionSEXP == R_UnboundValue)
+      return functionSEXP;
+
+   // find where it is bound
+   CachedFunction cached;
+   cached.symbolSEXP = Rf_install(name.c_str());
+   cached.functionSEXP = functionSEXP;
+   if (ns.empty())
+   {
+      cached.nsSymbolSEXP = R_NilValue;
+      cached.envSEXP = R_GlobalEnv;
+   }
+   else
+   {
+      cached.nsSymbolSEXP = Rf_install(ns.c_str());
+      cached.envSEXP = Rf_findVarInFrame(R_NamespaceRegistry,
+                                         cached.nsSymbolSEXP);
+      if (TYPEOF(cached.envSEXP) != ENVSXP)
+         return functionSEXP;
+   }
+   cached.frameSEXP = findBindingFrame(cached.envSEXP, cached.symbolSEXP);
+
+   // cache it (unless it's masked by a binding which isn't a function)
+   if (cached.frameSEXP != R_EmptyEnv && isCurrent(cached))
+   {
+      ::R_PreserveObject(cached.functionSEXP);
+      ::R_PreserveObject(cached.frameSEXP);
+      ::R_PreserveObject(cached.envSEXP);
+      s_functionCache[functionName] = cached;
+   }
+
+   return functionSEXP;
+}
+
 
 Error parseString(const std::string& str, SEXP* pSEXP, sexp::Protect* pProtect)
 {
@@ -224,6 +351,8 @@ Error evaluateString(const std::string& str,
                      SEXP* pSEXP, 
                      sexp::Protect* pProtect)
 {
+   TRACE_SPAN_DETAIL("r", "evaluateString", str);
+
    // refresh source if necessary (no-op in production)
    r::sourceManager().reloadIfNecessary();
    
@@ -297,7 +426,7 @@ void RFunction::commonInit(const std::string& functionName)
    }
    
    // lookup function
-   functionSEXP_ = sexp::findFunction(name, ns);
+   functionSEXP_ = resolveFunction(functionName_, name, ns);
    if (functionSEXP_ != R_UnboundValue)
       rProtect_.add(functionSEXP_);
 }
@@ -317,6 +446,8 @@ Error RFunction::call(SEXP* pResultSEXP, sexp::Protect* pProtect)
    
 Error RFunction::call(SEXP evalNS, SEXP* pResultSEXP, sexp::Protect* pProtect)
 {
+   TRACE_SPAN_DETAIL("r", "RFunction::call", functionName_);
+
    // verify the function
    if (functionSEXP_ == R_UnboundValue)
    {
@@ -341,8 +472,8 @@ Error RFunction::call(SEXP evalNS, SEXP* pResultSEXP, sexp::Protect* pProtect)
    {
       SETCAR(nextSlotSEXP, it->valueSEXP);
       // parameters can optionally be named
-      if (!(it->name.empty()))
-         SET_TAG(nextSlotSEXP, Rf_install(it->name.c_str()));
+      if (it->nameSEXP != R_NilValue)
+         SET_TAG(nextSlotSEXP, it->nameSEXP);
       nextSlotSEXP = CDR(nextSlotSEXP);
    }
    
@@ -108,6 +108,116 @@ void listEnvironment(SEXP env,
    }
 }
 
+namespace {
+
+// visit the bindings within a frame (a pairlist of value cells tagged with
+// their symbols) passing the symbol and value of each to the visitor
+template <typename Visitor>
+void visitFrame(SEXP frameSEXP, bool includeAll, Visitor* pVisitor)
+{
+   for ( ; frameSEXP != R_NilValue; frameSEXP = CDR(frameSEXP))
+   {
+      SEXP valueSEXP = CAR(frameSEXP);
+      if (valueSEXP == R_UnboundValue)
+         continue;
+
+      // skip hidden variables (as R_lsInternal does)
+      SEXP symbolSEXP = TAG(frameSEXP);
+      if (!includeAll && CHAR(PRINTNAME(symbolSEXP))[0] == '.')
+         continue;
+
+      // use the values of forced promises
+      if (TYPEOF(valueSEXP) == PROMSXP && PRVALUE(valueSEXP) != R_UnboundValue)
+         valueSEXP = PRVALUE(valueSEXP);
+
+      (*pVisitor)(symbolSEXP, valueSEXP);
+   }
+}
+
+template <typename Visitor>
+void visitBindings(SEXP env, bool includeAll, Visitor* pVisitor)
+{
+   SEXP hashTableSEXP = HASHTAB(env);
+   if (hashTableSEXP != R_NilValue)
+   {
+      for (int i = 0; i < LENGTH(hashTableSEXP); i++)
+         visitFrame(VECTOR_ELT(hashTableSEXP, i), includeAll, pVisitor);
+   }
+   else
+   {
+      visitFrame(FRAME(env), includeAll, pVisitor);
+   }
+}
+
+class BindingLister
+{
+public:
+   explicit BindingLister(std::vector<Variable>* pVariables)
+      : pVariables_(pVariables)
+   {
+   }
+
+   void operator()(SEXP symbolSEXP, SEXP valueSEXP)
+   {
+      pVariables_->push_back(std::make_pair(
+                     std::string(CHAR(PRINTNAME(symbolSEXP))), valueSEXP));
+   }
+
+private:
+   std::vector<Variable>* pVariables_;
+};
+
+std::size_t hashPointer(const void* pointer)
+{
+   std::size_t value = reinterpret_cast<std::size_t>(pointer);
+   return value ^ (value >> 4) ^ (value >> 13);
+}
+
+class BindingHasher
+{
+public:
+   BindingHasher() : count_(0), hash_(0) {}
+
+   void operator()(SEXP symbolSEXP, SEXP valueSEXP)
+   {
+      std::size_t binding = hashPointer(symbolSEXP);
+      binding ^= hashPointer(valueSEXP) + 0x9e3779b9 +
+                 (binding << 6) + (binding >> 2);
+
+      // bindings are combined by addition so the order in which they are
+      // visited (which changes as hash tables are resized) doesn't matter
+      hash_ += binding;
+      count_++;
+   }
+
+   std::size_t fingerprint() const
+   {
+      return hash_ ^ (count_ * 0x9e3779b9);
+   }
+
+private:
+   std::size_t count_;
+   std::size_t hash_;
+};
+
+} // anonymous namespace
+
+void listEnvironmentBindings(SEXP env,
+                             bool includeAll,
+                             std::vector<Variable>* pVariables)
+{
+   pVariables->clear();
+   BindingLister lister(pVariables);
+   visitBindings(env, includeAll, &lister);
+}
+
+std::size_t environmentFingerprint(SEXP env, bool includeAll)
+{
+   BindingHasher hasher;
+   visitBindings(env, includeAll, &hasher);
+   return hasher.fingerprint();
+}
+
 SEXP findVar(const std::string& name, const std::string& ns)
 {
    if (name.empty())
@@ -20,9 +20,12 @@
 
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
 #include <core/Log.hpp>
+#include <core/Trace.hpp>
 
 #include <r/RExec.hpp>
+#include <r/RSexp.hpp>
 
 using namespace core ;
 
@@ -35,9 +38,62 @@ SourceManager& sourceManager()
    return instance ;
 }
    
+Error SourceManager::loadToolsImage(const FilePath& imagePath)
+{
+   TRACE_SPAN("r", "loadToolsImage");
+
+   // read the image
+   r::sexp::Protect rProtect;
+   SEXP imageSEXP;
+   Error error = r::exec::RFunction("readRDS", imagePath.absolutePath())
+                                                .call(&imageSEXP, &rProtect);
+   if (error)
+      return error;
+
+   // byte code is specific to the version of R which compiled it
+   std::string imageVersion, rVersion;
+   error = r::sexp::getNamedListElement(imageSEXP, "rVersion", &imageVersion);
+   if (error)
+      return error;
+   error = r::exec::evaluateString("R.version.string", &rVersion);
+   if (error)
+      return error;
+   if (imageVersion != rVersion)
+   {
+      LOG_WARNING_MESSAGE("Not using tools image " +
+                          imagePath.absolutePath() + " (built for " +
+                          imageVersion + ")");
+      return Success();
+   }
+
+   // get the files, their source, and the function for running each
+   std::vector<std::string> files, sources;
+   error = r::sexp::getNamedListElement(imageSEXP, "files", &files);
+   if (error)
+      return error;
+   error = r::sexp::getNamedListElement(imageSEXP, "sources", &sources);
+   if (error)
+      return error;
+   int toolsIndex = r::sexp::indexOfElementNamed(imageSEXP, "tools");
+   if (toolsIndex == -1 || files.size() != sources.size())
+   {
+      Error imageError(r::errc::ListElementNotFoundError, ERROR_LOCATION);
+      imageError.addProperty("path", imagePath.absolutePath());
+      return imageError;
+   }
+
+   toolsImage_.clear();
+   for (std::size_t i = 0; i<files.size(); i++)
+      toolsImage_[files[i]] = ToolsImageEntry(sources[i], static_cast<int>(i));
+   pToolsImageSEXP_.reset(new r::sexp::PreservedSEXP(
+                                    VECTOR_ELT(imageSEXP, toolsIndex)));
+
+   return Success();
+}
+
 Error SourceManager::sourceTools(const core::FilePath& filePath)
 {
-   Error error = sourceLocal(filePath);
+   Error error = sourceToolsFile(filePath);
    if (error)
       return error;
 
@@ -85,10 +141,53 @@ void SourceManager::reloadIfNecessary()
 
 void SourceManager::reSourceTools(const core::FilePath& filePath)
 {
-   Error error = source(filePath, true);
+   Error error = sourceToolsFile(filePath);
    if (error)
       LOG_ERROR(error);
 }
+
+Error SourceManager::sourceToolsFile(const FilePath& filePath)
+{
+   std::string filename = filePath.filename();
+
+   // run the file from the tools image if we can
+   SEXP toolsSEXP = toolsFromImage(filePath);
+   if (toolsSEXP != R_NilValue)
+   {
+      TRACE_SPAN_DETAIL("r", "tools-image", filename);
+      recordSourcedFile(filePath, true);
+      return r::exec::RFunction(toolsSEXP).call();
+   }
+   else
+   {
+      TRACE_SPAN_DETAIL("r", "tools-source", filename);
+      return source(filePath, true);
+   }
+}
+
+SEXP SourceManager::toolsFromImage(const FilePath& filePath)
+{
+   ToolsImageMap::const_iterator it = toolsImage_.find(filePath.filename());
+   if (it == toolsImage_.end())
+      return R_NilValue;
+
+   // only use the image if the file hasn't changed since it was built
+   std::string source;
+   Error error = readStringFromFile(filePath, &source);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return R_NilValue;
+   }
+   if (source != it->second.source)
+   {
+      LOG_WARNING_MESSAGE("Tools image is out of date for " +
+                          filePath.absolutePath());
+      return R_NilValue;
+   }
+
+   return VECTOR_ELT(pToolsImageSEXP_->get(), it->second.index);
+}
    
 Error SourceManager::source(const FilePath& filePath, bool local)
 {
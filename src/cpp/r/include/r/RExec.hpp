@@ -84,7 +84,10 @@ core::Error evaluateString(const std::string& str, T* pValue)
    return sexp::extract(valueSEXP, pValue);
 }
    
-// call R functions
+// call R functions. namespace qualified functions (e.g. "utils:::head") and
+// rstudio tools (".rs." functions) are only looked up the first time they
+// are constructed. an RFunction can also be called repeatedly (use
+// clearParams to call it again with different parameters)
 class RFunction : boost::noncopyable
 {
 public:
@@ -154,6 +157,14 @@ public:
       SEXP paramSEXP = sexp::create(param, &rProtect_);
       params_.push_back(Param(name, paramSEXP));
    }
+
+   // clear the parameters (note that parameters created from c++ values
+   // remain protected until the function is destroyed so hot loops should
+   // add SEXP parameters which are protected elsewhere)
+   void clearParams()
+   {
+      params_.clear();
+   }
                         
    core::Error call(SEXP evalNS = R_GlobalEnv);
 
@@ -197,10 +208,11 @@ private:
    struct Param 
    {
       Param(const std::string& name, SEXP valueSEXP)
-         : name(name), valueSEXP(valueSEXP)
+         : nameSEXP(name.empty() ? R_NilValue : Rf_install(name.c_str())),
+           valueSEXP(valueSEXP)
       {
       }
-      std::string name ;
+      SEXP nameSEXP ;
       SEXP valueSEXP ;
    };
    std::vector<Param> params_ ;
@@ -49,6 +49,22 @@ void listEnvironment(SEXP env,
                      bool includeAll,
                      Protect* pProtect,
                      std::vector<Variable>* pVariables);
+
+// list the variables bound in an environment by reading its frame directly
+// (no R code is run, nothing is allocated and promises aren't forced; the
+// values of forced promises are returned in place of the promises). the
+// variables aren't sorted and their values aren't protected (they remain
+// reachable only while they're bound in the environment). note that the
+// base environment (which has no frame) isn't supported
+void listEnvironmentBindings(SEXP env,
+                             bool includeAll,
+                             std::vector<Variable>* pVariables);
+
+// a fingerprint of the variables bound in an environment (their symbols and
+// value pointers) which changes when a variable is added, removed or
+// assigned. computed from the frame without allocating so it is cheap
+// enough to call after every command, even for very large environments
+std::size_t environmentFingerprint(SEXP env, bool includeAll);
       
 // object info
 SEXP findVar(const std::string& name,
@@ -20,6 +20,7 @@
 #include <vector>
 
 #include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/unordered_map.hpp>
 
 #include <core/FilePath.hpp>
@@ -28,8 +29,14 @@ namespace core {
    class Error ;
 }
 
+typedef struct SEXPREC *SEXP;
+
 namespace r {
 
+namespace sexp {
+   class PreservedSEXP;
+}
+
 // singleton
 class SourceManager ;
 SourceManager& sourceManager();
@@ -46,6 +53,11 @@ public:
    bool autoReload() const { return autoReload_; }
    void setAutoReload(bool autoReload) { autoReload_ = autoReload; }
    
+   // load an image of byte-compiled tools files (built by BuildToolsImage.R)
+   // so that tools files in it can be run without being parsed. files which
+   // have changed since the image was built are sourced instead
+   core::Error loadToolsImage(const core::FilePath& imagePath);
+
    core::Error sourceTools(const core::FilePath& filePath);
    void ensureToolsLoaded();
 
@@ -67,9 +79,23 @@ private:
       bool local;
    };   
    typedef boost::unordered_map<std::string, SourcedFileInfo> SourcedFileMap;
+
+   struct ToolsImageEntry
+   {
+      ToolsImageEntry() : index(-1) {}
+      ToolsImageEntry(const std::string& source, int index)
+         : source(source), index(index)
+      {
+      }
+      std::string source;
+      int index;
+   };
+   typedef boost::unordered_map<std::string, ToolsImageEntry> ToolsImageMap;
    
    // helper functions
    core::Error source(const core::FilePath& filePath, bool local);
+   core::Error sourceToolsFile(const core::FilePath& filePath);
+   SEXP toolsFromImage(const core::FilePath& filePath);
    void reSourceTools(const core::FilePath& filePath);
    void recordSourcedFile(const core::FilePath& filePath, bool local);
    void reloadSourceIfNecessary(const SourcedFileMap::value_type& value);
@@ -78,6 +104,8 @@ private:
    bool autoReload_ ;
    SourcedFileMap sourcedFiles_ ;
    std::vector<core::FilePath> toolsFilePaths_;
+   ToolsImageMap toolsImage_;
+   boost::shared_ptr<sexp::PreservedSEXP> pToolsImageSEXP_;
 };
    
 } // namespace r
@@ -50,6 +50,8 @@ struct ROptions
          autoReloadSource(false),
          shellEscape(false),
          restoreWorkspace(true),
+         lazyWorkspaceRestore(true),
+         vectorGraphics(false),
          saveWorkspace(SA_SAVEASK)
    {
    }
@@ -62,6 +64,7 @@ struct ROptions
    boost::function<core::FilePath()> rHistoryDir;
    boost::function<bool()> alwaysSaveHistory;
    core::FilePath rSourcePath;
+   core::FilePath rToolsImagePath;
    core::FilePath rLibsExtra;
    std::string rLibsUser;
    std::string rCRANRepos;
@@ -70,6 +73,8 @@ struct ROptions
    bool autoReloadSource ;
    bool shellEscape;
    bool restoreWorkspace;
+   bool lazyWorkspaceRestore;
+   bool vectorGraphics;
    SA_TYPE saveWorkspace;
 };
       
@@ -136,6 +141,15 @@ core::Error run(const ROptions& options, const RCallbacks& callbacks);
    
 // deferred deserialization of the session
 void ensureDeserialized();
+
+// objects in a resumed global environment which haven't yet been read
+// (when the session was resumed with lazyWorkspaceRestore)
+bool isDeferredWorkspaceObject(const std::string& name,
+                               std::string* pClassName,
+                               int* pLength);
+
+// read the next deferred object (returns false if there are none left)
+bool prefetchDeferredWorkspaceObject();
       
 // set client metrics 
 void setClientMetrics(const RClientMetrics& metrics);
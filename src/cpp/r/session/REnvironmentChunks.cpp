@@ -0,0 +1,909 @@
+/*
+ * REnvironmentChunks.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "REnvironmentChunks.hpp"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <algorithm>
+
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Log.hpp>
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/BoostThread.hpp>
+#include <core/ChunkedFile.hpp>
+#include <core/json/Json.hpp>
+
+#define R_INTERNAL_FUNCTIONS
+#include <r/RInternal.hpp>
+#include <r/RExec.hpp>
+#include <r/RSexp.hpp>
+#include <r/RRoutines.hpp>
+
+using namespace core ;
+
+namespace r {
+namespace session {
+namespace environment_chunks {
+
+namespace {
+
+const char * const kManifestFile = "manifest";
+const int kManifestVersion = 1;
+
+// bound on the serialized data waiting to be compressed (or consumed)
+const std::size_t kMemoryLimit = 256 * 1024 * 1024;
+
+int compressionThreads()
+{
+   int cores = static_cast<int>(boost::thread::hardware_concurrency());
+   return std::max(1, std::min(cores, 8));
+}
+
+double megabytes(boost::uint64_t bytes)
+{
+   return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+double seconds(const boost::posix_time::time_duration& duration)
+{
+   return static_cast<double>(duration.total_milliseconds()) / 1000.0;
+}
+
+// NOTE: the stream callbacks below are invoked from within R_Serialize and
+// R_Unserialize (which are always called within r::exec::executeSafely) so
+// they report failure by calling Rf_error. they must not create any c++
+// objects which would require destruction.
+
+void outBytes(R_outpstream_t stream, void* buffer, int length)
+{
+   chunked_file::Writer* pWriter =
+                     static_cast<chunked_file::Writer*>(stream->data);
+   if (!pWriter->write(static_cast<const char*>(buffer), length))
+      Rf_error("error writing session data");
+}
+
+void outChar(R_outpstream_t stream, int c)
+{
+   char ch = static_cast<char>(c);
+   outBytes(stream, &ch, 1);
+}
+
+void inBytes(R_inpstream_t stream, void* buffer, int length)
+{
+   chunked_file::Reader* pReader =
+                     static_cast<chunked_file::Reader*>(stream->data);
+   if (!pReader->read(static_cast<char*>(buffer), length))
+      Rf_error("error reading session data");
+}
+
+int inChar(R_inpstream_t stream)
+{
+   char ch;
+   inBytes(stream, &ch, 1);
+   return static_cast<unsigned char>(ch);
+}
+
+Error serializeValue(SEXP valueSEXP, chunked_file::Writer* pWriter)
+{
+   struct R_outpstream_st stream;
+   R_InitOutPStream(&stream,
+                    static_cast<R_pstream_data_t>(pWriter),
+                    R_pstream_xdr_format,
+                    2,
+                    outChar,
+                    outBytes,
+                    NULL,
+                    R_NilValue);
+   return r::exec::executeSafely(boost::bind(R_Serialize, valueSEXP, &stream));
+}
+
+Error unserializeValue(chunked_file::Reader* pReader, SEXP* pValueSEXP)
+{
+   struct R_inpstream_st stream;
+   R_InitInPStream(&stream,
+                   static_cast<R_pstream_data_t>(pReader),
+                   R_pstream_any_format,
+                   inChar,
+                   inBytes,
+                   NULL,
+                   R_NilValue);
+   return r::exec::executeSafely<SEXP>(boost::bind(R_Unserialize, &stream),
+                                       pValueSEXP);
+}
+
+void globalEnvironmentNames(std::vector<std::string>* pNames)
+{
+   SEXP namesSEXP;
+   r::sexp::Protect rProtect(namesSEXP = R_lsInternal(R_GlobalEnv, TRUE));
+   for (int i=0; i<Rf_length(namesSEXP); i++)
+      pNames->push_back(CHAR(STRING_ELT(namesSEXP, i)));
+}
+
+// object entry within the manifest
+struct ManifestEntry
+{
+   ManifestEntry() : rawBytes(0), storedBytes(0), length(0) {}
+   std::string name;
+   std::string file;
+   boost::uint64_t rawBytes;
+   boost::uint64_t storedBytes;
+   std::string className;
+   int length;
+};
+
+Error readManifest(const FilePath& chunksPath,
+                   std::vector<ManifestEntry>* pEntries)
+{
+   FilePath manifestPath = chunksPath.complete(kManifestFile);
+   std::string contents;
+   Error error = readStringFromFile(manifestPath, &contents);
+   if (error)
+      return error;
+
+   json::Value value;
+   if (!json::parse(contents, &value) ||
+       !json::isType<json::Object>(value))
+   {
+      error = systemError(boost::system::errc::invalid_argument,
+                          ERROR_LOCATION);
+      error.addProperty("path", manifestPath.absolutePath());
+      return error;
+   }
+
+   json::Object& manifest = value.get_obj();
+   const json::Value& versionJson = manifest["version"];
+   const json::Value& objectsJson = manifest["objects"];
+   if (!json::isType<int>(versionJson) ||
+       versionJson.get_int() != kManifestVersion ||
+       !json::isType<json::Array>(objectsJson))
+   {
+      error = systemError(boost::system::errc::not_supported,
+                          ERROR_LOCATION);
+      error.addProperty("path", manifestPath.absolutePath());
+      return error;
+   }
+
+   const json::Array& objects = objectsJson.get_array();
+   for (json::Array::const_iterator it = objects.begin();
+        it != objects.end(); ++it)
+   {
+      if (!json::isType<json::Object>(*it))
+         continue;
+      json::Object object = it->get_obj();
+      if (!json::isType<std::string>(object["name"]) ||
+          !json::isType<std::string>(object["file"]))
+         continue;
+
+      ManifestEntry entry;
+      entry.name = object["name"].get_str();
+      entry.file = object["file"].get_str();
+      if (json::isType<int>(object["raw_bytes"]))
+         entry.rawBytes = object["raw_bytes"].get_uint64();
+      if (json::isType<int>(object["stored_bytes"]))
+         entry.storedBytes = object["stored_bytes"].get_uint64();
+      if (json::isType<std::string>(object["class"]))
+         entry.className = object["class"].get_str();
+      if (json::isType<int>(object["length"]))
+         entry.length = object["length"].get_int();
+      pEntries->push_back(entry);
+   }
+
+   return Success();
+}
+
+Error writeManifest(const FilePath& chunksPath,
+                    const std::vector<ManifestEntry>& entries,
+                    const json::Object& metricsJson)
+{
+   json::Array objectsJson;
+   for (std::vector<ManifestEntry>::const_iterator it = entries.begin();
+        it != entries.end(); ++it)
+   {
+      json::Object objectJson;
+      objectJson["name"] = it->name;
+      objectJson["file"] = it->file;
+      objectJson["raw_bytes"] = it->rawBytes;
+      objectJson["stored_bytes"] = it->storedBytes;
+      objectJson["class"] = it->className;
+      objectJson["length"] = it->length;
+      objectsJson.push_back(objectJson);
+   }
+
+   json::Object manifestJson;
+   manifestJson["version"] = kManifestVersion;
+   manifestJson["format"] = "xdr";
+   manifestJson["codec"] = chunked_file::codecName(
+                                          chunked_file::defaultCodec());
+   manifestJson["objects"] = objectsJson;
+   manifestJson["metrics"] = metricsJson;
+
+   std::ostringstream ostr;
+   json::writeFormatted(manifestJson, ostr);
+   return writeStringToFile(chunksPath.complete(kManifestFile), ostr.str());
+}
+
+// class and length of an object (recorded in the manifest so that deferred
+// objects can be described without reading them)
+void describeValue(SEXP valueSEXP, std::string* pClassName, int* pLength)
+{
+   // don't force promises
+   if (TYPEOF(valueSEXP) == PROMSXP)
+   {
+      *pClassName = "promise";
+      *pLength = 0;
+      return;
+   }
+
+   std::vector<std::string> classes;
+   Error error = r::exec::RFunction("class", valueSEXP).call(&classes);
+   if (!error && !classes.empty())
+      *pClassName = classes.front();
+   *pLength = r::sexp::length(valueSEXP);
+}
+
+
+// objects which have been restored lazily but not yet read
+struct DeferredObject
+{
+   DeferredObject()
+      : rawBytes(0), storedBytes(0), length(0), prefetchFailed(false)
+   {
+   }
+   FilePath chunkPath;
+   boost::uint64_t rawBytes;
+   boost::uint64_t storedBytes;
+   std::string className;
+   int length;
+   boost::shared_ptr<r::sexp::PreservedSEXP> pPromiseSEXP;
+   bool prefetchFailed;
+};
+typedef std::map<std::string,DeferredObject> DeferredObjects;
+DeferredObjects s_deferredObjects;
+
+// metrics on deferred objects
+struct DeferredMetrics
+{
+   DeferredMetrics()
+      : deferred(0), readOnAccess(0), prefetched(0), bytesRead(0)
+   {
+   }
+   int deferred;
+   int readOnAccess;
+   int prefetched;
+   boost::uint64_t bytesRead;
+   boost::posix_time::time_duration readTime;
+};
+DeferredMetrics s_deferredMetrics;
+
+// are we forcing a deferred object's promise from prefetch?
+bool s_prefetching = false;
+
+// is the object still bound to its (unforced) promise? it won't be if it
+// has been read or if the binding has since been removed or reassigned
+bool isPending(const std::string& name, const DeferredObject& object)
+{
+   SEXP valueSEXP = Rf_findVarInFrame(R_GlobalEnv, Rf_install(name.c_str()));
+   return valueSEXP == object.pPromiseSEXP->get() &&
+          PRVALUE(valueSEXP) == R_UnboundValue;
+}
+
+void removeStaleDeferredObjects()
+{
+   for (DeferredObjects::iterator it = s_deferredObjects.begin();
+        it != s_deferredObjects.end(); )
+   {
+      if (!isPending(it->first, it->second))
+         s_deferredObjects.erase(it++);
+      else
+         ++it;
+   }
+}
+
+Error deferObject(const ManifestEntry& entry, const FilePath& chunksPath)
+{
+   // create a promise which reads the object when it is forced
+   r::sexp::Protect rProtect;
+   SEXP callSEXP = Rf_lang3(Rf_install(".Call"),
+                            Rf_mkString("rs_restoreDeferredObject"),
+                            Rf_mkString(entry.name.c_str()));
+   rProtect.add(callSEXP);
+
+   r::exec::RFunction delayedAssign("delayedAssign");
+   delayedAssign.addParam(entry.name);
+   delayedAssign.addParam(callSEXP);
+   delayedAssign.addParam(R_BaseEnv);
+   delayedAssign.addParam(R_GlobalEnv);
+   Error error = delayedAssign.call();
+   if (error)
+      return error;
+
+   DeferredObject object;
+   object.chunkPath = chunksPath.complete(entry.file);
+   object.rawBytes = entry.rawBytes;
+   object.storedBytes = entry.storedBytes;
+   object.className = entry.className;
+   object.length = entry.length;
+   object.pPromiseSEXP.reset(new r::sexp::PreservedSEXP(
+      Rf_findVarInFrame(R_GlobalEnv, Rf_install(entry.name.c_str()))));
+   s_deferredObjects[entry.name] = object;
+
+   return Success();
+}
+
+Error readDeferredObject(const std::string& name, SEXP* pValueSEXP)
+{
+   using namespace boost::posix_time;
+   ptime startTime = microsec_clock::universal_time();
+
+   DeferredObjects::iterator it = s_deferredObjects.find(name);
+   if (it == s_deferredObjects.end())
+   {
+      Error error = systemError(boost::system::errc::no_such_file_or_directory,
+                                ERROR_LOCATION);
+      error.addProperty("object", name);
+      return error;
+   }
+
+   std::vector<FilePath> chunkPaths(1, it->second.chunkPath);
+   chunked_file::Reader reader(chunkPaths, compressionThreads(), kMemoryLimit);
+   Error error = unserializeValue(&reader, pValueSEXP);
+   Error readError = reader.finish();
+   if (readError)
+      error = readError;
+   if (error)
+   {
+      error.addProperty("object", name);
+      return error;
+   }
+
+   // update metrics
+   if (s_prefetching)
+      s_deferredMetrics.prefetched++;
+   else
+      s_deferredMetrics.readOnAccess++;
+   s_deferredMetrics.bytesRead += it->second.rawBytes;
+   s_deferredMetrics.readTime += microsec_clock::universal_time() - startTime;
+
+   s_deferredObjects.erase(it);
+
+   // report metrics once everything has been read
+   if (s_deferredObjects.empty())
+   {
+      boost::format fmt("Read %1% deferred objects (%2% on access, "
+                        "%3% prefetched, %4$.1f MB) in %5$.2fs");
+      LOG_INFO_MESSAGE(boost::str(fmt % s_deferredMetrics.deferred
+                                      % s_deferredMetrics.readOnAccess
+                                      % s_deferredMetrics.prefetched
+                                      % megabytes(s_deferredMetrics.bytesRead)
+                                      % seconds(s_deferredMetrics.readTime)));
+   }
+
+   return Success();
+}
+
+SEXP rs_restoreDeferredObject(SEXP nameSEXP)
+{
+   try
+   {
+      std::string name = r::sexp::asString(nameSEXP);
+      SEXP valueSEXP = R_NilValue;
+      Error error = readDeferredObject(name, &valueSEXP);
+      if (error)
+      {
+         LOG_ERROR(error);
+         throw r::exec::RErrorException("Unable to restore object '" +
+                                        name + "' from suspended session");
+      }
+      return valueSEXP;
+   }
+   catch(r::exec::RErrorException e)
+   {
+      r::exec::error(e.message());
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   return R_NilValue;
+}
+
+SEXP rs_deferredObjects()
+{
+   removeStaleDeferredObjects();
+
+   json::Object objectsJson;
+   for (DeferredObjects::const_iterator it = s_deferredObjects.begin();
+        it != s_deferredObjects.end(); ++it)
+   {
+      json::Object objectJson;
+      objectJson["class"] = it->second.className;
+      objectJson["length"] = it->second.length;
+      objectsJson[it->first] = objectJson;
+   }
+
+   r::sexp::Protect rProtect;
+   return r::sexp::create(objectsJson, &rProtect);
+}
+
+// environments which R serializes by reference (and so are the same
+// environment after restore no matter how many objects refer to them)
+bool isSerializedByName(SEXP envSEXP)
+{
+   return envSEXP == R_GlobalEnv ||
+          envSEXP == R_BaseEnv ||
+          envSEXP == R_EmptyEnv ||
+          envSEXP == R_BaseNamespace ||
+          R_IsNamespaceEnv(envSEXP) ||
+          R_IsPackageEnv(envSEXP);
+}
+
+// finds environments which can be reached from more than one top-level
+// object (these would be restored as distinct copies if the objects were
+// serialized independently)
+class SharedEnvironmentFinder
+{
+public:
+   // walk the object, returning true if it reaches an environment which
+   // was also reached by a previously walked object
+   bool reachesSharedEnvironment(SEXP valueSEXP)
+   {
+      std::set<SEXP> environments, visited;
+      std::vector<SEXP> pending(1, valueSEXP);
+      while (!pending.empty())
+      {
+         SEXP sexp = pending.back();
+         pending.pop_back();
+
+         // objects which can refer back to themselves are only walked once
+         switch (TYPEOF(sexp))
+         {
+            case CLOSXP:
+            case PROMSXP:
+            case VECSXP:
+            case EXPRSXP:
+            case EXTPTRSXP:
+            case S4SXP:
+               if (!visited.insert(sexp).second)
+                  continue;
+               break;
+            default:
+               break;
+         }
+
+         switch (TYPEOF(sexp))
+         {
+            // no references to follow (symbols and strings have R's
+            // own bookkeeping in their attributes)
+            case NILSXP:
+            case SYMSXP:
+            case CHARSXP:
+            case SPECIALSXP:
+            case BUILTINSXP:
+               continue;
+
+            case ENVSXP:
+               if (isSerializedByName(sexp) ||
+                   !environments.insert(sexp).second)
+               {
+                  continue;
+               }
+               if (environments_.count(sexp))
+                  return true;
+               pending.push_back(FRAME(sexp));
+               pending.push_back(HASHTAB(sexp));
+               pending.push_back(ENCLOS(sexp));
+               break;
+
+            case CLOSXP:
+               pending.push_back(FORMALS(sexp));
+               pending.push_back(BODY(sexp));
+               pending.push_back(CLOENV(sexp));
+               break;
+
+            case PROMSXP:
+               pending.push_back(PRVALUE(sexp));
+               pending.push_back(PRCODE(sexp));
+               pending.push_back(PRENV(sexp));
+               break;
+
+            case LISTSXP:
+            case LANGSXP:
+            case DOTSXP:
+               pending.push_back(CAR(sexp));
+               pending.push_back(CDR(sexp));
+               break;
+
+            case VECSXP:
+            case EXPRSXP:
+               for (int i = 0; i < Rf_length(sexp); i++)
+                  pending.push_back(VECTOR_ELT(sexp, i));
+               break;
+
+            case EXTPTRSXP:
+               pending.push_back(R_ExternalPtrProtected(sexp));
+               pending.push_back(R_ExternalPtrTag(sexp));
+               break;
+
+            default:
+               break;
+         }
+
+         pending.push_back(ATTRIB(sexp));
+      }
+
+      environments_.insert(environments.begin(), environments.end());
+      return false;
+   }
+
+private:
+   std::set<SEXP> environments_;
+};
+
+} // anonymous namespace
+
+
+bool canSave()
+{
+   removeStaleDeferredObjects();
+
+   std::vector<std::string> names;
+   globalEnvironmentNames(&names);
+   SharedEnvironmentFinder finder;
+   for (std::vector<std::string>::const_iterator it = names.begin();
+        it != names.end(); ++it)
+   {
+      SEXP symbolSEXP = Rf_install(it->c_str());
+      if (R_BindingIsActive(symbolSEXP, R_GlobalEnv))
+         return false;
+
+      // deferred objects are moved rather than serialized again (and
+      // walking them would force their promises)
+      if (s_deferredObjects.count(*it))
+         continue;
+
+      SEXP valueSEXP = Rf_findVarInFrame(R_GlobalEnv, symbolSEXP);
+      if (finder.reachesSharedEnvironment(valueSEXP))
+         return false;
+   }
+   return true;
+}
+
+Error save(const FilePath& chunksPath)
+{
+   using namespace boost::posix_time;
+   ptime startTime = microsec_clock::universal_time();
+
+   // if there are deferred objects then their chunks are (most likely)
+   // within chunksPath so move it aside before we reset it
+   removeStaleDeferredObjects();
+   FilePath previousPath;
+   if (!s_deferredObjects.empty() && chunksPath.exists())
+   {
+      previousPath = chunksPath.parent().complete(chunksPath.filename() +
+                                                  ".previous");
+      Error error = previousPath.removeIfExists();
+      if (!error)
+         error = chunksPath.move(previousPath);
+      if (error)
+         return error;
+
+      for (DeferredObjects::iterator it = s_deferredObjects.begin();
+           it != s_deferredObjects.end(); ++it)
+      {
+         FilePath& chunkPath = it->second.chunkPath;
+         if (chunkPath.parent() == chunksPath)
+            chunkPath = previousPath.complete(chunkPath.filename());
+      }
+   }
+
+   // reset the directory (the manifest is written last so its presence
+   // indicates that the save completed)
+   Error error = chunksPath.resetDirectory();
+   if (error)
+      return error;
+
+   std::vector<std::string> names;
+   globalEnvironmentNames(&names);
+
+   // serialize each object into its own chunk
+   int threads = compressionThreads();
+   chunked_file::Writer writer(threads, kMemoryLimit);
+   std::vector<ManifestEntry> entries;
+   std::vector<std::size_t> writtenEntries;
+   for (std::vector<std::string>::const_iterator it = names.begin();
+        it != names.end(); ++it)
+   {
+      ManifestEntry entry;
+      entry.name = *it;
+      entry.file = boost::lexical_cast<std::string>(entries.size());
+      FilePath chunkPath = chunksPath.complete(entry.file);
+
+      // move the chunks of deferred objects which haven't been read
+      DeferredObjects::iterator deferredIt = s_deferredObjects.find(*it);
+      if (deferredIt != s_deferredObjects.end())
+      {
+         DeferredObject& object = deferredIt->second;
+         error = object.chunkPath.move(chunkPath);
+         if (error)
+            return error;
+         object.chunkPath = chunkPath;
+
+         entry.rawBytes = object.rawBytes;
+         entry.storedBytes = object.storedBytes;
+         entry.className = object.className;
+         entry.length = object.length;
+         entries.push_back(entry);
+         continue;
+      }
+
+      SEXP valueSEXP = Rf_findVarInFrame(R_GlobalEnv, Rf_install(it->c_str()));
+      if (valueSEXP == R_UnboundValue)
+         continue;
+      describeValue(valueSEXP, &entry.className, &entry.length);
+
+      error = writer.beginChunk(chunkPath);
+      if (error)
+         return error;
+
+      error = serializeValue(valueSEXP, &writer);
+      if (error)
+      {
+         // (writer errors take precedence as they cause the R error)
+         Error writerError = writer.finish();
+         if (writerError)
+            error = writerError;
+         error.addProperty("object", *it);
+         return error;
+      }
+      writer.endChunk();
+
+      writtenEntries.push_back(entries.size());
+      entries.push_back(entry);
+   }
+
+   error = writer.finish();
+   if (error)
+      return error;
+
+   // record the sizes of the chunks we wrote
+   const std::vector<chunked_file::ChunkInfo>& chunks = writer.chunks();
+   for (std::size_t i = 0; i < chunks.size() && i < writtenEntries.size(); i++)
+   {
+      ManifestEntry& entry = entries[writtenEntries[i]];
+      entry.rawBytes = chunks[i].rawBytes;
+      entry.storedBytes = chunks[i].storedBytes;
+   }
+
+   boost::uint64_t rawBytes = 0, storedBytes = 0;
+   for (std::vector<ManifestEntry>::const_iterator it = entries.begin();
+        it != entries.end(); ++it)
+   {
+      rawBytes += it->rawBytes;
+      storedBytes += it->storedBytes;
+   }
+
+   double elapsed = seconds(microsec_clock::universal_time() - startTime);
+   double throughput = elapsed > 0 ? megabytes(rawBytes) / elapsed : 0;
+
+   json::Object metricsJson;
+   metricsJson["objects"] = static_cast<int>(entries.size());
+   metricsJson["deferred_objects"] = static_cast<int>(
+                               entries.size() - writtenEntries.size());
+   metricsJson["raw_bytes"] = rawBytes;
+   metricsJson["stored_bytes"] = storedBytes;
+   metricsJson["seconds"] = elapsed;
+   metricsJson["mb_per_second"] = throughput;
+   metricsJson["threads"] = threads;
+
+   error = writeManifest(chunksPath, entries, metricsJson);
+   if (error)
+      return error;
+
+   if (!previousPath.empty())
+   {
+      error = previousPath.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
+
+   // report metrics
+   boost::format fmt("Saved %1% objects (%2$.1f MB, %3$.1f MB on disk) "
+                     "in %4$.2fs (%5$.1f MB/s, %6% threads)");
+   LOG_INFO_MESSAGE(boost::str(fmt % entries.size()
+                                   % megabytes(rawBytes)
+                                   % megabytes(storedBytes)
+                                   % elapsed
+                                   % throughput
+                                   % threads));
+
+   return Success();
+}
+
+bool hasSavedState(const FilePath& chunksPath)
+{
+   return chunksPath.complete(kManifestFile).exists();
+}
+
+Error restore(const FilePath& chunksPath, bool lazy)
+{
+   using namespace boost::posix_time;
+   ptime startTime = microsec_clock::universal_time();
+
+   std::vector<ManifestEntry> entries;
+   Error error = readManifest(chunksPath, &entries);
+   if (error)
+      return error;
+
+   // lazy restore just binds each object to a promise
+   if (lazy)
+   {
+      s_deferredObjects.clear();
+      for (std::vector<ManifestEntry>::const_iterator it = entries.begin();
+           it != entries.end(); ++it)
+      {
+         error = deferObject(*it, chunksPath);
+         if (error)
+         {
+            error.addProperty("object", it->name);
+            return error;
+         }
+      }
+      s_deferredMetrics = DeferredMetrics();
+      s_deferredMetrics.deferred = s_deferredObjects.size();
+
+      boost::format fmt("Deferred restore of %1% objects (%2$.2fs)");
+      LOG_INFO_MESSAGE(boost::str(fmt % entries.size() %
+                        seconds(microsec_clock::universal_time() - startTime)));
+
+      return Success();
+   }
+
+   // read the objects in order (the reader decompresses ahead of us)
+   std::vector<FilePath> chunkPaths;
+   for (std::vector<ManifestEntry>::const_iterator it = entries.begin();
+        it != entries.end(); ++it)
+   {
+      chunkPaths.push_back(chunksPath.complete(it->file));
+   }
+   chunked_file::Reader reader(chunkPaths, compressionThreads(), kMemoryLimit);
+   for (std::size_t i = 0; i < entries.size(); i++)
+   {
+      const std::string& name = entries[i].name;
+      SEXP valueSEXP = R_NilValue;
+      r::sexp::Protect rProtect;
+      error = unserializeValue(&reader, &valueSEXP);
+      if (!error)
+      {
+         rProtect.add(valueSEXP);
+         error = r::exec::executeSafely(boost::bind(Rf_defineVar,
+                                                    Rf_install(name.c_str()),
+                                                    valueSEXP,
+                                                    R_GlobalEnv));
+      }
+
+      // failing to read a chunk is fatal but errors creating an object
+      // (e.g. a namespace it refers to can't be loaded) just lose it
+      Error chunkError = reader.endChunk();
+      if (chunkError)
+         return chunkError;
+
+      if (error)
+      {
+         error.addProperty("object", name);
+         LOG_ERROR(error);
+
+         std::string message = "Error restoring session data (" +
+                               name + "): " +
+                               r::exec::getErrorMessage();
+         REprintf("%s", message.c_str());
+      }
+   }
+
+   error = reader.finish();
+   if (error)
+      return error;
+
+   boost::format fmt("Restored %1% objects in %2$.2fs");
+   LOG_INFO_MESSAGE(boost::str(fmt % entries.size() %
+                     seconds(microsec_clock::universal_time() - startTime)));
+
+   return Success();
+}
+
+int deferredObjectCount()
+{
+   removeStaleDeferredObjects();
+   return s_deferredObjects.size();
+}
+
+bool isDeferredObject(const std::string& name,
+                      std::string* pClassName,
+                      int* pLength)
+{
+   DeferredObjects::const_iterator it = s_deferredObjects.find(name);
+   if (it == s_deferredObjects.end() || !isPending(it->first, it->second))
+      return false;
+
+   *pClassName = it->second.className;
+   *pLength = it->second.length;
+   return true;
+}
+
+bool restoreNextDeferredObject()
+{
+   removeStaleDeferredObjects();
+   for (DeferredObjects::iterator it = s_deferredObjects.begin();
+        it != s_deferredObjects.end(); ++it)
+   {
+      // skip objects we've already failed to read (the error will be
+      // reported again if and when the object is accessed)
+      if (it->second.prefetchFailed)
+         continue;
+
+      // force the promise (this reads the object and removes its entry)
+      std::string name = it->first;
+      SEXP promiseSEXP = it->second.pPromiseSEXP->get();
+      SEXP valueSEXP;
+      s_prefetching = true;
+      Error error = r::exec::executeSafely<SEXP>(
+                        boost::bind(Rf_eval, promiseSEXP, R_GlobalEnv),
+                        &valueSEXP);
+      s_prefetching = false;
+      if (error)
+      {
+         LOG_ERROR(error);
+         DeferredObjects::iterator failedIt = s_deferredObjects.find(name);
+         if (failedIt != s_deferredObjects.end())
+            failedIt->second.prefetchFailed = true;
+      }
+
+      return true;
+   }
+
+   return false;
+}
+
+void restoreDeferredObjects()
+{
+   while (restoreNextDeferredObject())
+   {
+   }
+}
+
+void registerRoutines()
+{
+   R_CallMethodDef restoreDeferredObjectMethodDef ;
+   restoreDeferredObjectMethodDef.name = "rs_restoreDeferredObject" ;
+   restoreDeferredObjectMethodDef.fun = (DL_FUNC) rs_restoreDeferredObject ;
+   restoreDeferredObjectMethodDef.numArgs = 1;
+   r::routines::addCallMethod(restoreDeferredObjectMethodDef);
+
+   R_CallMethodDef deferredObjectsMethodDef ;
+   deferredObjectsMethodDef.name = "rs_deferredObjects" ;
+   deferredObjectsMethodDef.fun = (DL_FUNC) rs_deferredObjects ;
+   deferredObjectsMethodDef.numArgs = 0;
+   r::routines::addCallMethod(deferredObjectsMethodDef);
+}
+
+} // namespace environment_chunks
+} // namespace session
+} // namespace r
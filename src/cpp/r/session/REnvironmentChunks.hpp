@@ -0,0 +1,78 @@
+/*
+ * REnvironmentChunks.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef R_SESSION_ENVIRONMENT_CHUNKS_HPP
+#define R_SESSION_ENVIRONMENT_CHUNKS_HPP
+
+#include <string>
+
+namespace core {
+   class Error;
+   class FilePath;
+}
+
+namespace r {
+namespace session {
+namespace environment_chunks {
+
+// Saves the global environment as a directory containing one chunk file
+// per top-level object (see core::chunked_file) plus a json manifest. The
+// objects are serialized one after another on the R thread while their
+// blocks are compressed and written by a pool of threads.
+//
+// Since each object is serialized independently, environments (other than
+// the global environment, namespaces and packages) which are shared between
+// several top-level objects would be restored as distinct copies. Such
+// global environments can't be saved as chunks.
+//
+// When restoring lazily each object is bound to a promise which reads it
+// from its chunk on first access ("deferred" objects). Deferred objects
+// which are still unread when the environment is next saved have their
+// chunks moved into the new save rather than being read and rewritten.
+
+// can the current global environment be saved as chunks? (active bindings
+// and environments shared between objects can't be, so in that case the
+// environment should be saved as a whole)
+bool canSave();
+
+core::Error save(const core::FilePath& chunksPath);
+
+// does chunksPath contain a complete set of saved chunks?
+bool hasSavedState(const core::FilePath& chunksPath);
+
+core::Error restore(const core::FilePath& chunksPath, bool lazy = false);
+
+// number of deferred objects which haven't yet been read
+int deferredObjectCount();
+
+// is name a deferred object which hasn't yet been read? (if so its class
+// and length as of when it was saved are returned)
+bool isDeferredObject(const std::string& name,
+                      std::string* pClassName,
+                      int* pLength);
+
+// read the next deferred object (returns false if there are none left)
+bool restoreNextDeferredObject();
+
+// read all of the deferred objects (required before saving the global
+// environment using R's own format, which would otherwise save promises)
+void restoreDeferredObjects();
+
+// register R routines (rs_restoreDeferredObject, rs_deferredObjects)
+void registerRoutines();
+
+} // namespace environment_chunks
+} // namespace session
+} // namespace r
+
+#endif // R_SESSION_ENVIRONMENT_CHUNKS_HPP
@@ -0,0 +1,117 @@
+/*
+ * REnvironmentChunksTests.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "REnvironmentChunks.hpp"
+
+#include <string>
+
+#include <boost/assert.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+
+#include <r/RExec.hpp>
+
+#include "RSearchPath.hpp"
+
+using namespace core ;
+
+namespace r {
+namespace session {
+namespace environment_chunks {
+
+namespace {
+
+void execute(const std::string& code)
+{
+   Error error = r::exec::executeString(code);
+   BOOST_ASSERT(!error);
+}
+
+bool evaluateLogical(const std::string& code)
+{
+   bool value = false;
+   Error error = r::exec::evaluateString(code, &value);
+   BOOST_ASSERT(!error);
+   return value;
+}
+
+void clearGlobalEnvironment()
+{
+   execute("rm(list = ls(envir = globalenv(), all.names = TRUE), "
+           "envir = globalenv())");
+}
+
+void testUnsharedEnvironments()
+{
+   clearGlobalEnvironment();
+
+   // closures over the global environment and closures each with their
+   // own environment can be saved as chunks
+   execute("f <- function(x) x + 1");
+   execute("makeCounter <- function() { n <- 0; function() n <<- n + 1 }");
+   execute("a <- makeCounter(); b <- makeCounter()");
+   execute("l <- list(a = 1, f = function() NULL, s = stats::sd)");
+   BOOST_ASSERT(canSave());
+}
+
+void testSharedEnvironments(const FilePath& scratchPath)
+{
+   clearGlobalEnvironment();
+
+   // two closures which share one enclosing environment
+   execute("makeCounter <- function() { n <- 0; "
+           "list(inc = function() n <<- n + 1, get = function() n) }");
+   execute("counter <- makeCounter()");
+   execute("inc <- counter$inc; get <- counter$get; rm(counter)");
+   BOOST_ASSERT(!canSave());
+
+   // saving falls back to the single file format which preserves them
+   execute("inc()");
+   Error error = search_path::save(scratchPath);
+   BOOST_ASSERT(!error);
+   BOOST_ASSERT(!hasSavedState(scratchPath.complete("environment_chunks")));
+
+   clearGlobalEnvironment();
+   error = search_path::restore(scratchPath);
+   BOOST_ASSERT(!error);
+   BOOST_ASSERT(evaluateLogical(
+                  "identical(environment(inc), environment(get))"));
+   execute("inc()");
+   BOOST_ASSERT(evaluateLogical("identical(get(), 2)"));
+
+   // an environment shared through an attribute and a list element
+   clearGlobalEnvironment();
+   execute("e <- new.env(); x <- structure(1, env = e); y <- list(e)");
+   BOOST_ASSERT(!canSave());
+
+   // an environment which refers to itself isn't shared
+   clearGlobalEnvironment();
+   execute("e <- new.env(); assign('self', e, envir = e)");
+   BOOST_ASSERT(canSave());
+}
+
+} // anonymous namespace
+
+
+// (requires an initialized R session, scratchPath is used to save state)
+void runEnvironmentChunksTests(const FilePath& scratchPath)
+{
+   testUnsharedEnvironments();
+   testSharedEnvironments(scratchPath);
+   clearGlobalEnvironment();
+}
+
+} // namespace environment_chunks
+} // namespace session
+} // namespace r
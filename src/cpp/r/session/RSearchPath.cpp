@@ -18,6 +18,7 @@
 //
 
 #include "RSearchPath.hpp"
+#include "REnvironmentChunks.hpp"
 
 #include <string>
 #include <vector>
@@ -51,6 +52,7 @@ namespace search_path {
 namespace {   
 
 const char * const kEnvironmentFile = "environment";
+const char * const kEnvironmentChunksDir = "environment_chunks";
 const char * const kSearchPathDir = "search_path";
    
 const char * const kSearchPathElementsDir = "search_path_elements";
@@ -217,9 +219,29 @@ void attachEnvironmentData(const FilePath& dataFilePath,
 
 Error save(const FilePath& statePath)
 {
-   // save the global environment
+   // save the global environment (as independently compressed chunks
+   // unless it contains bindings which can't be saved that way). remove
+   // the other format so a stale copy is never restored
    FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   Error error = saveGlobalEnvironment(environmentFile);
+   FilePath environmentChunksPath = statePath.complete(kEnvironmentChunksDir);
+   Error error;
+   if (environment_chunks::canSave())
+   {
+      error = environmentFile.removeIfExists();
+      if (error)
+         return error;
+      error = environment_chunks::save(environmentChunksPath);
+   }
+   else
+   {
+      // (objects which are still deferred must be read before their
+      // chunks are removed)
+      environment_chunks::restoreDeferredObjects();
+      error = environmentChunksPath.removeIfExists();
+      if (error)
+         return error;
+      error = saveGlobalEnvironment(environmentFile);
+   }
    if (error)
       return error;
    
@@ -283,11 +305,21 @@ Error save(const FilePath& statePath)
 }
 
 
-Error restore(const FilePath& statePath)
+Error restore(const FilePath& statePath, bool lazyEnvironment)
 {
    // restore global environment
-   FilePath environmentFile = statePath.complete(kEnvironmentFile);
-   Error error = restoreGlobalEnvironment(environmentFile);
+   Error error;
+   FilePath environmentChunksPath = statePath.complete(kEnvironmentChunksDir);
+   if (environment_chunks::hasSavedState(environmentChunksPath))
+   {
+      error = environment_chunks::restore(environmentChunksPath,
+                                          lazyEnvironment);
+   }
+   else
+   {
+      FilePath environmentFile = statePath.complete(kEnvironmentFile);
+      error = restoreGlobalEnvironment(environmentFile);
+   }
    if (error)
       return error;
    
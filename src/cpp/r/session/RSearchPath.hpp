@@ -24,7 +24,10 @@ namespace session {
 namespace search_path {
 
 core::Error save(const core::FilePath& statePath);
-core::Error restore(const core::FilePath& statePath);
+// (lazyEnvironment defers reading the objects in the global environment
+// until they are accessed if it was saved in chunks)
+core::Error restore(const core::FilePath& statePath,
+                    bool lazyEnvironment = false);
    
 } // namespace search_path
 } // namespace session
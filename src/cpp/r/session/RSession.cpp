@@ -17,6 +17,8 @@
 #include <iostream>
 
 #include <boost/regex.hpp>
+#include <boost/format.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string/trim.hpp>
@@ -45,6 +47,7 @@
 
 #include "RClientMetrics.hpp"
 #include "RSessionState.hpp"
+#include "REnvironmentChunks.hpp"
 #include "REmbedded.hpp"
 
 #include "graphics/RGraphicsUtils.hpp"
@@ -102,6 +105,9 @@ bool s_suspended = false;
 // q() function by user)
 bool s_quitIsInteractive = true;
 
+// time at which the session started running (for time to first prompt)
+boost::posix_time::ptime s_startTime;
+
 // temporarily suppress output
 bool s_suppressOuput = false;
 class SuppressOutputInScope
@@ -219,6 +225,14 @@ void deferredRestoreSuspendedSession(
    // complete deferred init
    completeDeferredSessionInit();
 
+   // log time to first prompt
+   using namespace boost::posix_time;
+   time_duration elapsed = microsec_clock::universal_time() - s_startTime;
+   boost::format fmt("Resumed session in %1$.2fs (%2% objects deferred)");
+   LOG_INFO_MESSAGE(boost::str(fmt %
+                   (static_cast<double>(elapsed.total_milliseconds()) / 1000.0)
+                   % r::session::environment_chunks::deferredObjectCount()));
+
 }
 
 Error saveDefaultGlobalEnvironment()
@@ -232,6 +246,10 @@ Error saveDefaultGlobalEnvironment()
 
    // suppress interrupts which occur during saving
    r::exec::IgnoreInterruptsScope ignoreInterrupts;
+
+   // read any objects which are still deferred (R would otherwise save
+   // their promises)
+   r::session::environment_chunks::restoreDeferredObjects();
          
    // save global environment
    Error error = r::exec::executeSafely(
@@ -338,6 +356,23 @@ Error initialize()
    // initialize console history capacity
    r::session::consoleHistory().setCapacityFromRHistsize();
 
+   // load the image of precompiled R tools (if we have one)
+   if (!s_options.rToolsImagePath.empty())
+   {
+      if (s_options.rToolsImagePath.exists())
+      {
+         Error error = r::sourceManager().loadToolsImage(
+                                                s_options.rToolsImagePath);
+         if (error)
+            LOG_ERROR(error);
+      }
+      else
+      {
+         LOG_WARNING_MESSAGE("Tools image not found: " +
+                             s_options.rToolsImagePath.absolutePath());
+      }
+   }
+
    // install R tools
    FilePath toolsFilePath = s_options.rSourcePath.complete("Tools.R");
    Error error = r::sourceManager().sourceTools(toolsFilePath);
@@ -368,7 +403,8 @@ Error initialize()
    }
 
    error = graphics::device::initialize(graphicsPath,
-                                        s_callbacks.locator);
+                                        s_callbacks.locator,
+                                        s_options.vectorGraphics);
    if (error) 
       return error;
    
@@ -396,6 +432,7 @@ Error initialize()
          // messages to make their way back to the user)
          boost::function<Error()> deferredRestoreAction;
          r::session::state::restore(s_suspendedSessionPath, 
+                                    s_options.lazyWorkspaceRestore,
                                     &deferredRestoreAction, 
                                     &errorMessages);
          
@@ -1132,6 +1169,9 @@ SEXP posixQuitHook(SEXP call, SEXP op, SEXP args, SEXP rho)
    
 Error run(const ROptions& options, const RCallbacks& callbacks) 
 {   
+   // record start time
+   s_startTime = boost::posix_time::microsec_clock::universal_time();
+
    // copy options and callbacks
    s_options = options ;
    s_callbacks = callbacks ;
@@ -1187,6 +1227,9 @@ Error run(const ROptions& options, const RCallbacks& callbacks)
    createUUIDMethodDef.numArgs = 0;
    r::routines::addCallMethod(createUUIDMethodDef);
 
+   // register deferred workspace object methods
+   r::session::environment_chunks::registerRoutines();
+
    // run R
    bool newSession = !s_suspendedSessionPath.exists();
    r::session::Callbacks cb;
@@ -1222,6 +1265,24 @@ void ensureDeserialized()
       s_deferredDeserializationAction.clear();
    }
 }
+
+bool isDeferredWorkspaceObject(const std::string& name,
+                               std::string* pClassName,
+                               int* pLength)
+{
+   return r::session::environment_chunks::isDeferredObject(name,
+                                                           pClassName,
+                                                           pLength);
+}
+
+bool prefetchDeferredWorkspaceObject()
+{
+   // suppress interrupts and output (as we do for the rest of the restore)
+   r::exec::IgnoreInterruptsScope ignoreInterrupts;
+   SuppressOutputInScope suppressOutput;
+
+   return r::session::environment_chunks::restoreNextDeferredObject();
+}
    
 namespace {
 
@@ -195,10 +195,10 @@ bool save(const FilePath& statePath)
    return saved;
 }
 
-Error deferredRestore(const FilePath& statePath)
+Error deferredRestore(const FilePath& statePath, bool lazyEnvironment)
 {
    // search path
-   Error error = search_path::restore(statePath);
+   Error error = search_path::restore(statePath, lazyEnvironment);
    if (error)
       return error;
 
@@ -206,6 +206,7 @@ Error deferredRestore(const FilePath& statePath)
 }
    
 bool restore(const FilePath& statePath,
+             bool lazyEnvironment,
              boost::function<Error()>* pDeferredRestoreAction,
              std::string* pErrorMessages)
 {
@@ -250,7 +251,9 @@ bool restore(const FilePath& statePath,
    // process that are potentially highly latent. this allows clients
    // to bring their UI up and then receive an event indicating that the
    // latent deserialization actions are taking place
-   *pDeferredRestoreAction = boost::bind(deferredRestore, statePath);
+   *pDeferredRestoreAction = boost::bind(deferredRestore,
+                                         statePath,
+                                         lazyEnvironment);
    
    // return true if there were no error messages
    return pErrorMessages->empty();
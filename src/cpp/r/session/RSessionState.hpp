@@ -31,6 +31,7 @@ namespace state {
 bool save(const core::FilePath& statePath);
    
 bool restore(const core::FilePath& statePath, 
+             bool lazyEnvironment,
              boost::function<core::Error()>* pDeferredRestoreAction,
              std::string* pErrorMessages); 
    
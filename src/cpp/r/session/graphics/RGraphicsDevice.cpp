@@ -16,18 +16,22 @@
 #include <cstdlib>
 
 #include <boost/bind.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/Error.hpp>
 #include <core/FilePath.hpp>
 #include <core/FileSerializer.hpp>
+#include <core/json/Json.hpp>
 
 #include <r/RExec.hpp>
 #include <r/RFunctionHook.hpp>
 #include <r/RRoutines.hpp>
 #include <r/RErrorCategory.hpp>
+#include <r/RSexp.hpp>
 
 #include "RGraphicsUtils.hpp"
 #include "RGraphicsPlotManager.hpp"
+#include "RGraphicsVectorList.hpp"
 #include "handler/RGraphicsHandler.hpp"
 
 // nix windows definitions
@@ -70,12 +74,55 @@ boost::function<bool(double*,double*)> s_locatorFunction;
 // global size attributes (used to initialize new devices)
 int s_width = 0;
 int s_height = 0;   
+
+// size requested by the client which hasn't yet been applied to the device.
+// applying a size replays the display list so bursts of requests (e.g. from
+// dragging the pane splitter) are coalesced: only the last one is applied,
+// either once no further requests have arrived for kResizeSettleMs or as
+// soon as R needs the device
+bool s_resizePending = false;
+DisplaySize s_requestedSize;
+boost::posix_time::ptime s_requestedSizeTime;
+const int kResizeSettleMs = 200;
+
+// resolution of our device (see handler::setDeviceAttributes)
+const int kDefaultResolution = 72;
    
 // provide GraphicsDeviceEvents for plot manager
 GraphicsDeviceEvents s_graphicsDeviceEvents;   
+
+// when rendering vector graphics we record the primitives drawn on the
+// current page (in addition to drawing them) so that plots can be written
+// as SVG which the client scales itself as it is resized
+bool s_vectorGraphics = false;
+VectorList s_vectorList;
+
+// statistics on the images we have rendered (by format)
+struct ImageStats
+{
+   ImageStats() : images(0), bytes(0), milliseconds(0) {}
+   int images;
+   double bytes;
+   double milliseconds;
+};
+ImageStats s_pngStats;
+ImageStats s_svgStats;
    
 using namespace handler;
 
+VectorStyle vectorStyle(const pGEcontext gc)
+{
+   VectorStyle style;
+   style.col = gc->col;
+   style.fill = gc->fill;
+   style.lwd = gc->lwd;
+   style.lty = gc->lty;
+   style.lend = gc->lend;
+   style.ljoin = gc->ljoin;
+   style.lmitre = gc->lmitre;
+   return style;
+}
+
    
 void GD_NewPage(const pGEcontext gc, pDevDesc dev)
 {
@@ -84,6 +131,9 @@ void GD_NewPage(const pGEcontext gc, pDevDesc dev)
    // delegate
    handler::newPage(gc, dev);
 
+   if (s_vectorGraphics)
+      s_vectorList.newPage(DisplaySize(s_width, s_height), gc->fill);
+
    // fire event (pass previousPageSnapshot)
    SEXP previousPageSnapshot = s_pGEDevDesc->savedSnapshot;
    s_graphicsDeviceEvents.onNewPage(previousPageSnapshot);
@@ -132,6 +182,9 @@ void GD_Clip(double x0, double x1, double y0, double y1, pDevDesc dev)
    TRACE_GD_CALL
 
    handler::clip(x0, x1, y0, y1, dev);
+
+   if (s_vectorGraphics)
+      s_vectorList.clip(x0, x1, y0, y1);
 }
 
 
@@ -145,6 +198,9 @@ void GD_Rect(double x0,
    TRACE_GD_CALL
 
    handler::rect(x0, y0, x1, y1, gc, dev);
+
+   if (s_vectorGraphics)
+      s_vectorList.rect(x0, y0, x1, y1, vectorStyle(gc));
 }
 
 void GD_Path(double *x,
@@ -158,6 +214,9 @@ void GD_Path(double *x,
    TRACE_GD_CALL
 
    handler::path(x, y, npoly, nper, winding, gc, dd);
+
+   if (s_vectorGraphics)
+      s_vectorList.path(x, y, npoly, nper, winding, vectorStyle(gc));
 }
 
 void GD_Raster(unsigned int *raster,
@@ -175,6 +234,12 @@ void GD_Raster(unsigned int *raster,
    TRACE_GD_CALL
 
    handler::raster(raster, w, h, x, y, width, height, rot, interpolate, gc, dd);
+
+   if (s_vectorGraphics)
+   {
+      s_vectorList.raster(raster, w, h, x, y, width, height, rot,
+                          interpolate);
+   }
 }
 
 SEXP GD_Cap(pDevDesc dd)
@@ -193,6 +258,9 @@ void GD_Circle(double x,
    TRACE_GD_CALL
 
    handler::circle(x, y, r, gc, dev);
+
+   if (s_vectorGraphics)
+      s_vectorList.circle(x, y, r, vectorStyle(gc));
 }
 
 void GD_Line(double x1,
@@ -205,6 +273,9 @@ void GD_Line(double x1,
    TRACE_GD_CALL
 
    handler::line(x1, y1, x2, y2, gc, dev);
+
+   if (s_vectorGraphics)
+      s_vectorList.line(x1, y1, x2, y2, vectorStyle(gc));
 }
 
 void GD_Polyline(int n,
@@ -216,6 +287,9 @@ void GD_Polyline(int n,
    TRACE_GD_CALL
 
    handler::polyline(n, x, y, gc, dev);
+
+   if (s_vectorGraphics)
+      s_vectorList.polyline(n, x, y, vectorStyle(gc));
 }
 
 void GD_Polygon(int n,
@@ -227,6 +301,9 @@ void GD_Polygon(int n,
    TRACE_GD_CALL
 
    handler::polygon(n, x, y, gc, dev);
+
+   if (s_vectorGraphics)
+      s_vectorList.polygon(n, x, y, vectorStyle(gc));
 }
 
 void GD_MetricInfo(int c,
@@ -255,6 +332,27 @@ double GD_StrWidthUTF8(const char *str, const pGEcontext gc, pDevDesc dev)
    return handler::strWidth(str, gc, dev);
 }
 
+// record text along with the metrics of our fonts (which the renderer of
+// the vector list may not have)
+void recordText(double x,
+                double y,
+                const char *str,
+                double rot,
+                double hadj,
+                const pGEcontext gc,
+                pDevDesc dev)
+{
+   VectorText text;
+   text.col = gc->col;
+   text.fontSize = gc->cex * gc->ps;
+   text.fontFace = gc->fontface;
+   text.fontFamily = gc->fontfamily;
+   text.rot = rot;
+   text.hadj = hadj;
+   text.width = handler::strWidth(str, gc, dev);
+   s_vectorList.text(x, y, str, text);
+}
+
 void GD_Text(double x,
              double y,
              const char *str,
@@ -266,6 +364,9 @@ void GD_Text(double x,
    TRACE_GD_CALL
 
    handler::text(x, y, str, rot, hadj, gc, dev);
+
+   if (s_vectorGraphics)
+      recordText(x, y, str, rot, hadj, gc, dev);
 }
 
 void GD_TextUTF8(double x,
@@ -279,6 +380,9 @@ void GD_TextUTF8(double x,
    TRACE_GD_CALL
 
    handler::text(x, y, str, rot, hadj, gc, dev);
+
+   if (s_vectorGraphics)
+      recordText(x, y, str, rot, hadj, gc, dev);
 }
 
 
@@ -412,6 +516,47 @@ void resizeGraphicsDevice()
    // notify listeners of resize
    s_graphicsDeviceEvents.onResized();
 }   
+
+void applyRequestedSize()
+{
+   if (!s_resizePending)
+      return;
+
+   s_resizePending = false;
+   s_width = s_requestedSize.width;
+   s_height = s_requestedSize.height;
+
+   // if there is a device active sync its size
+   if (s_pGEDevDesc != NULL)
+      resizeGraphicsDevice();
+}
+
+DisplaySize requestedDisplaySize()
+{
+   if (s_resizePending)
+      return s_requestedSize;
+   else
+      return DisplaySize(s_width, s_height);
+}
+
+// have there been no size requests for kResizeSettleMs?
+bool resizeSettled()
+{
+   using namespace boost::posix_time;
+   if (s_requestedSizeTime.is_not_a_date_time())
+      return true;
+   else
+      return (microsec_clock::universal_time() - s_requestedSizeTime) >=
+                                             milliseconds(kResizeSettleMs);
+}
+
+int displayResolution()
+{
+   if (s_pGEDevDesc != NULL && s_pGEDevDesc->dev->ipr[0] > 0)
+      return static_cast<int>(1.0 / s_pGEDevDesc->dev->ipr[0] + 0.5);
+   else
+      return kDefaultResolution;
+}
    
 // routine which creates device  
 SEXP createGD()
@@ -421,6 +566,9 @@ SEXP createGD()
       Rf_error("Only one RStudio graphics device is permitted");
 
    R_CheckDeviceAvailable();
+
+   // create at the most recently requested size
+   applyRequestedSize();
    
    BEGIN_SUSPEND_INTERRUPTS 
    {
@@ -578,8 +726,7 @@ void deviceConvert(double* x,
    }
 }
 
-Error saveSnapshot(const core::FilePath& snapshotFile,
-                   const core::FilePath& imageFile)
+Error saveSnapshot(const core::FilePath& snapshotFile)
 {
    // ensure we are active
    Error error = makeActive();
@@ -587,10 +734,16 @@ Error saveSnapshot(const core::FilePath& snapshotFile,
       return error ;
    
    // save snaphot file
-   error = r::exec::RFunction(".rs.saveGraphics",
-                              string_utils::utf8ToSystem(snapshotFile.absolutePath())).call();
+   return r::exec::RFunction(".rs.saveGraphics",
+                             string_utils::utf8ToSystem(snapshotFile.absolutePath())).call();
+}
+
+Error saveImage(const core::FilePath& imageFile)
+{
+   // ensure we are active
+   Error error = makeActive();
    if (error)
-      return error;
+      return error ;
 
    // resync display list before saving png if necessary. for unknown reasons
    // there are permutations of plotting code which leaves the underlying PNG
@@ -599,9 +752,53 @@ Error saveSnapshot(const core::FilePath& snapshotFile,
    if (handler::resyncDisplayListBeforeWriteToPNG())
       resyncDisplayList();
 
-   // save png file
-   DeviceContext* pDC = (DeviceContext*)s_pGEDevDesc->dev->deviceSpecific;
-   return handler::writeToPNG(imageFile, pDC, true);
+   using namespace boost::posix_time;
+   ptime startTime = microsec_clock::universal_time();
+
+   // save svg or png file
+   ImageStats* pStats;
+   if (s_vectorGraphics)
+   {
+      error = s_vectorList.writeSvg(imageFile);
+      pStats = &s_svgStats;
+   }
+   else
+   {
+      DeviceContext* pDC = (DeviceContext*)s_pGEDevDesc->dev->deviceSpecific;
+      error = handler::writeToPNG(imageFile, pDC, true);
+      pStats = &s_pngStats;
+   }
+   if (error)
+      return error;
+
+   // update stats
+   pStats->images++;
+   pStats->bytes += imageFile.size();
+   pStats->milliseconds +=
+         (microsec_clock::universal_time() - startTime).total_microseconds()
+                                                                  / 1000.0;
+   return Success();
+}
+
+json::Object imageStatsAsJson(const ImageStats& stats)
+{
+   json::Object statsJson;
+   statsJson["images"] = stats.images;
+   statsJson["bytes"] = stats.bytes;
+   statsJson["milliseconds"] = stats.milliseconds;
+   return statsJson;
+}
+
+// statistics on the images rendered so far (e.g. for comparing the size
+// and rendering time of vector and bitmap plots)
+SEXP rs_graphicsImageStats()
+{
+   json::Object statsJson;
+   statsJson["png"] = imageStatsAsJson(s_pngStats);
+   statsJson["svg"] = imageStatsAsJson(s_svgStats);
+
+   r::sexp::Protect rProtect;
+   return r::sexp::create(statsJson, &rProtect);
 }
 
 Error restoreSnapshot(const core::FilePath& snapshotFile)
@@ -624,11 +821,19 @@ void copyToActiveDevice()
    
 std::string imageFileExtension()
 {
-   return "png";
+   return s_vectorGraphics ? "svg" : "png";
+}
+
+bool scalableImages()
+{
+   return s_vectorGraphics;
 }
 
 void onBeforeExecute()
 {
+   // code which is about to execute may draw on (or query) the device
+   applyRequestedSize();
+
    if (s_pGEDevDesc != NULL)
    {
       DeviceContext* pDC = (DeviceContext*)s_pGEDevDesc->dev->deviceSpecific;
@@ -644,10 +849,14 @@ const int kDefaultHeight = 500;
    
 Error initialize(
             const FilePath& graphicsPath,
-            const boost::function<bool(double*,double*)>& locatorFunction)
+            const boost::function<bool(double*,double*)>& locatorFunction,
+            bool vectorGraphics)
 {      
    // save reference to locator function
    s_locatorFunction = locatorFunction;
+
+   // record vector graphics if requested
+   s_vectorGraphics = vectorGraphics;
    
    // device conversion functions
    UnitConversionFunctions convert;
@@ -659,11 +868,17 @@ Error initialize(
    // create plot manager (provide functions & events)
    GraphicsDeviceFunctions graphicsDevice;
    graphicsDevice.displaySize = displaySize;
+   graphicsDevice.requestedDisplaySize = requestedDisplaySize;
+   graphicsDevice.displayResolution = displayResolution;
+   graphicsDevice.resizeSettled = resizeSettled;
+   graphicsDevice.applyRequestedSize = applyRequestedSize;
    graphicsDevice.convert = convert;
    graphicsDevice.saveSnapshot = saveSnapshot;
+   graphicsDevice.saveImage = saveImage;
    graphicsDevice.restoreSnapshot = restoreSnapshot;
    graphicsDevice.copyToActiveDevice = copyToActiveDevice;
    graphicsDevice.imageFileExtension = imageFileExtension;
+   graphicsDevice.scalableImages = scalableImages;
    graphicsDevice.close = close;
    graphicsDevice.onBeforeExecute = onBeforeExecute;
    Error error = plotManager().initialize(graphicsPath,
@@ -693,6 +908,12 @@ Error initialize(
       activateGDMethodDef.numArgs = 0;
       r::routines::addCallMethod(activateGDMethodDef);
 
+      // register image statistics routine
+      R_CallMethodDef imageStatsMethodDef ;
+      imageStatsMethodDef.name = "rs_graphicsImageStats" ;
+      imageStatsMethodDef.fun = (DL_FUNC) rs_graphicsImageStats ;
+      imageStatsMethodDef.numArgs = 0;
+      r::routines::addCallMethod(imageStatsMethodDef);
 
       // register dev.set hook to handle special dev.set(which = 1) case
       error = function_hook::registerReplaceHook("dev.set",
@@ -721,25 +942,35 @@ void setSize(int width, int height)
 {
    // only set if the values have changed (prevents unnecessary plot 
    // invalidations from occuring)
-   if ( width != s_width || height != s_height )
+   if (DisplaySize(width, height) == requestedDisplaySize())
+      return;
+
+   // without a device there is nothing to resize
+   if (s_pGEDevDesc == NULL)
    {
+      s_resizePending = false;
       s_width = width;
       s_height = height;
-      
-      // if there is a device active sync its size
-      if (s_pGEDevDesc != NULL)
-         resizeGraphicsDevice();
+   }
+
+   // otherwise record the request (see applyRequestedSize). note that
+   // returning to the current size cancels any pending resize
+   else
+   {
+      s_resizePending = (width != s_width || height != s_height);
+      s_requestedSize = DisplaySize(width, height);
+      s_requestedSizeTime = boost::posix_time::microsec_clock::universal_time();
    }
 }
    
 int getWidth()
 {
-   return s_width;
+   return requestedDisplaySize().width;
 }
    
 int getHeight()
 {
-   return s_height;
+   return requestedDisplaySize().height;
 }
    
 void close()
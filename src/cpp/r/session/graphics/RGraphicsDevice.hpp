@@ -29,10 +29,11 @@ namespace device {
 extern const int kDefaultWidth;
 extern const int kDefaultHeight;    
    
-// initialize
+// initialize (vectorGraphics renders plots as SVG rather than PNG)
 core::Error initialize(
           const core::FilePath& graphicsPath,
-          const boost::function<bool(double*,double*)>& locatorFunction);
+          const boost::function<bool(double*,double*)>& locatorFunction,
+          bool vectorGraphics = false);
    
 // device size
 void setSize(int width, int height);
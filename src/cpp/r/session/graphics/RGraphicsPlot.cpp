@@ -14,6 +14,7 @@
 #include "RGraphicsPlot.hpp"
 
 #include <iostream>
+#include <algorithm>
 
 #include <boost/format.hpp>
 
@@ -31,12 +32,20 @@ using namespace core ;
 namespace r {
 namespace session {
 namespace graphics {
+
+namespace {
+
+// maximum number of rendered images to keep for each plot
+const std::size_t kMaxCachedImages = 4;
+
+} // anonymous namespace
       
 Plot::Plot(const GraphicsDeviceFunctions& graphicsDevice,
            const FilePath& baseDirPath,
            SEXP manipulatorSEXP)
    : graphicsDevice_(graphicsDevice), 
      baseDirPath_(baseDirPath),
+     renderedResolution_(graphicsDevice.displayResolution()),
      needsUpdate_(false),
      manipulator_(manipulatorSEXP)
 {
@@ -50,13 +59,15 @@ Plot::Plot(const GraphicsDeviceFunctions& graphicsDevice,
      baseDirPath_(baseDirPath), 
      storageUuid_(storageUuid),
      renderedSize_(renderedSize),
+     renderedResolution_(graphicsDevice.displayResolution()),
      needsUpdate_(false),
      manipulator_()
 {
-   // invalidate if the image file doesn't exist (allows the server
-   // to migrate between different image backends e.g. png, jpeg, etc)
-   if (!imageFilePath(storageUuid_).exists())
-      invalidate();
+   // if the image file doesn't exist it will be re-rendered from the
+   // snapshot when needed (allows the server to migrate between different
+   // image backends e.g. png, jpeg, etc)
+   if (imageFilePath(storageUuid_, renderedImageKey()).exists())
+      cachedImages_.push_back(renderedImageKey());
 } 
    
 std::string Plot::storageUuid() const
@@ -118,26 +129,36 @@ void Plot::saveManipulator() const
    
 Error Plot::renderFromDisplay()
 {
-   // we can use our cached representation if we don't need an update and our 
-   // rendered size is the same as the current graphics device size
-   if ( !needsUpdate_ &&
-        (renderedSize() == graphicsDevice_.displaySize()) )
+   ImageKey key(graphicsDevice_.requestedDisplaySize(),
+                graphicsDevice_.displayResolution());
+
+   // if the display list hasn't changed then we only need an image at the
+   // requested size (note that this never rewrites the snapshot)
+   if (!needsUpdate_ && hasStorage())
    {
-      return Success();
+      // use a cached image if we have one
+      std::list<ImageKey>::iterator it = std::find(cachedImages_.begin(),
+                                                   cachedImages_.end(),
+                                                   key);
+      if (it != cachedImages_.end())
+      {
+         cachedImages_.splice(cachedImages_.begin(), cachedImages_, it);
+         renderedSize_ = key.size;
+         renderedResolution_ = key.resolution;
+         return Success();
+      }
+
+      return renderImage(key);
    }
     
    // generate a new storage uuid
    std::string storageUuid = core::system::generateUuid();
    
-   // generate snapshot and image files
-   Error error = graphicsDevice_.saveSnapshot(snapshotFilePath(storageUuid),
-                                              imageFilePath(storageUuid));
+   // generate snapshot file
+   Error error = graphicsDevice_.saveSnapshot(snapshotFilePath(storageUuid));
    if (error)
       return Error(errc::PlotRenderingError, error, ERROR_LOCATION);
    
-   // save rendered size
-   renderedSize_ = graphicsDevice_.displaySize();
-   
    // save manipulator (if any)
    saveManipulator(storageUuid);
 
@@ -147,6 +168,11 @@ Error Plot::renderFromDisplay()
    // update state
    storageUuid_ = storageUuid;
    needsUpdate_ = false;
+
+   // render the image
+   error = renderImage(key);
+   if (error)
+      return error;
    
    // return error status 
    return removeError;
@@ -168,12 +194,10 @@ Error Plot::renderFromDisplaySnapshot(SEXP snapshot)
    //
    // we can't generate an image file at this point in the processing
    // because the GraphicsDevice has already moved on to the next page. this is
-   // OK though because we simply set needsUpdate_ = true below and the next
-   // time renderFromDisplay is called it will be rendered
+   // OK though because the cache of images is now empty so the next time
+   // renderFromDisplay is called (after the snapshot has been restored to
+   // the display) the image will be rendered
    //
-   
-   // save rendered size
-   renderedSize_ = graphicsDevice_.displaySize();
 
    // save manipulator (if any)
    saveManipulator(storageUuid);
@@ -183,7 +207,7 @@ Error Plot::renderFromDisplaySnapshot(SEXP snapshot)
    
    // update state
    storageUuid_ = storageUuid;
-   needsUpdate_ = true;
+   needsUpdate_ = false;
    
    // return error status
    return removeError;
@@ -192,7 +216,7 @@ Error Plot::renderFromDisplaySnapshot(SEXP snapshot)
 
 std::string Plot::imageFilename() const
 {
-   return imageFilePath(storageUuid()).filename();
+   return imageFilePath(storageUuid(), renderedImageKey()).filename();
 }
 
 Error Plot::renderToDisplay()
@@ -217,7 +241,7 @@ Error Plot::removeFiles()
       return Success();
    
    Error snapshotError = snapshotFilePath(storageUuid_).removeIfExists();
-   Error imageError = imageFilePath(storageUuid_).removeIfExists();
+   Error imageError = removeCachedImages();
    Error manipulatorError = manipulatorFilePath(storageUuid_).removeIfExists();
    
    if (snapshotError)
@@ -240,6 +264,54 @@ bool Plot::hasStorage() const
    return !storageUuid_.empty();
 }
 
+Plot::ImageKey Plot::renderedImageKey() const
+{
+   return ImageKey(renderedSize_, renderedResolution_);
+}
+
+Error Plot::renderImage(const ImageKey& key)
+{
+   // apply any pending resize to the device
+   graphicsDevice_.applyRequestedSize();
+
+   // write the image
+   Error error = graphicsDevice_.saveImage(imageFilePath(storageUuid_, key));
+   if (error)
+      return Error(errc::PlotRenderingError, error, ERROR_LOCATION);
+
+   // add it to the cache (removing the least recently used image if the
+   // cache is full)
+   cachedImages_.remove(key);
+   cachedImages_.push_front(key);
+   if (cachedImages_.size() > kMaxCachedImages)
+   {
+      error = imageFilePath(storageUuid_, cachedImages_.back()).removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+      cachedImages_.pop_back();
+   }
+
+   // update state
+   renderedSize_ = key.size;
+   renderedResolution_ = key.resolution;
+
+   return Success();
+}
+
+Error Plot::removeCachedImages()
+{
+   Error error = legacyImageFilePath(storageUuid_).removeIfExists();
+   for (std::list<ImageKey>::const_iterator it = cachedImages_.begin();
+        it != cachedImages_.end(); ++it)
+   {
+      Error removeError = imageFilePath(storageUuid_, *it).removeIfExists();
+      if (removeError && !error)
+         error = removeError;
+   }
+   cachedImages_.clear();
+   return error;
+}
+
 FilePath Plot::snapshotFilePath() const
 {
    return snapshotFilePath(storageUuid());
@@ -251,7 +323,19 @@ FilePath Plot::snapshotFilePath(const std::string& storageUuid) const
    return baseDirPath_.complete(storageUuid + ".snapshot");
 }
    
-FilePath Plot::imageFilePath(const std::string& storageUuid) const
+FilePath Plot::imageFilePath(const std::string& storageUuid,
+                             const ImageKey& key) const
+{
+   boost::format fmt("%1%_%2%x%3%_%4%.%5%");
+   std::string filename = boost::str(fmt % storageUuid
+                                         % key.size.width
+                                         % key.size.height
+                                         % key.resolution
+                                         % graphicsDevice_.imageFileExtension());
+   return baseDirPath_.complete(filename);
+}
+
+FilePath Plot::legacyImageFilePath(const std::string& storageUuid) const
 {
    std::string extension = graphicsDevice_.imageFileExtension();
    return baseDirPath_.complete(storageUuid + "." + extension);
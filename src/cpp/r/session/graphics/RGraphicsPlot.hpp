@@ -15,6 +15,7 @@
 #define R_SESSION_GRAPHICS_PLOT_HPP
 
 #include <string>
+#include <list>
 
 #include <boost/utility.hpp>
 
@@ -58,8 +59,11 @@ public:
    void manipulatorAsJson(core::json::Value* pValue) const;
    void saveManipulator() const;
    
+   // note that the display list has changed (a new snapshot is required)
    void invalidate();
    
+   // save a snapshot of the display (if it has changed) and render an image
+   // of it at the requested size (if one isn't already cached)
    core::Error renderFromDisplay();
    core::Error renderFromDisplaySnapshot(SEXP snapshot);
    std::string imageFilename() const;
@@ -71,11 +75,33 @@ public:
    void purgeInMemoryResources();
    
 private:
+   // rendered images are cached by size and resolution
+   struct ImageKey
+   {
+      ImageKey(const DisplaySize& size, int resolution)
+         : size(size), resolution(resolution)
+      {
+      }
+      DisplaySize size;
+      int resolution;
+
+      bool operator==(const ImageKey& other) const
+      {
+         return size == other.size && resolution == other.resolution;
+      }
+   };
+
    bool hasStorage() const;
 
+   ImageKey renderedImageKey() const;
+   core::Error renderImage(const ImageKey& key);
+   core::Error removeCachedImages();
+
    core::FilePath snapshotFilePath() const ;
    core::FilePath snapshotFilePath(const std::string& storageUuid) const;
-   core::FilePath imageFilePath(const std::string& storageUuid) const;
+   core::FilePath imageFilePath(const std::string& storageUuid,
+                                const ImageKey& key) const;
+   core::FilePath legacyImageFilePath(const std::string& storageUuid) const;
 
    bool hasManipulatorFile() const;
    core::FilePath manipulatorFilePath(const std::string& storageUuid) const;
@@ -87,8 +113,12 @@ private:
    core::FilePath baseDirPath_;
    std::string storageUuid_ ;
    DisplaySize renderedSize_ ;
+   int renderedResolution_;
    bool needsUpdate_;
 
+   // images of the current snapshot (most recently used first)
+   std::list<ImageKey> cachedImages_;
+
    // manipulator and protection scope for it
    mutable PlotManipulator manipulator_;
 };
@@ -14,6 +14,7 @@
 #include "RGraphicsPlotManager.hpp"
 
 #include <algorithm>
+#include <cmath>
 
 #include <boost/bind.hpp>
 #include <boost/function.hpp>
@@ -46,6 +47,10 @@ double pixelsToInches(int pixels)
    return (double)pixels / 96.0;
 }
 
+// largest change in aspect ratio for which a scalable image is scaled by
+// the client rather than rendered again
+const double kMaxScaledAspectChange = 0.05;
+
 } // anonymous namespace
 
 const char * const kPngFormat = "png";
@@ -399,7 +404,35 @@ bool PlotManager::hasOutput() const
     
 bool PlotManager::hasChanges() const
 {
-   return displayHasChanges_ ;
+   if (displayHasChanges_)
+      return true;
+
+   // once the client has stopped resizing the active plot needs to be
+   // rendered at the size it last requested
+   if (!hasPlot() || !graphicsDevice_.resizeSettled())
+      return false;
+
+   DisplaySize renderedSize = activePlot().renderedSize();
+   DisplaySize requestedSize = graphicsDevice_.requestedDisplaySize();
+   if (renderedSize == requestedSize)
+      return false;
+
+   // scalable images are scaled by the client so they need only be
+   // rendered again if their aspect ratio no longer fits
+   if (graphicsDevice_.scalableImages())
+   {
+      if (renderedSize.height <= 0 || requestedSize.height <= 0)
+         return true;
+
+      double renderedAspect = static_cast<double>(renderedSize.width) /
+                              renderedSize.height;
+      double requestedAspect = static_cast<double>(requestedSize.width) /
+                               requestedSize.height;
+      return std::fabs(requestedAspect / renderedAspect - 1.0) >
+                                                      kMaxScaledAspectChange;
+   }
+
+   return true;
 }
    
 void PlotManager::render(boost::function<void(DisplayState)> outputFunction)
@@ -447,6 +480,9 @@ void PlotManager::render(boost::function<void(DisplayState)> outputFunction)
 
       // get manipulator
       activePlot().manipulatorAsJson(&plotManipulatorJson);
+
+      // clear changes flag again (rendering may have resized the device)
+      displayHasChanges_ = false;
    }
    else  // write "empty" image 
    {
@@ -709,7 +745,9 @@ void PlotManager::onDeviceResized()
    if (suppressDeviceEvents_)
       return;
    
-   invalidateActivePlot();
+   // resizing doesn't change the display list so the active plot's
+   // snapshot is still valid (it just needs an image at the new size)
+   displayHasChanges_ = true;
 }
 
 void PlotManager::onDeviceClosed()
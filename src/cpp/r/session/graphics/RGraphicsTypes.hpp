@@ -58,13 +58,22 @@ struct UnitConversionFunctions
 
 struct GraphicsDeviceFunctions
 {
+   // size of the device and the size most recently requested for it (these
+   // differ while a resize is pending, see device::setSize)
    boost::function<DisplaySize()> displaySize;
+   boost::function<DisplaySize()> requestedDisplaySize;
+   boost::function<int()> displayResolution;
+   boost::function<bool()> resizeSettled;
+   boost::function<void()> applyRequestedSize;
    UnitConversionFunctions convert;
-   boost::function<core::Error(const core::FilePath&,
-                               const core::FilePath&)> saveSnapshot;
+   boost::function<core::Error(const core::FilePath&)> saveSnapshot;
+   boost::function<core::Error(const core::FilePath&)> saveImage;
    boost::function<core::Error(const core::FilePath&)> restoreSnapshot;
    boost::function<void()> copyToActiveDevice;
    boost::function<std::string()> imageFileExtension;
+   // are images scalable (i.e. they can be displayed at any size by the
+   // client without being rendered again)
+   boost::function<bool()> scalableImages;
    boost::function<void()> close;
    boost::function<void()> onBeforeExecute;
 };  
@@ -0,0 +1,698 @@
+/*
+ * RGraphicsVectorList.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "RGraphicsVectorList.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include <boost/cstdint.hpp>
+
+#include <core/Error.hpp>
+#include <core/FilePath.hpp>
+#include <core/FileSerializer.hpp>
+#include <core/StringUtils.hpp>
+
+using namespace core ;
+
+namespace r {
+namespace session {
+namespace graphics {
+
+namespace {
+
+// operations
+enum
+{
+   kOpPage = 1,
+   kOpClip,
+   kOpLine,
+   kOpPolyline,
+   kOpPolygon,
+   kOpRect,
+   kOpCircle,
+   kOpPath,
+   kOpRaster,
+   kOpText
+};
+
+// line ends and joins (as defined by the graphics engine)
+const int kRoundCap = 1;
+const int kButtCap = 2;
+const int kRoundJoin = 1;
+const int kMitreJoin = 2;
+
+// line types (lty) with special meanings
+const int kSolidLine = 0;
+const int kBlankLine = -1;
+
+// R line widths are in 1/96 inch and the device is at 72 dpi
+const double kLineWidthScale = 72.0 / 96.0;
+
+// sequential reader for the encoded list
+class Reader
+{
+public:
+   explicit Reader(const std::string& data) : data_(data), pos_(0) {}
+
+   bool atEnd() const { return pos_ >= data_.size(); }
+
+   int readByte()
+   {
+      return static_cast<unsigned char>(data_[pos_++]);
+   }
+
+   unsigned int readUInt()
+   {
+      boost::uint32_t value;
+      std::memcpy(&value, data_.data() + pos_, sizeof(value));
+      pos_ += sizeof(value);
+      return value;
+   }
+
+   double readDouble()
+   {
+      float value;
+      std::memcpy(&value, data_.data() + pos_, sizeof(value));
+      pos_ += sizeof(value);
+      return value;
+   }
+
+   std::string readString()
+   {
+      unsigned int length = readUInt();
+      std::string value = data_.substr(pos_, length);
+      pos_ += length;
+      return value;
+   }
+
+   VectorStyle readStyle()
+   {
+      VectorStyle style;
+      style.col = readUInt();
+      style.fill = readUInt();
+      style.lwd = readDouble();
+      style.lty = static_cast<int>(readUInt());
+      style.lend = readByte();
+      style.ljoin = readByte();
+      style.lmitre = readDouble();
+      return style;
+   }
+
+   void readPoints(std::vector<double>* pX, std::vector<double>* pY)
+   {
+      unsigned int n = readUInt();
+      for (unsigned int i=0; i<n; i++)
+      {
+         pX->push_back(readDouble());
+         pY->push_back(readDouble());
+      }
+   }
+
+private:
+   const std::string& data_;
+   std::size_t pos_;
+};
+
+int alphaOf(unsigned int color) { return (color >> 24) & 0xFF; }
+
+std::string colorAsSvg(unsigned int color)
+{
+   std::ostringstream ostr;
+   ostr << "#" << std::hex << std::setfill('0')
+        << std::setw(2) << (color & 0xFF)
+        << std::setw(2) << ((color >> 8) & 0xFF)
+        << std::setw(2) << ((color >> 16) & 0xFF);
+   return ostr.str();
+}
+
+std::string strokeAsSvg(const VectorStyle& style)
+{
+   std::ostringstream ostr;
+   ostr << std::fixed << std::setprecision(2);
+
+   int alpha = alphaOf(style.col);
+   if (alpha == 0 || style.lty == kBlankLine)
+   {
+      ostr << " stroke=\"none\"";
+      return ostr.str();
+   }
+
+   ostr << " stroke=\"" << colorAsSvg(style.col) << "\"";
+   if (alpha < 255)
+      ostr << " stroke-opacity=\"" << (alpha / 255.0) << "\"";
+
+   double lwd = (style.lwd > 0.01 ? style.lwd : 0.01) * kLineWidthScale;
+   ostr << " stroke-width=\"" << lwd << "\"";
+
+   if (style.lend == kRoundCap)
+      ostr << " stroke-linecap=\"round\"";
+   else if (style.lend == kButtCap)
+      ostr << " stroke-linecap=\"butt\"";
+   else
+      ostr << " stroke-linecap=\"square\"";
+
+   if (style.ljoin == kRoundJoin)
+      ostr << " stroke-linejoin=\"round\"";
+   else if (style.ljoin == kMitreJoin)
+      ostr << " stroke-linejoin=\"miter\" stroke-miterlimit=\""
+           << style.lmitre << "\"";
+   else
+      ostr << " stroke-linejoin=\"bevel\"";
+
+   // dash pattern (each hex digit of lty is a segment length in lwd units)
+   if (style.lty != kSolidLine)
+   {
+      double unit = (style.lwd > 1 ? style.lwd : 1) * kLineWidthScale;
+      ostr << " stroke-dasharray=\"";
+      unsigned int dt = static_cast<unsigned int>(style.lty);
+      for (int i = 0; dt != 0; dt >>= 4, i++)
+         ostr << (i > 0 ? "," : "") << (dt & 0xF) * unit;
+      ostr << "\"";
+   }
+
+   return ostr.str();
+}
+
+std::string fillAsSvg(unsigned int fill)
+{
+   std::ostringstream ostr;
+   ostr << std::fixed << std::setprecision(2);
+   int alpha = alphaOf(fill);
+   if (alpha == 0)
+   {
+      ostr << " fill=\"none\"";
+   }
+   else
+   {
+      ostr << " fill=\"" << colorAsSvg(fill) << "\"";
+      if (alpha < 255)
+         ostr << " fill-opacity=\"" << (alpha / 255.0) << "\"";
+   }
+   return ostr.str();
+}
+
+void writePointsAsSvg(const std::vector<double>& x,
+                      const std::vector<double>& y,
+                      std::ostream& ostr)
+{
+   for (std::size_t i=0; i<x.size(); i++)
+      ostr << (i > 0 ? " " : "") << x[i] << "," << y[i];
+}
+
+std::string fontFamilyAsSvg(const std::string& family, int fontFace)
+{
+   if (fontFace == 5)
+      return "Symbol";
+   else if (family.empty() || family == "sans")
+      return "Helvetica, Arial, sans-serif";
+   else if (family == "serif")
+      return "Times, serif";
+   else if (family == "mono")
+      return "Courier, monospace";
+   else
+      return string_utils::htmlEscape(family, true);
+}
+
+void appendUInt32(boost::uint32_t value, std::string* pData)
+{
+   for (int i=0; i<4; i++)
+      pData->push_back(static_cast<char>((value >> (8*i)) & 0xFF));
+}
+
+void appendUInt16(boost::uint16_t value, std::string* pData)
+{
+   pData->push_back(static_cast<char>(value & 0xFF));
+   pData->push_back(static_cast<char>((value >> 8) & 0xFF));
+}
+
+// encode R raster data (ABGR) as a top-down 32-bit BMP (which unlike png
+// we can write without an image library)
+std::string rasterAsBmp(const std::vector<unsigned int>& pixels, int w, int h)
+{
+   const boost::uint32_t kHeaderSize = 14 + 108;
+   boost::uint32_t imageSize = 4 * w * h;
+
+   std::string bmp;
+   bmp.reserve(kHeaderSize + imageSize);
+
+   // file header
+   bmp.append("BM");
+   appendUInt32(kHeaderSize + imageSize, &bmp);
+   appendUInt32(0, &bmp);
+   appendUInt32(kHeaderSize, &bmp);
+
+   // BITMAPV4HEADER
+   appendUInt32(108, &bmp);
+   appendUInt32(w, &bmp);
+   appendUInt32(static_cast<boost::uint32_t>(-h), &bmp); // top-down
+   appendUInt16(1, &bmp);
+   appendUInt16(32, &bmp);
+   appendUInt32(3, &bmp); // BI_BITFIELDS
+   appendUInt32(imageSize, &bmp);
+   appendUInt32(2835, &bmp);
+   appendUInt32(2835, &bmp);
+   appendUInt32(0, &bmp);
+   appendUInt32(0, &bmp);
+   appendUInt32(0x00FF0000, &bmp); // red
+   appendUInt32(0x0000FF00, &bmp); // green
+   appendUInt32(0x000000FF, &bmp); // blue
+   appendUInt32(0xFF000000, &bmp); // alpha
+   appendUInt32(0x73524742, &bmp); // LCS_sRGB
+   bmp.append(36 + 12, '\0');      // endpoints and gamma
+
+   // pixels (BGRA)
+   for (std::size_t i=0; i<pixels.size(); i++)
+   {
+      unsigned int pixel = pixels[i];
+      bmp.push_back(static_cast<char>((pixel >> 16) & 0xFF));
+      bmp.push_back(static_cast<char>((pixel >> 8) & 0xFF));
+      bmp.push_back(static_cast<char>(pixel & 0xFF));
+      bmp.push_back(static_cast<char>((pixel >> 24) & 0xFF));
+   }
+
+   return bmp;
+}
+
+std::string base64Encode(const std::string& data)
+{
+   const char* const kChars =
+      "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+   std::string encoded;
+   encoded.reserve(((data.size() + 2) / 3) * 4);
+   for (std::size_t i=0; i<data.size(); i += 3)
+   {
+      boost::uint32_t chunk =
+               static_cast<unsigned char>(data[i]) << 16;
+      if (i + 1 < data.size())
+         chunk |= static_cast<unsigned char>(data[i+1]) << 8;
+      if (i + 2 < data.size())
+         chunk |= static_cast<unsigned char>(data[i+2]);
+
+      encoded.push_back(kChars[(chunk >> 18) & 0x3F]);
+      encoded.push_back(kChars[(chunk >> 12) & 0x3F]);
+      encoded.push_back(i + 1 < data.size() ? kChars[(chunk >> 6) & 0x3F] : '=');
+      encoded.push_back(i + 2 < data.size() ? kChars[chunk & 0x3F] : '=');
+   }
+   return encoded;
+}
+
+} // anonymous namespace
+
+void VectorList::newPage(const DisplaySize& size, unsigned int fill)
+{
+   data_.clear();
+   writeByte(kOpPage);
+   writeUInt(fill);
+   writeDouble(size.width);
+   writeDouble(size.height);
+}
+
+void VectorList::clip(double x0, double x1, double y0, double y1)
+{
+   writeByte(kOpClip);
+   writeDouble(x0);
+   writeDouble(x1);
+   writeDouble(y0);
+   writeDouble(y1);
+}
+
+void VectorList::line(double x1, double y1, double x2, double y2,
+                      const VectorStyle& style)
+{
+   writeByte(kOpLine);
+   writeStyle(style);
+   writeDouble(x1);
+   writeDouble(y1);
+   writeDouble(x2);
+   writeDouble(y2);
+}
+
+void VectorList::polyline(int n, const double* x, const double* y,
+                          const VectorStyle& style)
+{
+   writeByte(kOpPolyline);
+   writeStyle(style);
+   writePoints(n, x, y);
+}
+
+void VectorList::polygon(int n, const double* x, const double* y,
+                         const VectorStyle& style)
+{
+   writeByte(kOpPolygon);
+   writeStyle(style);
+   writePoints(n, x, y);
+}
+
+void VectorList::rect(double x0, double y0, double x1, double y1,
+                      const VectorStyle& style)
+{
+   writeByte(kOpRect);
+   writeStyle(style);
+   writeDouble(x0);
+   writeDouble(y0);
+   writeDouble(x1);
+   writeDouble(y1);
+}
+
+void VectorList::circle(double x, double y, double r,
+                        const VectorStyle& style)
+{
+   writeByte(kOpCircle);
+   writeStyle(style);
+   writeDouble(x);
+   writeDouble(y);
+   writeDouble(r);
+}
+
+void VectorList::path(const double* x, const double* y,
+                      int npoly, const int* nper,
+                      bool winding, const VectorStyle& style)
+{
+   writeByte(kOpPath);
+   writeStyle(style);
+   writeByte(winding ? 1 : 0);
+   writeUInt(npoly);
+   int offset = 0;
+   for (int i=0; i<npoly; i++)
+   {
+      writePoints(nper[i], x + offset, y + offset);
+      offset += nper[i];
+   }
+}
+
+void VectorList::raster(const unsigned int* pixels, int w, int h,
+                        double x, double y, double width, double height,
+                        double rot, bool interpolate)
+{
+   writeByte(kOpRaster);
+   writeDouble(x);
+   writeDouble(y);
+   writeDouble(width);
+   writeDouble(height);
+   writeDouble(rot);
+   writeByte(interpolate ? 1 : 0);
+   writeUInt(w);
+   writeUInt(h);
+   data_.append(reinterpret_cast<const char*>(pixels),
+                sizeof(unsigned int) * w * h);
+}
+
+void VectorList::text(double x, double y, const std::string& str,
+                      const VectorText& text)
+{
+   writeByte(kOpText);
+   writeDouble(x);
+   writeDouble(y);
+   writeDouble(text.rot);
+   writeDouble(text.hadj);
+   writeDouble(text.width);
+   writeUInt(text.col);
+   writeDouble(text.fontSize);
+   writeByte(text.fontFace);
+   writeString(text.fontFamily);
+   writeString(str);
+}
+
+Error VectorList::writeSvg(const FilePath& filePath) const
+{
+   std::ostringstream ostr;
+   ostr << std::fixed << std::setprecision(2);
+
+   ostr << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+
+   int clipId = 0;
+   bool inClipGroup = false;
+   Reader reader(data_);
+   while (!reader.atEnd())
+   {
+      int op = reader.readByte();
+      switch(op)
+      {
+         case kOpPage:
+         {
+            unsigned int fill = reader.readUInt();
+            double width = reader.readDouble();
+            double height = reader.readDouble();
+
+            // scale to fit the viewport (i.e. the client's plot frame)
+            ostr << "<svg xmlns=\"http://www.w3.org/2000/svg\" "
+                 << "xmlns:xlink=\"http://www.w3.org/1999/xlink\" "
+                 << "width=\"100%\" height=\"100%\" "
+                 << "viewBox=\"0 0 " << width << " " << height << "\" "
+                 << "preserveAspectRatio=\"xMidYMid meet\">\n";
+            ostr << "<rect width=\"" << width << "\" height=\"" << height
+                 << "\"" << fillAsSvg(fill) << "/>\n";
+            break;
+         }
+
+         case kOpClip:
+         {
+            double x0 = reader.readDouble();
+            double x1 = reader.readDouble();
+            double y0 = reader.readDouble();
+            double y1 = reader.readDouble();
+            if (inClipGroup)
+               ostr << "</g>\n";
+            ostr << "<clipPath id=\"c" << clipId << "\"><rect x=\""
+                 << std::min(x0, x1) << "\" y=\"" << std::min(y0, y1)
+                 << "\" width=\"" << std::fabs(x1 - x0)
+                 << "\" height=\"" << std::fabs(y1 - y0)
+                 << "\"/></clipPath>\n";
+            ostr << "<g clip-path=\"url(#c" << clipId << ")\">\n";
+            clipId++;
+            inClipGroup = true;
+            break;
+         }
+
+         case kOpLine:
+         {
+            VectorStyle style = reader.readStyle();
+            double x1 = reader.readDouble();
+            double y1 = reader.readDouble();
+            double x2 = reader.readDouble();
+            double y2 = reader.readDouble();
+            ostr << "<line x1=\"" << x1 << "\" y1=\"" << y1
+                 << "\" x2=\"" << x2 << "\" y2=\"" << y2 << "\""
+                 << strokeAsSvg(style) << "/>\n";
+            break;
+         }
+
+         case kOpPolyline:
+         case kOpPolygon:
+         {
+            VectorStyle style = reader.readStyle();
+            std::vector<double> x, y;
+            reader.readPoints(&x, &y);
+            ostr << (op == kOpPolyline ? "<polyline" : "<polygon")
+                 << " points=\"";
+            writePointsAsSvg(x, y, ostr);
+            ostr << "\""
+                 << (op == kOpPolyline ? std::string(" fill=\"none\"") :
+                                         fillAsSvg(style.fill))
+                 << strokeAsSvg(style) << "/>\n";
+            break;
+         }
+
+         case kOpRect:
+         {
+            VectorStyle style = reader.readStyle();
+            double x0 = reader.readDouble();
+            double y0 = reader.readDouble();
+            double x1 = reader.readDouble();
+            double y1 = reader.readDouble();
+            ostr << "<rect x=\"" << std::min(x0, x1)
+                 << "\" y=\"" << std::min(y0, y1)
+                 << "\" width=\"" << std::fabs(x1 - x0)
+                 << "\" height=\"" << std::fabs(y1 - y0) << "\""
+                 << fillAsSvg(style.fill) << strokeAsSvg(style) << "/>\n";
+            break;
+         }
+
+         case kOpCircle:
+         {
+            VectorStyle style = reader.readStyle();
+            double x = reader.readDouble();
+            double y = reader.readDouble();
+            double r = reader.readDouble();
+            ostr << "<circle cx=\"" << x << "\" cy=\"" << y
+                 << "\" r=\"" << (r > 0.5 ? r : 0.5) << "\""
+                 << fillAsSvg(style.fill) << strokeAsSvg(style) << "/>\n";
+            break;
+         }
+
+         case kOpPath:
+         {
+            VectorStyle style = reader.readStyle();
+            bool winding = reader.readByte() != 0;
+            unsigned int npoly = reader.readUInt();
+            ostr << "<path d=\"";
+            for (unsigned int i=0; i<npoly; i++)
+            {
+               std::vector<double> x, y;
+               reader.readPoints(&x, &y);
+               for (std::size_t j=0; j<x.size(); j++)
+                  ostr << (j == 0 ? "M" : "L") << x[j] << "," << y[j] << " ";
+               ostr << "Z ";
+            }
+            ostr << "\" fill-rule=\"" << (winding ? "nonzero" : "evenodd")
+                 << "\"" << fillAsSvg(style.fill) << strokeAsSvg(style)
+                 << "/>\n";
+            break;
+         }
+
+         case kOpRaster:
+         {
+            double x = reader.readDouble();
+            double y = reader.readDouble();
+            double width = reader.readDouble();
+            double height = reader.readDouble();
+            double rot = reader.readDouble();
+            bool interpolate = reader.readByte() != 0;
+            int w = reader.readUInt();
+            int h = reader.readUInt();
+            std::vector<unsigned int> pixels;
+            pixels.reserve(w * h);
+            for (int i=0; i<w*h; i++)
+               pixels.push_back(reader.readUInt());
+
+            // same transformation as the device (flipped vertically)
+            ostr << "<image transform=\"translate(" << x << "," << y << ") "
+                 << "rotate(" << -rot << ") "
+                 << "scale(" << (width / w) << "," << (height / h) << ") "
+                 << "translate(0," << (h / 2.0) << ") scale(1,-1) "
+                 << "translate(0," << (-h / 2.0) << ")\" "
+                 << "width=\"" << w << "\" height=\"" << h << "\" "
+                 << "preserveAspectRatio=\"none\""
+                 << (interpolate ? "" : " image-rendering=\"optimizeSpeed\"")
+                 << " xlink:href=\"data:image/bmp;base64,"
+                 << base64Encode(rasterAsBmp(pixels, w, h)) << "\"/>\n";
+            break;
+         }
+
+         case kOpText:
+         {
+            double x = reader.readDouble();
+            double y = reader.readDouble();
+            double rot = reader.readDouble();
+            double hadj = reader.readDouble();
+            double width = reader.readDouble();
+            unsigned int col = reader.readUInt();
+            double fontSize = reader.readDouble();
+            int fontFace = reader.readByte();
+            std::string fontFamily = reader.readString();
+            std::string str = reader.readString();
+            if (alphaOf(col) == 0)
+               break;
+
+            // start the text hadj of its (measured) width before x,y
+            // along the baseline so that we needn't rely on text-anchor
+            double radians = rot * M_PI / 180.0;
+            double startX = x - hadj * width * std::cos(radians);
+            double startY = y + hadj * width * std::sin(radians);
+
+            ostr << "<text x=\"" << startX << "\" y=\"" << startY << "\"";
+            if (rot != 0)
+            {
+               ostr << " transform=\"rotate(" << -rot << "," << startX
+                    << "," << startY << ")\"";
+            }
+            ostr << " font-family=\"" << fontFamilyAsSvg(fontFamily, fontFace)
+                 << "\" font-size=\"" << fontSize << "\"";
+            if (fontFace == 2 || fontFace == 4)
+               ostr << " font-weight=\"bold\"";
+            if (fontFace == 3 || fontFace == 4)
+               ostr << " font-style=\"italic\"";
+            ostr << fillAsSvg(col);
+
+            // use the device's metrics for the width of the text
+            if (width > 0)
+            {
+               ostr << " textLength=\"" << width << "\" "
+                    << "lengthAdjust=\"spacingAndGlyphs\"";
+            }
+            ostr << " xml:space=\"preserve\">"
+                 << string_utils::htmlEscape(str, false) << "</text>\n";
+            break;
+         }
+
+         default:
+         {
+            return systemError(boost::system::errc::bad_message,
+                               ERROR_LOCATION);
+         }
+      }
+   }
+
+   if (inClipGroup)
+      ostr << "</g>\n";
+   if (!data_.empty())
+      ostr << "</svg>\n";
+
+   return writeStringToFile(filePath, ostr.str());
+}
+
+void VectorList::writeStyle(const VectorStyle& style)
+{
+   writeUInt(style.col);
+   writeUInt(style.fill);
+   writeDouble(style.lwd);
+   writeUInt(static_cast<unsigned int>(style.lty));
+   writeByte(style.lend);
+   writeByte(style.ljoin);
+   writeDouble(style.lmitre);
+}
+
+void VectorList::writePoints(int n, const double* x, const double* y)
+{
+   writeUInt(n);
+   for (int i=0; i<n; i++)
+   {
+      writeDouble(x[i]);
+      writeDouble(y[i]);
+   }
+}
+
+void VectorList::writeByte(int value)
+{
+   data_.push_back(static_cast<char>(value));
+}
+
+void VectorList::writeUInt(unsigned int value)
+{
+   boost::uint32_t value32 = value;
+   data_.append(reinterpret_cast<const char*>(&value32), sizeof(value32));
+}
+
+// (coordinates don't need double precision so we store floats)
+void VectorList::writeDouble(double value)
+{
+   float valueFloat = static_cast<float>(value);
+   data_.append(reinterpret_cast<const char*>(&valueFloat),
+                sizeof(valueFloat));
+}
+
+void VectorList::writeString(const std::string& value)
+{
+   writeUInt(value.size());
+   data_.append(value);
+}
+
+} // namespace graphics
+} // namespace session
+} // namespace r
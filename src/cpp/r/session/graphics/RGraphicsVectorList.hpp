@@ -0,0 +1,119 @@
+/*
+ * RGraphicsVectorList.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef R_SESSION_GRAPHICS_VECTOR_LIST_HPP
+#define R_SESSION_GRAPHICS_VECTOR_LIST_HPP
+
+#include <string>
+
+#include <boost/utility.hpp>
+
+#include "RGraphicsTypes.hpp"
+
+namespace core {
+   class Error;
+   class FilePath;
+}
+
+namespace r {
+namespace session {
+namespace graphics {
+
+// drawing attributes of a primitive (colors are R packed ABGR values,
+// line attributes use the graphics engine's encodings)
+struct VectorStyle
+{
+   VectorStyle()
+      : col(0), fill(0), lwd(1), lty(0), lend(1), ljoin(1), lmitre(10)
+   {
+   }
+   unsigned int col;
+   unsigned int fill;
+   double lwd;
+   int lty;
+   int lend;
+   int ljoin;
+   double lmitre;
+};
+
+// attributes of a text primitive. width is the width of the string as
+// measured by the device so that text can be laid out identically by
+// renderers which don't have the device's fonts
+struct VectorText
+{
+   VectorText()
+      : col(0), fontSize(12), fontFace(1), rot(0), hadj(0), width(0)
+   {
+   }
+   unsigned int col;
+   double fontSize;
+   int fontFace;
+   std::string fontFamily;
+   double rot;
+   double hadj;
+   double width;
+};
+
+// Compact binary list of the primitives drawn on the current page of a
+// device (in device coordinates). The list can be rendered as SVG, which
+// browsers scale to any size without another round trip to R.
+class VectorList : boost::noncopyable
+{
+public:
+   VectorList() {}
+
+   // start a new page
+   void newPage(const DisplaySize& size, unsigned int fill);
+
+   void clip(double x0, double x1, double y0, double y1);
+
+   void line(double x1, double y1, double x2, double y2,
+             const VectorStyle& style);
+   void polyline(int n, const double* x, const double* y,
+                 const VectorStyle& style);
+   void polygon(int n, const double* x, const double* y,
+                const VectorStyle& style);
+   void rect(double x0, double y0, double x1, double y1,
+             const VectorStyle& style);
+   void circle(double x, double y, double r, const VectorStyle& style);
+   void path(const double* x, const double* y, int npoly, const int* nper,
+             bool winding, const VectorStyle& style);
+   void raster(const unsigned int* pixels, int w, int h,
+               double x, double y, double width, double height,
+               double rot, bool interpolate);
+   void text(double x, double y, const std::string& str,
+             const VectorText& text);
+
+   // size of the encoded list (bytes)
+   std::size_t size() const { return data_.size(); }
+
+   // write the list as an SVG document
+   core::Error writeSvg(const core::FilePath& filePath) const;
+
+private:
+   void writeStyle(const VectorStyle& style);
+   void writePoints(int n, const double* x, const double* y);
+   void writeByte(int value);
+   void writeUInt(unsigned int value);
+   void writeDouble(double value);
+   void writeString(const std::string& value);
+
+private:
+   std::string data_;
+};
+
+} // namespace graphics
+} // namespace session
+} // namespace r
+
+#endif // R_SESSION_GRAPHICS_VECTOR_LIST_HPP
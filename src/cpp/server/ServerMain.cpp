@@ -18,11 +18,13 @@
 #include <core/Error.hpp>
 #include <core/ProgramStatus.hpp>
 #include <core/ProgramOptions.hpp>
+#include <core/Trace.hpp>
 
 #include <core/text/TemplateFilter.hpp>
 
 #include <core/system/System.hpp>
 #include <core/system/Crypto.hpp>
+#include <core/system/Environment.hpp>
 
 #include <core/http/URL.hpp>
 #include <core/http/AsyncUriHandler.hpp>
@@ -51,6 +53,8 @@
 #include "ServerSessionProxy.hpp"
 #include "ServerREnvironment.hpp"
 #include "ServerSessionManager.hpp"
+#include "ServerTelemetry.hpp"
+#include "ServerWorkers.hpp"
 
 using namespace core ;
 using namespace server;
@@ -114,9 +118,11 @@ Error httpServerInit()
    // set server options
    s_pHttpServer->setAbortOnResourceError(true);
 
-   // initialize the http server
+   // initialize the http server (workers share the port with each other)
    Options& options = server::options();
-   return s_pHttpServer->init(options.wwwAddress(), options.wwwPort());
+   return s_pHttpServer->init(options.wwwAddress(),
+                              options.wwwPort(),
+                              workers::isWorker());
 }
 
 void httpServerAddHandlers()
@@ -148,6 +154,10 @@ void httpServerAddHandlers()
    // establish logging handler
    uri_handlers::addBlocking("/log", secureJsonRpcHandler(gwt::handleLogRequest));
 
+   // establish telemetry handler (for members of the admin group)
+   uri_handlers::addBlocking("/admin/metrics",
+                             secureHttpHandler(telemetry::handleMetricsRequest));
+
    // establish progress handler
    FilePath wwwLocalPath(server::options().wwwLocalPath());
    FilePath progressPagePath = wwwLocalPath.complete("progress.htm");
@@ -174,6 +184,31 @@ void handleSIGCHLD(int)
 {
 }
 
+// SIGUSR2 enables tracing (if it's disabled) or writes the trace
+void toggleOrWriteTrace()
+{
+   if (!core::trace::isEnabled())
+   {
+      core::trace::setEnabled(true);
+      LOG_WARNING_MESSAGE("Tracing enabled");
+      return;
+   }
+
+   FilePath tracePath;
+   if (util::system::effectiveUserIsRoot())
+      tracePath = FilePath("/var/log/rserver-trace.json");
+   else
+      tracePath = FilePath("/tmp/rstudio-server/rserver-trace.json");
+
+   Error error = tracePath.parent().ensureDirectory();
+   if (!error)
+      error = core::trace::writeChromeTrace(tracePath);
+   if (error)
+      LOG_ERROR(error);
+   else
+      LOG_WARNING_MESSAGE("Trace written to " + tracePath.absolutePath());
+}
+
 // wait for and handle child exit signals
 Error waitForChildExits()
 {
@@ -189,12 +224,13 @@ Error waitForChildExits()
    if (result != 0)
       return systemError(errno, ERROR_LOCATION);
 
-   // block SIGCHLD (so we can sigwait on it below). note that on OSX
-   // we also need to wait for termination related signals (otherwise
-   // they are never delivered)
+   // block SIGCHLD and SIGUSR2 (so we can sigwait on them below). note
+   // that on OSX we also need to wait for termination related signals
+   // (otherwise they are never delivered)
    sigset_t wait_mask;
    sigemptyset(&wait_mask);
    sigaddset(&wait_mask, SIGCHLD);
+   sigaddset(&wait_mask, SIGUSR2);
 #ifdef __APPLE__
    sigaddset(&wait_mask, SIGINT);
    sigaddset(&wait_mask, SIGQUIT);
@@ -217,6 +253,13 @@ Error waitForChildExits()
       if (sig == SIGCHLD)
       {
          sessionManager().notifySIGCHLD();
+         workers::notifySIGCHLD();
+      }
+
+      // SIGUSR2
+      else if (sig == SIGUSR2)
+      {
+         toggleOrWriteTrace();
       }
 
 #ifdef __APPLE__
@@ -237,6 +280,40 @@ Error waitForChildExits()
    return Success();
 }
 
+Error initializeHttpServer()
+{
+   // initialize http server
+   Error error = httpServerInit();
+   if (error)
+      return error;
+
+   // add handlers and initiliaze addins (offline has distinct behavior)
+   if (server::options().serverOffline())
+   {
+      offline::httpServerAddHandlers();
+   }
+   else
+   {
+      // add handlers
+      httpServerAddHandlers();
+
+      // initialize addins
+      error = addins::initialize();
+      if (error)
+         return error;
+
+      // initialize pam auth if we don't already have an auth handler
+      if (!auth::handler::isRegistered())
+      {
+         error = pam_auth::initialize();
+         if (error)
+            return error;
+      }
+   }
+
+   return Success();
+}
+
 } // anonymous namespace
 
 // provide global access to handlers
@@ -277,14 +354,19 @@ int main(int argc, char * const argv[])
       // initialize log
       initializeSystemLog("rserver", core::system::kLogLevelWarning);
 
+      // tracing (enabled by RSTUDIO_TRACE or SIGUSR2)
+      core::trace::setProcessName("rserver");
+      if (!core::system::getenv("RSTUDIO_TRACE").empty())
+         core::trace::setEnabled(true);
+
       // read program options 
       Options& options = server::options();
       ProgramStatus status = options.read(argc, argv); 
       if ( status.exit() )
          return status.exitCode() ;
       
-      // daemonize if requested
-      if (options.serverDaemonize())
+      // daemonize if requested (workers were started by a daemon)
+      if (options.serverDaemonize() && !workers::isWorker())
       {
          Error error = util::system::daemonize();
          if (error)
@@ -299,13 +381,17 @@ int main(int argc, char * const argv[])
       }
 
       // detect R environment variables (calls R (and this forks) so must
-      // happen after daemonize so that upstart script can correctly track us
-      std::string errMsg;
-      bool detected = r_environment::initialize(&errMsg);
-      if (!detected)
+      // happen after daemonize so that upstart script can correctly track us).
+      // workers don't launch sessions so don't need them
+      if (!workers::isWorker())
       {
-         program_options::reportError(errMsg, ERROR_LOCATION);
-         return EXIT_FAILURE;
+         std::string errMsg;
+         bool detected = r_environment::initialize(&errMsg);
+         if (!detected)
+         {
+            program_options::reportError(errMsg, ERROR_LOCATION);
+            return EXIT_FAILURE;
+         }
       }
 
       // increase the number of open files allowed (need more files
@@ -335,34 +421,32 @@ int main(int argc, char * const argv[])
       if (error)
          return core::system::exitFailure(error, ERROR_LOCATION);
 
-      // initialize http server
-      error = httpServerInit();
+      // initialize telemetry (totaled by the supervisor with workers)
+      error = telemetry::initialize();
       if (error)
          return core::system::exitFailure(error, ERROR_LOCATION);
 
-      // add handlers and initiliaze addins (offline has distinct behavior)
-      if (server::options().serverOffline())
+      // with worker processes the workers serve http and we launch and
+      // reap sessions for them (they're started before we give up root
+      // so they can bind privileged ports)
+      bool superviseWorkers = options.wwwWorkerProcesses() > 0 &&
+                              !workers::isWorker() &&
+                              !options.verifyInstallation();
+      if (superviseWorkers)
       {
-         offline::httpServerAddHandlers();
+         error = workers::startWorkers(options.wwwWorkerProcesses(),
+                                       argc,
+                                       argv);
       }
       else
       {
-         // add handlers
-         httpServerAddHandlers();
-
-         // initialize addins
-         error = addins::initialize();
-         if (error)
-            return core::system::exitFailure(error, ERROR_LOCATION);
-
-         // initialize pam auth if we don't already have an auth handler
-         if (!auth::handler::isRegistered())
-         {
-            error = pam_auth::initialize();
-            if (error)
-               return core::system::exitFailure(error, ERROR_LOCATION);
-         }
+         if (workers::isWorker())
+            error = workers::initializeWorker();
+         if (!error)
+            error = initializeHttpServer();
       }
+      if (error)
+         return core::system::exitFailure(error, ERROR_LOCATION);
 
       // enforce restricted mode if we are running under app armor
       // note that failure to do this (for whatever unanticipated reason)
@@ -396,9 +480,12 @@ int main(int argc, char * const argv[])
       }
 
       // run http server
-      error = s_pHttpServer->run(options.wwwThreadPoolSize());
-      if (error)
-         return core::system::exitFailure(error, ERROR_LOCATION);
+      if (!superviseWorkers)
+      {
+         error = s_pHttpServer->run(options.wwwThreadPoolSize());
+         if (error)
+            return core::system::exitFailure(error, ERROR_LOCATION);
+      }
 
       // wait for child exits
       error = waitForChildExits();
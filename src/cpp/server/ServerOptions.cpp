@@ -101,9 +101,15 @@ ProgramStatus Options::read(int argc, char * const argv[])
       ("www-local-path",
          value<std::string>(&wwwLocalPath_)->default_value("www"),
          "www files path")
+      ("www-worker-processes",
+         value<int>(&wwwWorkerProcesses_)->default_value(0),
+         "worker processes which serve http (0 to serve from this process)")
       ("www-thread-pool-size",
          value<int>(&wwwThreadPoolSize_)->default_value(2),
-         "thread pool size");
+         "thread pool size")
+      ("www-proxy-streaming",
+         value<bool>(&wwwProxyStreaming_)->default_value(1),
+         "stream proxied session content rather than buffering it");
 
    // rsession
    options_description rsession("rsession");
@@ -150,13 +156,28 @@ ProgramStatus Options::read(int argc, char * const argv[])
         value<bool>(&deprecatedAuthPamRequiresPriv)->default_value(true),
         "deprecated: will always be true");
 
+   // admin
+   options_description admin("admin");
+   admin.add_options()
+      ("admin-group",
+        value<std::string>(&adminGroup_)->default_value(""),
+        "group whose members may view server telemetry (/admin/metrics)")
+      ("admin-telemetry-interval",
+        value<int>(&adminTelemetryInterval_)->default_value(10),
+        "minimum seconds between samples of session resource usage")
+      ("admin-telemetry-max-sessions",
+        value<int>(&adminTelemetryMaxSessions_)->default_value(1000),
+        "maximum number of sessions sampled for telemetry");
+
    // define program options
    FilePath defaultConfigPath("/etc/rstudio/rserver.conf");
    std::string configFile = defaultConfigPath.exists() ?
                                  defaultConfigPath.absolutePath() : "";
    program_options::OptionsDescription optionsDesc("rserver", configFile);
-   optionsDesc.commandLine.add(verify).add(server).add(www).add(rsession).add(auth);
-   optionsDesc.configFile.add(server).add(www).add(rsession).add(auth);
+   optionsDesc.commandLine.add(verify).add(server).add(www).add(rsession).add(auth)
+                          .add(admin);
+   optionsDesc.configFile.add(server).add(www).add(rsession).add(auth)
+                         .add(admin);
  
    // read options
    ProgramStatus status = core::program_options::read(optionsDesc, argc, argv);
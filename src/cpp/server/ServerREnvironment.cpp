@@ -13,6 +13,10 @@
 
 #include "ServerREnvironment.hpp"
 
+#include <unistd.h>
+
+#include <boost/lexical_cast.hpp>
+
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/Thread.hpp>
@@ -21,6 +25,8 @@
 #include <server/ServerOptions.hpp>
 #include <server/ServerUriHandlers.hpp>
 
+#include <server/util/system/System.hpp>
+
 using namespace core;
 
 namespace server {
@@ -45,12 +51,27 @@ bool initialize(std::string* pErrMsg)
    FilePath rLdScriptPath(server::options().rldpathPath());
    std::string ldLibraryPath = server::options().rsessionLdLibraryPath();
 
+   // cache the detected R environment (so restarts needn't run R). when
+   // not running as root the cache is kept in a directory of our own
+   FilePath cacheFilePath;
+   if (util::system::effectiveUserIsRoot())
+   {
+      cacheFilePath = FilePath("/var/lib/rstudio-server/r-environment");
+   }
+   else
+   {
+      std::string cacheDir = "/tmp/rstudio-server-" +
+                       boost::lexical_cast<std::string>(::geteuid());
+      cacheFilePath = FilePath(cacheDir).complete("r-environment");
+   }
+
    // attempt to detect R environment
    std::string errMsg;
    r_util::EnvironmentVars rEnvVars;
    return r_util::detectREnvironment(rWhichRPath,
                                      rLdScriptPath,
                                      ldLibraryPath,
+                                     cacheFilePath,
                                      &s_rEnvironmentVars,
                                      pErrMsg);
 }
@@ -34,6 +34,7 @@
 #include <server/auth/ServerValidateUser.hpp>
 
 #include "ServerREnvironment.hpp"
+#include "ServerWorkers.hpp"
 
 
 using namespace core;
@@ -50,6 +51,14 @@ Error SessionManager::launchSession(const std::string& username)
 {
    using namespace boost::posix_time;
 
+   // workers have the supervisor launch sessions (it reaps them and merges
+   // launches requested by several workers at once)
+   if (workers::isWorker())
+   {
+      workers::requestLaunch(username);
+      return Success();
+   }
+
    LOCK_MUTEX(launchesMutex_)
    {
       // check whether we already have a launch pending
@@ -90,7 +99,7 @@ Error SessionManager::launchSession(const std::string& username)
    else
    {
       // add it to our active pids
-      addActivePid(pid);
+      addActivePid(pid, username);
 
       // return success
       return Success();
@@ -99,6 +108,12 @@ Error SessionManager::launchSession(const std::string& username)
 
 void SessionManager::removePendingLaunch(const std::string& username)
 {
+   if (workers::isWorker())
+   {
+      workers::notifyLaunched(username);
+      return;
+   }
+
    LOCK_MUTEX(launchesMutex_)
    {
       pendingLaunches_.erase(username);
@@ -175,11 +190,11 @@ void SessionManager::notifySIGCHLD()
    }
 }
 
-void SessionManager::addActivePid(PidType pid)
+void SessionManager::addActivePid(PidType pid, const std::string& username)
 {
    LOCK_MUTEX(pidsMutex_)
    {
-      activePids_.push_back(pid);
+      activePids_[pid] = username;
    }
    END_LOCK_MUTEX
 }
@@ -188,15 +203,28 @@ void SessionManager::removeActivePid(PidType pid)
 {
    LOCK_MUTEX(pidsMutex_)
    {
-      activePids_.erase(std::remove(activePids_.begin(),
-                                    activePids_.end(),
-                                    pid),
-                        activePids_.end());
+      activePids_.erase(pid);
    }
    END_LOCK_MUTEX
 }
 
 std::vector<PidType> SessionManager::activePids()
+{
+   std::vector<PidType> pids;
+   LOCK_MUTEX(pidsMutex_)
+   {
+      for (SessionMap::const_iterator it = activePids_.begin();
+           it != activePids_.end();
+           ++it)
+      {
+         pids.push_back(it->first);
+      }
+   }
+   END_LOCK_MUTEX
+   return pids;
+}
+
+SessionManager::SessionMap SessionManager::activeSessions()
 {
    LOCK_MUTEX(pidsMutex_)
    {
@@ -205,7 +233,7 @@ std::vector<PidType> SessionManager::activePids()
    END_LOCK_MUTEX
 
    // keep compiler happy
-   return std::vector<PidType>();
+   return SessionMap();
 }
 
 
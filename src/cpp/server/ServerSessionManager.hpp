@@ -53,8 +53,12 @@ public:
    // notificatio that a SIGCHLD was received
    void notifySIGCHLD();
 
+   // sessions we have launched (pid to username)
+   typedef std::map<PidType,std::string> SessionMap;
+   SessionMap activeSessions();
+
 private:
-   void addActivePid(PidType pid);
+   void addActivePid(PidType pid, const std::string& username);
    void removeActivePid(PidType pid);
    std::vector<PidType> activePids();
 
@@ -64,9 +68,9 @@ private:
    typedef std::map<std::string,boost::posix_time::ptime> LaunchMap;
    LaunchMap pendingLaunches_;
 
-   // pids we have launched
+   // pids we have launched (and the users they were launched for)
    boost::mutex pidsMutex_;
-   std::vector<PidType> activePids_;
+   SessionMap activePids_;
 };
 
 // Lower-level global functions for launching sessions. These are used
@@ -17,6 +17,7 @@
 #include <sstream>
 #include <map>
 
+#include <boost/weak_ptr.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <boost/thread/mutex.hpp>
@@ -35,6 +36,7 @@
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
 #include <core/http/LocalStreamAsyncClient.hpp>
+#include <core/http/StreamPump.hpp>
 #include <core/http/Util.hpp>
 #include <core/system/System.hpp>
 #include <core/system/PosixUser.hpp>
@@ -52,6 +54,7 @@
 #include <server/ServerOptions.hpp>
 
 #include "ServerSessionManager.hpp"
+#include "ServerTelemetry.hpp"
 
 using namespace core ;
 
@@ -103,6 +106,72 @@ void logIfNotConnectionTerminated(const Error& error,
    }
 }
 
+void handleStreamingProxyComplete(
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      boost::shared_ptr<http::LocalStreamAsyncClient> pClient,
+      const Error& error)
+{
+   if (error)
+      logIfNotConnectionTerminated(error, ptrConnection->request());
+
+   // close the session connection (the browser connection is closed once
+   // the last reference to it is released)
+   pClient->close();
+}
+
+void handleStreamingProxyHeadersWritten(
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      boost::shared_ptr<http::LocalStreamAsyncClient> pClient,
+      const Error& error)
+{
+   // pump the rest of the content from the session to the browser
+   boost::shared_ptr<http::StreamPump> pPump;
+   Error pumpError = error;
+   if (!pumpError)
+   {
+      pumpError = http::StreamPump::create(ptrConnection->ioService(),
+                                           pClient->nativeSocket(),
+                                           ptrConnection->nativeSocket(),
+                                           &pPump);
+   }
+
+   if (pumpError)
+   {
+      handleStreamingProxyComplete(ptrConnection, pClient, pumpError);
+      return;
+   }
+
+   pPump->start(boost::bind(handleStreamingProxyComplete,
+                            ptrConnection,
+                            pClient,
+                            _1));
+}
+
+void handleStreamingProxyResponse(
+      boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
+      boost::weak_ptr<http::LocalStreamAsyncClient> weakClient,
+      std::string username,
+      const http::Response& response)
+{
+   // if there was a launch pending then remove it
+   sessionManager().removePendingLaunch(username);
+
+   // the client is alive while it calls us (it's only referenced weakly
+   // by this handler since the client holds the handler)
+   boost::shared_ptr<http::LocalStreamAsyncClient> pClient = weakClient.lock();
+   if (!pClient)
+      return;
+
+   // forward the headers (and any content read along with them) now
+   // rather than waiting for the whole response
+   ptrConnection->writeResponseHeaders(
+         response,
+         boost::bind(handleStreamingProxyHeadersWritten,
+                     ptrConnection,
+                     pClient,
+                     _1));
+}
+
 void handleContentError(
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
       std::string username,
@@ -187,7 +256,8 @@ void proxyRequest(
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection,
       const http::ErrorHandler& errorHandler,
       const http::ConnectionRetryProfile& connectionRetryProfile =
-                                             http::ConnectionRetryProfile())
+                                             http::ConnectionRetryProfile(),
+      bool streamResponse = false)
 {
    // calculate stream path
    FilePath streamPath = session::local_streams::streamPath(username);
@@ -203,10 +273,25 @@ void proxyRequest(
    // assign request
    pClient->request().assign(ptrConnection->request());
 
-   // execute
-   pClient->execute(
-         boost::bind(handleProxyResponse, ptrConnection, username, _1),
-         errorHandler);
+   // execute (streaming the response to the browser as it's read if
+   // requested, otherwise reading the whole response then writing it)
+   if (streamResponse)
+   {
+      boost::weak_ptr<http::LocalStreamAsyncClient> weakClient(pClient);
+      pClient->executeStreaming(
+            boost::bind(handleStreamingProxyResponse,
+                        ptrConnection,
+                        weakClient,
+                        username,
+                        _1),
+            errorHandler);
+   }
+   else
+   {
+      pClient->execute(
+            boost::bind(handleProxyResponse, ptrConnection, username, _1),
+            errorHandler);
+   }
 }
 
 // function used to periodically validate that the user is valid (has an
@@ -270,16 +355,22 @@ void proxyContentRequest(
       const std::string& username,
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection)
 {
+   telemetry::recordProxyRequest(username, telemetry::ContentRequest);
+
+   // content (plots, downloads, help, etc.) can be large so is streamed
    proxyRequest(username,
                 ptrConnection,
                 boost::bind(handleContentError, ptrConnection, username, _1),
-                sessionRetryProfile(username));
+                sessionRetryProfile(username),
+                server::options().wwwProxyStreaming());
 }
 
 void proxyRpcRequest(
       const std::string& username,
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection)
 {
+   telemetry::recordProxyRequest(username, telemetry::RpcRequest);
+
    // validate the user if this is client_init
    if (boost::algorithm::ends_with(ptrConnection->request().uri(),
                                    "client_init"))
@@ -298,6 +389,8 @@ void proxyEventsRequest(
       const std::string& username,
       boost::shared_ptr<core::http::AsyncConnection> ptrConnection)
 {
+   telemetry::recordProxyRequest(username, telemetry::EventsRequest);
+
    // validate the user
    if (!validateUser(ptrConnection, username))
       return;
@@ -0,0 +1,728 @@
+/*
+ * ServerTelemetry.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "ServerTelemetry.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include <boost/foreach.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/BoostThread.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/Thread.hpp>
+#include <core/system/System.hpp>
+
+#include <core/http/Request.hpp>
+#include <core/http/Response.hpp>
+
+#include <server/util/system/System.hpp>
+
+#include <server/ServerOptions.hpp>
+
+#include "ServerSessionManager.hpp"
+#include "ServerWorkers.hpp"
+
+using namespace core;
+
+namespace server {
+namespace telemetry {
+
+namespace {
+
+// proxied requests
+
+const char * const kRequestTypes[] = { "rpc", "events", "content" };
+const std::size_t kRequestTypeCount = 3;
+
+struct RequestCounts
+{
+   RequestCounts()
+   {
+      std::fill(counts, counts + kRequestTypeCount, 0);
+   }
+   boost::uint64_t counts[kRequestTypeCount];
+};
+
+typedef std::map<std::string,RequestCounts> RequestCountsMap;
+
+// (in workers these are the counts not yet sent to the supervisor, which
+// totals them for all of the workers)
+boost::mutex s_requestsMutex;
+RequestCountsMap s_requestCounts;
+
+// how often workers send their counts to the supervisor
+const int kSendRequestCountsSeconds = 1;
+
+// messages between workers and the supervisor (usernames are last as
+// they may contain spaces)
+const char * const kRequestsMessage = "requests ";
+const char * const kSessionMessage = "session ";
+const char * const kTelemetryQuery = "telemetry";
+
+// session resource usage
+
+struct ProcessUsage
+{
+   ProcessUsage()
+      : cpuTicks(0), residentPages(0),
+        hasIo(false), readBytes(0), writeBytes(0),
+        hasOpenFiles(false), openFiles(0)
+   {
+   }
+
+   boost::uint64_t cpuTicks;
+   boost::uint64_t residentPages;
+
+   // io and open files can only be read for our own processes (or with
+   // privilege) so may not be available
+   bool hasIo;
+   boost::uint64_t readBytes;
+   boost::uint64_t writeBytes;
+   bool hasOpenFiles;
+   boost::uint64_t openFiles;
+};
+
+struct UserUsage
+{
+   UserUsage()
+      : sessions(0), cpuSeconds(0), residentBytes(0),
+        ioSessions(0), readBytes(0), writeBytes(0),
+        openFilesSessions(0), openFiles(0)
+   {
+   }
+
+   boost::uint64_t sessions;
+   double cpuSeconds;
+   boost::uint64_t residentBytes;
+   boost::uint64_t ioSessions;
+   boost::uint64_t readBytes;
+   boost::uint64_t writeBytes;
+   boost::uint64_t openFilesSessions;
+   boost::uint64_t openFiles;
+};
+
+struct Sample
+{
+   Sample() : durationSeconds(0), skippedSessions(0) {}
+
+   boost::posix_time::ptime time;
+   double durationSeconds;
+   std::size_t skippedSessions;
+   std::map<std::string,UserUsage> users;
+};
+
+boost::mutex s_sampleMutex;
+Sample s_sample;
+
+bool isProcessNotFoundError(const Error& error)
+{
+   return error.code() == boost::system::errc::no_such_file_or_directory ||
+          error.code() == boost::system::errc::no_such_process;
+}
+
+std::string procPath(PidType pid, const char* name)
+{
+   return "/proc/" + boost::lexical_cast<std::string>(pid) + "/" + name;
+}
+
+Error readProcFile(PidType pid, const char* name, std::string* pContents)
+{
+   std::string path = procPath(pid, name);
+   int fd = ::open(path.c_str(), O_RDONLY);
+   if (fd == -1)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", path);
+      return error;
+   }
+
+   pContents->clear();
+   char buffer[4096];
+   for (;;)
+   {
+      ssize_t bytesRead = ::read(fd, buffer, sizeof(buffer));
+      if (bytesRead == -1 && errno == EINTR)
+         continue;
+      if (bytesRead == -1)
+      {
+         Error error = systemError(errno, ERROR_LOCATION);
+         error.addProperty("path", path);
+         ::close(fd);
+         return error;
+      }
+      if (bytesRead == 0)
+         break;
+      pContents->append(buffer, bytesRead);
+   }
+
+   ::close(fd);
+   return Success();
+}
+
+// read the command name, parent and cpu time from /proc/<pid>/stat
+Error readStat(PidType pid,
+               std::string* pCommand,
+               PidType* pParentPid,
+               boost::uint64_t* pCpuTicks)
+{
+   std::string stat;
+   Error error = readProcFile(pid, "stat", &stat);
+   if (error)
+      return error;
+
+   // the command is in parentheses (and may itself contain them)
+   std::string::size_type open = stat.find('(');
+   std::string::size_type close = stat.rfind(')');
+   if (open == std::string::npos || close == std::string::npos || close < open)
+      return systemError(boost::system::errc::protocol_error, ERROR_LOCATION);
+   *pCommand = stat.substr(open + 1, close - open - 1);
+
+   // fields following the command (starting with the state)
+   std::istringstream istr(stat.substr(close + 1));
+   std::vector<std::string> fields;
+   std::string field;
+   while (fields.size() < 13 && istr >> field)
+      fields.push_back(field);
+   if (fields.size() < 13)
+      return systemError(boost::system::errc::protocol_error, ERROR_LOCATION);
+
+   *pParentPid = safe_convert::stringTo<PidType>(fields[1], -1);
+   *pCpuTicks = safe_convert::stringTo<boost::uint64_t>(fields[11], 0) +
+                safe_convert::stringTo<boost::uint64_t>(fields[12], 0);
+   return Success();
+}
+
+Error countOpenFiles(PidType pid, boost::uint64_t* pCount)
+{
+   std::string path = procPath(pid, "fd");
+   DIR* pDir = ::opendir(path.c_str());
+   if (pDir == NULL)
+      return systemError(errno, ERROR_LOCATION);
+
+   *pCount = 0;
+   struct dirent* pEntry;
+   while ((pEntry = ::readdir(pDir)) != NULL)
+   {
+      if (pEntry->d_name[0] != '.')
+         (*pCount)++;
+   }
+
+   ::closedir(pDir);
+   return Success();
+}
+
+Error readProcessUsage(PidType pid, ProcessUsage* pUsage)
+{
+   std::string command;
+   PidType parentPid;
+   Error error = readStat(pid, &command, &parentPid, &pUsage->cpuTicks);
+   if (error)
+      return error;
+
+   // resident set size is the second field of statm
+   std::string statm;
+   error = readProcFile(pid, "statm", &statm);
+   if (error)
+      return error;
+   std::istringstream statmStream(statm);
+   boost::uint64_t size;
+   statmStream >> size >> pUsage->residentPages;
+
+   std::string io;
+   if (!readProcFile(pid, "io", &io))
+   {
+      std::istringstream ioStream(io);
+      std::string name;
+      boost::uint64_t value;
+      while (ioStream >> name >> value)
+      {
+         if (name == "read_bytes:")
+            pUsage->readBytes = value;
+         else if (name == "write_bytes:")
+            pUsage->writeBytes = value;
+      }
+      pUsage->hasIo = true;
+   }
+
+   if (!countOpenFiles(pid, &pUsage->openFiles))
+      pUsage->hasOpenFiles = true;
+
+   return Success();
+}
+
+// requests <rpc> <events> <content> <username>
+std::string requestCountsMessage(const std::string& username,
+                                 const RequestCounts& requestCounts)
+{
+   std::ostringstream ostr;
+   ostr << kRequestsMessage;
+   for (std::size_t i = 0; i < kRequestTypeCount; i++)
+      ostr << requestCounts.counts[i] << " ";
+   ostr << username;
+   return ostr.str();
+}
+
+bool parseRequestCounts(const std::string& message,
+                        std::string* pUsername,
+                        RequestCounts* pRequestCounts)
+{
+   std::istringstream istr(message.substr(::strlen(kRequestsMessage)));
+   for (std::size_t i = 0; i < kRequestTypeCount; i++)
+   {
+      if (!(istr >> pRequestCounts->counts[i]))
+         return false;
+   }
+   istr.get();
+   return std::getline(istr, *pUsername) && !pUsername->empty();
+}
+
+// session <pid> <username>
+bool parseSession(const std::string& message,
+                  SessionManager::SessionMap* pSessions)
+{
+   std::istringstream istr(message.substr(::strlen(kSessionMessage)));
+   PidType pid;
+   std::string username;
+   if (!(istr >> pid))
+      return false;
+   istr.get();
+   if (!std::getline(istr, username) || username.empty())
+      return false;
+   (*pSessions)[pid] = username;
+   return true;
+}
+
+void addRequestCounts(const std::string& username,
+                      const RequestCounts& requestCounts)
+{
+   LOCK_MUTEX(s_requestsMutex)
+   {
+      RequestCounts& total = s_requestCounts[username];
+      for (std::size_t i = 0; i < kRequestTypeCount; i++)
+         total.counts[i] += requestCounts.counts[i];
+   }
+   END_LOCK_MUTEX
+}
+
+// worker
+
+void sendRequestCounts()
+{
+   RequestCountsMap requestCounts;
+   LOCK_MUTEX(s_requestsMutex)
+   {
+      requestCounts.swap(s_requestCounts);
+   }
+   END_LOCK_MUTEX
+
+   for (RequestCountsMap::const_iterator it = requestCounts.begin();
+        it != requestCounts.end();
+        ++it)
+   {
+      workers::notifySupervisor(requestCountsMessage(it->first, it->second));
+   }
+}
+
+void sendRequestCountsThread()
+{
+   try
+   {
+      for (;;)
+      {
+         boost::this_thread::sleep(
+                  boost::posix_time::seconds(kSendRequestCountsSeconds));
+         sendRequestCounts();
+      }
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+}
+
+// supervisor (called on the threads servicing the workers)
+
+void onWorkerNotification(const std::string& message)
+{
+   if (boost::algorithm::starts_with(message, kRequestsMessage))
+   {
+      std::string username;
+      RequestCounts requestCounts;
+      if (parseRequestCounts(message, &username, &requestCounts))
+         addRequestCounts(username, requestCounts);
+   }
+}
+
+void onWorkerQuery(const std::string& query, std::vector<std::string>* pReply)
+{
+   if (query != kTelemetryQuery)
+      return;
+
+   // the workers sample our sessions (so we needn't)
+   SessionManager::SessionMap sessions = sessionManager().activeSessions();
+   for (SessionManager::SessionMap::const_iterator it = sessions.begin();
+        it != sessions.end();
+        ++it)
+   {
+      pReply->push_back(kSessionMessage +
+                        boost::lexical_cast<std::string>(it->first) + " " +
+                        it->second);
+   }
+
+   RequestCountsMap requestCounts;
+   LOCK_MUTEX(s_requestsMutex)
+   {
+      requestCounts = s_requestCounts;
+   }
+   END_LOCK_MUTEX
+   for (RequestCountsMap::const_iterator it = requestCounts.begin();
+        it != requestCounts.end();
+        ++it)
+   {
+      pReply->push_back(requestCountsMessage(it->first, it->second));
+   }
+}
+
+// the active sessions and request counts (sessions are launched by the
+// supervisor when there are workers so we ask it for them and for the
+// counts it has totaled)
+Error readServerState(SessionManager::SessionMap* pSessions,
+                      RequestCountsMap* pRequestCounts)
+{
+   if (!workers::isWorker())
+   {
+      *pSessions = sessionManager().activeSessions();
+      LOCK_MUTEX(s_requestsMutex)
+      {
+         *pRequestCounts = s_requestCounts;
+      }
+      END_LOCK_MUTEX
+      return Success();
+   }
+
+   // (our own counts are sent first so the totals include them)
+   sendRequestCounts();
+
+   std::vector<std::string> reply;
+   Error error = workers::querySupervisor(kTelemetryQuery, &reply);
+   if (error)
+      return error;
+
+   BOOST_FOREACH(const std::string& line, reply)
+   {
+      if (boost::algorithm::starts_with(line, kSessionMessage))
+      {
+         parseSession(line, pSessions);
+      }
+      else if (boost::algorithm::starts_with(line, kRequestsMessage))
+      {
+         std::string username;
+         RequestCounts requestCounts;
+         if (parseRequestCounts(line, &username, &requestCounts))
+            (*pRequestCounts)[username] = requestCounts;
+      }
+   }
+
+   return Success();
+}
+
+void sampleSessions(const SessionManager::SessionMap& sessions,
+                    Sample* pSample)
+{
+   using namespace boost::posix_time;
+   ptime started = microsec_clock::universal_time();
+
+   double ticksPerSecond = ::sysconf(_SC_CLK_TCK);
+   boost::uint64_t pageSize = ::sysconf(_SC_PAGESIZE);
+   std::size_t maxSessions = std::max(
+                     server::options().adminTelemetryMaxSessions(), 0);
+
+   pSample->users.clear();
+   pSample->skippedSessions = 0;
+   std::size_t sampled = 0;
+   for (SessionManager::SessionMap::const_iterator it = sessions.begin();
+        it != sessions.end();
+        ++it)
+   {
+      if (sampled >= maxSessions)
+      {
+         pSample->skippedSessions++;
+         continue;
+      }
+      sampled++;
+
+      ProcessUsage usage;
+      Error error = readProcessUsage(it->first, &usage);
+      if (error)
+      {
+         // sessions can exit at any time
+         if (!isProcessNotFoundError(error))
+            LOG_ERROR(error);
+         continue;
+      }
+
+      UserUsage& user = pSample->users[it->second];
+      user.sessions++;
+      user.cpuSeconds += usage.cpuTicks / ticksPerSecond;
+      user.residentBytes += usage.residentPages * pageSize;
+      if (usage.hasIo)
+      {
+         user.ioSessions++;
+         user.readBytes += usage.readBytes;
+         user.writeBytes += usage.writeBytes;
+      }
+      if (usage.hasOpenFiles)
+      {
+         user.openFilesSessions++;
+         user.openFiles += usage.openFiles;
+      }
+   }
+
+   pSample->time = microsec_clock::universal_time();
+   pSample->durationSeconds =
+               (pSample->time - started).total_microseconds() / 1000000.0;
+}
+
+// prometheus text format
+
+void writeMetric(const char* name,
+                 const char* type,
+                 const char* help,
+                 std::ostream& ostr)
+{
+   ostr << "# HELP " << name << " " << help << "\n"
+        << "# TYPE " << name << " " << type << "\n";
+}
+
+std::string labelValue(const std::string& value)
+{
+   std::string escaped;
+   escaped.reserve(value.size() + 2);
+   escaped.push_back('"');
+   for (std::string::const_iterator it = value.begin(); it != value.end(); ++it)
+   {
+      if (*it == '\\' || *it == '"')
+      {
+         escaped.push_back('\\');
+         escaped.push_back(*it);
+      }
+      else if (*it == '\n')
+      {
+         escaped.append("\\n");
+      }
+      else
+      {
+         escaped.push_back(*it);
+      }
+   }
+   escaped.push_back('"');
+   return escaped;
+}
+
+typedef boost::uint64_t UserUsage::*UsageCount;
+
+void writeUserMetric(const char* name,
+                     const char* type,
+                     const char* help,
+                     const Sample& sample,
+                     UsageCount count,
+                     UsageCount available,
+                     std::ostream& ostr)
+{
+   writeMetric(name, type, help, ostr);
+   for (std::map<std::string,UserUsage>::const_iterator it =
+         sample.users.begin(); it != sample.users.end(); ++it)
+   {
+      if (available != NULL && it->second.*available == 0)
+         continue;
+      ostr << name << "{user=" << labelValue(it->first) << "} "
+           << it->second.*count << "\n";
+   }
+}
+
+// (cpu time and io are totals for the active sessions so they fall when
+// sessions exit and are gauges rather than counters)
+void writeSample(const Sample& sample, std::ostream& ostr)
+{
+   typedef std::map<std::string,UserUsage>::const_iterator iterator;
+
+   writeUserMetric("rstudio_sessions", "gauge",
+                   "Active R sessions.",
+                   sample, &UserUsage::sessions, NULL, ostr);
+
+   writeMetric("rstudio_session_cpu_seconds", "gauge",
+               "CPU time used by active sessions.", ostr);
+   for (iterator it = sample.users.begin(); it != sample.users.end(); ++it)
+   {
+      ostr << "rstudio_session_cpu_seconds{user="
+           << labelValue(it->first) << "} " << it->second.cpuSeconds << "\n";
+   }
+
+   writeUserMetric("rstudio_session_resident_memory_bytes", "gauge",
+                   "Resident memory of active sessions.",
+                   sample, &UserUsage::residentBytes, NULL, ostr);
+   writeUserMetric("rstudio_session_read_bytes", "gauge",
+                   "Bytes read from storage by active sessions.",
+                   sample, &UserUsage::readBytes, &UserUsage::ioSessions, ostr);
+   writeUserMetric("rstudio_session_written_bytes", "gauge",
+                   "Bytes written to storage by active sessions.",
+                   sample, &UserUsage::writeBytes, &UserUsage::ioSessions, ostr);
+   writeUserMetric("rstudio_session_open_files", "gauge",
+                   "Open file descriptors of active sessions.",
+                   sample, &UserUsage::openFiles,
+                   &UserUsage::openFilesSessions, ostr);
+}
+
+void writeRequestCounts(const RequestCountsMap& requestCounts,
+                        std::ostream& ostr)
+{
+   writeMetric("rstudio_proxy_requests_total", "counter",
+               "Requests proxied to sessions.", ostr);
+   for (RequestCountsMap::const_iterator it = requestCounts.begin();
+        it != requestCounts.end();
+        ++it)
+   {
+      for (std::size_t i = 0; i < kRequestTypeCount; i++)
+      {
+         ostr << "rstudio_proxy_requests_total{user="
+              << labelValue(it->first) << ",type=\"" << kRequestTypes[i]
+              << "\"} " << it->second.counts[i] << "\n";
+      }
+   }
+}
+
+bool isAdmin(const std::string& username)
+{
+   std::string adminGroup = server::options().adminGroup();
+   if (adminGroup.empty())
+      return false;
+
+   bool belongsToGroup = false;
+   Error error = util::system::userBelongsToGroup(username,
+                                                  adminGroup,
+                                                  &belongsToGroup);
+   if (error)
+      LOG_ERROR(error);
+   return belongsToGroup;
+}
+
+} // anonymous namespace
+
+Error initialize()
+{
+   if (workers::isWorker())
+   {
+      // (signals are handled only by the main thread)
+      core::system::SignalBlocker signalBlocker;
+      Error error = signalBlocker.blockAll();
+      if (error)
+         return error;
+      core::thread::safeLaunchThread(sendRequestCountsThread);
+   }
+   else
+   {
+      workers::setHandlers(onWorkerNotification, onWorkerQuery);
+   }
+
+   return Success();
+}
+
+void recordProxyRequest(const std::string& username, ProxyRequestType type)
+{
+   LOCK_MUTEX(s_requestsMutex)
+   {
+      s_requestCounts[username].counts[type]++;
+   }
+   END_LOCK_MUTEX
+}
+
+void handleMetricsRequest(const std::string& username,
+                          const http::Request& request,
+                          http::Response* pResponse)
+{
+   using namespace boost::posix_time;
+
+   if (!isAdmin(username))
+   {
+      pResponse->setError(http::status::Forbidden, "Forbidden");
+      return;
+   }
+
+   SessionManager::SessionMap sessions;
+   RequestCountsMap requestCounts;
+   Error error = readServerState(&sessions, &requestCounts);
+   if (error)
+   {
+      LOG_ERROR(error);
+      pResponse->setError(http::status::ServiceUnavailable,
+                          "Service Unavailable");
+      return;
+   }
+
+   std::ostringstream ostr;
+   ostr << std::setprecision(15);
+
+   LOCK_MUTEX(s_sampleMutex)
+   {
+      // sample again only once the interval has passed
+      ptime now = microsec_clock::universal_time();
+      int interval = server::options().adminTelemetryInterval();
+      if (s_sample.time.is_not_a_date_time() ||
+          now - s_sample.time >= seconds(interval))
+      {
+         sampleSessions(sessions, &s_sample);
+      }
+
+      writeSample(s_sample, ostr);
+
+      writeMetric("rstudio_telemetry_sessions_skipped", "gauge",
+                  "Sessions not sampled (beyond admin-telemetry-max-sessions).",
+                  ostr);
+      ostr << "rstudio_telemetry_sessions_skipped "
+           << s_sample.skippedSessions << "\n";
+
+      writeMetric("rstudio_telemetry_sample_duration_seconds", "gauge",
+                  "Time taken to sample sessions.", ostr);
+      ostr << "rstudio_telemetry_sample_duration_seconds "
+           << s_sample.durationSeconds << "\n";
+
+      ptime epoch(boost::gregorian::date(1970, 1, 1));
+      writeMetric("rstudio_telemetry_sample_timestamp_seconds", "gauge",
+                  "Time sessions were last sampled.", ostr);
+      ostr << "rstudio_telemetry_sample_timestamp_seconds "
+           << (s_sample.time - epoch).total_milliseconds() / 1000.0 << "\n";
+   }
+   END_LOCK_MUTEX
+
+   writeRequestCounts(requestCounts, ostr);
+
+   pResponse->setNoCacheHeaders();
+   pResponse->setContentType("text/plain; version=0.0.4");
+   pResponse->setBodyUnencoded(ostr.str());
+}
+
+} // namespace telemetry
+} // namespace server
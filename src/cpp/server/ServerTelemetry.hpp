@@ -0,0 +1,57 @@
+/*
+ * ServerTelemetry.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SERVER_TELEMETRY_HPP
+#define SERVER_TELEMETRY_HPP
+
+#include <string>
+
+namespace core {
+   class Error;
+namespace http {
+   class Request;
+   class Response;
+} // namespace http
+} // namespace core
+
+// Resource usage of sessions (cpu, memory, io and open files read from
+// /proc and totaled by user) along with counts of the requests proxied to
+// them. These are served in the Prometheus text format to members of the
+// admin group. Sessions are sampled when the metrics are requested but no
+// more often than the admin-telemetry-interval (so frequent or concurrent
+// scrapes don't add to the overhead). With worker processes the supervisor
+// totals the workers' request counts and tells them its sessions.
+
+namespace server {
+namespace telemetry {
+
+enum ProxyRequestType
+{
+   RpcRequest,
+   EventsRequest,
+   ContentRequest
+};
+
+core::Error initialize();
+
+void recordProxyRequest(const std::string& username, ProxyRequestType type);
+
+// handler for /admin/metrics
+void handleMetricsRequest(const std::string& username,
+                          const core::http::Request& request,
+                          core::http::Response* pResponse);
+
+} // namespace telemetry
+} // namespace server
+
+#endif // SERVER_TELEMETRY_HPP
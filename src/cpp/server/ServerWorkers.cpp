@@ -0,0 +1,580 @@
+/*
+ * ServerWorkers.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "ServerWorkers.hpp"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include <cstring>
+#include <set>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/foreach.hpp>
+#include <boost/function.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/BoostThread.hpp>
+#include <core/FilePath.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/Thread.hpp>
+#include <core/system/System.hpp>
+#include <core/system/Environment.hpp>
+#include <core/system/ProcessArgs.hpp>
+
+#include "ServerSessionManager.hpp"
+
+using namespace core;
+
+namespace server {
+namespace workers {
+
+namespace {
+
+// environment variable which gives a worker its end of the channel
+const char * const kWorkerChannelFd = "RS_SERVER_WORKER_FD";
+
+// messages (lines) sent by workers to the supervisor
+const char * const kLaunchMessage = "launch ";
+const char * const kLaunchedMessage = "launched ";
+
+// notifications and queries for the supervisor's handlers. queries are
+// numbered and the supervisor ends its reply with a line containing the
+// number (so that a late reply to a query which timed out is discarded)
+const char * const kNotificationPrefix = "! ";
+const char * const kQueryPrefix = "? ";
+const char * const kReplyEndPrefix = ". ";
+const int kQueryTimeoutSeconds = 10;
+
+// workers which exit this soon after starting aren't restarted (they'd
+// most likely fail again, e.g. if the port can't be bound)
+const int kMinWorkerLifetimeSeconds = 10;
+
+int channelFd()
+{
+   static int fd = safe_convert::stringTo<int>(
+                        core::system::getenv(kWorkerChannelFd), -1);
+   return fd;
+}
+
+Error setCloseOnExec(int fd)
+{
+   int flags = ::fcntl(fd, F_GETFD);
+   if (flags == -1 || ::fcntl(fd, F_SETFD, flags | FD_CLOEXEC) == -1)
+      return systemError(errno, ERROR_LOCATION);
+   else
+      return Success();
+}
+
+Error writeLine(int fd, const std::string& message)
+{
+   std::string line = message + "\n";
+   const char* pos = line.data();
+   std::size_t remaining = line.size();
+   while (remaining > 0)
+   {
+      ssize_t written = ::write(fd, pos, remaining);
+      if (written == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         return systemError(errno, ERROR_LOCATION);
+      }
+      pos += written;
+      remaining -= written;
+   }
+   return Success();
+}
+
+// read lines until eof (or an error)
+void readLines(int fd, const boost::function<void(const std::string&)>& onLine)
+{
+   std::string pending;
+   char buffer[1024];
+   for (;;)
+   {
+      ssize_t bytesRead = ::read(fd, buffer, sizeof(buffer));
+      if (bytesRead == -1 && errno == EINTR)
+         continue;
+      if (bytesRead <= 0)
+         break;
+
+      pending.append(buffer, bytesRead);
+      std::string::size_type eol;
+      while ((eol = pending.find('\n')) != std::string::npos)
+      {
+         onLine(pending.substr(0, eol));
+         pending.erase(0, eol + 1);
+      }
+   }
+}
+
+// worker
+
+// (writes to the channel are made with the channel mutex held)
+boost::mutex s_channelMutex;
+boost::mutex s_launchesMutex;
+std::set<std::string> s_requestedLaunches;
+
+// the outstanding query (queries are made one at a time) and the reply
+// received so far
+boost::mutex s_queryMutex;
+boost::mutex s_replyMutex;
+boost::condition s_replyCondition;
+int s_querySequence = 0;
+std::vector<std::string> s_reply;
+bool s_replyComplete = false;
+
+void onSupervisorLine(const std::string& line)
+{
+   LOCK_MUTEX(s_replyMutex)
+   {
+      if (boost::algorithm::starts_with(line, kReplyEndPrefix))
+      {
+         // the end of an earlier reply (which timed out) just discards it
+         int sequence = safe_convert::stringTo<int>(
+                              line.substr(::strlen(kReplyEndPrefix)), -1);
+         if (sequence == s_querySequence)
+         {
+            s_replyComplete = true;
+            s_replyCondition.notify_all();
+         }
+         else
+         {
+            s_reply.clear();
+         }
+      }
+      else
+      {
+         s_reply.push_back(line);
+      }
+   }
+   END_LOCK_MUTEX
+}
+
+void watchSupervisor()
+{
+   // the supervisor only writes replies to us so this returns only once
+   // it exits
+   readLines(channelFd(), onSupervisorLine);
+
+   LOG_WARNING_MESSAGE("Supervisor exited (stopping worker)");
+   ::_exit(EXIT_SUCCESS);
+}
+
+Error sendToSupervisor(const std::string& message)
+{
+   Error error;
+   LOCK_MUTEX(s_channelMutex)
+   {
+      error = writeLine(channelFd(), message);
+   }
+   END_LOCK_MUTEX
+   return error;
+}
+
+// supervisor
+
+struct Worker
+{
+   PidType pid;
+   boost::posix_time::ptime started;
+};
+
+boost::mutex s_workersMutex;
+std::vector<Worker> s_workers;
+std::string s_executablePath;
+std::vector<std::string> s_args;
+
+NotificationHandler s_notificationHandler;
+QueryHandler s_queryHandler;
+
+void handleWorkerQuery(int fd, const std::string& message)
+{
+   // (queries are of the form <sequence> <query>)
+   std::string::size_type sep = message.find(' ');
+   std::string sequence = message.substr(0, sep);
+   std::string query;
+   if (sep != std::string::npos)
+      query = message.substr(sep + 1);
+
+   std::vector<std::string> reply;
+   if (s_queryHandler)
+      s_queryHandler(query, &reply);
+   reply.push_back(kReplyEndPrefix + sequence);
+
+   // (replies are only written by the thread servicing the worker)
+   std::string lines;
+   BOOST_FOREACH(const std::string& line, reply)
+   {
+      lines.append(line);
+      lines.append("\n");
+   }
+   lines.erase(lines.size() - 1);
+   Error error = writeLine(fd, lines);
+   if (error)
+      LOG_ERROR(error);
+}
+
+void handleWorkerMessage(int fd, const std::string& message)
+{
+   if (boost::algorithm::starts_with(message, kNotificationPrefix))
+   {
+      if (s_notificationHandler)
+         s_notificationHandler(message.substr(::strlen(kNotificationPrefix)));
+   }
+   else if (boost::algorithm::starts_with(message, kQueryPrefix))
+   {
+      handleWorkerQuery(fd, message.substr(::strlen(kQueryPrefix)));
+   }
+   else if (boost::algorithm::starts_with(message, kLaunchMessage))
+   {
+      std::string username = message.substr(::strlen(kLaunchMessage));
+      Error error = sessionManager().launchSession(username);
+      if (error)
+         LOG_ERROR(error);
+   }
+   else if (boost::algorithm::starts_with(message, kLaunchedMessage))
+   {
+      std::string username = message.substr(::strlen(kLaunchedMessage));
+      sessionManager().removePendingLaunch(username);
+   }
+   else
+   {
+      LOG_WARNING_MESSAGE("Unexpected message from worker: " + message);
+   }
+}
+
+void serviceWorker(int fd)
+{
+   readLines(fd, boost::bind(handleWorkerMessage, fd, _1));
+   ::close(fd);
+}
+
+// write a fixed message to stderr and exit (for use in a forked child)
+void exitChild(const char* message)
+{
+   ssize_t written = ::write(STDERR_FILENO, message, ::strlen(message));
+   (void)written;
+   ::_exit(EXIT_FAILURE);
+}
+
+Error startWorker()
+{
+   // create the channel (neither end is inherited by the sessions we
+   // launch; the worker's end is made inheritable in the worker)
+   int fds[2];
+   if (::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == -1)
+      return systemError(errno, ERROR_LOCATION);
+   Error error = setCloseOnExec(fds[0]);
+   if (!error)
+      error = setCloseOnExec(fds[1]);
+   if (error)
+   {
+      ::close(fds[0]);
+      ::close(fds[1]);
+      return error;
+   }
+
+   // prepare the args and environment before forking
+   core::system::Options environment;
+   core::system::environment(&environment);
+   core::system::setenv(&environment,
+                        kWorkerChannelFd,
+                        boost::lexical_cast<std::string>(fds[1]));
+   std::vector<std::string> env;
+   for (core::system::Options::const_iterator it = environment.begin();
+        it != environment.end();
+        ++it)
+   {
+      env.push_back(it->first + "=" + it->second);
+   }
+   core::system::ProcessArgs args(s_args);
+   core::system::ProcessArgs envArgs(env);
+
+   pid_t pid = ::fork();
+   if (pid == -1)
+   {
+      error = systemError(errno, ERROR_LOCATION);
+      ::close(fds[0]);
+      ::close(fds[1]);
+      return error;
+   }
+
+   // child (other threads may have held locks, e.g. within malloc or the
+   // log, when we forked so only async-signal-safe calls are made here)
+   else if (pid == 0)
+   {
+      // workers restarted after we've dropped privilege need root back
+      // to bind the port (and to switch user themselves)
+      if (::getuid() == 0 && (::seteuid(0) == -1 || ::setegid(0) == -1))
+         exitChild("rserver: unable to restore privilege for worker\n");
+
+      ::fcntl(fds[1], F_SETFD, 0);
+
+      sigset_t emptySet;
+      ::sigemptyset(&emptySet);
+      ::pthread_sigmask(SIG_SETMASK, &emptySet, NULL);
+
+      ::execve(s_executablePath.c_str(), args.args(), envArgs.args());
+      exitChild("rserver: unable to execute worker\n");
+   }
+
+   // parent
+   ::close(fds[1]);
+
+   Worker worker;
+   worker.pid = pid;
+   worker.started = boost::posix_time::microsec_clock::universal_time();
+   LOCK_MUTEX(s_workersMutex)
+   {
+      s_workers.push_back(worker);
+   }
+   END_LOCK_MUTEX
+
+   // service the worker's requests (with signals blocked so that they
+   // continue to be handled only by the main thread)
+   core::system::SignalBlocker signalBlocker;
+   error = signalBlocker.blockAll();
+   if (error)
+      LOG_ERROR(error);
+   core::thread::safeLaunchThread(boost::bind(serviceWorker, fds[0]));
+
+   return Success();
+}
+
+// waitpid which tries again after EINTR
+int waitPid(PidType pid, int* pStatus)
+{
+   for (;;)
+   {
+      int result = ::waitpid(pid, pStatus, WNOHANG);
+      if (result == -1 && errno == EINTR)
+         continue;
+      return result;
+   }
+}
+
+} // anonymous namespace
+
+bool isWorker()
+{
+   return channelFd() != -1;
+}
+
+Error initializeWorker()
+{
+   Error error = setCloseOnExec(channelFd());
+   if (error)
+      return error;
+
+   core::system::SignalBlocker signalBlocker;
+   error = signalBlocker.blockAll();
+   if (error)
+      return error;
+   core::thread::safeLaunchThread(watchSupervisor);
+
+   return Success();
+}
+
+void requestLaunch(const std::string& username)
+{
+   LOCK_MUTEX(s_launchesMutex)
+   {
+      s_requestedLaunches.insert(username);
+   }
+   END_LOCK_MUTEX
+
+   Error error = sendToSupervisor(kLaunchMessage + username);
+   if (error)
+      LOG_ERROR(error);
+}
+
+void notifyLaunched(const std::string& username)
+{
+   // (this is called for every proxied response so we only tell the
+   // supervisor about sessions we asked it to launch)
+   bool requested = false;
+   LOCK_MUTEX(s_launchesMutex)
+   {
+      requested = s_requestedLaunches.erase(username) > 0;
+   }
+   END_LOCK_MUTEX
+
+   if (requested)
+   {
+      Error error = sendToSupervisor(kLaunchedMessage + username);
+      if (error)
+         LOG_ERROR(error);
+   }
+}
+
+void notifySupervisor(const std::string& message)
+{
+   Error error = sendToSupervisor(kNotificationPrefix + message);
+   if (error)
+      LOG_ERROR(error);
+}
+
+Error querySupervisor(const std::string& query,
+                      std::vector<std::string>* pReply)
+{
+   using namespace boost;
+
+   try
+   {
+      lock_guard<mutex> queryLock(s_queryMutex);
+
+      int sequence;
+      {
+         lock_guard<mutex> replyLock(s_replyMutex);
+         sequence = ++s_querySequence;
+         s_reply.clear();
+         s_replyComplete = false;
+      }
+
+      Error error = sendToSupervisor(kQueryPrefix +
+                                     lexical_cast<std::string>(sequence) +
+                                     " " + query);
+      if (error)
+         return error;
+
+      unique_lock<mutex> replyLock(s_replyMutex);
+      system_time timeoutTime = get_system_time() +
+                                posix_time::seconds(kQueryTimeoutSeconds);
+      while (!s_replyComplete)
+      {
+         if (!s_replyCondition.timed_wait(replyLock, timeoutTime))
+         {
+            return systemError(boost::system::errc::timed_out,
+                               ERROR_LOCATION);
+         }
+      }
+      pReply->swap(s_reply);
+   }
+   catch(const thread_resource_error& e)
+   {
+      return Error(boost::thread_error::ec_from_exception(e), ERROR_LOCATION);
+   }
+
+   return Success();
+}
+
+void setHandlers(const NotificationHandler& notificationHandler,
+                 const QueryHandler& queryHandler)
+{
+   s_notificationHandler = notificationHandler;
+   s_queryHandler = queryHandler;
+}
+
+Error startWorkers(int count, int argc, char * const argv[])
+{
+#ifndef SO_REUSEPORT
+   // workers can't share the port
+   return systemError(boost::system::errc::not_supported, ERROR_LOCATION);
+#else
+   FilePath executablePath;
+   Error error = core::system::executablePath(argc, argv, &executablePath);
+   if (error)
+      return error;
+   s_executablePath = executablePath.absolutePath();
+   s_args.assign(argv, argv + argc);
+
+   for (int i = 0; i < count; i++)
+   {
+      error = startWorker();
+      if (error)
+         return error;
+   }
+
+   return Success();
+#endif
+}
+
+void notifySIGCHLD()
+{
+   using namespace boost::posix_time;
+
+   // nothing to do if we aren't the supervisor
+   if (s_executablePath.empty())
+      return;
+
+   std::vector<Worker> workers;
+   LOCK_MUTEX(s_workersMutex)
+   {
+      workers = s_workers;
+   }
+   END_LOCK_MUTEX
+
+   BOOST_FOREACH(const Worker& worker, workers)
+   {
+      int status;
+      if (waitPid(worker.pid, &status) != worker.pid)
+         continue;
+      if (!WIFEXITED(status) && !WIFSIGNALED(status))
+         continue;
+
+      LOCK_MUTEX(s_workersMutex)
+      {
+         for (std::vector<Worker>::iterator it = s_workers.begin();
+              it != s_workers.end(); ++it)
+         {
+            if (it->pid == worker.pid)
+            {
+               s_workers.erase(it);
+               break;
+            }
+         }
+      }
+      END_LOCK_MUTEX
+
+      boost::format fmt("Worker exited (pid=%1%, status=%2%)");
+      LOG_WARNING_MESSAGE(boost::str(fmt % worker.pid % status));
+
+      // restart it unless it exited right after starting
+      if ((microsec_clock::universal_time() - worker.started) >=
+                                          seconds(kMinWorkerLifetimeSeconds))
+      {
+         Error error = startWorker();
+         if (error)
+            LOG_ERROR(error);
+      }
+   }
+
+   // without workers nothing serves http
+   bool noWorkers = false;
+   LOCK_MUTEX(s_workersMutex)
+   {
+      noWorkers = s_workers.empty();
+   }
+   END_LOCK_MUTEX
+   if (noWorkers)
+   {
+      LOG_ERROR_MESSAGE("All workers exited");
+      ::exit(EXIT_FAILURE);
+   }
+}
+
+} // namespace workers
+} // namespace server
@@ -0,0 +1,74 @@
+/*
+ * ServerWorkers.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SERVER_WORKERS_HPP
+#define SERVER_WORKERS_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+namespace core {
+   class Error;
+}
+
+// When www-worker-processes is set rserver runs as a supervisor and that
+// many worker processes. Workers are rserver executed again with one end
+// of a local socket connected to the supervisor. They each listen on the
+// www port (sharing it using SO_REUSEPORT so the kernel balances
+// connections between them) and do all of the authentication, static file
+// serving and proxying. The supervisor doesn't serve http: it launches
+// sessions when workers ask it to (so launches requested by several workers
+// at once are merged), reaps the sessions and restarts workers which exit.
+// Other modules can also send their own notifications and queries to the
+// supervisor (e.g. so that it can total the telemetry of all workers).
+
+namespace server {
+namespace workers {
+
+// is this process a worker? (workers are told by their environment)
+bool isWorker();
+
+// workers: start watching the supervisor (so we exit when it exits)
+core::Error initializeWorker();
+
+// workers: ask the supervisor to launch a session for a user and tell it
+// when a session which we asked it to launch has responded
+void requestLaunch(const std::string& username);
+void notifyLaunched(const std::string& username);
+
+// workers: send a notification to the supervisor's handler, or send a
+// query and wait for the handler's reply (messages can't contain newlines)
+void notifySupervisor(const std::string& message);
+core::Error querySupervisor(const std::string& query,
+                            std::vector<std::string>* pReply);
+
+// supervisor: handlers for notifications and queries from workers (these
+// are called on the threads servicing each worker so concurrently)
+typedef boost::function<void(const std::string&)> NotificationHandler;
+typedef boost::function<void(const std::string&,
+                             std::vector<std::string>*)> QueryHandler;
+void setHandlers(const NotificationHandler& notificationHandler,
+                 const QueryHandler& queryHandler);
+
+// supervisor: start the workers and begin servicing their requests
+core::Error startWorkers(int count, int argc, char * const argv[]);
+
+// supervisor: reap workers which have exited (restarting them)
+void notifySIGCHLD();
+
+} // namespace workers
+} // namespace server
+
+#endif // SERVER_WORKERS_HPP
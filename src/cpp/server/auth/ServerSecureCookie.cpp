@@ -29,6 +29,7 @@
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
 #include <core/http/Util.hpp>
+#include <core/http/ValidatedCookieCache.hpp>
 
 #include <core/system/Crypto.hpp>
 #include <core/system/System.hpp>
@@ -48,6 +49,10 @@ const char * const kDelim = "|";
 // secure cookie key
 std::string s_secureCookieKey ;
 
+// cookies which have been validated (every request presents the user's
+// cookie so this saves computing its hmac for each of them)
+http::ValidatedCookieCache s_validatedCookies;
+
 
 Error base64HMAC(const std::string& value,
                  const std::string& expires,
@@ -81,6 +86,7 @@ http::Cookie createSecureCookie(
    // generate expires string
    std::string expires = http::util::httpDate(
             boost::posix_time::second_clock::universal_time() + validDuration);
+   boost::posix_time::ptime expiresTime = http::util::parseHttpDate(expires);
 
    // form signed cookie value (will simply be an empty string if an
    // error occurs during encoding. this will cause the application to
@@ -101,6 +107,9 @@ http::Cookie createSecureCookie(
                           http::util::urlEncode(expires) +
                           kDelim +
                           http::util::urlEncode(hmac);
+
+      // we know it's valid so requests which present it can skip validation
+      s_validatedCookies.insert(signedCookieValue, value, expiresTime);
    }
 
    // return the cookie
@@ -121,6 +130,13 @@ std::string readSecureCookie(const core::http::Request& request,
    if (signedCookieValue.empty())
       return std::string();
 
+   // return the value of cookies which were already validated
+   using namespace boost::posix_time;
+   ptime now = second_clock::universal_time();
+   std::string cachedValue;
+   if (s_validatedCookies.find(signedCookieValue, now, &cachedValue))
+      return cachedValue;
+
    // split it into its parts (url decode them as well)
    std::string value, expires, hmac;
    using namespace boost;
@@ -154,8 +170,8 @@ std::string readSecureCookie(const core::http::Request& request,
       return std::string();
    }
 
-   // compare hmac to the one in the cookie
-   if (hmac != computedHmac)
+   // compare hmac to the one in the cookie (in constant time)
+   if (!core::system::crypto::constantTimeEquals(hmac, computedHmac))
    {
       // will occur in normal course of operations if the user upgrades
       // their browser (and the User-Agent changes). could also occur
@@ -164,14 +180,14 @@ std::string readSecureCookie(const core::http::Request& request,
    }
 
    // check the expiration
-   using namespace boost::posix_time;
    ptime expiresTime = http::util::parseHttpDate(expires);
    if (expiresTime.is_not_a_date_time())
       return std::string();
-   else if (expiresTime <= second_clock::universal_time())
+   else if (expiresTime <= now)
       return std::string();
 
-   // ok to return the value
+   // ok to return the value (remembering that the cookie is valid)
+   s_validatedCookies.insert(signedCookieValue, value, expiresTime);
    return value;
 }
 
@@ -213,6 +229,11 @@ void remove(const http::Request& request,
             const std::string& path,
             core::http::Response* pResponse)
 {
+   // stop accepting the cookie without validating it
+   std::string signedCookieValue = request.cookieValue(name);
+   if (!signedCookieValue.empty())
+      s_validatedCookies.remove(signedCookieValue);
+
    // create vanilla cookie (no need for secure cookie since we are removing)
    http::Cookie cookie(request, name, std::string(), path);
 
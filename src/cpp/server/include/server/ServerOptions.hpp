@@ -86,6 +86,16 @@ public:
       return wwwThreadPoolSize_;
    }
 
+   int wwwWorkerProcesses() const
+   {
+      return wwwWorkerProcesses_;
+   }
+
+   bool wwwProxyStreaming() const
+   {
+      return wwwProxyStreaming_;
+   }
+
    // auth
    bool authValidateUsers()
    {
@@ -143,6 +153,22 @@ public:
       return rsessionUserProcessLimit_;
    }
 
+   // admin
+   std::string adminGroup() const
+   {
+      return std::string(adminGroup_.c_str());
+   }
+
+   int adminTelemetryInterval() const
+   {
+      return adminTelemetryInterval_;
+   }
+
+   int adminTelemetryMaxSessions() const
+   {
+      return adminTelemetryMaxSessions_;
+   }
+
 private:
    bool verifyInstallation_;
    std::string serverWorkingDir_;
@@ -154,6 +180,8 @@ private:
    std::string wwwPort_ ;
    std::string wwwLocalPath_ ;
    int wwwThreadPoolSize_;
+   int wwwWorkerProcesses_;
+   bool wwwProxyStreaming_;
    bool authValidateUsers_;
    std::string authRequiredUserGroup_;
    std::string authPamHelperPath_;
@@ -165,6 +193,9 @@ private:
    int rsessionMemoryLimitMb_;
    int rsessionStackLimitMb_;
    int rsessionUserProcessLimit_;
+   std::string adminGroup_;
+   int adminTelemetryInterval_;
+   int adminTelemetryMaxSessions_;
 };
       
 } // namespace server
@@ -72,6 +72,9 @@ const int kListChanged = 45;
 const int kConsoleProcessCreated = 46;
 const int kUiPrefsChanged = 47;
 const int kHandleUnsavedChanges = 48;
+const int kFileUploadProgress = 49;
+const int kFindResult = 50;
+const int kFindOperationEnded = 51;
 }   
 
 void ClientEvent::init(int type, const json::Value& data)
@@ -181,6 +184,12 @@ std::string ClientEvent::typeName() const
          return "ui_prefs_changed";
       case client_events::kHandleUnsavedChanges:
          return "handle_unsaved_changes";
+      case client_events::kFileUploadProgress:
+         return "file_upload_progress";
+      case client_events::kFindResult:
+         return "find_result";
+      case client_events::kFindOperationEnded:
+         return "find_operation_ended";
       default:
          LOG_WARNING_MESSAGE("unexpected event type: " + 
                              boost::lexical_cast<std::string>(type_));
@@ -22,6 +22,7 @@
 #include <core/Error.hpp>
 #include <core/BoostErrors.hpp>
 #include <core/Thread.hpp>
+#include <core/Trace.hpp>
 #include <core/system/System.hpp>
 
 
@@ -317,6 +318,8 @@ void ClientEventService::run()
          // events on the next iteration of the accept loop
          if (request.clientId == clientId())
          {
+            TRACE_SPAN("events", "flush");
+
             // deque the events
             std::vector<ClientEvent> events;
             clientEventQueue.remove(&events);
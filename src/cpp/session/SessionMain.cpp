@@ -38,6 +38,7 @@
 #include <core/Scope.hpp>
 #include <core/Settings.hpp>
 #include <core/Thread.hpp>
+#include <core/Trace.hpp>
 #include <core/Log.hpp>
 #include <core/system/System.hpp>
 #include <core/ProgramStatus.hpp>
@@ -89,6 +90,7 @@
 #include "modules/SessionCrypto.hpp"
 #include "modules/SessionDiff.hpp"
 #include "modules/SessionFiles.hpp"
+#include "modules/SessionFind.hpp"
 #include "modules/SessionWorkspace.hpp"
 #include "modules/SessionWorkbench.hpp"
 #include "modules/SessionData.hpp"
@@ -102,6 +104,7 @@
 #include "modules/SessionHistory.hpp"
 #include "modules/SessionLimits.hpp"
 #include "modules/SessionLists.hpp"
+#include "modules/SessionMemory.hpp"
 #include "modules/SessionContentUrls.hpp"
 
 #include <session/projects/SessionProjects.hpp>
@@ -148,6 +151,9 @@ bool s_rSessionResumed = false;
 // manage global state indicating whether R is processing input
 volatile sig_atomic_t s_rProcessingInput = 0;
 
+// start of the trace span for r's evaluation of the current console input
+boost::int64_t s_consoleInputTraceStart = 0;
+
 // did we fail to coerce the charset to UTF-8
 bool s_printCharsetWarning = false;
 
@@ -526,6 +532,8 @@ void handleRpcRequest(const core::json::JsonRpcRequest& request,
                       boost::shared_ptr<HttpConnection> ptrConnection,
                       ConnectionType connectionType)
 {
+   TRACE_SPAN_DETAIL("rpc", "handleRpcRequest", request.method);
+
    // record the time just prior to execution of the event
    // (so we can determine if any events were added during execution)
    using namespace boost::posix_time; 
@@ -1006,6 +1014,9 @@ bool waitForMethod(const std::string& method,
 
       // perform background processing (true for isIdle)
       module_context::onBackgroundProcessing(true);
+#ifndef _WIN32
+      modules::memory::onIdle(allowSuspend);
+#endif
 
       // process pending events in desktop mode
       processDesktopGuiEvents();
@@ -1042,6 +1053,9 @@ bool waitForMethod(const std::string& method,
 
          // since we got a connection we can reset the timeout time
          timeoutTime = timeoutTimeFromNow();
+#ifndef _WIN32
+         modules::memory::onActivity();
+#endif
 
          // after we've processed at least one waitForMethod it is now safe to
          // initialize the polledEventHandler (which is used to maintain rsession
@@ -1144,9 +1158,41 @@ Error bufferConsoleInput(const core::json::JsonRpcRequest& request,
    return extractConsoleInput(request);
 }
 
+// enable or disable tracing of hot path spans (see core/Trace.hpp)
+Error setTraceEnabled(const core::json::JsonRpcRequest& request,
+                      json::JsonRpcResponse* pResponse)
+{
+   bool enabled;
+   Error error = json::readParams(request.params, &enabled);
+   if (error)
+      return error;
+
+   core::trace::setEnabled(enabled);
+   return Success();
+}
+
+// write the recorded spans as chrome trace json (returns the trace path)
+Error writeTrace(const core::json::JsonRpcRequest& request,
+                 json::JsonRpcResponse* pResponse)
+{
+   FilePath tracePath = session::options().userScratchPath().complete(
+                                                      "rsession-trace.json");
+   Error error = core::trace::writeChromeTrace(tracePath);
+   if (error)
+      return error;
+
+   pResponse->setResult(module_context::createAliasedPath(tracePath));
+   return Success();
+}
+
 Error startHttpConnectionListener()
 {
    initializeHttpConnectionListener();
+
+   // stream file uploads to disk as they arrive
+   httpConnectionListener().setFormParserFactory(
+                                    modules::files::createUploadFormParser);
+
    return httpConnectionListener().start();
 }
 
@@ -1249,69 +1295,83 @@ Error rInit(const r::session::RInitInfo& rInitInfo)
    using namespace core::system;
    using namespace session::module_context;
    ExecBlock initialize ;
+   initialize.setTimingHandler(module_context::recordStartupTiming);
    initialize.addFunctions()
    
       // client event service
-      (startClientEventService)
+      ("client events", startClientEventService)
 
       // json-rpc listeners
-      (bind(registerRpcMethod, kConsoleInput, bufferConsoleInput))
+      ("console_input",
+         bind(registerRpcMethod, kConsoleInput, bufferConsoleInput))
+      ("set_trace_enabled",
+         bind(registerRpcMethod, "set_trace_enabled", setTraceEnabled))
+      ("write_trace",
+         bind(registerRpcMethod, "write_trace", writeTrace))
 
       // signal handlers
-      (registerSignalHandlers)
+      ("signal handlers", registerSignalHandlers)
 
       // main module context
-      (module_context::initialize)
+      ("module_context", module_context::initialize)
 
       // projects (early project init required -- module inits below
       // can then depend on e.g. computed defaultEncoding)
-      (projects::initialize)
+      ("projects", projects::initialize)
 
       // source database
-      (source_database::initialize)
+      ("source_database", source_database::initialize)
    
       // modules with c++ implementations
-      (modules::lists::initialize)
-      (modules::path::initialize)
-      (modules::content_urls::initialize)
-      (modules::limits::initialize)
-      (modules::agreement::initialize)
-      (modules::console::initialize)
-      (modules::console_process::initialize)
+      ("lists", modules::lists::initialize)
+      ("path", modules::path::initialize)
+      ("content_urls", modules::content_urls::initialize)
+      ("limits", modules::limits::initialize)
+#ifndef _WIN32
+      ("memory", modules::memory::initialize)
+#endif
+      ("agreement", modules::agreement::initialize)
+      ("console", modules::console::initialize)
+      ("console_process", modules::console_process::initialize)
 #ifdef RSTUDIO_SERVER
-      (modules::crypto::initialize)
+      ("crypto", modules::crypto::initialize)
 #endif
-      (modules::diff::initialize)
-      (modules::files::initialize)
-      (modules::workspace::initialize)
-      (modules::workbench::initialize)
-      (modules::data::initialize)
-      (modules::help::initialize)
-      (modules::plots::initialize)
-      (modules::packages::initialize)
-      (modules::source::initialize)
-      (modules::source_control::initialize)
-      (modules::tex::initialize)
-      (modules::history::initialize)
-      (modules::code_search::initialize)
+      ("diff", modules::diff::initialize)
+      ("files", modules::files::initialize)
+      ("workspace", modules::workspace::initialize)
+      ("workbench", modules::workbench::initialize)
+      ("data", modules::data::initialize)
+      ("help", modules::help::initialize)
+      ("plots", modules::plots::initialize)
+      ("packages", modules::packages::initialize)
+      ("source", modules::source::initialize)
+      ("source_control", modules::source_control::initialize)
+      ("tex", modules::tex::initialize)
+      ("history", modules::history::initialize)
+      ("code_search", modules::code_search::initialize)
+      ("find", modules::find::initialize)
 
       // workers
-      (workers::web_request::initialize)
+      ("web_request", workers::web_request::initialize)
 
       // addins
-      (addins::initialize)
+      ("addins", addins::initialize)
 
       // R code
-      (bind(sourceModuleRFile, "SessionCodeTools.R"))
+      ("SessionCodeTools.R",
+         bind(sourceModuleRFile, "SessionCodeTools.R"))
    
       // unsupported functions
-      (bind(r::function_hook::registerUnsupported, "bug.report", "utils"))
-      (bind(r::function_hook::registerUnsupported, "help.request", "utils"))
+      ("bug.report",
+         bind(r::function_hook::registerUnsupported, "bug.report", "utils"))
+      ("help.request",
+         bind(r::function_hook::registerUnsupported, "help.request", "utils"))
    ;
 
    Error error = initialize.execute();
    if (error)
       return error;
+   module_context::logStartupTimings();
    
    // if we are in verify installation mode then we should exit (successfully) now
    if (session::options().verifyInstallation())
@@ -1404,6 +1464,8 @@ bool rConsoleRead(const std::string& prompt,
 
    // r is not processing input
    s_rProcessingInput = false;
+   core::trace::end("r", "console-input", s_consoleInputTraceStart);
+   s_consoleInputTraceStart = 0;
 
    if (!s_consoleInputBuffer.empty())
    {
@@ -1450,6 +1512,7 @@ bool rConsoleRead(const std::string& prompt,
 
    // we are about to return input to r so set the flag indicating that state
    s_rProcessingInput = true;
+   s_consoleInputTraceStart = core::trace::begin();
 
    ClientEvent promptEvent(kConsoleWritePrompt, prompt);
    session::clientEventQueue().add(promptEvent);
@@ -2094,6 +2157,13 @@ Error registerUriHandler(const std::string& name,
 }
 
 
+Error registerBackgroundUriHandler(const std::string& name,
+                                   const BackgroundUriHandler& handler)
+{
+   httpConnectionListener().addBackgroundUriHandler(name, handler);
+   return Success();
+}
+
 Error registerAsyncLocalUriHandler(
                          const std::string& name,
                          const http::UriAsyncHandlerFunction& handlerFunction)
@@ -2345,6 +2415,12 @@ int main (int argc, char * const argv[])
       // from the main thread vs. child threads)
       s_mainThreadId = boost::this_thread::get_id();
 
+      // tracing can be enabled at startup (otherwise it is enabled using
+      // the set_trace_enabled rpc)
+      core::trace::setProcessName("rsession");
+      if (!core::system::getenv("RSTUDIO_TRACE").empty())
+         core::trace::setEnabled(true);
+
       // determine character set
       s_printCharsetWarning = !ensureUtf8Charset();
 
@@ -2478,6 +2554,7 @@ int main (int argc, char * const argv[])
       rOptions.rHistoryDir = boost::bind(rHistoryDir);
       rOptions.alwaysSaveHistory = boost::bind(alwaysSaveHistoryOption);
       rOptions.rSourcePath = options.coreRSourcePath();
+      rOptions.rToolsImagePath = options.rToolsImagePath();
       if (!desktopMode) // ignore r-libs-user in desktop mode
          rOptions.rLibsUser = options.rLibsUser();
       rOptions.rLibsExtra = options.sessionPackagesPath();
@@ -2491,6 +2568,8 @@ int main (int argc, char * const argv[])
       rOptions.autoReloadSource = options.autoReloadSource();
       rOptions.shellEscape = options.rShellEscape();
       rOptions.restoreWorkspace = restoreWorkspaceOption();
+      rOptions.lazyWorkspaceRestore = options.lazyRestore();
+      rOptions.vectorGraphics = options.vectorGraphics();
       rOptions.saveWorkspace = saveWorkspaceOption();
       
       // r callbacks
@@ -13,9 +13,12 @@
 
 #include "SessionModuleContextInternal.hpp"
 
+#include <deque>
 #include <vector>
+#include <sstream>
 
 #include <boost/assert.hpp>
+#include <boost/foreach.hpp>
 #include <boost/utility.hpp>
 #include <boost/signal.hpp>
 #include <boost/numeric/conversion/cast.hpp>
@@ -172,6 +175,73 @@ SEXP rs_threadSleep(SEXP secondsSEXP)
    return R_NilValue;
 }
 
+// measure the overhead of calling R functions via r::exec::RFunction
+// (debugging function which returns the microseconds per call when looking
+// up the function each call, when using the function cache and when
+// reusing a single RFunction)
+double benchmarkRFunction(const std::string& name, bool reuse, int calls)
+{
+   using namespace boost::posix_time;
+   r::sexp::Protect rProtect;
+   SEXP paramSEXP = r::sexp::create(1, &rProtect);
+
+   ptime start = microsec_clock::universal_time();
+   r::exec::RFunction reusedFunction(name);
+   for (int i = 0; i < calls; i++)
+   {
+      Error error;
+      if (reuse)
+      {
+         reusedFunction.clearParams();
+         reusedFunction.addParam(paramSEXP);
+         error = reusedFunction.call();
+      }
+      else
+      {
+         r::exec::RFunction function(name);
+         function.addParam(paramSEXP);
+         error = function.call();
+      }
+      if (error)
+         throw r::exec::RErrorException(error.summary());
+   }
+   time_duration elapsed = microsec_clock::universal_time() - start;
+
+   return static_cast<double>(elapsed.total_microseconds()) / calls;
+}
+
+SEXP rs_benchmarkRFunction(SEXP callsSEXP)
+{
+   try
+   {
+      int calls = std::max(r::sexp::asInteger(callsSEXP), 1);
+
+      std::vector<double> timings;
+      timings.push_back(benchmarkRFunction("identity", false, calls));
+      timings.push_back(benchmarkRFunction("base:::identity", false, calls));
+      timings.push_back(benchmarkRFunction("base:::identity", true, calls));
+
+      std::vector<std::string> names;
+      names.push_back("lookup");
+      names.push_back("cached");
+      names.push_back("reused");
+
+      r::sexp::Protect rProtect;
+      SEXP timingsSEXP = r::sexp::create(timings, &rProtect);
+      Rf_setAttrib(timingsSEXP,
+                   R_NamesSymbol,
+                   r::sexp::create(names, &rProtect));
+      return timingsSEXP;
+   }
+   catch(r::exec::RErrorException& e)
+   {
+      r::exec::error(e.message());
+   }
+   CATCH_UNEXPECTED_EXCEPTION
+
+   return R_NilValue;
+}
+
 // get rstudio version from R
 SEXP rs_rstudioVersion()
 {
@@ -344,6 +414,152 @@ FilePath registerMonitoredUserScratchDir(const std::string& dirName,
 
 
 
+namespace {
+
+struct StartupTiming
+{
+   StartupTiming(const std::string& name,
+                 const boost::posix_time::time_duration& elapsed,
+                 bool deferred)
+      : name(name), elapsed(elapsed), deferred(deferred)
+   {
+   }
+   std::string name;
+   boost::posix_time::time_duration elapsed;
+   bool deferred;
+};
+
+std::vector<StartupTiming> s_startupTimings;
+
+typedef std::pair<std::string,boost::function<Error()> > DeferredInitializer;
+std::deque<DeferredInitializer> s_deferredInitializers;
+bool s_deferredInitStarted = false;
+
+void logStartupTimings(const std::string& label, bool deferred)
+{
+   std::vector<StartupTiming> timings;
+   boost::posix_time::time_duration total;
+   BOOST_FOREACH(const StartupTiming& timing, s_startupTimings)
+   {
+      if (timing.deferred == deferred)
+      {
+         timings.push_back(timing);
+         total += timing.elapsed;
+      }
+   }
+
+   std::ostringstream ostr;
+   ostr << label << " took " << total.total_milliseconds() << "ms (";
+   for (std::size_t i = 0; i < timings.size(); i++)
+   {
+      if (i > 0)
+         ostr << ", ";
+      ostr << timings[i].name << " "
+           << timings[i].elapsed.total_milliseconds() << "ms";
+   }
+   ostr << ")";
+   LOG_INFO_MESSAGE(ostr.str());
+}
+
+bool executeDeferredInitializer()
+{
+   if (s_deferredInitializers.empty())
+      return false;
+
+   DeferredInitializer initializer = s_deferredInitializers.front();
+   s_deferredInitializers.pop_front();
+
+   using namespace boost::posix_time;
+   ptime start = microsec_clock::universal_time();
+   Error error = initializer.second();
+   if (error)
+      LOG_ERROR(error);
+   s_startupTimings.push_back(StartupTiming(
+                                    initializer.first,
+                                    microsec_clock::universal_time() - start,
+                                    true));
+
+   if (s_deferredInitializers.empty())
+   {
+      logStartupTimings("Deferred initialization", true);
+      return false;
+   }
+   else
+   {
+      return true;
+   }
+}
+
+void scheduleDeferredInitializers()
+{
+   // one initializer at a time during idle time (so the session stays
+   // responsive to the user while they run)
+   scheduleIncrementalWork(boost::posix_time::milliseconds(20),
+                           executeDeferredInitializer,
+                           true);
+}
+
+void onDeferredInit()
+{
+   s_deferredInitStarted = true;
+   if (!s_deferredInitializers.empty())
+      scheduleDeferredInitializers();
+}
+
+Error getStartupTrace(const json::JsonRpcRequest& request,
+                      json::JsonRpcResponse* pResponse)
+{
+   json::Array initializers;
+   boost::int64_t totalMs = 0, deferredMs = 0;
+   BOOST_FOREACH(const StartupTiming& timing, s_startupTimings)
+   {
+      boost::int64_t ms = timing.elapsed.total_milliseconds();
+      if (timing.deferred)
+         deferredMs += ms;
+      else
+         totalMs += ms;
+
+      json::Object initializer;
+      initializer["name"] = timing.name;
+      initializer["ms"] = ms;
+      initializer["deferred"] = timing.deferred;
+      initializers.push_back(initializer);
+   }
+
+   json::Object result;
+   result["initializers"] = initializers;
+   result["total_ms"] = totalMs;
+   result["deferred_ms"] = deferredMs;
+   result["deferred_pending"] =
+                     static_cast<int>(s_deferredInitializers.size());
+   pResponse->setResult(result);
+   return Success();
+}
+
+} // anonymous namespace
+
+void addDeferredInitializer(const std::string& name,
+                            const boost::function<Error()>& initializer)
+{
+   s_deferredInitializers.push_back(std::make_pair(name, initializer));
+
+   // schedule if deferred init has already happened and the initializers
+   // scheduled then have all been executed
+   if (s_deferredInitStarted && s_deferredInitializers.size() == 1)
+      scheduleDeferredInitializers();
+}
+
+void recordStartupTiming(const std::string& name,
+                         const boost::posix_time::time_duration& elapsed)
+{
+   s_startupTimings.push_back(StartupTiming(name, elapsed, false));
+}
+
+void logStartupTimings()
+{
+   logStartupTimings("Session initialization", false);
+}
+
 Error initialize()
 {
    // register rs_enqueClientEvent with R 
@@ -381,6 +597,14 @@ Error initialize()
    methodDef6.numArgs = 1;
    r::routines::addCallMethod(methodDef6);
 
+   // register rs_benchmarkRFunction with R (debugging function used to
+   // measure the overhead of r::exec::RFunction calls)
+   R_CallMethodDef benchmarkMethodDef ;
+   benchmarkMethodDef.name = "rs_benchmarkRFunction" ;
+   benchmarkMethodDef.fun = (DL_FUNC) rs_benchmarkRFunction ;
+   benchmarkMethodDef.numArgs = 1;
+   r::routines::addCallMethod(benchmarkMethodDef);
+
    // register rs_rstudioVersion with R
    R_CallMethodDef methodDef7 ;
    methodDef7.name = "rs_rstudioVersion" ;
@@ -408,6 +632,12 @@ Error initialize()
    // initialize monitored scratch dir
    initializeMonitoredUserScratchDir();
 
+   // execute deferred initializers once the client is initialized
+   events().onDeferredInit.connect(onDeferredInit);
+   error = registerRpcMethod("get_startup_trace", getStartupTrace);
+   if (error)
+      return error;
+
    // source the ModuleTools.R file
    FilePath modulesPath = session::options().modulesRSourcePath();
    return r::sourceManager().sourceTools(modulesPath.complete("ModuleTools.R"));
@@ -646,12 +876,17 @@ FilePath tempFile(const std::string& prefix, const std::string& extension)
 }
 
 json::Object createFileSystemItem(const FileInfo& fileInfo)
+{
+   return createFileSystemItem(fileInfo,
+                               module_context::createAliasedPath(fileInfo));
+}
+
+json::Object createFileSystemItem(const FileInfo& fileInfo,
+                                  const std::string& aliasedPath)
 {
    json::Object entry ;
 
-   std::string aliasedPath = module_context::createAliasedPath(fileInfo);
-   std::string rawPath =
-         module_context::resolveAliasedPath(aliasedPath).absolutePath();
+   std::string rawPath = fileInfo.absolutePath();
 
    entry["path"] = aliasedPath;
    if (aliasedPath != rawPath)
@@ -712,7 +947,7 @@ bool fileListingFilter(const core::FileInfo& fileInfo)
       return true;
    }
    else if ((options().programMode() == kSessionProgramModeServer) &&
-            filePath.isDirectory() &&
+            fileInfo.isDirectory() &&
             filePath.filename() == ".ssh" &&
             filePath.parent() == module_context::userHomePath())
    {
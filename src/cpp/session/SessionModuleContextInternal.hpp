@@ -14,6 +14,10 @@
 #ifndef SESSION_MODULE_CONTEXT_INTERNAL_HPP
 #define SESSION_MODULE_CONTEXT_INTERNAL_HPP
 
+#include <string>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
 #include <session/SessionModuleContext.hpp>
 
 namespace core {
@@ -34,6 +38,11 @@ void onResumed(const core::Settings& persistentState);
 // notify of backgound processing
 void onBackgroundProcessing(bool isIdle);
 
+// startup profiling (logged and returned by get_startup_trace)
+void recordStartupTiming(const std::string& name,
+                         const boost::posix_time::time_duration& elapsed);
+void logStartupTimings();
+
 } // namespace module_context
 } // namespace session
 
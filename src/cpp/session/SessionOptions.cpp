@@ -116,12 +116,34 @@ core::ProgramStatus Options::read(int argc, char * const argv[])
       ("session-timeout-minutes",
          value<int>(&timeoutMinutes_)->default_value(120),
          "session timeout (minutes)" )
+      ("session-idle-trim-minutes",
+         value<int>(&idleTrimMinutes_)->default_value(5),
+         "free unused memory once the session is idle (minutes, 0 to never)")
+      ("session-memory-suspend-threshold",
+         value<int>(&memorySuspendThreshold_)->default_value(0),
+         "suspend the largest idle sessions when available memory falls "
+         "below (percent, 0 to never)")
+      ("session-memory-suspend-target",
+         value<int>(&memorySuspendTarget_)->default_value(20),
+         "available memory to restore by suspending idle sessions (percent)")
+      ("session-memory-suspend-idle-minutes",
+         value<int>(&memorySuspendIdleMinutes_)->default_value(15),
+         "minimum idle time of sessions suspended for memory (minutes)")
       ("session-preflight-script",
          value<std::string>(&preflightScript_)->default_value(""),
          "session preflight script")
       ("session-create-public-folder",
          value<bool>(&createPublicFolder_)->default_value(false),
-         "automatically create public folder");
+         "automatically create public folder")
+      ("session-lazy-restore",
+         value<bool>(&lazyRestore_)->default_value(true),
+         "read objects from suspended sessions on first access")
+      ("session-restore-prefetch",
+         value<bool>(&restorePrefetch_)->default_value(true),
+         "read lazily restored objects while the session is idle")
+      ("session-vector-graphics",
+         value<bool>(&vectorGraphics_)->default_value(false),
+         "render plots as svg (scaled by the client) rather than png");
 
    // r options
    options_description r("r") ;
@@ -132,6 +154,9 @@ core::ProgramStatus Options::read(int argc, char * const argv[])
       ("r-modules-source", 
          value<std::string>(&modulesRSourcePath_)->default_value("R/modules"),
          "Modules R source path")
+      ("r-tools-image",
+         value<std::string>(&rToolsImagePath_)->default_value("R/ToolsImage.rds"),
+         "Precompiled R tools image (empty to always source R tools)")
       ("r-session-packages",
          value<std::string>(&sessionPackagesPath_)->default_value("R/library"),
          "R packages path")
@@ -262,7 +287,10 @@ core::ProgramStatus Options::read(int argc, char * const argv[])
 
    // session timeout seconds is always -1 in desktop mode
    if (programMode_ == kSessionProgramModeDesktop)
+   {
       timeoutMinutes_ = 0;
+      memorySuspendThreshold_ = 0;
+   }
 
    // if we are in desktop mode and no agreement file path was
    // specified then default to gpl-standalone
@@ -278,6 +306,7 @@ core::ProgramStatus Options::read(int argc, char * const argv[])
    resolvePath(resourcePath, &wwwLocalPath_);
    resolvePath(resourcePath, &coreRSourcePath_);
    resolvePath(resourcePath, &modulesRSourcePath_);
+   resolvePath(resourcePath, &rToolsImagePath_);
    resolvePath(resourcePath, &sessionPackagesPath_);
    resolvePath(resourcePath, &rpostbackPath_);
 
@@ -22,10 +22,14 @@
 #include <boost/asio/write.hpp>
 #include <boost/asio/placeholders.hpp>
 #include <boost/enable_shared_from_this.hpp>
+#include <boost/iostreams/stream.hpp>
+#include <boost/iostreams/concepts.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/SafeConvert.hpp>
+#include <core/Thread.hpp>
+#include <core/Trace.hpp>
 
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
@@ -40,6 +44,24 @@
 
 namespace session {
 
+// iostreams sink used to write streaming response bodies to a socket
+template <typename SocketType>
+class SocketSink : public boost::iostreams::sink
+{
+public:
+   explicit SocketSink(SocketType& socket) : pSocket_(&socket) {}
+
+   std::streamsize write(const char* s, std::streamsize n)
+   {
+      // throws on error (which the stream converts to badbit)
+      boost::asio::write(*pSocket_, boost::asio::buffer(s, n));
+      return n;
+   }
+
+private:
+   SocketType* pSocket_;
+};
+
 template <typename ProtocolType>
 class HttpConnectionImpl :
    public HttpConnection,
@@ -53,9 +75,14 @@ public:
 
 public:
    HttpConnectionImpl(boost::asio::io_service& ioService,
-                      const Handler& handler)
-      : socket_(ioService), handler_(handler)
+                      const Handler& handler,
+                      const core::http::MultipartFormParserFactory&
+                                          formParserFactory =
+                                       core::http::MultipartFormParserFactory())
+      : socket_(ioService), handler_(handler), traceStart_(0)
    {
+      if (formParserFactory)
+         requestParser_.setMultipartFormParserFactory(formParserFactory);
    }
 
    virtual ~HttpConnectionImpl()
@@ -77,11 +104,22 @@ public:
 
    virtual void sendResponse(const core::http::Response &response)
    {
+      core::trace::end("http", "request", traceStart_, request_.uri());
+
+      // streaming bodies are written on a background thread
+      if (response.hasStreamingBody())
+      {
+         sendStreamingResponse(response);
+         return;
+      }
+
       // set log entry type depending upon what happens (default to success)
       HttpLog::EntryType logEntryType = HttpLog::ConnectionResponded;
 
       try
       {
+         TRACE_SPAN("http", "write");
+
          // write the response
          boost::asio::write(socket_,
                             response.toBuffers(
@@ -136,6 +174,7 @@ public:
    {
       // setup response
       core::http::Response response ;
+      TRACE_SPAN("http", "write-json-rpc");
 
       // automagic gzip support
       if (request().acceptsEncoding(core::http::kGzipEncoding))
@@ -165,6 +204,7 @@ public:
    // is successfully read the Connection is passed to the Handler
    void startReading()
    {
+      traceStart_ = core::trace::begin();
       readSome();
    }
 
@@ -174,6 +214,76 @@ public:
 
 private:
 
+   void sendStreamingResponse(const core::http::Response& response)
+   {
+      // take a copy of the response (the caller's goes out of scope) and
+      // keep this connection alive until the body has been written
+      boost::shared_ptr<core::http::Response> pResponse(
+                                             new core::http::Response());
+      pResponse->assign(response);
+
+      core::thread::safeLaunchThread(
+         boost::bind(&HttpConnectionImpl<ProtocolType>::writeStreamingResponse,
+                     HttpConnectionImpl<ProtocolType>::shared_from_this(),
+                     pResponse));
+   }
+
+   void writeStreamingResponse(
+                     boost::shared_ptr<core::http::Response> pResponse)
+   {
+      HttpLog::EntryType logEntryType = HttpLog::ConnectionResponded;
+
+      try
+      {
+         // headers
+         boost::asio::write(socket_,
+                            pResponse->toBuffers(
+                                  core::http::Header::connectionClose()));
+
+         // body
+         typedef SocketSink<typename ProtocolType::socket> Sink;
+         boost::iostreams::stream<Sink> bodyStream(Sink(socket_), 65536);
+         core::Error error = pResponse->streamingBody()(bodyStream);
+         if (!error)
+            bodyStream.flush();
+
+         if (error || bodyStream.fail())
+         {
+            // a failed write is almost always the client going away
+            if (error)
+            {
+               error.addProperty("request-uri", request_.uri());
+               LOG_ERROR(error);
+            }
+            logEntryType = bodyStream.fail() ? HttpLog::ConnectionTerminated :
+                                               HttpLog::ConnectionError;
+         }
+      }
+      catch(const boost::system::system_error& e)
+      {
+         core::Error error = core::Error(e.code(), ERROR_LOCATION);
+         error.addProperty("request-uri", request_.uri());
+         if (core::http::isConnectionTerminatedError(error))
+         {
+            logEntryType = HttpLog::ConnectionTerminated;
+         }
+         else
+         {
+            LOG_ERROR(error);
+            logEntryType = HttpLog::ConnectionError;
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+
+      // always log and close connection
+      try
+      {
+         httpLog().addEntry(logEntryType, requestId_);
+         close();
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
    // async request reading interface
    void readSome()
    {
@@ -200,13 +310,32 @@ private:
          if (!e)
          {
             // parse next chunk
+            boost::int64_t traceParseStart = core::trace::begin();
             core::http::RequestParser::status status = requestParser_.parse(
                                         request_,
                                         buffer_.data(),
                                         buffer_.data() + bytesTransferred);
+            core::trace::end("http", "parse", traceParseStart);
+
+            // upload exceeded the size limit - return a json-rpc error
+            // (as text/html so the browser/gwt can read it)
+            if (status == core::http::RequestParser::error &&
+                requestParser_.bodyLimitExceeded())
+            {
+               core::http::Response response;
+               response.setContentType("text/html");
+               core::Error fileTooLargeError = core::systemError(
+                                    boost::system::errc::file_too_large,
+                                    ERROR_LOCATION);
+               core::json::setJsonRpcError(fileTooLargeError, &response);
+               sendResponse(response);
+
+               // no more async operations w/ shared_from_this() initiated so this
+               // object has no more references to it and will be destroyed
+            }
 
             // error - return bad request
-            if (status == core::http::RequestParser::error)
+            else if (status == core::http::RequestParser::error)
             {
                core::http::Response response;
                response.setStatusCode(core::http::status::BadRequest);
@@ -264,6 +393,7 @@ private:
    core::http::Request request_;
    std::string requestId_;
    Handler handler_;
+   boost::int64_t traceStart_;
 };
 
 } // namespace session
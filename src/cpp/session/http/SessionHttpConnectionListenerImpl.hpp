@@ -15,6 +15,7 @@
 #define SESSION_HTTP_CONNECTION_LISTENER_IMPL_HPP
 
 #include <queue>
+#include <vector>
 
 #include <boost/shared_ptr.hpp>
 
@@ -26,6 +27,8 @@
 #include <core/FilePath.hpp>
 #include <core/Error.hpp>
 #include <core/BoostErrors.hpp>
+#include <core/Thread.hpp>
+#include <core/Trace.hpp>
 #include <core/system/System.hpp>
 
 #include <core/http/SocketAcceptorService.hpp>
@@ -117,6 +120,22 @@ public:
       }
    }
 
+   virtual void setFormParserFactory(
+            const core::http::MultipartFormParserFactory& factory)
+   {
+      formParserFactory_ = factory;
+   }
+
+   virtual void addBackgroundUriHandler(const std::string& prefix,
+                                        const BackgroundUriHandler& handler)
+   {
+      LOCK_MUTEX(backgroundUriHandlersMutex_)
+      {
+         backgroundUriHandlers_.push_back(std::make_pair(prefix, handler));
+      }
+      END_LOCK_MUTEX
+   }
+
    virtual void stop()
    {
       // don't stop if we never started
@@ -193,7 +212,8 @@ private:
             boost::bind(
                  &HttpConnectionListenerImpl<ProtocolType>::enqueConnection,
                  this,
-                 _1))
+                 _1),
+            formParserFactory_)
       );
 
       // wait for next connection
@@ -208,6 +228,8 @@ private:
 
    void handleAccept(const boost::system::error_code& ec)
    {
+      TRACE_SPAN("http", "accept");
+
       try
       {
          if (!ec)
@@ -273,6 +295,10 @@ private:
       if (checkForHttpLog(ptrHttpConnection))
          return;
 
+      // see if a background handler can respond to this request
+      if (checkForBackgroundUriHandler(ptrHttpConnection))
+         return;
+
       // place the connection on the correct queue
       if (isGetEvents(ptrHttpConnection))
          eventsConnectionQueue_.enqueConnection(ptrHttpConnection);
@@ -354,6 +380,43 @@ private:
       }
    }
 
+   bool checkForBackgroundUriHandler(
+                        boost::shared_ptr<HttpConnection> ptrConnection)
+   {
+      const core::http::Request& request = ptrConnection->request();
+
+      BackgroundUriHandler handler;
+      LOCK_MUTEX(backgroundUriHandlersMutex_)
+      {
+         for (std::vector<std::pair<std::string,BackgroundUriHandler> >
+                  ::const_iterator it = backgroundUriHandlers_.begin();
+              it != backgroundUriHandlers_.end();
+              ++it)
+         {
+            if (boost::algorithm::starts_with(request.uri(), it->first))
+            {
+               handler = it->second;
+               break;
+            }
+         }
+      }
+      END_LOCK_MUTEX
+
+      if (!handler)
+         return false;
+
+      core::http::Response response;
+      if (handler(request, &response))
+      {
+         ptrConnection->sendResponse(response);
+         return true;
+      }
+      else
+      {
+         return false;
+      }
+   }
+
 private:
 
    // acceptor service (includes io service)
@@ -361,6 +424,12 @@ private:
 
    // next connection
    boost::shared_ptr<HttpConnectionImpl<ProtocolType> > ptrNextConnection_;
+   core::http::MultipartFormParserFactory formParserFactory_;
+
+   // handlers which respond directly on the listener thread
+   boost::mutex backgroundUriHandlersMutex_;
+   std::vector<std::pair<std::string,BackgroundUriHandler> >
+                                                   backgroundUriHandlers_;
 
    // connection queues
    HttpConnectionQueue mainConnectionQueue_;
@@ -66,14 +66,29 @@
 
 */
 
+#include <boost/function.hpp>
+
+#include <core/http/MultipartFormParser.hpp>
+
 #include "SessionHttpConnectionQueue.hpp"
 
 namespace core {
 	class Error;
+   namespace http {
+      class Request;
+      class Response;
+   }
 }
 
 namespace session {
 
+// handler which is given the chance to respond to a request directly on the
+// listener thread (returns false to decline the request, in which case it is
+// queued for the main thread as usual). these handlers must NEVER execute R
+// code and must return quickly since they block the reading of requests.
+typedef boost::function<bool(const core::http::Request&,
+                             core::http::Response*)> BackgroundUriHandler;
+
 // global initialization (allows instantation of listener which
 // implements the protocol appropriate for our current configuration)
 void initializeHttpConnectionListener();
@@ -91,6 +106,17 @@ public:
 	virtual core::Error start() = 0;
 	virtual void stop() = 0;
 
+   // stream multipart/form-data request bodies through parsers created
+   // by this factory (must be called prior to start, the factory is
+   // invoked on the listener thread)
+   virtual void setFormParserFactory(
+            const core::http::MultipartFormParserFactory& factory) = 0;
+
+   // add a handler for requests whose uri begins with the specified prefix
+   // (may be called after start)
+   virtual void addBackgroundUriHandler(const std::string& prefix,
+                                        const BackgroundUriHandler& handler) = 0;
+
    // connection queues
 	virtual HttpConnectionQueue& mainConnectionQueue() = 0;
 	virtual HttpConnectionQueue& eventsConnectionQueue() = 0;
@@ -57,6 +57,12 @@ core::FilePath safeCurrentPath();
 
 core::json::Object createFileSystemItem(const core::FileInfo& fileInfo);
 core::json::Object createFileSystemItem(const core::FilePath& filePath);
+
+// variation of createFileSystemItem for callers that already have the
+// aliased path (e.g. when listing a directory the aliased path of each
+// file can be derived from the aliased path of the directory)
+core::json::Object createFileSystemItem(const core::FileInfo& fileInfo,
+                                        const std::string& aliasedPath);
    
 // get a temp file
 core::FilePath tempFile(const std::string& prefix, 
@@ -86,6 +92,15 @@ core::Error registerAsyncLocalUriHandler(
                    const std::string& name,
                    const core::http::UriAsyncHandlerFunction& handlerFunction);
 
+// register a uri handler which runs on the http listener thread (rather
+// than the main thread) so it can respond even while R is busy. the handler
+// returns false to defer to the regular (main thread) uri handlers and must
+// NEVER execute R code
+typedef boost::function<bool(const core::http::Request&,
+                             core::http::Response*)> BackgroundUriHandler;
+core::Error registerBackgroundUriHandler(const std::string& name,
+                                         const BackgroundUriHandler& handler);
+
 // register a local uri handler (scoped by a special prefix which indicates
 // a local scope)
 core::Error registerLocalUriHandler(
@@ -188,6 +203,7 @@ struct Events : boost::noncopyable
    boost::signal<void(bool)>           onBackgroundProcessing;
    boost::signal<void(bool)>           onShutdown;
    boost::signal<void ()>              onSysSleep;
+   boost::signal<void ()>              onPackageLibraryMutated;
 };
 
 Events& events();
@@ -237,6 +253,15 @@ void schedulePeriodicWork(const boost::posix_time::time_duration& period,
                           bool idleOnly = true);
 
 
+// register initialization which isn't needed before the first prompt
+// (e.g. probing external tools or scanning installed packages). deferred
+// initializers are executed one at a time during idle time once the
+// client has been initialized (their timings are reported along with
+// those of the session's other initializers)
+void addDeferredInitializer(const std::string& name,
+                            const boost::function<core::Error()>& initializer);
+
+
 core::Error readAndDecodeFile(const core::FilePath& filePath,
                               const std::string& encoding,
                               bool allowSubstChars,
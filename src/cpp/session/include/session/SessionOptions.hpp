@@ -108,8 +108,22 @@ public:
 
    int timeoutMinutes() const { return timeoutMinutes_; }
 
+   int idleTrimMinutes() const { return idleTrimMinutes_; }
+
+   int memorySuspendThreshold() const { return memorySuspendThreshold_; }
+
+   int memorySuspendTarget() const { return memorySuspendTarget_; }
+
+   int memorySuspendIdleMinutes() const { return memorySuspendIdleMinutes_; }
+
    bool createPublicFolder() const { return createPublicFolder_; }
 
+   bool lazyRestore() const { return lazyRestore_; }
+
+   bool restorePrefetch() const { return restorePrefetch_; }
+
+   bool vectorGraphics() const { return vectorGraphics_; }
+
    unsigned int minimumUserId() const { return 100; }
    
    core::FilePath coreRSourcePath() const 
@@ -122,6 +136,11 @@ public:
       return core::FilePath(modulesRSourcePath_.c_str()); 
    }
 
+   core::FilePath rToolsImagePath() const
+   {
+      return core::FilePath(rToolsImagePath_.c_str());
+   }
+
    core::FilePath sessionPackagesPath() const
    {
       return core::FilePath(sessionPackagesPath_.c_str());
@@ -267,11 +286,19 @@ private:
    std::string secret_;
    std::string preflightScript_;
    int timeoutMinutes_;
+   int idleTrimMinutes_;
+   int memorySuspendThreshold_;
+   int memorySuspendTarget_;
+   int memorySuspendIdleMinutes_;
    bool createPublicFolder_;
+   bool lazyRestore_;
+   bool restorePrefetch_;
+   bool vectorGraphics_;
 
    // r
    std::string coreRSourcePath_;
    std::string modulesRSourcePath_;
+   std::string rToolsImagePath_;
    std::string sessionPackagesPath_;
    std::string rLibsUser_;
    std::string rCRANRepos_;
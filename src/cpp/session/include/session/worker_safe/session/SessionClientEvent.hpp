@@ -71,6 +71,9 @@ extern const int kListChanged;
 extern const int kConsoleProcessCreated;
 extern const int kUiPrefsChanged;
 extern const int kHandleUnsavedChanges;
+extern const int kFileUploadProgress;
+extern const int kFindResult;
+extern const int kFindOperationEnded;
 }
    
 class ClientEvent
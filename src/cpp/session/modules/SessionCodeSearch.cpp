@@ -14,6 +14,7 @@
 #include "SessionCodeSearch.hpp"
 
 #include <iostream>
+#include <map>
 #include <vector>
 #include <set>
 
@@ -29,8 +30,11 @@
 #include <core/FilePath.hpp>
 #include <core/FileSerializer.hpp>
 #include <core/SafeConvert.hpp>
+#include <core/Thread.hpp>
 
 #include <core/r_util/RSourceIndex.hpp>
+#include <core/r_util/RSourceIndexCache.hpp>
+#include <core/r_util/RSourceSymbolTable.hpp>
 
 #include <core/system/FileChangeEvent.hpp>
 #include <core/system/FileMonitor.hpp>
@@ -39,6 +43,7 @@
 
 #include <r/RExec.hpp>
 
+#include <session/SessionOptions.hpp>
 #include <session/SessionUserSettings.hpp>
 #include <session/SessionModuleContext.hpp>
 
@@ -93,11 +98,20 @@ bool enforceMaxResults(std::size_t maxResults,
 }
 
 
+// name of the file (within the project scratch path) used to persist
+// the project's source indexes between sessions
+const char * const kSourceIndexCacheFile = "r_source_index";
+
 class SourceFileIndex : boost::noncopyable
 {
 public:
    SourceFileIndex()
-      : indexing_(false)
+      : indexing_(false),
+        generation_(0),
+        threadGeneration_(0),
+        pendingRequests_(0),
+        cacheDirty_(false),
+        threadStarted_(false)
    {
    }
 
@@ -110,30 +124,48 @@ public:
    template <typename ForwardIterator>
    void enqueFiles(ForwardIterator begin, ForwardIterator end)
    {
-      // add all R source files to the indexing queue
+      // read the indexes persisted by the previous session
+      std::map<std::string,r_util::CachedSourceIndex> cachedIndexes;
+      readCache(&cachedIndexes);
+
+      // add all R source files to the index. files which haven't changed
+      // since they were cached are added immediately and the rest are
+      // queued for indexing on the background thread
       using namespace core::system;
+      std::size_t cachedEntries = 0;
       for ( ; begin != end; ++begin)
       {
-         if (isRSourceFile(*begin))
+         if (!isRSourceFile(*begin))
+            continue;
+
+         std::map<std::string,r_util::CachedSourceIndex>::const_iterator it =
+                                 cachedIndexes.find(begin->absolutePath());
+         if (it != cachedIndexes.end() &&
+             it->second.isCurrent(*begin) &&
+             it->second.pIndex->context() ==
+                              module_context::createAliasedPath(*begin))
+         {
+            entries_.insert(Entry(*begin, it->second.pIndex));
+            symbols_.add(it->second.pIndex);
+            cachedEntries++;
+         }
+         else
          {
-            FileChangeEvent addEvent(FileChangeEvent::FileAdded, *begin);
-            indexingQueue_.push(addEvent);
+            enqueIndexRequest(FileChangeEvent(FileChangeEvent::FileAdded,
+                                              *begin));
          }
       }
 
-      // schedule indexing if necessary. perform up to 200ms of work
-      // immediately and then continue in periodic 20ms chunks until
-      // we are completed.
-      if (!indexingQueue_.empty() && !indexing_)
-      {
-         indexing_ = true;
+      // the cache needs to be re-written if any of its files have changed
+      // or been removed
+      if (cachedEntries != cachedIndexes.size())
+         cacheDirty_ = true;
 
-         module_context::scheduleIncrementalWork(
-                           boost::posix_time::milliseconds(200),
-                           boost::posix_time::milliseconds(20),
-                           boost::bind(&SourceFileIndex::dequeAndIndex, this),
-                           false /* allow indexing even when non-idle */);
-      }
+      // sort the symbols now rather than on the first search
+      if (pendingRequests_ == 0)
+         symbols_.merge();
+
+      scheduleIndexing();
    }
 
    void enqueFileChange(const core::system::FileChangeEvent& event)
@@ -142,54 +174,18 @@ public:
       if (!isRSourceFile(event.fileInfo()))
          return;
 
-      // add to the queue
-      indexingQueue_.push(event);
-
-      // schedule indexing if necessary. don't index anything immediately
-      // (this is to defend against large numbers of files being enqued
-      // at once and typing up the main thread). rather, schedule indexing
-      // to occur during idle time in 20ms chunks
-      if (!indexing_)
-      {
-         indexing_ = true;
-
-         module_context::scheduleIncrementalWork(
-                           boost::posix_time::milliseconds(20),
-                           boost::bind(&SourceFileIndex::dequeAndIndex, this),
-                           false /* allow indexing even when non-idle */);
-      }
+      // queue for indexing on the background thread
+      enqueIndexRequest(event);
+      scheduleIndexing();
    }
 
    bool findGlobalFunction(const std::string& functionName,
                            const std::set<std::string>& excludeContexts,
                            r_util::RSourceItem* pFunctionItem)
    {
-      std::vector<r_util::RSourceItem> sourceItems;
-      BOOST_FOREACH(const Entry& entry, entries_)
-      {
-         // bail if this is an exluded context
-         if (excludeContexts.find(entry.pIndex->context()) !=
-             excludeContexts.end())
-         {
-            continue;
-         }
-
-         // scan the next index
-         sourceItems.clear();
-         entry.pIndex->search(
-                  boost::bind(isGlobalFunctionNamed, _1, functionName),
-                  std::back_inserter(sourceItems));
-
-         // return if we got a hit
-         if (sourceItems.size() > 0)
-         {
-            *pFunctionItem = sourceItems[0];
-            return true;
-         }
-      }
-
-      // none found
-      return false;
+      return symbols_.findGlobalFunction(functionName,
+                                         excludeContexts,
+                                         pFunctionItem);
    }
 
    void searchSource(const std::string& term,
@@ -198,28 +194,7 @@ public:
                      const std::set<std::string>& excludeContexts,
                      std::vector<r_util::RSourceItem>* pItems)
    {
-      BOOST_FOREACH(const Entry& entry, entries_)
-      {
-         // bail if this is an exluded context
-         if (excludeContexts.find(entry.pIndex->context()) !=
-             excludeContexts.end())
-         {
-            continue;
-         }
-
-         // scan the next index
-         entry.pIndex->search(term,
-                              prefixOnly,
-                              false,
-                              std::back_inserter(*pItems));
-
-         // return if we are past maxResults
-         if (pItems->size() >= maxResults)
-         {
-            pItems->resize(maxResults);
-            return;
-         }
-      }
+      symbols_.search(term, prefixOnly, excludeContexts, maxResults, pItems);
    }
 
    void searchFiles(const std::string& term,
@@ -275,9 +250,13 @@ public:
 
    void clear()
    {
-      indexing_ = false;
-      indexingQueue_ = std::queue<core::system::FileChangeEvent>();
+      // results of requests which are still outstanding are discarded
+      // when they arrive (and the background thread skips them)
+      generation_++;
+      threadGeneration_.set(generation_);
       entries_.clear();
+      symbols_.clear();
+      cacheDirty_ = false;
    }
 
 private:
@@ -301,26 +280,130 @@ private:
       }
    };
 
+   // request to the background thread to index a file (or write the cache)
+   struct IndexRequest
+   {
+      IndexRequest(int generation,
+                   const core::system::FileChangeEvent& event)
+         : generation(generation),
+           event(event),
+           lineEnding(string_utils::LineEndingPosix)
+      {
+      }
+
+      int generation;
+      core::system::FileChangeEvent event;
+      std::string context;
+      std::string encoding;
+      string_utils::LineEnding lineEnding;
+
+      // cache to write (if this is a cache write request)
+      FilePath cachePath;
+      std::vector<r_util::CachedSourceIndex> cachedIndexes;
+   };
+
+   struct IndexResult
+   {
+      IndexResult(int generation,
+                  const core::system::FileChangeEvent& event)
+         : generation(generation), event(event), decodeRequired(false)
+      {
+      }
+
+      int generation;
+      core::system::FileChangeEvent event;
+      boost::shared_ptr<r_util::RSourceIndex> pIndex;
+
+      // the file's encoding can't be decoded on the background thread so
+      // it needs to be indexed on the main thread
+      bool decodeRequired;
+   };
+
 private:
 
-   bool dequeAndIndex()
+   void enqueIndexRequest(const core::system::FileChangeEvent& event)
+   {
+      boost::shared_ptr<IndexRequest> pRequest(
+                                    new IndexRequest(generation_, event));
+      pRequest->context = module_context::createAliasedPath(event.fileInfo());
+      pRequest->encoding = projects::projectContext().defaultEncoding();
+      pRequest->lineEnding = session::options().sourceLineEnding();
+      enqueRequest(pRequest);
+
+      // the cache will need to be written once this has been indexed
+      cacheDirty_ = true;
+   }
+
+   void enqueCacheWriteRequest()
+   {
+      // the indexes are immutable so the background thread can safely
+      // write them while we continue to use them
+      boost::shared_ptr<IndexRequest> pRequest(
+            new IndexRequest(generation_, core::system::FileChangeEvent(
+                              core::system::FileChangeEvent::None, FileInfo())));
+      pRequest->cachePath = projects::projectContext().scratchPath().complete(
+                                                      kSourceIndexCacheFile);
+      BOOST_FOREACH(const Entry& entry, entries_)
+      {
+         pRequest->cachedIndexes.push_back(
+                     r_util::CachedSourceIndex(entry.fileInfo, entry.pIndex));
+      }
+      enqueRequest(pRequest);
+   }
+
+   void enqueRequest(boost::shared_ptr<IndexRequest> pRequest)
+   {
+      // start the background thread if necessary
+      if (!threadStarted_)
+      {
+         threadStarted_ = true;
+         core::thread::safeLaunchThread(
+                     boost::bind(&SourceFileIndex::indexingThreadMain, this));
+      }
+
+      pendingRequests_++;
+      requests_.enque(pRequest);
+   }
+
+   void scheduleIndexing()
+   {
+      // check for completed requests every 50ms until they are all done
+      // (note that we allow this even when non-idle)
+      if (pendingRequests_ > 0 && !indexing_)
+      {
+         indexing_ = true;
+
+         module_context::schedulePeriodicWork(
+                           boost::posix_time::milliseconds(50),
+                           boost::bind(&SourceFileIndex::dequeResults, this),
+                           false);
+      }
+   }
+
+   bool dequeResults()
    {
       using namespace core::system;
 
-      if (!indexingQueue_.empty())
+      boost::shared_ptr<IndexResult> pResult;
+      while (results_.deque(&pResult))
       {
-         // remove the event from the queue
-         FileChangeEvent event = indexingQueue_.front();
-         indexingQueue_.pop();
+         pendingRequests_--;
+
+         // ignore results from before the index was last cleared
+         if (pResult->generation != generation_)
+            continue;
 
          // process the change
-         const FileInfo& fileInfo = event.fileInfo();
-         switch(event.type())
+         const FileInfo& fileInfo = pResult->event.fileInfo();
+         switch(pResult->event.type())
          {
             case FileChangeEvent::FileAdded:
             case FileChangeEvent::FileModified:
             {
-               updateIndexEntry(fileInfo);
+               if (pResult->pIndex)
+                  updateIndexEntry(fileInfo, pResult->pIndex);
+               else if (pResult->decodeRequired)
+                  updateIndexEntry(fileInfo);
                break;
             }
 
@@ -335,11 +418,138 @@ private:
          }
       }
 
+      // once we are caught up sort the symbols and persist the indexes
+      if (pendingRequests_ == 0)
+      {
+         symbols_.merge();
+
+         if (cacheDirty_)
+         {
+            cacheDirty_ = false;
+            enqueCacheWriteRequest();
+         }
+      }
+
       // return status
-      indexing_ = !indexingQueue_.empty();
+      indexing_ = pendingRequests_ > 0;
       return indexing_;
    }
 
+   void indexingThreadMain()
+   {
+      try
+      {
+         while (true)
+         {
+            boost::shared_ptr<IndexRequest> pRequest;
+            if (!requests_.deque(&pRequest, boost::posix_time::seconds(1)))
+               continue;
+
+            boost::shared_ptr<IndexResult> pResult(
+                  new IndexResult(pRequest->generation, pRequest->event));
+
+            // write the cache
+            if (!pRequest->cachePath.empty())
+            {
+               Error error = r_util::writeSourceIndexCache(
+                                                pRequest->cachePath,
+                                                pRequest->cachedIndexes);
+               if (error)
+                  LOG_ERROR(error);
+            }
+
+            // index the file (unless the index has since been cleared)
+            else if (pRequest->generation == threadGeneration_.get() &&
+                     pRequest->event.type() !=
+                                 core::system::FileChangeEvent::FileRemoved)
+            {
+               pResult->pIndex = indexFile(*pRequest,
+                                           &(pResult->decodeRequired));
+            }
+
+            results_.enque(pResult);
+         }
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+   }
+
+   // index a file on the background thread. note that we can't call R to
+   // convert the file's encoding so files which aren't UTF-8 (or ASCII,
+   // which is valid in every encoding) are left for the main thread
+   static boost::shared_ptr<r_util::RSourceIndex> indexFile(
+                                             const IndexRequest& request,
+                                             bool* pDecodeRequired)
+   {
+      boost::shared_ptr<r_util::RSourceIndex> pIndex;
+
+      FilePath filePath(request.event.fileInfo().absolutePath());
+      std::string code;
+      Error error = readStringFromFile(filePath, &code, request.lineEnding);
+      if (error)
+      {
+         error.addProperty("src-file", filePath.absolutePath());
+         LOG_ERROR(error);
+         return pIndex;
+      }
+
+      if (!isUtf8Encoding(request.encoding) && !isAscii(code))
+      {
+         *pDecodeRequired = true;
+         return pIndex;
+      }
+
+      stripBOM(&code);
+      error = string_utils::utf8Clean(code.begin(), code.end(), '?');
+      if (error)
+      {
+         LOG_ERROR(error);
+         return pIndex;
+      }
+
+      pIndex.reset(new r_util::RSourceIndex(request.context, code));
+      return pIndex;
+   }
+
+   static bool isUtf8Encoding(const std::string& encoding)
+   {
+      return boost::algorithm::iequals(encoding, "UTF-8") ||
+             boost::algorithm::iequals(encoding, "UTF8") ||
+             boost::algorithm::iequals(encoding, "ASCII");
+   }
+
+   static bool isAscii(const std::string& code)
+   {
+      for (std::string::const_iterator it = code.begin();
+           it != code.end(); ++it)
+      {
+         if (static_cast<unsigned char>(*it) > 127)
+            return false;
+      }
+      return true;
+   }
+
+   void readCache(std::map<std::string,r_util::CachedSourceIndex>* pIndexes)
+   {
+      FilePath cachePath = projects::projectContext().scratchPath().complete(
+                                                      kSourceIndexCacheFile);
+      if (!cachePath.exists())
+         return;
+
+      std::vector<r_util::CachedSourceIndex> cachedIndexes;
+      Error error = r_util::readSourceIndexCache(cachePath, &cachedIndexes);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      BOOST_FOREACH(const r_util::CachedSourceIndex& index, cachedIndexes)
+      {
+         pIndexes->insert(std::make_pair(index.fileInfo.absolutePath(),
+                                         index));
+      }
+   }
+
    void updateIndexEntry(const FileInfo& fileInfo)
    {
       // read the file
@@ -362,6 +572,12 @@ private:
       boost::shared_ptr<r_util::RSourceIndex> pIndex(
                 new r_util::RSourceIndex(context, code));
 
+      updateIndexEntry(fileInfo, pIndex);
+   }
+
+   void updateIndexEntry(const FileInfo& fileInfo,
+                         boost::shared_ptr<r_util::RSourceIndex> pIndex)
+   {
       // attempt to add the entry
       Entry entry(fileInfo, pIndex);
       std::pair<std::set<Entry>::iterator,bool> result = entries_.insert(entry);
@@ -369,6 +585,8 @@ private:
       // insert failed, remove then re-add
       if (result.second == false)
       {
+         symbols_.remove(result.first->pIndex->context());
+
          // was the first item, erase and re-insert without a hint
          if (result.first == entries_.begin())
          {
@@ -387,6 +605,8 @@ private:
             entries_.insert(hintIter, entry);
          }
       }
+
+      symbols_.add(pIndex);
    }
 
    void removeIndexEntry(const FileInfo& fileInfo)
@@ -397,7 +617,10 @@ private:
       // do the find (will use Entry::operator< for equivilance test)
       std::set<Entry>::iterator it = entries_.find(entry);
       if (it != entries_.end())
+      {
+         symbols_.remove(it->pIndex->context());
          entries_.erase(it);
+      }
    }
 
    static bool isRSourceFile(const FileInfo& fileInfo)
@@ -411,9 +634,21 @@ private:
    // index entries
    std::set<Entry> entries_;
 
-   // indexing queue
+   // items of all of the entries (for searching)
+   r_util::RSourceSymbolTable symbols_;
+
+   // indexing state (main thread). generation_ is incremented whenever the
+   // index is cleared so that results from before then can be discarded
    bool indexing_;
-   std::queue<core::system::FileChangeEvent> indexingQueue_;
+   int generation_;
+   core::thread::ThreadsafeValue<int> threadGeneration_;
+   int pendingRequests_;
+   bool cacheDirty_;
+
+   // background indexing thread and its queues
+   bool threadStarted_;
+   core::thread::ThreadsafeQueue<boost::shared_ptr<IndexRequest> > requests_;
+   core::thread::ThreadsafeQueue<boost::shared_ptr<IndexResult> > results_;
 };
 
 // global source file index
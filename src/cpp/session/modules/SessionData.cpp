@@ -168,13 +168,15 @@ SEXP dataViewerHook(SEXP call, SEXP op, SEXP args, SEXP rho)
       r::sexp::Protect rProtect;
       SEXP formattedDataSEXP = Rf_allocVector(VECSXP, displayedColumns);
       rProtect.add(formattedDataSEXP);
+      r::exec::RFunction formatFx(".rs.formatDataColumn");
+      SEXP displayedRowsSEXP = r::sexp::create(displayedRows, &rProtect);
       for (int i=0; i<displayedColumns; i++)
       {
          SEXP columnSEXP = VECTOR_ELT(dataSEXP, i);
          SEXP formattedColumnSEXP;
-         r::exec::RFunction formatFx(".rs.formatDataColumn");
+         formatFx.clearParams();
          formatFx.addParam(columnSEXP);
-         formatFx.addParam(displayedRows);
+         formatFx.addParam(displayedRowsSEXP);
          Error error = formatFx.call(&formattedColumnSEXP, &rProtect);
          if (error)
             throw r::exec::RErrorException(error.summary());
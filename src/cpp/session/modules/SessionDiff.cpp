@@ -13,9 +13,12 @@
 
 #include "SessionDiff.hpp"
 
+#include <sstream>
+
+#include <boost/foreach.hpp>
 #include <boost/function.hpp>
 #include <boost/format.hpp>
-#include <boost/regex.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
@@ -23,6 +26,7 @@
 #include <core/StringUtils.hpp>
 #include <core/system/System.hpp>
 #include <core/system/Process.hpp>
+#include <core/text/UnifiedDiff.hpp>
 
 #include <core/http/Util.hpp>
 #include <core/http/Request.hpp>
@@ -86,6 +90,100 @@ bool getDiffViewParams(const http::Request& request,
    return true;
 }
 
+void writeEscaped(const char* begin, const char* end, std::ostream& os)
+{
+   for (const char* pos = begin; pos < end; ++pos)
+   {
+      switch (*pos)
+      {
+         case '&':
+            os << "&amp;";
+            break;
+         case '<':
+            os << "&lt;";
+            break;
+         default:
+            os.put(*pos);
+      }
+   }
+}
+
+void writeDiv(const char* cssClass,
+              char prefix,
+              const char* begin,
+              const char* end,
+              std::ostream& os)
+{
+   os << "<div class=\"" << cssClass << "\">";
+   if (prefix != '\0')
+      os.put(prefix);
+   writeEscaped(begin, end, os);
+   os << "</div>\n";
+}
+
+void writeDiv(const char* cssClass, const std::string& text, std::ostream& os)
+{
+   writeDiv(cssClass, '\0', text.data(), text.data() + text.size(), os);
+}
+
+void writeDiffHtml(const text::UnifiedDiff& diff, std::ostream& os)
+{
+   const char* text = diff.linesText().data();
+   BOOST_FOREACH(const text::DiffFile& file, diff.files())
+   {
+      // file headers (an svn Index line and its underline form one header)
+      const std::vector<std::string>& headerLines = file.headerLines;
+      for (std::size_t i = 0; i < headerLines.size(); i++)
+      {
+         const std::string& line = headerLines[i];
+         if (boost::algorithm::starts_with(line, "Index: ") &&
+             i + 1 < headerLines.size() &&
+             boost::algorithm::starts_with(headerLines[i + 1], "="))
+         {
+            writeDiv("header proportional", line + "\n" + headerLines[++i], os);
+         }
+         else if (boost::algorithm::starts_with(line, "diff "))
+         {
+            writeDiv("header proportional", line, os);
+         }
+         else
+         {
+            writeDiv("comment", line, os);
+         }
+      }
+
+      // hunks
+      for (std::size_t h = 0; h < file.hunkCount; h++)
+      {
+         const text::DiffHunk& hunk = diff.hunks()[file.firstHunk + h];
+         writeDiv("group", hunk.header, os);
+
+         for (std::size_t l = 0; l < hunk.lineCount; l++)
+         {
+            const text::DiffLine& line = diff.lines()[hunk.firstLine + l];
+            const char* begin = text + line.textOffset;
+            const char* end = begin + line.textLength;
+            switch (line.type)
+            {
+               case text::DiffLineAdded:
+                  writeDiv("added", '+', begin, end, os);
+                  break;
+               case text::DiffLineDeleted:
+                  writeDiv("deleted", '-', begin, end, os);
+                  break;
+               case text::DiffLineComment:
+                  writeDiv("comment", '\\', begin, end, os);
+                  break;
+               case text::DiffLineContext:
+               default:
+                  writeDiv("unchanged", ' ', begin, end, os);
+                  break;
+            }
+         }
+      }
+   }
+}
+
 void handleDiffViewRequest(const http::Request& request, http::Response* pResponse)
 {
    // get parameters
@@ -112,19 +210,12 @@ void handleDiffViewRequest(const http::Request& request, http::Response* pRespon
       return;
    }
 
-   std::string diff = core::string_utils::textToHtml(result.stdOut);
-   const boost::regex index("^(Index: [^\n]*\n=+)$");
-   const boost::regex plus("^(\\+[^\n]*)$");
-   const boost::regex minus("^(\\-[^\n]*)$");
-   const boost::regex space("^( [^\n]*)$");
-   const boost::regex group("^(@@[^\n]*)$");
-   const boost::regex comment("^([@\\\\][^\n]*)$");
-   diff = regex_replace(diff, index, "<div class=\"header proportional\">\\1</div>");
-   diff = regex_replace(diff, plus, "<div class=\"added\">\\1</div>");
-   diff = regex_replace(diff, minus, "<div class=\"deleted\">\\1</div>");
-   diff = regex_replace(diff, space, "<div class=\"unchanged\">\\1</div>");
-   diff = regex_replace(diff, group, "<div class=\"group\">\\1</div>");
-   diff = regex_replace(diff, comment, "<div class=\"comment\">\\1</div>");
+   // parse the diff and render it
+   text::UnifiedDiff unifiedDiff;
+   unifiedDiff.parse(result.stdOut);
+   std::ostringstream diffStream;
+   writeDiffHtml(unifiedDiff, diffStream);
+   std::string diff = diffStream.str();
 
    // define html template
    boost::format htmlFmt(
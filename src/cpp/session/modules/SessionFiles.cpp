@@ -24,6 +24,9 @@
 
 #include <boost/foreach.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
@@ -33,10 +36,13 @@
 #include <core/Settings.hpp>
 #include <core/Exec.hpp>
 #include <core/DateTime.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/ZipWriter.hpp>
 
 #include <core/http/Util.hpp>
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
+#include <core/http/MultipartFormParser.hpp>
 
 #include <core/json/Json.hpp>
 
@@ -184,6 +190,59 @@ Error listFiles(const json::JsonRpcRequest& request, json::JsonRpcResponse* pRes
 }
 
 
+// IN: String path, Boolean monitor, String sortKey ("name", "size" or
+//     "mtime"), Boolean ascending, String filter (name prefix),
+//     String cursor (empty for the first page), Int pageSize
+// OUT: Object page { files, offset, total, cursor (empty if final page) }
+Error listFilesPage(const json::JsonRpcRequest& request,
+                    json::JsonRpcResponse* pResponse)
+{
+   // get args
+   std::string path, sortKey;
+   bool monitor;
+   ListingPageOptions options;
+   Error error = json::readParams(request.params,
+                                  &path,
+                                  &monitor,
+                                  &sortKey,
+                                  &options.ascending,
+                                  &options.filter,
+                                  &options.cursor,
+                                  &options.pageSize);
+   if (error)
+      return error;
+   FilePath targetPath = module_context::resolveAliasedPath(path) ;
+
+   if (sortKey == "size")
+      options.sortKey = ListingPageOptions::SortBySize;
+   else if (sortKey == "mtime")
+      options.sortKey = ListingPageOptions::SortByModified;
+   else
+      options.sortKey = ListingPageOptions::SortByName;
+   if (options.pageSize <= 0)
+      return Error(json::errc::ParamInvalid, ERROR_LOCATION);
+
+   json::Object page;
+   if (monitor &&
+       !session::projects::projectContext().isMonitoringDirectory(targetPath))
+   {
+      // (keeps the existing monitor if it is already for this path)
+      error = s_filesListingMonitor.startPaged(targetPath, options, &page);
+   }
+   else
+   {
+      if (monitor)
+         s_filesListingMonitor.stop();
+      error = FilesListingMonitor::listPage(targetPath, options, &page);
+   }
+   if (error)
+      return error;
+
+   pResponse->setResult(page);
+   return Success();
+}
+
+
 // IN: String path
 core::Error createFolder(const core::json::JsonRpcRequest& request,
                          json::JsonRpcResponse* pResponse)
@@ -532,20 +591,60 @@ Error detectZipFileOverwrites(const FilePath& uploadedZipFile,
    return Success();
 }
    
-bool validateUploadedFile(const http::File& file, http::Response* pResponse)
+boost::uintmax_t uploadByteLimit()
 {
-   // get limit
-   size_t mbLimit = session::options().limitFileUploadSizeMb();
+   // get limit (0 indicates no limit)
+   int mbLimit = session::options().limitFileUploadSizeMb();
+   if (mbLimit <= 0)
+      return 0;
+
+   // convert limit to bytes
+   return static_cast<boost::uintmax_t>(mbLimit) * 1024 * 1024;
+}
+
+void removeSpooledUpload(const http::File& file)
+{
+   if (file.isSpooled())
+   {
+      Error error = file.spoolPath.removeIfExists();
+      if (error)
+         LOG_ERROR(error);
+   }
+}
 
+void onUploadProgress(boost::shared_ptr<boost::posix_time::ptime> pLastReport,
+                      boost::uintmax_t totalBytes,
+                      boost::uintmax_t bytesReceived)
+{
+   using namespace boost::posix_time;
+
+   // throttle to one event every 500ms (always report completion)
+   ptime now = microsec_clock::universal_time();
+   bool finished = bytesReceived >= totalBytes;
+   if (!finished &&
+       !pLastReport->is_not_a_date_time() &&
+       (now - *pLastReport) < milliseconds(500))
+   {
+      return;
+   }
+   *pLastReport = now;
+
+   json::Object progressJson;
+   progressJson["bytes_received"] = static_cast<double>(bytesReceived);
+   progressJson["bytes_total"] = static_cast<double>(totalBytes);
+   ClientEvent event(client_events::kFileUploadProgress, progressJson);
+   module_context::enqueClientEvent(event);
+}
+
+bool validateUploadedFile(const http::File& file, http::Response* pResponse)
+{
    // don't enforce if no limit specified
-   if (mbLimit <= 0)
+   boost::uintmax_t byteLimit = uploadByteLimit();
+   if (byteLimit == 0)
       return true;
 
-   // convert limit to bytes
-   size_t byteLimit = mbLimit * 1024 * 1024;
-   
    // compare to file size
-   if (file.contents.size() > byteLimit)
+   if (file.size() > byteLimit)
    {
       Error fileTooLargeError = systemError(boost::system::errc::file_too_large,
                                             ERROR_LOCATION);
@@ -574,13 +673,17 @@ void handleFileUploadRequest(const http::Request& request,
    // first validate that we got the required fields
    if (file.name.empty() || targetDirectory.empty())
    {
+      removeSpooledUpload(file);
       json::setJsonRpcError(json::errc::ParamInvalid, pResponse);
       return;
    }
    
    // now validate the file
    if ( !validateUploadedFile(file, pResponse) )
+   {
+      removeSpooledUpload(file);
       return ;
+   }
    
    // form destination path
    FilePath destDir = module_context::resolveAliasedPath(targetDirectory);
@@ -588,16 +691,35 @@ void handleFileUploadRequest(const http::Request& request,
    
    // establish whether this is a zip file and create appropriate temp file path
    bool isZip = destPath.extensionLowerCase() == ".zip";
-   FilePath tempFilePath = module_context::tempFile("upload", 
-                                                    isZip ? "zip" : "bin");
-   
-   // attempt to write the temp file
-   Error saveError = core::writeStringToFile(tempFilePath, file.contents);
-   if (saveError)
+   std::string tempFileExt = isZip ? "zip" : "bin";
+   FilePath tempFilePath;
+
+   // if the file was spooled to disk as it was read then just give it the
+   // right extension (it stays alongside the spool file so this is a rename)
+   if (file.isSpooled())
    {
-      LOG_ERROR(saveError);
-      json::setJsonRpcError(saveError, pResponse);
-      return;
+      tempFilePath = file.spoolPath.parent().complete(
+                              file.spoolPath.filename() + "." + tempFileExt);
+      Error moveError = file.spoolPath.move(tempFilePath);
+      if (moveError)
+      {
+         LOG_ERROR(moveError);
+         removeSpooledUpload(file);
+         json::setJsonRpcError(moveError, pResponse);
+         return;
+      }
+   }
+   // otherwise write the in-memory contents to a temp file
+   else
+   {
+      tempFilePath = module_context::tempFile("upload", tempFileExt);
+      Error saveError = core::writeStringToFile(tempFilePath, file.contents);
+      if (saveError)
+      {
+         LOG_ERROR(saveError);
+         json::setJsonRpcError(saveError, pResponse);
+         return;
+      }
    }
    
    // detect any potential overwrites 
@@ -631,10 +753,9 @@ void handleFileUploadRequest(const http::Request& request,
    json::setJsonRpcResult(uploadJson, pResponse);   
 }
    
-void setAttachmentResponse(const http::Request& request,
-                           const std::string& filename,
-                           const FilePath& attachmentPath,
-                           http::Response* pResponse)
+void setAttachmentHeaders(const http::Request& request,
+                          const std::string& filename,
+                          http::Response* pResponse)
 {
    if (request.headerValue("User-Agent").find("MSIE") == std::string::npos)
    {
@@ -654,8 +775,41 @@ void setAttachmentResponse(const http::Request& request,
                         "attachment; filename*=UTF-8''"
                         + http::util::urlEncode(filename, false));
    pResponse->setHeader("Content-Type", "application/octet-stream");
+}
+
+void setAttachmentResponse(const http::Request& request,
+                           const std::string& filename,
+                           const FilePath& attachmentPath,
+                           http::Response* pResponse)
+{
+   setAttachmentHeaders(request, filename, pResponse);
    pResponse->setBody(attachmentPath);
 }
+
+// NOTE: this is called on a background thread (as the response is being
+// written) so must not call into R
+Error writeExportZip(const FilePath& parentPath,
+                     const std::vector<std::string>& files,
+                     std::ostream& os)
+{
+   // favor speed over size (use up to 4 threads for compression)
+   int threads = std::max(1, std::min(
+                     static_cast<int>(boost::thread::hardware_concurrency()),
+                     4));
+   ZipWriter zipWriter(os, 1, threads);
+
+   BOOST_FOREACH(const std::string& file, files)
+   {
+      FilePath filePath = parentPath.complete(file);
+      Error error = filePath.isDirectory() ?
+                           zipWriter.addDirectory(filePath, file) :
+                           zipWriter.addFile(filePath, file);
+      if (error)
+         return error;
+   }
+
+   return zipWriter.finish();
+}
    
 void handleMultipleFileExportRequest(const http::Request& request, 
                                      http::Response* pResponse)
@@ -705,21 +859,13 @@ void handleMultipleFileExportRequest(const http::Request& request,
       files.push_back(file);
    }
    
-   // create the zip file
-   FilePath tempZipFilePath = module_context::tempFile("export", "zip");
-   Error error = r::exec::RFunction(".rs.createZipFile",
-                                    tempZipFilePath.absolutePath(),
-                                    parentPath.absolutePath(),
-                                    files).call();
-   if (error)
-   {
-      LOG_ERROR(error);
-      pResponse->setError(error);
-      return;
-   }
-   
-   // return attachment
-   setAttachmentResponse(request, name, tempZipFilePath, pResponse);
+   // return attachment (the zip is written directly to the connection as
+   // it is created rather than to a temporary file)
+   setAttachmentHeaders(request, name, pResponse);
+   pResponse->setStreamingBody(boost::bind(writeExportZip,
+                                           parentPath,
+                                           files,
+                                           _1));
 }
    
 void handleFileExportRequest(const http::Request& request, 
@@ -803,6 +949,32 @@ SEXP rs_pathInfo(SEXP pathSEXP)
 
 } // anonymous namespace
 
+boost::shared_ptr<http::MultipartFormParser> createUploadFormParser(
+                                             const http::Request& request)
+{
+   if (!boost::algorithm::starts_with(request.uri(), "/upload"))
+      return boost::shared_ptr<http::MultipartFormParser>();
+
+   // report progress relative to the declared content length
+   boost::uintmax_t contentLength = safe_convert::stringTo<boost::uintmax_t>(
+                                    request.headerValue("Content-Length"), 0);
+   boost::shared_ptr<boost::posix_time::ptime> pLastReport(
+                                             new boost::posix_time::ptime());
+   http::MultipartFormParser::ProgressHandler onProgress =
+                  boost::bind(onUploadProgress, pLastReport, contentLength, _1);
+
+   // spool into the user scratch path (we are on the listener thread so
+   // can't ask R for a tempfile)
+   FilePath spoolDir = session::options().userScratchPath().complete(
+                                                            "upload-spool");
+
+   return boost::shared_ptr<http::MultipartFormParser>(
+            new http::MultipartFormParser(request.headerValue("Content-Type"),
+                                          spoolDir,
+                                          uploadByteLimit(),
+                                          onProgress));
+}
+
 bool isMonitoringDirectory(const FilePath& directory)
 {
    FilePath monitoredPath = s_filesListingMonitor.currentMonitoredPath();
@@ -832,6 +1004,7 @@ Error initialize()
    initBlock.addFunctions()
       (bind(registerRpcMethod, "stat", stat))
       (bind(registerRpcMethod, "list_files", listFiles))
+      (bind(registerRpcMethod, "list_files_page", listFilesPage))
       (bind(registerRpcMethod, "create_folder", createFolder))
       (bind(registerRpcMethod, "delete_files", deleteFiles))
       (bind(registerRpcMethod, "copy_file", copyFile))
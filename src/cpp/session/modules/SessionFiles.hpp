@@ -14,9 +14,15 @@
 #ifndef SESSION_SESSION_FILES_HPP
 #define SESSION_SESSION_FILES_HPP
 
+#include <boost/shared_ptr.hpp>
+
 namespace core {
    class Error;
    class FilePath;
+   namespace http {
+      class Request;
+      class MultipartFormParser;
+   }
 }
  
 namespace session {
@@ -25,6 +31,11 @@ namespace files {
    
 bool isMonitoringDirectory(const core::FilePath& directory);
 
+// parser which spools uploads to disk as they are read (called on the
+// http connection listener thread so must not touch R)
+boost::shared_ptr<core::http::MultipartFormParser> createUploadFormParser(
+                                       const core::http::Request& request);
+
 core::Error initialize();
                        
 } // namespace files
@@ -14,19 +14,27 @@
 #include "SessionFilesListingMonitor.hpp"
 
 #include <algorithm>
+#include <iterator>
 
 #include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/foreach.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/algorithm/string/predicate.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
 #include <core/FileInfo.hpp>
 #include <core/FilePath.hpp>
+#include <core/SafeConvert.hpp>
+#include <core/StringUtils.hpp>
 
 #include <core/json/JsonRpc.hpp>
 
 #include <core/system/FileMonitor.hpp>
 #include <core/system/FileChangeEvent.hpp>
+#include <core/system/FileScanner.hpp>
 
 #include <session/SessionModuleContext.hpp>
 
@@ -38,37 +46,315 @@ namespace session {
 namespace modules { 
 namespace files {
 
+namespace {
+
+// sort key of a file within a page order
+struct PageKey
+{
+   PageKey() : value(0) {}
+   boost::int64_t value;
+   std::string foldedName;
+   std::string name;
+};
+
+typedef std::pair<PageKey,std::size_t> PageEntry;
+
+PageKey pageKey(const FileInfo& fileInfo, ListingPageOptions::SortKey sortKey)
+{
+   PageKey key;
+   std::string path = fileInfo.absolutePath();
+   key.name = path.substr(path.find_last_of('/') + 1);
+   key.foldedName = string_utils::toLower(key.name);
+   if (sortKey == ListingPageOptions::SortBySize)
+      key.value = fileInfo.size();
+   else if (sortKey == ListingPageOptions::SortByModified)
+      key.value = fileInfo.lastWriteTime();
+   return key;
+}
+
+int comparePageKeys(const PageKey& a, const PageKey& b)
+{
+   if (a.value != b.value)
+      return a.value < b.value ? -1 : 1;
+   int result = a.foldedName.compare(b.foldedName);
+   if (result != 0)
+      return result;
+   return a.name.compare(b.name);
+}
+
+bool pageKeyLess(const PageKey& a, const PageKey& b, bool ascending)
+{
+   int result = comparePageKeys(a, b);
+   return ascending ? result < 0 : result > 0;
+}
+
+bool pageEntryLess(const PageEntry& a, const PageEntry& b, bool ascending)
+{
+   return pageKeyLess(a.first, b.first, ascending);
+}
+
+bool cursorLess(const PageKey& cursor, const PageEntry& entry, bool ascending)
+{
+   return pageKeyLess(cursor, entry.first, ascending);
+}
+
+bool matchesPageFilter(const PageKey& key, const std::string& foldedFilter)
+{
+   return boost::algorithm::starts_with(key.foldedName, foldedFilter);
+}
+
+// cursors are of the form <sort key>:<direction>:<value>:<name>
+std::string sortCode(const ListingPageOptions& options)
+{
+   const char* keys = "nsm";
+   return std::string(1, keys[options.sortKey]) + ":" +
+          (options.ascending ? "a" : "d");
+}
+
+std::string createCursor(const ListingPageOptions& options, const PageKey& key)
+{
+   return sortCode(options) + ":" +
+          boost::lexical_cast<std::string>(key.value) + ":" +
+          key.name;
+}
+
+Error parseCursor(const ListingPageOptions& options, PageKey* pKey)
+{
+   // the cursor must be for the same sort as the page
+   std::string code = sortCode(options) + ":";
+   std::size_t valueEnd = options.cursor.find(':', code.size());
+   if (!boost::algorithm::starts_with(options.cursor, code) ||
+       valueEnd == std::string::npos)
+   {
+      Error error = systemError(boost::system::errc::invalid_argument,
+                                ERROR_LOCATION);
+      error.addProperty("cursor", options.cursor);
+      return error;
+   }
+
+   pKey->value = safe_convert::stringTo<boost::int64_t>(
+                  options.cursor.substr(code.size(), valueEnd - code.size()),
+                  0);
+   pKey->name = options.cursor.substr(valueEnd + 1);
+   pKey->foldedName = string_utils::toLower(pKey->name);
+   return Success();
+}
+
+// creates the json for files in a directory listing
+class FileItemWriter
+{
+public:
+   FileItemWriter(const FilePath& rootPath,
+                  const core::system::DirectoryListing& listing)
+   {
+      // get source control status (merely log errors doing this)
+      Error error = source_control::status(rootPath, &vcsStatus_);
+      if (error)
+         LOG_ERROR(error);
+
+      // derive aliased paths from the aliased path of the root (rather
+      // than aliasing each file)
+      aliasedRoot_ = module_context::createAliasedPath(rootPath);
+      if (!boost::algorithm::ends_with(aliasedRoot_, "/"))
+         aliasedRoot_.append("/");
+      rootLength_ = listing.path.length();
+      if (!boost::algorithm::ends_with(listing.path, "/"))
+         rootLength_++;
+   }
+
+   json::Object fileItem(const FileInfo& fileInfo) const
+   {
+      std::string path = fileInfo.absolutePath();
+      core::json::Object fileObject = module_context::createFileSystemItem(
+                                    fileInfo,
+                                    aliasedRoot_ + path.substr(rootLength_));
+
+      FilePath filePath(path);
+      source_control::VCSStatus status = vcsStatus_.getStatus(filePath);
+      json::Object vcsObj;
+      Error error = modules::source_control::statusToJson(filePath,
+                                                          status,
+                                                          &vcsObj);
+      if (error)
+         LOG_ERROR(error);
+      fileObject["vcs_status"] = vcsObj;
+      return fileObject;
+   }
+
+private:
+   source_control::StatusResult vcsStatus_;
+   std::string aliasedRoot_;
+   std::size_t rootLength_;
+};
+
+} // anonymous namespace
+
+// the visible files of a listing which match a filter, in page order
+struct FilesListingMonitor::PageOrder
+{
+   PageOrder(const core::system::DirectoryListing& listing,
+             const ListingPageOptions& options)
+      : sortKey(options.sortKey),
+        ascending(options.ascending),
+        filter(string_utils::toLower(options.filter))
+   {
+      for (std::size_t i = 0; i < listing.entries.size(); i++)
+      {
+         const FileInfo& fileInfo = listing.entries[i];
+         if (!module_context::fileListingFilter(fileInfo))
+            continue;
+
+         PageKey key = pageKey(fileInfo, sortKey);
+         if (matchesPageFilter(key, filter))
+            entries.push_back(PageEntry(key, i));
+      }
+
+      std::sort(entries.begin(),
+                entries.end(),
+                boost::bind(pageEntryLess, _1, _2, ascending));
+   }
+
+   bool isFor(const ListingPageOptions& options) const
+   {
+      return sortKey == options.sortKey &&
+             ascending == options.ascending &&
+             filter == string_utils::toLower(options.filter);
+   }
+
+   // write the page after the cursor (also returns the cursor for the
+   // next page, which is empty if this is the final page)
+   Error writePage(const FilePath& rootPath,
+                   const core::system::DirectoryListing& listing,
+                   const ListingPageOptions& options,
+                   json::Object* pPage,
+                   std::string* pNextCursor) const
+   {
+      // find the start of the page
+      std::vector<PageEntry>::const_iterator begin = entries.begin();
+      if (!options.cursor.empty())
+      {
+         PageKey cursorKey;
+         Error error = parseCursor(options, &cursorKey);
+         if (error)
+            return error;
+
+         begin = std::upper_bound(entries.begin(),
+                                  entries.end(),
+                                  cursorKey,
+                                  boost::bind(cursorLess, _1, _2, ascending));
+      }
+      std::vector<PageEntry>::const_iterator end = begin;
+      std::advance(end, std::min<std::ptrdiff_t>(
+                                 std::max(options.pageSize, 1),
+                                 std::distance(begin, entries.end())));
+
+      // write its files
+      FileItemWriter writer(rootPath, listing);
+      json::Array jsonFiles;
+      for (std::vector<PageEntry>::const_iterator it = begin; it != end; ++it)
+         jsonFiles.push_back(writer.fileItem(listing.entries[it->second]));
+
+      pNextCursor->clear();
+      if (end != entries.end())
+         *pNextCursor = createCursor(options, (end - 1)->first);
+
+      json::Object& page = *pPage;
+      page["files"] = jsonFiles;
+      page["offset"] = static_cast<int>(std::distance(entries.begin(), begin));
+      page["total"] = static_cast<int>(entries.size());
+      page["cursor"] = *pNextCursor;
+      return Success();
+   }
+
+   ListingPageOptions::SortKey sortKey;
+   bool ascending;
+   std::string filter;
+   std::vector<PageEntry> entries;
+};
+
 Error FilesListingMonitor::start(const FilePath& filePath, json::Array* pJsonFiles)
 {
    // always stop existing
    stop();
 
-   // scan the directory (populates pJsonFiles out parameter)
-   std::vector<FilePath> files;
-   Error error = listFiles(filePath, &files, pJsonFiles);
+   return startMonitor(filePath, pJsonFiles);
+}
+
+Error FilesListingMonitor::startPaged(const FilePath& filePath,
+                                      const ListingPageOptions& options,
+                                      json::Object* pPage)
+{
+   // start monitoring unless we are already monitoring this path
+   if (!pListing_ || filePath.absolutePath() != pListing_->path)
+   {
+      stop();
+
+      Error error = startMonitor(filePath, NULL);
+      if (error)
+         return error;
+   }
+
+   // compute the page order if we don't already have it
+   if (!pPageOrder_ || !pPageOrder_->isFor(options))
+      pPageOrder_.reset(new PageOrder(*pListing_, options));
+
+   std::string nextCursor;
+   Error error = pPageOrder_->writePage(filePath,
+                                        *pListing_,
+                                        options,
+                                        pPage,
+                                        &nextCursor);
+   if (error)
+      return error;
+
+   // start a new page window for a first page (or a page with a different
+   // order) otherwise extend the window to the end of this page
+   if (!paged_ || options.cursor.empty() || !pPageOrder_->isFor(pageWindow_))
+      pageWindow_ = options;
+   pageWindow_.cursor = nextCursor;
+   paged_ = true;
+
+   return Success();
+}
+
+Error FilesListingMonitor::startMonitor(const FilePath& filePath,
+                                        json::Array* pJsonFiles)
+{
+   // list the directory (populates pJsonFiles out parameter if it was
+   // provided, paged listings write their pages from the listing instead)
+   boost::shared_ptr<core::system::DirectoryListing> pListing(
+                                       new core::system::DirectoryListing());
+   Error error;
+   if (pJsonFiles != NULL)
+      error = listFiles(filePath, pListing.get(), pJsonFiles);
+   else
+      error = core::system::listDirectory(filePath.absolutePath(),
+                                          pListing.get());
    if (error)
       return error;
 
-   // copy the file listing into a vector of FileInfo which we will order so that it can
-   // be compared with the initial scan of the file montor for changes
-   std::vector<FileInfo> prevFiles;
-   std::transform(files.begin(),
-                  files.end(),
-                  std::back_inserter(prevFiles),
-                  core::toFileInfo);
+   // keep the listing (it's updated as files change). note that the
+   // monitor's initial scan uses the listing itself if the directory hasn't
+   // changed since it was listed (otherwise it's compared with the initial
+   // scan when the monitor is registered to find the changes in between)
+   pListing_ = pListing;
 
    // kickoff new monitor
    core::system::file_monitor::Callbacks cb;
    cb.onRegistered = boost::bind(&FilesListingMonitor::onRegistered,
-                                    this, _1, filePath, prevFiles, _2);
-   cb.onRegistrationError =  boost::bind(core::log::logError, _1, ERROR_LOCATION);
-   cb.onFilesChanged = boost::bind(module_context::enqueFileChangedEvents, filePath, _1);
+                                    this, _1, filePath, pListing, _2);
+   cb.onRegistrationError = boost::bind(
+                                    &FilesListingMonitor::onRegistrationError,
+                                    this, _1, pListing);
+   cb.onFilesChanged = boost::bind(&FilesListingMonitor::onFilesChanged,
+                                   this, filePath, pListing, _1);
    cb.onMonitoringError = boost::bind(core::log::logError, _1, ERROR_LOCATION);
    cb.onUnregistered = boost::bind(&FilesListingMonitor::onUnregistered, this, _1);
    core::system::file_monitor::registerMonitor(filePath,
                                                false,
                                                module_context::fileListingFilter,
-                                               cb);
+                                               cb,
+                                               pListing);
 
    return Success();
 }
@@ -82,6 +368,13 @@ void FilesListingMonitor::stop()
       core::system::file_monitor::unregisterMonitor(currentHandle_);
       currentHandle_ = core::system::file_monitor::Handle();
    }
+
+   // reset listing and paging state
+   pListing_.reset();
+   listingIndex_.clear();
+   pPageOrder_.reset();
+   paged_ = false;
+   pageWindow_ = ListingPageOptions();
 }
 
 const FilePath& FilesListingMonitor::currentMonitoredPath() const
@@ -89,11 +382,20 @@ const FilePath& FilesListingMonitor::currentMonitoredPath() const
    return currentPath_;
 }
 
-void FilesListingMonitor::onRegistered(core::system::file_monitor::Handle handle,
-                                       const FilePath& filePath,
-                                       const std::vector<FileInfo>& prevFiles,
-                                       const tree<core::FileInfo>& files)
+void FilesListingMonitor::onRegistered(
+               core::system::file_monitor::Handle handle,
+               const FilePath& filePath,
+               boost::shared_ptr<core::system::DirectoryListing> pListing,
+               const tree<core::FileInfo>& files)
 {
+   // if the monitor has been stopped or restarted since this registration
+   // was requested then unregister it
+   if (pListing != pListing_)
+   {
+      core::system::file_monitor::unregisterMonitor(handle);
+      return;
+   }
+
    // set path and current handle
    currentPath_ = filePath;
    currentHandle_ = handle;
@@ -101,16 +403,27 @@ void FilesListingMonitor::onRegistered(core::system::file_monitor::Handle handle
    // compare the previously returned listing with the initial scan to see if any
    // file changes occurred between listings
    std::vector<core::system::FileChangeEvent> events;
-   core::system::collectFileChangeEvents(prevFiles.begin(),
-                                         prevFiles.end(),
+   core::system::collectFileChangeEvents(pListing->entries.begin(),
+                                         pListing->entries.end(),
                                          files.begin(files.begin()),
                                          files.end(files.begin()),
                                          module_context::fileListingFilter,
                                          &events);
 
-   // enque any events we discovered
+   // apply and enque any events we discovered
    if (!events.empty())
-      module_context::enqueFileChangedEvents(filePath, events);
+      onFilesChanged(filePath, pListing, events);
+}
+
+void FilesListingMonitor::onRegistrationError(
+               const Error& error,
+               boost::shared_ptr<core::system::DirectoryListing> pListing)
+{
+   LOG_ERROR(error);
+
+   // don't page a listing which won't be kept up to date
+   if (pListing == pListing_)
+      stop();
 }
 
 void FilesListingMonitor::onUnregistered(core::system::file_monitor::Handle handle)
@@ -121,46 +434,148 @@ void FilesListingMonitor::onUnregistered(core::system::file_monitor::Handle hand
    // we clear our state explicitly here as well
    if (currentHandle_ == handle)
    {
-      currentPath_ = FilePath();
       currentHandle_ = core::system::file_monitor::Handle();
+      stop();
    }
 }
 
+void FilesListingMonitor::onFilesChanged(
+               const FilePath& filePath,
+               boost::shared_ptr<core::system::DirectoryListing> pListing,
+               const std::vector<core::system::FileChangeEvent>& events)
+{
+   // ignore events for a monitor which has since been stopped or restarted
+   if (!pListing_ || pListing != pListing_)
+      return;
+
+   std::vector<FileInfo>& entries = pListing_->entries;
+   if (listingIndex_.empty())
+   {
+      for (std::size_t i = 0; i < entries.size(); i++)
+         listingIndex_[entries[i].absolutePath()] = i;
+   }
+
+   std::vector<core::system::FileChangeEvent> windowEvents;
+   BOOST_FOREACH(const core::system::FileChangeEvent& event, events)
+   {
+      // find the file in the listing
+      std::string path = event.fileInfo().absolutePath();
+      std::map<std::string,std::size_t>::iterator indexIt =
+                                                listingIndex_.find(path);
+      FileInfo* pEntry = indexIt != listingIndex_.end() ?
+                                       &entries[indexIt->second] : NULL;
+
+      // send the event if the file was or is within the page window
+      if (!paged_ ||
+          isInPageWindow(event.fileInfo()) ||
+          (pEntry != NULL && isInPageWindow(*pEntry)))
+      {
+         windowEvents.push_back(event);
+      }
+
+      // update the listing (its order doesn't matter since pages are
+      // sorted separately, so removed files are replaced by the last entry)
+      if (event.type() == core::system::FileChangeEvent::FileRemoved)
+      {
+         if (pEntry != NULL)
+         {
+            std::size_t index = indexIt->second;
+            listingIndex_.erase(indexIt);
+            if (index != entries.size() - 1)
+            {
+               entries[index] = entries.back();
+               listingIndex_[entries[index].absolutePath()] = index;
+            }
+            entries.pop_back();
+         }
+      }
+      else if (pEntry != NULL)
+      {
+         *pEntry = event.fileInfo();
+      }
+      else
+      {
+         listingIndex_[path] = entries.size();
+         entries.push_back(event.fileInfo());
+      }
+   }
+
+   // the page order needs to be recomputed
+   pPageOrder_.reset();
+
+   if (!windowEvents.empty())
+      module_context::enqueFileChangedEvents(filePath, windowEvents);
+}
+
+bool FilesListingMonitor::isInPageWindow(const FileInfo& fileInfo) const
+{
+   if (!module_context::fileListingFilter(fileInfo))
+      return false;
+
+   PageKey key = pageKey(fileInfo, pageWindow_.sortKey);
+   if (!matchesPageFilter(key, string_utils::toLower(pageWindow_.filter)))
+      return false;
+
+   // files after the cursor of the last page listed aren't in the window
+   // (unless the last page listed was the final page)
+   if (pageWindow_.cursor.empty())
+      return true;
+
+   PageKey cursorKey;
+   Error error = parseCursor(pageWindow_, &cursorKey);
+   if (error)
+      return true;
+
+   return !pageKeyLess(cursorKey, key, pageWindow_.ascending);
+}
+
+Error FilesListingMonitor::listPage(const FilePath& rootPath,
+                                    const ListingPageOptions& options,
+                                    json::Object* pPage)
+{
+   core::system::DirectoryListing listing;
+   Error error = core::system::listDirectory(rootPath.absolutePath(),
+                                             &listing);
+   if (error)
+      return error;
+
+   std::string nextCursor;
+   return PageOrder(listing, options).writePage(rootPath,
+                                                listing,
+                                                options,
+                                                pPage,
+                                                &nextCursor);
+}
+
 Error FilesListingMonitor::listFiles(const FilePath& rootPath,
-                                     std::vector<FilePath>* pFiles,
+                                     core::system::DirectoryListing* pListing,
                                      json::Array* pJsonFiles)
 {
    // enumerate the files
-   pFiles->clear();
-   core::Error error = rootPath.children(pFiles) ;
+   Error error = core::system::listDirectory(rootPath.absolutePath(),
+                                             pListing);
    if (error)
       return error;
+   const std::vector<FileInfo>& files = pListing->entries;
 
-   // get source control status (merely log errors doing this)
-   source_control::StatusResult vcsStatus;
-   error = source_control::status(rootPath, &vcsStatus);
-   if (error)
-      LOG_ERROR(error);
-
-   // sort the files by name
-   std::sort(pFiles->begin(), pFiles->end(), core::compareAbsolutePathNoCase);
+   // sort the files by name (case insensitive)
+   std::vector<std::pair<std::string,std::size_t> > sorted;
+   sorted.reserve(files.size());
+   for (std::size_t i = 0; i < files.size(); i++)
+   {
+      sorted.push_back(std::make_pair(
+                          string_utils::toLower(files[i].absolutePath()), i));
+   }
+   std::sort(sorted.begin(), sorted.end());
 
    // produce json listing
-   BOOST_FOREACH( core::FilePath& filePath, *pFiles)
+   FileItemWriter writer(rootPath, *pListing);
+   for (std::size_t i = 0; i < sorted.size(); i++)
    {
-      // files which may have been deleted after the listing or which
-      // are not end-user visible
-      if (filePath.exists() && module_context::fileListingFilter(core::FileInfo(filePath)))
-      {
-         source_control::VCSStatus status = vcsStatus.getStatus(filePath);
-         core::json::Object fileObject = module_context::createFileSystemItem(filePath);
-         json::Object vcsObj;
-         error = modules::source_control::statusToJson(filePath, status, &vcsObj);
-         if (error)
-            LOG_ERROR(error);
-         fileObject["vcs_status"] = vcsObj;
-         pJsonFiles->push_back(fileObject) ;
-      }
+      // files which are not end-user visible
+      const FileInfo& fileInfo = files[sorted[i].second];
+      if (module_context::fileListingFilter(fileInfo))
+         pJsonFiles->push_back(writer.fileItem(fileInfo));
    }
 
    return Success();
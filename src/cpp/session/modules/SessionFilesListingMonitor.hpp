@@ -14,15 +14,18 @@
 #ifndef SESSION_SESSION_FILES_LISTING_MONITOR_HPP
 #define SESSION_SESSION_FILES_LISTING_MONITOR_HPP
 
+#include <map>
 #include <string>
 #include <vector>
 
+#include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
 
 #include <core/collection/Tree.hpp>
 
 #include <core/json/Json.hpp>
 #include <core/system/FileMonitor.hpp>
+#include <core/system/FileScanner.hpp>
 
 namespace core {
    class Error;
@@ -42,12 +45,50 @@ namespace modules {
 
 namespace files {
 
+// options for listing a page of a directory
+struct ListingPageOptions
+{
+   enum SortKey
+   {
+      SortByName,
+      SortBySize,
+      SortByModified
+   };
+
+   ListingPageOptions()
+      : sortKey(SortByName), ascending(true), pageSize(500)
+   {
+   }
+
+   SortKey sortKey;
+   bool ascending;
+
+   // only list files whose names start with filter (case insensitive)
+   std::string filter;
+
+   // cursor returned with the previous page (empty for the first page).
+   // cursors encode the sort key of the last file of the page so they
+   // remain valid as files are added and removed
+   std::string cursor;
+
+   int pageSize;
+};
+
 class FilesListingMonitor : boost::noncopyable
 {
 public:
+   FilesListingMonitor() : paged_(false) {}
+
    // kickoff monitoring
    core::Error start(const core::FilePath& filePath, core::json::Array* pJsonFiles);
 
+   // kickoff monitoring (unless the path is already being monitored) and
+   // list a page of its files. once paging, change events are only sent for
+   // files within the pages listed since the first page
+   core::Error startPaged(const core::FilePath& filePath,
+                          const ListingPageOptions& options,
+                          core::json::Object* pPage);
+
    void stop();
 
    // what path are we currently monitoring?
@@ -58,27 +99,62 @@ public:
    static core::Error listFiles(const core::FilePath& rootPath,
                                 core::json::Array* pJsonFiles)
    {
-      std::vector<core::FilePath> files;
-      return listFiles(rootPath, &files, pJsonFiles);
+      core::system::DirectoryListing listing;
+      return listFiles(rootPath, &listing, pJsonFiles);
    }
 
+   // list a page of files without monitoring
+   static core::Error listPage(const core::FilePath& rootPath,
+                               const ListingPageOptions& options,
+                               core::json::Object* pPage);
+
 private:
    // stateful handlers for registration and unregistration
    void onRegistered(core::system::file_monitor::Handle handle,
                      const core::FilePath& filePath,
-                     const std::vector<core::FileInfo>& prevFiles,
+                     boost::shared_ptr<core::system::DirectoryListing> pListing,
                      const tree<core::FileInfo>& files);
 
+   void onRegistrationError(
+                     const core::Error& error,
+                     boost::shared_ptr<core::system::DirectoryListing> pListing);
+
    void onUnregistered(core::system::file_monitor::Handle handle);
 
+   void onFilesChanged(
+               const core::FilePath& filePath,
+               boost::shared_ptr<core::system::DirectoryListing> pListing,
+               const std::vector<core::system::FileChangeEvent>& events);
+
    // helpers
+   core::Error startMonitor(const core::FilePath& filePath,
+                            core::json::Array* pJsonFiles);
+
    static core::Error listFiles(const core::FilePath& rootPath,
-                                std::vector<core::FilePath>* pFiles,
+                                core::system::DirectoryListing* pListing,
                                 core::json::Array* pJsonFiles);
 
+   bool isInPageWindow(const core::FileInfo& fileInfo) const;
+
 private:
    core::FilePath currentPath_;
    core::system::file_monitor::Handle currentHandle_;
+
+   // listing of the monitored directory (kept up to date with changes)
+   boost::shared_ptr<core::system::DirectoryListing> pListing_;
+
+   // index of each path within the listing's entries (built when the first
+   // changes are applied)
+   std::map<std::string,std::size_t> listingIndex_;
+
+   // the listing's files in page order (computed on demand)
+   struct PageOrder;
+   boost::shared_ptr<PageOrder> pPageOrder_;
+
+   // options of the first page and cursor of the last page listed (change
+   // events are only sent for files between the two)
+   bool paged_;
+   ListingPageOptions pageWindow_;
 };
 
 
@@ -0,0 +1,456 @@
+/*
+ * SessionFind.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionFind.hpp"
+
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/foreach.hpp>
+#include <boost/regex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/trim.hpp>
+
+#include <core/Error.hpp>
+#include <core/Exec.hpp>
+#include <core/FileInfo.hpp>
+#include <core/FilePath.hpp>
+#include <core/Log.hpp>
+#include <core/RegexUtils.hpp>
+#include <core/Thread.hpp>
+
+#include <core/system/FileChangeEvent.hpp>
+#include <core/system/FileScanner.hpp>
+#include <core/system/System.hpp>
+
+#include <core/text/TextSearch.hpp>
+
+#include <session/SessionModuleContext.hpp>
+#include <session/projects/SessionProjects.hpp>
+
+using namespace core ;
+
+namespace session {
+namespace modules {
+namespace find {
+
+namespace {
+
+// maximum number of matching lines reported by a find
+const std::size_t kMaxMatches = 1000;
+
+// maximum number of threads used to search files
+const int kMaxSearchThreads = 8;
+
+// paths of the files in the project (maintained using the project file
+// monitor so finds within the project don't need to list directories)
+std::set<std::string> s_projectFiles;
+bool s_projectFilesMonitored = false;
+
+bool matchesFilePatterns(const FilePath& filePath,
+                         const std::vector<boost::regex>& filePatterns)
+{
+   if (filePatterns.empty())
+      return true;
+
+   std::string filename = filePath.filename();
+   BOOST_FOREACH(const boost::regex& pattern, filePatterns)
+   {
+      if (boost::regex_match(filename, pattern))
+         return true;
+   }
+   return false;
+}
+
+// A find runs on a background thread (which searches the files using a
+// pool of threads) and its results are sent to the client periodically
+// (from the main thread) as find_result events until the find completes
+// or is stopped.
+class FindOperation : boost::noncopyable,
+                      public boost::enable_shared_from_this<FindOperation>
+{
+public:
+   FindOperation(const std::string& handle,
+                 const text::TextMatcher& matcher,
+                 const FilePath& directory,
+                 const std::vector<boost::regex>& filePatterns,
+                 bool listFiles,
+                 const std::vector<FilePath>& files)
+      : handle_(handle),
+        matcher_(matcher),
+        directory_(directory),
+        filePatterns_(filePatterns),
+        listFiles_(listFiles),
+        files_(files),
+        matchCount_(0),
+        stopped_(false),
+        finished_(false)
+   {
+   }
+
+   const std::string& handle() const { return handle_; }
+
+   void start()
+   {
+      boost::shared_ptr<FindOperation> pThis = shared_from_this();
+      core::thread::safeLaunchThread(
+                     boost::bind(&FindOperation::findThreadMain, pThis));
+
+      module_context::schedulePeriodicWork(
+                     boost::posix_time::milliseconds(100),
+                     boost::bind(&FindOperation::enqueResults, pThis),
+                     false);
+   }
+
+   void stop()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         stopped_ = true;
+      }
+      END_LOCK_MUTEX
+   }
+
+private:
+   typedef std::pair<FilePath,std::vector<text::LineMatch> > FileMatches;
+
+   bool isStopped()
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         return stopped_;
+      }
+      END_LOCK_MUTEX
+
+      return true;
+   }
+
+   void listFiles(const std::string& directory)
+   {
+      if (isStopped())
+         return;
+
+      core::system::DirectoryListing listing;
+      Error error = core::system::listDirectory(directory, &listing);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      BOOST_FOREACH(const FileInfo& fileInfo, listing.entries)
+      {
+         if (!module_context::fileListingFilter(fileInfo))
+            continue;
+
+         // (don't follow symlinked directories, which could form a cycle)
+         if (fileInfo.isDirectory())
+         {
+            if (!fileInfo.isSymlink())
+               listFiles(fileInfo.absolutePath());
+         }
+         else
+         {
+            files_.push_back(FilePath(fileInfo.absolutePath()));
+         }
+      }
+   }
+
+   void findThreadMain()
+   {
+      try
+      {
+         if (listFiles_)
+            listFiles(directory_.absolutePath());
+
+         files_.erase(std::remove_if(files_.begin(),
+                                     files_.end(),
+                                     !boost::bind(matchesFilePatterns,
+                                                  _1,
+                                                  boost::cref(filePatterns_))),
+                      files_.end());
+
+         int threads = std::max(1, std::min<int>(
+                                       boost::thread::hardware_concurrency(),
+                                       kMaxSearchThreads));
+         text::searchFiles(files_,
+                           matcher_,
+                           kMaxMatches,
+                           threads,
+                           boost::bind(&FindOperation::onMatches,
+                                       this, _1, _2),
+                           boost::bind(&FindOperation::isStopped, this));
+      }
+      CATCH_UNEXPECTED_EXCEPTION
+
+      LOCK_MUTEX(mutex_)
+      {
+         finished_ = true;
+      }
+      END_LOCK_MUTEX
+   }
+
+   // called on the search threads
+   bool onMatches(const FilePath& filePath,
+                  const std::vector<text::LineMatch>& matches)
+   {
+      LOCK_MUTEX(mutex_)
+      {
+         if (stopped_ || matchCount_ >= kMaxMatches)
+            return false;
+
+         std::size_t count = std::min(matches.size(),
+                                      kMaxMatches - matchCount_);
+         std::vector<text::LineMatch> fileMatches(matches.begin(),
+                                                  matches.begin() + count);
+         pending_.push_back(FileMatches(filePath, fileMatches));
+         matchCount_ += count;
+         return matchCount_ < kMaxMatches;
+      }
+      END_LOCK_MUTEX
+
+      return false;
+   }
+
+   // called periodically on the main thread
+   bool enqueResults()
+   {
+      std::vector<FileMatches> pending;
+      bool stopped = false, finished = false, truncated = false;
+      LOCK_MUTEX(mutex_)
+      {
+         pending.swap(pending_);
+         stopped = stopped_;
+         finished = finished_;
+         truncated = matchCount_ >= kMaxMatches;
+      }
+      END_LOCK_MUTEX
+
+      if (!stopped && !pending.empty())
+      {
+         json::Array resultsJson;
+         BOOST_FOREACH(const FileMatches& fileMatches, pending)
+         {
+            std::string file = module_context::createAliasedPath(
+                                                         fileMatches.first);
+            BOOST_FOREACH(const text::LineMatch& match, fileMatches.second)
+            {
+               json::Object matchJson;
+               matchJson["file"] = file;
+               matchJson["line"] = match.line;
+               matchJson["line_value"] = match.lineText;
+               json::Array matchOnJson, matchOffJson;
+               std::copy(match.matchOn.begin(), match.matchOn.end(),
+                         std::back_inserter(matchOnJson));
+               std::copy(match.matchOff.begin(), match.matchOff.end(),
+                         std::back_inserter(matchOffJson));
+               matchJson["match_on"] = matchOnJson;
+               matchJson["match_off"] = matchOffJson;
+               resultsJson.push_back(matchJson);
+            }
+         }
+
+         json::Object resultJson;
+         resultJson["handle"] = handle_;
+         resultJson["results"] = resultsJson;
+         module_context::enqueClientEvent(
+                  ClientEvent(client_events::kFindResult, resultJson));
+      }
+
+      if (finished)
+      {
+         json::Object endedJson;
+         endedJson["handle"] = handle_;
+         endedJson["stopped"] = stopped;
+         endedJson["truncated"] = truncated;
+         module_context::enqueClientEvent(
+                  ClientEvent(client_events::kFindOperationEnded, endedJson));
+      }
+
+      return !finished;
+   }
+
+private:
+   const std::string handle_;
+   const text::TextMatcher matcher_;
+   const FilePath directory_;
+   const std::vector<boost::regex> filePatterns_;
+   const bool listFiles_;
+   std::vector<FilePath> files_;
+
+   boost::mutex mutex_;
+   std::vector<FileMatches> pending_;
+   std::size_t matchCount_;
+   bool stopped_;
+   bool finished_;
+};
+
+boost::shared_ptr<FindOperation> s_pCurrentFind;
+
+void stopCurrentFind()
+{
+   if (s_pCurrentFind)
+   {
+      s_pCurrentFind->stop();
+      s_pCurrentFind.reset();
+   }
+}
+
+Error beginFind(const json::JsonRpcRequest& request,
+                json::JsonRpcResponse* pResponse)
+{
+   std::string searchString, directory, filePatternsString;
+   bool isRegex, ignoreCase;
+   Error error = json::readParams(request.params,
+                                  &searchString,
+                                  &isRegex,
+                                  &ignoreCase,
+                                  &directory,
+                                  &filePatternsString);
+   if (error)
+      return error;
+
+   text::TextMatcher matcher;
+   error = matcher.initialize(searchString, isRegex, ignoreCase);
+   if (error)
+      return error;
+
+   FilePath dirPath = module_context::resolveAliasedPath(directory);
+   if (!dirPath.exists())
+      return pathNotFoundError(dirPath.absolutePath(), ERROR_LOCATION);
+
+   // file patterns are a comma separated list of wildcards (e.g. *.R, *.Rd)
+   std::vector<std::string> patterns;
+   boost::algorithm::split(patterns,
+                           filePatternsString,
+                           boost::algorithm::is_any_of(","));
+   std::vector<boost::regex> filePatterns;
+   BOOST_FOREACH(std::string pattern, patterns)
+   {
+      boost::algorithm::trim(pattern);
+      if (!pattern.empty())
+         filePatterns.push_back(regex_utils::wildcardPatternToRegex(pattern));
+   }
+
+   // use the monitored project files for finds within the project
+   bool listFiles = true;
+   std::vector<FilePath> files;
+   projects::ProjectContext& context = projects::projectContext();
+   if (s_projectFilesMonitored && dirPath.isWithin(context.directory()))
+   {
+      std::string prefix = dirPath.absolutePath() + "/";
+      std::set<std::string>::const_iterator it;
+      for (it = s_projectFiles.lower_bound(prefix);
+           it != s_projectFiles.end() &&
+           it->compare(0, prefix.size(), prefix) == 0;
+           ++it)
+      {
+         files.push_back(FilePath(*it));
+      }
+      listFiles = false;
+   }
+
+   // start the find (stopping any find already underway)
+   stopCurrentFind();
+   s_pCurrentFind.reset(new FindOperation(core::system::generateUuid(false),
+                                          matcher,
+                                          dirPath,
+                                          filePatterns,
+                                          listFiles,
+                                          files));
+   s_pCurrentFind->start();
+
+   pResponse->setResult(s_pCurrentFind->handle());
+   return Success();
+}
+
+Error stopFind(const json::JsonRpcRequest& request,
+               json::JsonRpcResponse* pResponse)
+{
+   std::string handle;
+   Error error = json::readParams(request.params, &handle);
+   if (error)
+      return error;
+
+   if (s_pCurrentFind && s_pCurrentFind->handle() == handle)
+      stopCurrentFind();
+
+   return Success();
+}
+
+void onFileMonitorEnabled(const tree<core::FileInfo>& files)
+{
+   s_projectFiles.clear();
+   for (tree<core::FileInfo>::leaf_iterator it = files.begin_leaf();
+        it != files.end_leaf();
+        ++it)
+   {
+      if (!it->isDirectory())
+         s_projectFiles.insert(it->absolutePath());
+   }
+   s_projectFilesMonitored = true;
+}
+
+void onFilesChanged(const std::vector<core::system::FileChangeEvent>& events)
+{
+   BOOST_FOREACH(const core::system::FileChangeEvent& event, events)
+   {
+      const FileInfo& fileInfo = event.fileInfo();
+      if (fileInfo.isDirectory())
+         continue;
+
+      if (event.type() == core::system::FileChangeEvent::FileAdded)
+         s_projectFiles.insert(fileInfo.absolutePath());
+      else if (event.type() == core::system::FileChangeEvent::FileRemoved)
+         s_projectFiles.erase(fileInfo.absolutePath());
+   }
+}
+
+void onFileMonitorDisabled()
+{
+   s_projectFiles.clear();
+   s_projectFilesMonitored = false;
+}
+
+} // anonymous namespace
+
+Error initialize()
+{
+   // subscribe to project context file monitoring state changes
+   // (note that if there is no project this will no-op)
+   session::projects::FileMonitorCallbacks cb;
+   cb.onMonitoringEnabled = onFileMonitorEnabled;
+   cb.onFilesChanged = onFilesChanged;
+   cb.onMonitoringDisabled = onFileMonitorDisabled;
+   projects::projectContext().subscribeToFileMonitor("Find in files", cb);
+
+   using boost::bind;
+   using namespace module_context;
+   ExecBlock initBlock ;
+   initBlock.addFunctions()
+      (bind(registerRpcMethod, "begin_find", beginFind))
+      (bind(registerRpcMethod, "stop_find", stopFind));
+
+   return initBlock.execute();
+}
+
+} // namespace find
+} // namespace modules
+} // namespace session
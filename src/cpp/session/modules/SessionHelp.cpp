@@ -14,10 +14,15 @@
 #include "SessionHelp.hpp"
 
 #include <algorithm>
+#include <list>
+#include <map>
+#include <sstream>
 
 #include <boost/ref.hpp>
+#include <boost/utility.hpp>
 #include <boost/regex.hpp>
 #include <boost/function.hpp>
+#include <boost/foreach.hpp>
 #include <boost/range/iterator_range.hpp>
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/algorithm/string.hpp>
@@ -26,6 +31,9 @@
 #include <core/Error.hpp>
 #include <core/Exec.hpp>
 #include <core/Log.hpp>
+#include <core/Thread.hpp>
+#include <core/StringUtils.hpp>
+#include <core/text/DcfParser.hpp>
 
 #include <core/http/Request.hpp>
 #include <core/http/Response.hpp>
@@ -43,6 +51,8 @@
 
 #include <session/SessionModuleContext.hpp>
 
+#include "SessionHelpIndex.hpp"
+
 // protect R against windows TRUE/FALSE defines
 #undef TRUE
 #undef FALSE
@@ -67,6 +77,185 @@ const char * const kCustomHelprLocation = "/custom/helpr";
 // (only do this for 2.13 or higher)
 bool s_provideHeaders = false;
 
+// maximum number of results returned by help searches
+const std::size_t kMaxSearchResults = 100;
+
+// maximum total size of the help page cache
+const std::size_t kMaxHelpPageCacheBytes = 8 * 1024 * 1024;
+
+// get the package associated with a help page path (returns an empty
+// string if the path isn't for a package help page)
+std::string packageForHelpPage(const std::string& path)
+{
+   boost::regex pageRegex("^/library/([^/]+)/html/[^/]+\\.html$");
+   boost::smatch match;
+   if (regex_match(path, match, pageRegex))
+      return match[1];
+   else
+      return std::string();
+}
+
+Error readPackageVersion(const FilePath& descriptionPath,
+                         std::string* pVersion)
+{
+   std::map<std::string,std::string> fields;
+   std::string userErrMsg;
+   Error error = text::parseDcfFile(descriptionPath, true, &fields,
+                                    &userErrMsg);
+   if (error)
+      return error;
+
+   *pVersion = fields["Version"];
+   return Success();
+}
+
+// cache of rendered help pages. pages are keyed by the version of the
+// package which provides them (as read from its DESCRIPTION file) so pages
+// for an updated package are never served from the cache. lookups are done
+// on the http listener thread so must not call into R.
+class HelpPageCache : boost::noncopyable
+{
+public:
+   HelpPageCache()
+      : pMutex_(new boost::mutex()), bytes_(0)
+   {
+   }
+
+   void insert(const std::string& path,
+               const FilePath& packagePath,
+               const std::string& content)
+   {
+      std::string package = packageForHelpPage(path);
+      if (package.empty())
+         return;
+
+      LOCK_MUTEX(*pMutex_)
+      {
+         // note the package version (and the description file's
+         // modification time so we can tell if it changes)
+         PackageInfo info;
+         info.descriptionPath = packagePath.childPath("DESCRIPTION");
+         info.modified = info.descriptionPath.lastWriteTime();
+         Error error = readPackageVersion(info.descriptionPath,
+                                          &info.version);
+         if (error)
+         {
+            LOG_ERROR(error);
+            return;
+         }
+         packages_[package] = info;
+
+         // add the page
+         std::string key = pageKey(package, info.version, path);
+         removeEntry(key);
+         entries_.push_front(std::make_pair(key, content));
+         index_[key] = entries_.begin();
+         bytes_ += content.size();
+
+         // evict least recently used pages
+         while (bytes_ > kMaxHelpPageCacheBytes && entries_.size() > 1)
+            removeEntry(entries_.back().first);
+      }
+      END_LOCK_MUTEX
+   }
+
+   bool lookup(const std::string& path, std::string* pContent)
+   {
+      std::string package = packageForHelpPage(path);
+      if (package.empty())
+         return false;
+
+      LOCK_MUTEX(*pMutex_)
+      {
+         std::map<std::string,PackageInfo>::iterator pkgIt =
+                                                   packages_.find(package);
+         if (pkgIt == packages_.end())
+            return false;
+
+         // re-read the version if the package has been re-installed
+         PackageInfo& info = pkgIt->second;
+         std::time_t modified = info.descriptionPath.lastWriteTime();
+         if (modified != info.modified)
+         {
+            Error error = readPackageVersion(info.descriptionPath,
+                                             &info.version);
+            if (error)
+            {
+               packages_.erase(pkgIt);
+               return false;
+            }
+            info.modified = modified;
+         }
+
+         std::map<std::string,Entries::iterator>::iterator it =
+                     index_.find(pageKey(package, info.version, path));
+         if (it == index_.end())
+            return false;
+
+         // mark as most recently used
+         entries_.splice(entries_.begin(), entries_, it->second);
+         *pContent = it->second->second;
+         return true;
+      }
+      END_LOCK_MUTEX
+
+      // keep compiler happy
+      return false;
+   }
+
+   void clear()
+   {
+      LOCK_MUTEX(*pMutex_)
+      {
+         packages_.clear();
+         entries_.clear();
+         index_.clear();
+         bytes_ = 0;
+      }
+      END_LOCK_MUTEX
+   }
+
+private:
+   static std::string pageKey(const std::string& package,
+                              const std::string& version,
+                              const std::string& path)
+   {
+      return package + "_" + version + ":" + path;
+   }
+
+   void removeEntry(const std::string& key)
+   {
+      std::map<std::string,Entries::iterator>::iterator it = index_.find(key);
+      if (it != index_.end())
+      {
+         bytes_ -= it->second->second.size();
+         entries_.erase(it->second);
+         index_.erase(it);
+      }
+   }
+
+private:
+   struct PackageInfo
+   {
+      FilePath descriptionPath;
+      std::time_t modified;
+      std::string version;
+   };
+
+   // pages (most recently used first) and an index into them by key
+   typedef std::list<std::pair<std::string,std::string> > Entries;
+
+   // make mutex heap based to avoid boost mutex assertions when
+   // it is destructucted in a multicore forked child
+   boost::mutex* pMutex_;
+   std::map<std::string,PackageInfo> packages_;
+   Entries entries_;
+   std::map<std::string,Entries::iterator> index_;
+   std::size_t bytes_;
+};
+
+HelpPageCache s_helpPageCache;
+
 std::string localURL(const std::string& address)
 {
    return "http://" + address + ":" + s_localPort + "/";
@@ -552,12 +741,8 @@ SEXP callHandler(const std::string& path,
    return resultSEXP;
 }
 
-template <typename Filter>
-void handleHttpdRequest(const std::string& location,
-                        const HandlerSource& handlerSource,
-                        const http::Request& request, 
-                        const Filter& filter,
-                        http::Response* pResponse)
+std::string httpdRequestPath(const std::string& location,
+                             const http::Request& request)
 {
    // get the raw uri & strip its location prefix
    std::string uri = request.uri();
@@ -568,10 +753,85 @@ void handleHttpdRequest(const std::string& location,
    size_t pos = uri.find("?");
    if (pos != std::string::npos)
       uri.erase(pos);
-   
+
    // uri has now been reduced to path. url decode it (we noted that R
    // was url encoding dashes in e.g. help for memory-limits)
-   std::string path = http::util::urlDecode(uri);
+   return http::util::urlDecode(uri);
+}
+
+// determine whether the result of httpd is a plain html page (i.e. with no
+// explicit status code, headers, or file payload) and if so get its content
+bool isPlainHtmlResult(SEXP httpdSEXP, std::string* pContent)
+{
+   if (TYPEOF(httpdSEXP) != VECSXP || LENGTH(httpdSEXP) < 1)
+      return false;
+
+   if (LENGTH(httpdSEXP) > 1)
+   {
+      SEXP ctSEXP = VECTOR_ELT(httpdSEXP, 1);
+      if (TYPEOF(ctSEXP) == STRSXP && LENGTH(ctSEXP) > 0 &&
+          std::strcmp(CHAR(STRING_ELT(ctSEXP, 0)), "text/html"))
+      {
+         return false;
+      }
+   }
+
+   if (LENGTH(httpdSEXP) > 2)
+   {
+      SEXP headersSEXP = VECTOR_ELT(httpdSEXP, 2);
+      if (TYPEOF(headersSEXP) == STRSXP && LENGTH(headersSEXP) > 0)
+         return false;
+   }
+
+   if (LENGTH(httpdSEXP) > 3 &&
+       r::sexp::asInteger(VECTOR_ELT(httpdSEXP, 3)) != http::status::Ok)
+   {
+      return false;
+   }
+
+   SEXP payloadSEXP = VECTOR_ELT(httpdSEXP, 0);
+   if (TYPEOF(payloadSEXP) != STRSXP || LENGTH(payloadSEXP) != 1)
+      return false;
+
+   SEXP namesSEXP = r::sexp::getNames(httpdSEXP);
+   if (TYPEOF(namesSEXP) == STRSXP && LENGTH(namesSEXP) > 0 &&
+       !std::strcmp(CHAR(STRING_ELT(namesSEXP, 0)), "file"))
+   {
+      return false;
+   }
+
+   *pContent = r::sexp::asString(STRING_ELT(payloadSEXP, 0));
+   return true;
+}
+
+void cacheHelpPage(const std::string& path, const std::string& content)
+{
+   std::string package = packageForHelpPage(path);
+   if (package.empty())
+      return;
+
+   std::string packagePath;
+   r::exec::RFunction findPackage("find.package", package);
+   findPackage.addParam("quiet", true);
+   Error error = findPackage.call(&packagePath);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   if (!packagePath.empty())
+      s_helpPageCache.insert(path, FilePath(packagePath), content);
+}
+
+template <typename Filter>
+void handleHttpdRequest(const std::string& location,
+                        const HandlerSource& handlerSource,
+                        const http::Request& request, 
+                        const Filter& filter,
+                        http::Response* pResponse)
+{
+   std::string path = httpdRequestPath(location, request);
 
    // server custom css file if necessary
    if (boost::algorithm::ends_with(path, "/R.css"))
@@ -627,6 +887,15 @@ void handleHttpdRequest(const std::string& location,
    // content returned from httpd
    else if (TYPEOF(httpdSEXP) == VECSXP && LENGTH(httpdSEXP) > 0)
    {
+      // cache rendered help pages
+      std::string content;
+      if (location == kHelpLocation &&
+          request.queryString().empty() &&
+          isPlainHtmlResult(httpdSEXP, &content))
+      {
+         cacheHelpPage(path, content);
+      }
+
       handleHttpdResult(httpdSEXP, request, filter, pResponse);
    }
    
@@ -729,6 +998,112 @@ void handleHelpRequest(const http::Request& request, http::Response* pResponse)
                       pResponse);
 }
 
+void setHelpPageResponse(const std::string& content,
+                         const http::Request& request,
+                         http::Response* pResponse)
+{
+   pResponse->setStatusCode(http::status::Ok);
+   pResponse->setContentType("text/html");
+   setDynamicContentResponse(content,
+                             request,
+                             HelpContentsFilter(request),
+                             pResponse);
+}
+
+// serve searches from the full-text index (search categories, etc. and
+// searches with no results are left to R's more forgiving search)
+bool handleHelpSearchRequest(const http::Request& request,
+                             http::Response* pResponse)
+{
+   std::string query = request.queryParamValue("pattern");
+   if (query.empty())
+      query = request.queryParamValue("name");
+   if (query.empty())
+      return false;
+
+   std::vector<index::SearchResult> results;
+   if (!index::search(query, kMaxSearchResults, &results) || results.empty())
+      return false;
+
+   using namespace string_utils;
+   std::ostringstream ostr;
+   ostr << "<!DOCTYPE html PUBLIC \"-//W3C//DTD HTML 4.01 Transitional//EN\">"
+        << "<html><head><title>R: Search Results</title>\n"
+        << "<meta http-equiv=\"Content-Type\" "
+        <<       "content=\"text/html; charset=utf-8\">\n"
+        << "<link rel=\"stylesheet\" type=\"text/css\" "
+        <<       "href=\"/doc/html/R.css\">\n"
+        << "</head><body>\n"
+        << "<h1>Search Results</h1>\n"
+        << "<p>The search string was <b>\"" << htmlEscape(query, false)
+        << "\"</b></p>\n<hr>\n<dl>\n";
+   BOOST_FOREACH(const index::SearchResult& result, results)
+   {
+      std::string href = "/library/" +
+                         http::util::urlEncode(result.package, false) +
+                         "/html/" +
+                         http::util::urlEncode(result.topic, false) +
+                         ".html";
+      ostr << "<dt><a href=\"" << htmlEscape(href, true) << "\">"
+           << htmlEscape(result.package + "::" + result.name, false)
+           << "</a></dt>\n"
+           << "<dd>" << htmlEscape(result.title, false) << "</dd>\n";
+   }
+   ostr << "</dl>\n</body></html>\n";
+
+   setHelpPageResponse(ostr.str(), request, pResponse);
+   return true;
+}
+
+// called on the http listener thread to serve help searches and cached
+// help pages without waiting for R (returns false for other requests so
+// they are handled by handleHelpRequest as usual)
+bool handleHelpRequestInBackground(const http::Request& request,
+                                   http::Response* pResponse)
+{
+   std::string path = httpdRequestPath(kHelpLocation, request);
+
+   if (path == "/doc/html/Search")
+      return handleHelpSearchRequest(request, pResponse);
+
+   std::string content;
+   if (request.queryString().empty() &&
+       s_helpPageCache.lookup(path, &content))
+   {
+      setHelpPageResponse(content, request, pResponse);
+      return true;
+   }
+
+   return false;
+}
+
+// (re)build the help index from the current library paths
+void rebuildHelpIndex()
+{
+   std::vector<std::string> libPaths;
+   Error error = r::exec::RFunction(".libPaths").call(&libPaths);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   std::vector<FilePath> libFilePaths;
+   BOOST_FOREACH(const std::string& libPath, libPaths)
+   {
+      libFilePaths.push_back(FilePath(libPath));
+   }
+   index::rebuild(libFilePaths);
+}
+
+void onPackageLibraryMutated()
+{
+   // pages link to topics in other packages so discard them all
+   s_helpPageCache.clear();
+
+   rebuildHelpIndex();
+}
+
 Error setHelpPort()
 {
    Options& options = session::options();
@@ -750,9 +1125,18 @@ Error initialize()
    // determine whether we should provide headers to custom handlers
    s_provideHeaders = r::util::hasRequiredVersion("2.13");
 
+   // subscribe to events
    using boost::bind;
-   using core::http::UriHandler;
    using namespace module_context;
+   events().onPackageLibraryMutated.connect(onPackageLibraryMutated);
+
+   // build the help index after init (rd databases can't be read on
+   // win32 since we don't link to zlib there)
+#ifndef _WIN32
+   events().onDeferredInit.connect(rebuildHelpIndex);
+#endif
+
+   using core::http::UriHandler;
    using namespace r::function_hook ;
    ExecBlock initBlock ;
    initBlock.addFunctions()
@@ -761,6 +1145,9 @@ Error initialize()
       (bind(registerRBrowseUrlHandler, handleLocalHttpUrl))
       (bind(registerRBrowseFileHandler, handleRShowDocFile))
       (bind(registerUriHandler, kHelpLocation, handleHelpRequest))
+      (bind(registerBackgroundUriHandler,
+            kHelpLocation,
+            handleHelpRequestInBackground))
       (bind(registerUriHandler, kCustomHelprLocation, handleCustomHelprRequest))
       (bind(registerUriHandler, kCustomLocation, handleCustomRequest))
       (bind(registerUriHandler, kSessionLocation, handleSessionRequest))
@@ -0,0 +1,493 @@
+/*
+ * SessionHelpIndex.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionHelpIndex.hpp"
+
+#include <cmath>
+#include <ctime>
+#include <cctype>
+#include <set>
+#include <map>
+#include <algorithm>
+
+#include <boost/utility.hpp>
+#include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/algorithm/string/classification.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Error.hpp>
+#include <core/Log.hpp>
+#include <core/FilePath.hpp>
+#include <core/Thread.hpp>
+#include <core/r_util/RSerialization.hpp>
+
+using namespace core;
+
+namespace session {
+namespace modules {
+namespace help {
+namespace index {
+
+namespace {
+
+// relative weights of terms depending upon where they appear in a topic
+const int kNameWeight = 10;
+const int kAliasWeight = 8;
+const int kTitleWeight = 5;
+const int kKeywordWeight = 3;
+const int kBodyWeight = 1;
+
+// cap on the weight contributed by repeated occurrences of a body term
+const int kMaxBodyTermWeight = 5;
+
+const char * const kStopWords[] = {
+   "a", "an", "and", "are", "as", "at", "be", "by", "for", "from", "if",
+   "in", "is", "it", "of", "on", "or", "that", "the", "this", "to", "with"
+};
+
+// initialized statically since words are tokenized on several threads
+const std::set<std::string> s_stopWords(
+      kStopWords,
+      kStopWords + (sizeof(kStopWords) / sizeof(kStopWords[0])));
+
+bool isStopWord(const std::string& word)
+{
+   return s_stopWords.find(word) != s_stopWords.end();
+}
+
+bool isWordChar(char ch)
+{
+   return std::isalnum(static_cast<unsigned char>(ch)) ||
+          ch == '.' || ch == '_';
+}
+
+// split text into lowercase words (R identifiers such as is.na and
+// read_csv are kept together)
+void tokenize(const std::string& text, std::vector<std::string>* pWords)
+{
+   std::string::const_iterator it = text.begin();
+   while (it != text.end())
+   {
+      while (it != text.end() && !isWordChar(*it))
+         ++it;
+
+      std::string word;
+      while (it != text.end() && isWordChar(*it))
+      {
+         word.push_back(std::tolower(static_cast<unsigned char>(*it)));
+         ++it;
+      }
+
+      boost::algorithm::trim_if(word, boost::algorithm::is_any_of("._"));
+      if (word.length() >= 2 && word.length() <= 64 && !isStopWord(word))
+         pWords->push_back(word);
+   }
+}
+
+// collect the text of an Rd element (ignoring comments)
+void rdText(const r_util::SerializedObjectPtr& pElement, std::string* pText)
+{
+   if (pElement->stringAttribute("Rd_tag") == "COMMENT")
+      return;
+
+   if (pElement->type == r_util::kStringType)
+   {
+      BOOST_FOREACH(const std::string& str, pElement->strings)
+      {
+         pText->append(str);
+      }
+   }
+   else
+   {
+      BOOST_FOREACH(const r_util::SerializedObjectPtr& pChild,
+                    pElement->elements)
+      {
+         rdText(pChild, pText);
+      }
+   }
+}
+
+std::string collapseWhitespace(const std::string& text)
+{
+   std::string result;
+   bool pendingSpace = false;
+   BOOST_FOREACH(char ch, text)
+   {
+      if (std::isspace(static_cast<unsigned char>(ch)))
+      {
+         pendingSpace = !result.empty();
+      }
+      else
+      {
+         if (pendingSpace)
+            result.push_back(' ');
+         result.push_back(ch);
+         pendingSpace = false;
+      }
+   }
+   return result;
+}
+
+class Index : boost::noncopyable
+{
+public:
+   Index() {}
+
+   void addLibrary(const FilePath& libPath, std::set<std::string>* pPackages)
+   {
+      // record the library's modification time (packages being installed
+      // or removed will change it)
+      libraryStamps_.push_back(std::make_pair(libPath,
+                                              libPath.lastWriteTime()));
+
+      std::vector<FilePath> packagePaths;
+      Error error = libPath.children(&packagePaths);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      BOOST_FOREACH(const FilePath& packagePath, packagePaths)
+      {
+         // packages in earlier libraries mask those in later ones
+         std::string package = packagePath.filename();
+         if (boost::algorithm::starts_with(package, "00LOCK") ||
+             pPackages->find(package) != pPackages->end())
+         {
+            continue;
+         }
+
+         FilePath rdbPath = packagePath.childPath("help/" + package);
+         if (!FilePath(rdbPath.absolutePath() + ".rdx").exists())
+            continue;
+
+         pPackages->insert(package);
+         addPackage(package, rdbPath);
+      }
+   }
+
+   bool isStale() const
+   {
+      typedef std::pair<FilePath,std::time_t> LibraryStamp;
+      BOOST_FOREACH(const LibraryStamp& stamp, libraryStamps_)
+      {
+         if (stamp.first.lastWriteTime() != stamp.second)
+            return true;
+      }
+      return false;
+   }
+
+   void search(const std::string& query,
+               std::size_t maxResults,
+               std::vector<SearchResult>* pResults) const
+   {
+      std::vector<std::string> words;
+      tokenize(query, &words);
+      std::sort(words.begin(), words.end());
+      words.erase(std::unique(words.begin(), words.end()), words.end());
+      if (words.empty())
+         return;
+
+      // score documents (tf weight * idf) and count the words they match
+      std::map<int, std::pair<std::size_t,double> > scores;
+      BOOST_FOREACH(const std::string& word, words)
+      {
+         std::map<std::string,Postings>::const_iterator it =
+                                                      postings_.find(word);
+         if (it == postings_.end())
+            continue;
+
+         const Postings& postings = it->second;
+         double idf = std::log(1.0 + (double(documents_.size()) /
+                                      double(postings.size())));
+         BOOST_FOREACH(const Posting& posting, postings)
+         {
+            std::pair<std::size_t,double>& score = scores[posting.first];
+            score.first++;
+            score.second += posting.second * idf;
+         }
+      }
+
+      // rank documents matching more words first, then by score
+      std::vector<std::pair<std::pair<std::size_t,double>,int> > ranked;
+      ranked.reserve(scores.size());
+      for (std::map<int, std::pair<std::size_t,double> >::const_iterator
+            it = scores.begin(); it != scores.end(); ++it)
+      {
+         ranked.push_back(std::make_pair(it->second, -it->first));
+      }
+      std::size_t count = std::min(maxResults, ranked.size());
+      std::partial_sort(ranked.begin(),
+                        ranked.begin() + count,
+                        ranked.end(),
+                        std::greater<std::pair<std::pair<std::size_t,double>,
+                                               int> >());
+
+      for (std::size_t i = 0; i < count; i++)
+      {
+         const Document& doc = documents_[-ranked[i].second];
+         SearchResult result;
+         result.package = doc.package;
+         result.topic = doc.topic;
+         result.name = doc.name;
+         result.title = doc.title;
+         pResults->push_back(result);
+      }
+   }
+
+   std::size_t documentCount() const { return documents_.size(); }
+
+private:
+   void addPackage(const std::string& package, const FilePath& rdbPath)
+   {
+      r_util::LazyLoadDB db;
+      Error error = db.open(rdbPath);
+      if (error)
+      {
+         LOG_ERROR(error);
+         return;
+      }
+
+      BOOST_FOREACH(const std::string& topic, db.names())
+      {
+         r_util::SerializedObjectPtr pRd;
+         Error error = db.read(topic, &pRd);
+         if (error)
+         {
+            // unsupported compression is expected for some databases
+            if (error.code() != boost::system::errc::not_supported)
+            {
+               error.addProperty("topic", package + "::" + topic);
+               LOG_ERROR(error);
+            }
+            continue;
+         }
+
+         addTopic(package, topic, pRd);
+      }
+   }
+
+   void addTopic(const std::string& package,
+                 const std::string& topic,
+                 const r_util::SerializedObjectPtr& pRd)
+   {
+      Document doc;
+      doc.package = package;
+      doc.topic = topic;
+
+      std::map<std::string,int> weights;
+      BOOST_FOREACH(const r_util::SerializedObjectPtr& pSection, pRd->elements)
+      {
+         std::string tag = pSection->stringAttribute("Rd_tag");
+         std::string text;
+         rdText(pSection, &text);
+
+         if (tag == "\\name")
+         {
+            doc.name = collapseWhitespace(text);
+            addWords(text, kNameWeight, &weights);
+         }
+         else if (tag == "\\title")
+         {
+            doc.title = collapseWhitespace(text);
+            addWords(text, kTitleWeight, &weights);
+         }
+         else if (tag == "\\alias")
+         {
+            addWords(text, kAliasWeight, &weights);
+         }
+         else if (tag == "\\keyword" || tag == "\\concept")
+         {
+            addWords(text, kKeywordWeight, &weights);
+         }
+         else if (tag != "\\docType" && tag != "\\encoding")
+         {
+            addWords(text, kBodyWeight, &weights);
+         }
+      }
+
+      if (doc.name.empty())
+         doc.name = topic;
+
+      int docId = documents_.size();
+      documents_.push_back(doc);
+      for (std::map<std::string,int>::const_iterator it = weights.begin();
+           it != weights.end();
+           ++it)
+      {
+         postings_[it->first].push_back(std::make_pair(docId, it->second));
+      }
+   }
+
+   static void addWords(const std::string& text,
+                        int weight,
+                        std::map<std::string,int>* pWeights)
+   {
+      std::vector<std::string> words;
+      tokenize(text, &words);
+      BOOST_FOREACH(const std::string& word, words)
+      {
+         int& termWeight = (*pWeights)[word];
+         if (weight != kBodyWeight)
+            termWeight += weight;
+         else if (termWeight < kMaxBodyTermWeight)
+            termWeight += kBodyWeight;
+      }
+   }
+
+private:
+   struct Document
+   {
+      std::string package;
+      std::string topic;
+      std::string name;
+      std::string title;
+   };
+   std::vector<Document> documents_;
+
+   // postings for each word (document id and weight)
+   typedef std::pair<int,int> Posting;
+   typedef std::vector<Posting> Postings;
+   std::map<std::string,Postings> postings_;
+
+   std::vector<std::pair<FilePath,std::time_t> > libraryStamps_;
+};
+
+// index state (shared between the main, listener and build threads). make
+// mutex heap based to avoid boost mutex assertions when it is destructed
+// in a multicore forked child
+boost::mutex* s_pMutex = new boost::mutex();
+boost::shared_ptr<const Index> s_pIndex;
+std::vector<FilePath> s_libPaths;
+bool s_building = false;
+bool s_rebuildPending = false;
+
+void buildIndexThread()
+{
+   while (true)
+   {
+      std::vector<FilePath> libPaths;
+      LOCK_MUTEX(*s_pMutex)
+      {
+         libPaths = s_libPaths;
+      }
+      END_LOCK_MUTEX
+
+      using namespace boost::posix_time;
+      ptime start = microsec_clock::universal_time();
+
+      boost::shared_ptr<Index> pIndex(new Index());
+      std::set<std::string> packages;
+      BOOST_FOREACH(const FilePath& libPath, libPaths)
+      {
+         if (libPath.exists())
+            pIndex->addLibrary(libPath, &packages);
+      }
+
+      LOG_DEBUG_MESSAGE("Indexed " +
+         boost::lexical_cast<std::string>(pIndex->documentCount()) +
+         " help topics in " +
+         boost::lexical_cast<std::string>(
+            (microsec_clock::universal_time() - start).total_milliseconds()) +
+         "ms");
+
+      // publish the index then check whether another build was requested
+      // while we were working
+      bool done = true;
+      LOCK_MUTEX(*s_pMutex)
+      {
+         s_pIndex = pIndex;
+         if (s_rebuildPending)
+         {
+            s_rebuildPending = false;
+            done = false;
+         }
+         else
+         {
+            s_building = false;
+         }
+      }
+      END_LOCK_MUTEX
+
+      if (done)
+         break;
+   }
+}
+
+void requestBuild()
+{
+   bool launch = false;
+   LOCK_MUTEX(*s_pMutex)
+   {
+      if (s_building)
+      {
+         s_rebuildPending = true;
+      }
+      else
+      {
+         s_building = true;
+         launch = true;
+      }
+   }
+   END_LOCK_MUTEX
+
+   if (launch)
+      core::thread::safeLaunchThread(buildIndexThread);
+}
+
+} // anonymous namespace
+
+void rebuild(const std::vector<FilePath>& libPaths)
+{
+   LOCK_MUTEX(*s_pMutex)
+   {
+      s_libPaths = libPaths;
+   }
+   END_LOCK_MUTEX
+
+   requestBuild();
+}
+
+bool search(const std::string& query,
+            std::size_t maxResults,
+            std::vector<SearchResult>* pResults)
+{
+   boost::shared_ptr<const Index> pIndex;
+   LOCK_MUTEX(*s_pMutex)
+   {
+      pIndex = s_pIndex;
+   }
+   END_LOCK_MUTEX
+
+   if (!pIndex)
+      return false;
+
+   // packages may have been installed or removed outside of the session
+   // (e.g. by R CMD INSTALL) so check whether the index is stale
+   if (pIndex->isStale())
+      requestBuild();
+
+   pIndex->search(query, maxResults, pResults);
+   return true;
+}
+
+} // namespace index
+} // namespace help
+} // namepace modules
+} // namesapce session
+
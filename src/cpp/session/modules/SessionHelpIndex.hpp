@@ -0,0 +1,58 @@
+/*
+ * SessionHelpIndex.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_SESSION_HELP_INDEX_HPP
+#define SESSION_SESSION_HELP_INDEX_HPP
+
+#include <string>
+#include <vector>
+
+namespace core {
+   class FilePath;
+}
+
+namespace session {
+namespace modules {
+namespace help {
+namespace index {
+
+// Full-text index of the Rd databases of installed packages. The index is
+// built on a background thread (without calling into R) and can be
+// searched from any thread.
+
+struct SearchResult
+{
+   std::string package;
+   std::string topic;
+   std::string name;
+   std::string title;
+};
+
+// (re)build the index from the packages installed within libPaths. if a
+// build is already in progress another is performed once it completes.
+void rebuild(const std::vector<core::FilePath>& libPaths);
+
+// search the index for topics matching all of the words in query (falling
+// back to topics matching any of them). returns false if the index is not
+// yet available. if a library has changed since the index was built a
+// rebuild is started (and the current index is used in the meantime).
+bool search(const std::string& query,
+            std::size_t maxResults,
+            std::vector<SearchResult>* pResults);
+
+} // namespace index
+} // namespace help
+} // namepace modules
+} // namesapce session
+
+#endif // SESSION_SESSION_HELP_INDEX_HPP
@@ -0,0 +1,412 @@
+/*
+ * SessionMemory.cpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#include "SessionMemory.hpp"
+
+#include <time.h>
+#include <errno.h>
+#include <dirent.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <core/Log.hpp>
+#include <core/Error.hpp>
+#include <core/Exec.hpp>
+#include <core/SafeConvert.hpp>
+
+#include <core/json/JsonRpc.hpp>
+
+#include <r/RExec.hpp>
+
+#include <session/SessionConstants.hpp>
+#include <session/SessionLocalStreams.hpp>
+#include <session/SessionModuleContext.hpp>
+
+using namespace core;
+
+namespace session {
+namespace modules {
+namespace memory {
+
+namespace {
+
+// Idle sessions first free what memory they can (R's gc then returning
+// free heap to the system). If available memory on the machine falls
+// below the suspend threshold, the idle sessions holding the most memory
+// (by resident size weighted by idle time) suspend themselves until
+// enough would be released to reach the target. Each session decides
+// this for itself. Sessions publish when they were last active as the
+// modification time of their local stream, so every session ranks the
+// others the same way. Idle sessions which can't suspend (e.g. they have
+// running child processes) keep publishing activity so that they aren't
+// ranked (and counted on to release memory).
+
+// how often we check available memory while idle, and how often we
+// publish activity
+const int kMemoryCheckSeconds = 60;
+const int kPublishActivitySeconds = 60;
+
+boost::posix_time::ptime s_lastActivity;
+boost::posix_time::ptime s_lastPublishedActivity;
+boost::posix_time::ptime s_lastSuspendableCheck;
+boost::posix_time::ptime s_lastMemoryCheck;
+bool s_trimmedSinceActivity = false;
+
+// memory reclaimed by trimming
+int s_trimCount = 0;
+boost::uint64_t s_trimmedBytes = 0;
+
+std::string procPath(PidType pid, const std::string& name)
+{
+   return "/proc/" + boost::lexical_cast<std::string>(pid) + "/" + name;
+}
+
+// command name of a process (from /proc/<pid>/stat)
+bool processCommand(PidType pid, std::string* pCommand)
+{
+   std::ifstream stat(procPath(pid, "stat").c_str());
+   std::string contents;
+   if (!std::getline(stat, contents))
+      return false;
+
+   std::string::size_type open = contents.find('(');
+   std::string::size_type close = contents.rfind(')');
+   if (open == std::string::npos || close == std::string::npos || close < open)
+      return false;
+
+   *pCommand = contents.substr(open + 1, close - open - 1);
+   return true;
+}
+
+// resident size of a process (from /proc/<pid>/statm)
+bool residentBytes(PidType pid, boost::uint64_t* pBytes)
+{
+   std::ifstream statm(procPath(pid, "statm").c_str());
+   boost::uint64_t size, residentPages;
+   if (!(statm >> size >> residentPages))
+      return false;
+
+   *pBytes = residentPages * ::sysconf(_SC_PAGESIZE);
+   return true;
+}
+
+// total and available memory of the machine (from /proc/meminfo, older
+// kernels don't report MemAvailable so we estimate it)
+bool memoryInfo(boost::uint64_t* pTotal, boost::uint64_t* pAvailable)
+{
+   std::ifstream meminfo("/proc/meminfo");
+   std::map<std::string,boost::uint64_t> values;
+   std::string name, units;
+   boost::uint64_t value;
+   while (meminfo >> name >> value)
+   {
+      values[name] = value * 1024;
+      std::getline(meminfo, units);
+   }
+
+   *pTotal = values["MemTotal:"];
+   if (values.count("MemAvailable:"))
+      *pAvailable = values["MemAvailable:"];
+   else
+      *pAvailable = values["MemFree:"] + values["Buffers:"] + values["Cached:"];
+
+   return *pTotal > 0;
+}
+
+void publishActivity()
+{
+   std::string userIdentity = session::options().userIdentity();
+   FilePath streamPath = session::local_streams::streamPath(userIdentity);
+   if (::utimes(streamPath.absolutePath().c_str(), NULL) == -1 &&
+       errno != ENOENT)
+   {
+      Error error = systemError(errno, ERROR_LOCATION);
+      error.addProperty("path", streamPath.absolutePath());
+      LOG_ERROR(error);
+   }
+}
+
+void trimMemory()
+{
+   boost::uint64_t before = 0, after = 0;
+   residentBytes(::getpid(), &before);
+
+   r::exec::RFunction gc("gc");
+   gc.addParam("verbose", false);
+   Error error = gc.call();
+   if (error)
+      LOG_ERROR(error);
+
+#ifdef __GLIBC__
+   ::malloc_trim(0);
+#endif
+
+   residentBytes(::getpid(), &after);
+   boost::uint64_t reclaimed = before > after ? before - after : 0;
+   s_trimCount++;
+   s_trimmedBytes += reclaimed;
+
+   boost::format fmt("Trimmed idle session memory "
+                     "(reclaimed %1% bytes, resident %2% bytes)");
+   LOG_INFO_MESSAGE(boost::str(fmt % reclaimed % after));
+}
+
+struct IdleSession
+{
+   PidType pid;
+   boost::uint64_t residentBytes;
+   double score;
+
+   bool operator<(const IdleSession& other) const
+   {
+      return score > other.score;
+   }
+};
+
+// sessions (including this one) idle for at least the specified time
+std::vector<IdleSession> idleSessions(int minIdleSeconds)
+{
+   std::vector<IdleSession> sessions;
+
+   // idle time of each user's session (from its stream)
+   std::map<uid_t,int> idleSeconds;
+   time_t now = ::time(NULL);
+   DIR* pDir = ::opendir(kSessionLocalStreamsDir);
+   if (pDir == NULL)
+   {
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      return sessions;
+   }
+   struct dirent* pEntry;
+   while ((pEntry = ::readdir(pDir)) != NULL)
+   {
+      if (pEntry->d_name[0] == '.')
+         continue;
+      std::string path = std::string(kSessionLocalStreamsDir) + "/" +
+                         pEntry->d_name;
+      struct stat st;
+      if (::stat(path.c_str(), &st) == -1)
+         continue;
+      int idle = static_cast<int>(now - st.st_mtime);
+      if (idle >= minIdleSeconds)
+         idleSeconds[st.st_uid] = idle;
+   }
+   ::closedir(pDir);
+
+   // find the session processes of those users
+   std::string sessionCommand;
+   if (!processCommand(::getpid(), &sessionCommand))
+      return sessions;
+   pDir = ::opendir("/proc");
+   if (pDir == NULL)
+   {
+      LOG_ERROR(systemError(errno, ERROR_LOCATION));
+      return sessions;
+   }
+   while ((pEntry = ::readdir(pDir)) != NULL)
+   {
+      PidType pid = safe_convert::stringTo<PidType>(pEntry->d_name, -1);
+      if (pid <= 0)
+         continue;
+
+      struct stat st;
+      if (::stat(procPath(pid, "").c_str(), &st) == -1)
+         continue;
+      std::map<uid_t,int>::const_iterator it = idleSeconds.find(st.st_uid);
+      if (it == idleSeconds.end())
+         continue;
+
+      std::string command;
+      IdleSession session;
+      if (!processCommand(pid, &command) || command != sessionCommand ||
+          !residentBytes(pid, &session.residentBytes))
+      {
+         continue;
+      }
+
+      session.pid = pid;
+      session.score = static_cast<double>(session.residentBytes) * it->second;
+      sessions.push_back(session);
+   }
+   ::closedir(pDir);
+
+   return sessions;
+}
+
+void suspendIfMemoryNeeded(int idleSeconds)
+{
+   boost::uint64_t total, available;
+   if (!memoryInfo(&total, &available))
+      return;
+
+   // nothing to do unless we're below the threshold
+   int threshold = session::options().memorySuspendThreshold();
+   if (available >= total / 100 * threshold)
+      return;
+
+   // suspend the highest ranked idle sessions until enough would be
+   // released to reach the target
+   int target = std::max(session::options().memorySuspendTarget(), threshold);
+   boost::uint64_t needed = total / 100 * target - available;
+   int minIdleSeconds = session::options().memorySuspendIdleMinutes() * 60;
+   std::vector<IdleSession> sessions = idleSessions(minIdleSeconds);
+   std::sort(sessions.begin(), sessions.end());
+
+   boost::uint64_t released = 0;
+   for (std::vector<IdleSession>::const_iterator it = sessions.begin();
+        it != sessions.end() && released < needed;
+        ++it)
+   {
+      if (it->pid == ::getpid())
+      {
+         boost::format fmt("Suspending idle session for memory (resident "
+                           "%1% bytes, idle %2% seconds, available memory "
+                           "%3% of %4% bytes)");
+         LOG_WARNING_MESSAGE(boost::str(
+               fmt % it->residentBytes % idleSeconds % available % total));
+
+         // request a cooperative suspend (as the server does)
+         ::kill(::getpid(), SIGUSR1);
+         return;
+      }
+
+      released += it->residentBytes;
+   }
+}
+
+void onBackgroundProcessing(bool isIdle)
+{
+   using namespace boost::posix_time;
+
+   // R is busy
+   if (!isIdle)
+   {
+      onActivity();
+      return;
+   }
+
+   ptime now = microsec_clock::universal_time();
+   int idleSeconds = (now - s_lastActivity).total_seconds();
+
+   // free memory once per idle period
+   int trimMinutes = session::options().idleTrimMinutes();
+   if (trimMinutes > 0 && !s_trimmedSinceActivity &&
+       idleSeconds >= trimMinutes * 60)
+   {
+      s_trimmedSinceActivity = true;
+      trimMemory();
+   }
+
+   // check available memory once we've been idle long enough
+   if (session::options().memorySuspendThreshold() > 0 &&
+       idleSeconds >= session::options().memorySuspendIdleMinutes() * 60 &&
+       now - s_lastMemoryCheck >= seconds(kMemoryCheckSeconds))
+   {
+      s_lastMemoryCheck = now;
+      suspendIfMemoryNeeded(idleSeconds);
+   }
+}
+
+Error getMemoryStats(const json::JsonRpcRequest& request,
+                     json::JsonRpcResponse* pResponse)
+{
+   using namespace boost::posix_time;
+
+   boost::uint64_t resident = 0;
+   residentBytes(::getpid(), &resident);
+
+   json::Object result;
+   result["resident_bytes"] = static_cast<boost::int64_t>(resident);
+   result["idle_seconds"] =
+      (microsec_clock::universal_time() - s_lastActivity).total_seconds();
+   result["trim_count"] = s_trimCount;
+   result["trimmed_bytes"] = static_cast<boost::int64_t>(s_trimmedBytes);
+   pResponse->setResult(result);
+
+   return Success();
+}
+
+} // anonymous namespace
+
+void onIdle(const boost::function<bool()>& allowSuspend)
+{
+   using namespace boost::posix_time;
+
+   if (session::options().programMode() != kSessionProgramModeServer)
+      return;
+
+   ptime now = microsec_clock::universal_time();
+   if (now - s_lastSuspendableCheck < seconds(kPublishActivitySeconds))
+      return;
+   s_lastSuspendableCheck = now;
+
+   if (session::options().memorySuspendThreshold() <= 0 || !allowSuspend())
+   {
+      s_lastPublishedActivity = now;
+      publishActivity();
+   }
+}
+
+void onActivity()
+{
+   using namespace boost::posix_time;
+
+   ptime now = microsec_clock::universal_time();
+   s_lastActivity = now;
+   s_trimmedSinceActivity = false;
+
+   if (session::options().programMode() == kSessionProgramModeServer &&
+       now - s_lastPublishedActivity >= seconds(kPublishActivitySeconds))
+   {
+      s_lastPublishedActivity = now;
+      publishActivity();
+   }
+}
+
+Error initialize()
+{
+   using namespace boost::posix_time;
+   s_lastActivity = microsec_clock::universal_time();
+   s_lastMemoryCheck = s_lastActivity;
+
+   using boost::bind;
+   using namespace module_context;
+   events().onBackgroundProcessing.connect(bind(onBackgroundProcessing, _1));
+
+   ExecBlock initBlock ;
+   initBlock.addFunctions()
+      (bind(registerRpcMethod, "get_memory_stats", getMemoryStats));
+   return initBlock.execute();
+}
+
+} // namespace memory
+} // namespace modules
+} // namesapce session
@@ -0,0 +1,41 @@
+/*
+ * SessionMemory.hpp
+ *
+ * Copyright (C) 2009-11 by RStudio, Inc.
+ *
+ * This program is licensed to you under the terms of version 3 of the
+ * GNU Affero General Public License. This program is distributed WITHOUT
+ * ANY EXPRESS OR IMPLIED WARRANTY, INCLUDING THOSE OF NON-INFRINGEMENT,
+ * MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE. Please refer to the
+ * AGPL (http://www.gnu.org/licenses/agpl-3.0.txt) for more details.
+ *
+ */
+
+#ifndef SESSION_MEMORY_HPP
+#define SESSION_MEMORY_HPP
+
+#include <boost/function.hpp>
+
+namespace core {
+   class Error;
+}
+
+namespace session {
+namespace modules {
+namespace memory {
+
+// notify the module of user activity (requests other than get_events)
+void onActivity();
+
+// notify the module that the session is waiting for a request and whether
+// it could suspend now (sessions which can't suspend for memory publish
+// activity so that other sessions don't rank them as idle)
+void onIdle(const boost::function<bool()>& allowSuspend);
+
+core::Error initialize();
+
+} // namespace memory
+} // namespace modules
+} // namesapce session
+
+#endif // SESSION_MEMORY_HPP
@@ -29,6 +29,7 @@
 #include <r/RSexp.hpp>
 #include <r/RExec.hpp>
 #include <r/RFunctionHook.hpp>
+#include <r/RRoutines.hpp>
 
 #include <session/SessionModuleContext.hpp>
 
@@ -174,10 +175,25 @@ Error availablePackagesEnd(const core::json::JsonRpcRequest& request,
    return Success();
 }
 
+SEXP rs_packageLibraryMutated()
+{
+   // broadcast event to server modules
+   module_context::events().onPackageLibraryMutated();
+
+   return R_NilValue;
+}
+
 } // anonymous namespace
 
 Error initialize()
 {
+   // register packageLibraryMutated function
+   R_CallMethodDef methodDef ;
+   methodDef.name = "rs_packageLibraryMutated" ;
+   methodDef.fun = (DL_FUNC) rs_packageLibraryMutated ;
+   methodDef.numArgs = 0;
+   r::routines::addCallMethod(methodDef);
+
    using boost::bind;
    using namespace module_context;
    ExecBlock initBlock ;
@@ -188,7 +204,18 @@ Error initialize()
             availablePackagesEnd))
       (bind(sourceModuleRFile, "SessionPackages.R"))
       (bind(r::exec::executeString, ".rs.packages.initialize()"));
-   return initBlock.execute();
+   Error error = initBlock.execute();
+   if (error)
+      return error;
+
+   // subscribe to attach/detach events of any installed packages which
+   // weren't found by listing the libraries during init (this requires
+   // scanning all of the package libraries so we wait for the session
+   // to be up)
+   addDeferredInitializer("package events",
+                          bind(r::exec::executeString,
+                               ".rs.updatePackageEvents()"));
+   return Success();
 }
 
 
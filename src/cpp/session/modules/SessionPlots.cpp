@@ -650,6 +650,14 @@ void onSysSleep()
    detectChanges(true);
 }
 
+void onBackgroundProcessing(bool isIdle)
+{
+   // resizes are deferred until the client stops requesting them so
+   // check for changes while idle (see graphics::device::setSize)
+   if (isIdle)
+      detectChanges(false);
+}
+
 void onBeforeExecute()
 {
    r::session::graphics::display().onBeforeExecute();
@@ -711,6 +719,8 @@ Error initialize()
    module_context::events().onDetectChanges.connect(bind(onDetectChanges, _1));
    module_context::events().onBeforeExecute.connect(bind(onBeforeExecute));
    module_context::events().onSysSleep.connect(bind(onSysSleep));
+   module_context::events().onBackgroundProcessing.connect(
+                                          bind(onBackgroundProcessing, _1));
 
    // connect to onShowManipulator
    using namespace r::session;
@@ -42,6 +42,7 @@
 #include <core/GitGraph.hpp>
 #include <core/Scope.hpp>
 #include <core/StringUtils.hpp>
+#include <core/text/UnifiedDiff.hpp>
 
 #include <r/RExec.hpp>
 
@@ -1509,6 +1510,25 @@ Error vcsPull(const json::JsonRpcRequest& request,
    return Success();
 }
 
+Error diffFile(std::string path,
+               int mode,
+               int contextLines,
+               std::string* pOutput)
+{
+   if (contextLines < 0)
+      contextLines = 999999999;
+
+   if (static_cast<PatchMode>(mode) == PatchModeStage)
+      splitRename(path, &path, NULL);
+   else
+      splitRename(path, NULL, &path);
+
+   return s_pVcsImpl_->diffFile(resolveAliasedPath(path),
+                                static_cast<PatchMode>(mode),
+                                contextLines,
+                                pOutput);
+}
+
 Error vcsDiffFile(const json::JsonRpcRequest& request,
                   json::JsonRpcResponse* pResponse)
 {
@@ -1524,19 +1544,8 @@ Error vcsDiffFile(const json::JsonRpcRequest& request,
    if (error)
       return error;
 
-   if (contextLines < 0)
-      contextLines = 999999999;
-
-   if (static_cast<PatchMode>(mode) == PatchModeStage)
-      splitRename(path, &path, NULL);
-   else
-      splitRename(path, NULL, &path);
-
    std::string output;
-   error = s_pVcsImpl_->diffFile(resolveAliasedPath(path),
-                                 static_cast<PatchMode>(mode),
-                                 contextLines,
-                                 &output);
+   error = diffFile(path, mode, contextLines, &output);
    if (error)
       return error;
 
@@ -1554,6 +1563,123 @@ Error vcsDiffFile(const json::JsonRpcRequest& request,
    return Success();
 }
 
+// the most recently parsed diff (so that the hunks of a large diff can be
+// fetched a window at a time without re-running the diff)
+struct ParsedDiff
+{
+   ParsedDiff() : mode(-1), contextLines(0) {}
+   std::string path;
+   int mode;
+   int contextLines;
+   text::UnifiedDiff diff;
+};
+ParsedDiff s_parsedDiff;
+
+json::Value diffLineTypeJson(text::DiffLineType type)
+{
+   switch (type)
+   {
+      case text::DiffLineAdded:
+         return "+";
+      case text::DiffLineDeleted:
+         return "-";
+      case text::DiffLineComment:
+         return "\\";
+      case text::DiffLineContext:
+      default:
+         return " ";
+   }
+}
+
+json::Object diffHunkJson(const text::UnifiedDiff& diff,
+                          const text::DiffHunk& hunk)
+{
+   json::Array linesJson;
+   for (std::size_t i = 0; i < hunk.lineCount; i++)
+   {
+      const text::DiffLine& line = diff.lines()[hunk.firstLine + i];
+      json::Array lineJson;
+      lineJson.push_back(diffLineTypeJson(line.type));
+      lineJson.push_back(line.oldLine);
+      lineJson.push_back(line.newLine);
+      lineJson.push_back(diff.lineText(line));
+      linesJson.push_back(lineJson);
+   }
+
+   const text::DiffFile& file = diff.files()[hunk.file];
+   json::Object hunkJson;
+   hunkJson["old_path"] = file.oldPath;
+   hunkJson["new_path"] = file.newPath;
+   hunkJson["header"] = hunk.header;
+   hunkJson["old_start"] = hunk.oldStart;
+   hunkJson["old_count"] = hunk.oldCount;
+   hunkJson["new_start"] = hunk.newStart;
+   hunkJson["new_count"] = hunk.newCount;
+   hunkJson["lines"] = linesJson;
+   return hunkJson;
+}
+
+// structured alternative to vcs_diff_file for large diffs: returns a window
+// of hunks (as parsed lines) along with the total hunk and line counts.
+// the diff is re-run when the first window is requested
+Error vcsDiffFileHunks(const json::JsonRpcRequest& request,
+                       json::JsonRpcResponse* pResponse)
+{
+   std::string path;
+   int mode, contextLines, firstHunk, maxHunks;
+   Error error = json::readParams(request.params,
+                                  &path,
+                                  &mode,
+                                  &contextLines,
+                                  &firstHunk,
+                                  &maxHunks);
+   if (error)
+      return error;
+   if (firstHunk < 0 || maxHunks <= 0)
+      return Error(json::errc::ParamInvalid, ERROR_LOCATION);
+
+   if (firstHunk == 0 ||
+       path != s_parsedDiff.path ||
+       mode != s_parsedDiff.mode ||
+       contextLines != s_parsedDiff.contextLines)
+   {
+      std::string output;
+      error = diffFile(path, mode, contextLines, &output);
+      if (error)
+         return error;
+
+      s_parsedDiff = ParsedDiff();
+      s_parsedDiff.path = path;
+      s_parsedDiff.mode = mode;
+      s_parsedDiff.contextLines = contextLines;
+      s_parsedDiff.diff.parse(output);
+   }
+
+   const text::UnifiedDiff& diff = s_parsedDiff.diff;
+   std::size_t first = std::min(static_cast<std::size_t>(firstHunk),
+                                diff.hunks().size());
+   std::size_t last = std::min(first + maxHunks, diff.hunks().size());
+   json::Array hunksJson;
+   for (std::size_t i = first; i < last; i++)
+      hunksJson.push_back(diffHunkJson(diff, diff.hunks()[i]));
+
+   bool binary = false;
+   BOOST_FOREACH(const text::DiffFile& file, diff.files())
+   {
+      binary = binary || file.binary;
+   }
+
+   json::Object resultJson;
+   resultJson["size"] = static_cast<uint64_t>(diff.size());
+   resultJson["binary"] = binary;
+   resultJson["hunk_count"] = static_cast<int>(diff.hunks().size());
+   resultJson["line_count"] = static_cast<int>(diff.lines().size());
+   resultJson["first_hunk"] = static_cast<int>(first);
+   resultJson["hunks"] = hunksJson;
+   pResponse->setResult(resultJson);
+   return Success();
+}
+
 Error vcsApplyPatch(const json::JsonRpcRequest& request,
                     json::JsonRpcResponse* pResponse)
 {
@@ -2502,6 +2628,35 @@ void onResume(const core::Settings&)
    enqueueRefreshEvent();
 }
 
+Error initializeGit()
+{
+   FilePath gitIgnore = s_pVcsImpl_->root().childPath(".gitignore");
+   Error error = augmentGitIgnore(gitIgnore);
+   if (error)
+      LOG_ERROR(error);
+
+   // Save version
+   core::system::ProcessResult result;
+   error = core::system::runCommand(git() << "--version",
+                                    procOptions(),
+                                    &result);
+   if (error)
+      return error;
+
+   if (result.exitStatus == 0)
+   {
+      boost::smatch matches;
+      if (boost::regex_search(result.stdOut,
+                              matches,
+                              boost::regex("\\d+(\\.\\d+)+")))
+      {
+         string_utils::parseVersion(matches[0], &s_gitVersion);
+      }
+   }
+
+   return Success();
+}
+
 bool tryGit(const FilePath& workingDir)
 {
    // get the git bin dir from settings if it is there
@@ -2527,32 +2682,10 @@ bool tryGit(const FilePath& workingDir)
 
    s_pVcsImpl_.reset(new GitVCSImpl(GitVCSImpl::detectGitDir(workingDir)));
 
-   FilePath gitIgnore = s_pVcsImpl_->root().childPath(".gitignore");
-   Error error = augmentGitIgnore(gitIgnore);
-   if (error)
-      LOG_ERROR(error);
-
-   // Save version
+   // updating .gitignore and checking the version of git (which runs git)
+   // can wait until the session is up
    s_gitVersion = GIT_1_7_2;
-   core::system::ProcessResult result;
-   error = core::system::runCommand(git() << "--version",
-                                    procOptions(),
-                                    &result);
-   if (error)
-      LOG_ERROR(error);
-   else
-   {
-      if (result.exitStatus == 0)
-      {
-         boost::smatch matches;
-         if (boost::regex_search(result.stdOut,
-                                 matches,
-                                 boost::regex("\\d+(\\.\\d+)+")))
-         {
-            string_utils::parseVersion(matches[0], &s_gitVersion);
-         }
-      }
-   }
+   module_context::addDeferredInitializer("git", initializeGit);
 
    return true;
 }
@@ -2662,6 +2795,7 @@ core::Error initialize()
       (bind(registerRpcMethod, "vcs_push", vcsPush))
       (bind(registerRpcMethod, "vcs_pull", vcsPull))
       (bind(registerRpcMethod, "vcs_diff_file", vcsDiffFile))
+      (bind(registerRpcMethod, "vcs_diff_file_hunks", vcsDiffFileHunks))
       (bind(registerRpcMethod, "vcs_apply_patch", vcsApplyPatch))
       (bind(registerRpcMethod, "vcs_history_count", vcsHistoryCount))
       (bind(registerRpcMethod, "vcs_history", vcsHistory))
@@ -17,7 +17,9 @@
 
 #include <boost/bind.hpp>
 #include <boost/format.hpp>
+#include <boost/foreach.hpp>
 #include <boost/utility.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <core/Error.hpp>
 #include <core/Log.hpp>
@@ -32,6 +34,7 @@
 #include <r/session/RSession.hpp>
 
 #include <session/SessionModuleContext.hpp>
+#include <session/SessionOptions.hpp>
 #include <session/SessionUserSettings.hpp>
 
 using namespace core ;
@@ -57,58 +60,15 @@ bool handleRBrowseEnv(const core::FilePath& filePath)
    }
 }
 
-json::Value classOfGlobalVar(SEXP globalVar)
-{
-   std::string value;
-   Error error = r::exec::RFunction(".rs.getSingleClass",
-                                    globalVar).call(&value);
-   if (error)
-   {
-      LOG_ERROR(error);
-      return json::Value(); // return null
-   }
-   else
-   {
-      return value;
-   }
-}
-
-json::Value valueOfGlobalVar(SEXP globalVar)
-{
-   std::string value;
-   Error error = r::exec::RFunction(".rs.valueAsString",
-                                    globalVar).call(&value);
-   if (error)
-   {
-      LOG_ERROR(error);
-      return json::Value(); // return null
-   }
-   else
-   {
-      return value;
-   }
-}
-
-json::Value descriptionOfGlobalVar(SEXP globalVar)
-{
-   std::string value;
-   Error error = r::exec::RFunction(".rs.valueDescription",
-                                    globalVar).call(&value);
-   if (error)
-   {
-      LOG_ERROR(error);
-      return json::Value(); // return null
-   }
-   else
-   {
-      return value;
-   }
-}
-
-json::Value jsonValueForGlobalVar(const std::string& name)
+// describe a global variable. variables which need to be probed for their
+// class, value and description are returned with nulls for these and
+// with pDescribe set (so they can then be described together using
+// describeGlobalVars)
+json::Object jsonValueForGlobalVar(const std::string& name, bool* pDescribe)
 {
    json::Object jsonObject ;
    jsonObject["name"] = name;
+   *pDescribe = false;
    
    // get R alias to object and get its type and lengt
    //
@@ -121,14 +81,28 @@ json::Value jsonValueForGlobalVar(const std::string& name)
    // assignment language expressions show up as "(unknown)" but then are
    // correctly displayed in refreshed listings of the workspace.
    //
+   // objects from a lazily restored session which haven't yet been read
+   // are described using the metadata saved with them (probing them would
+   // force them to be read)
+   std::string className;
+   int length;
+   if (r::session::isDeferredWorkspaceObject(name, &className, &length))
+   {
+      jsonObject["type"] = className;
+      jsonObject["len"] = length;
+      jsonObject["value"] = std::string("(not yet loaded)");
+      jsonObject["extra"] = json::Value(); // null
+      return jsonObject;
+   }
+
    SEXP globalVar = findVar(name);
    if ((globalVar != R_UnboundValue) && !r::sexp::isLanguage(globalVar))
    {
-      Protect rProtect(globalVar);
-      jsonObject["type"] = classOfGlobalVar(globalVar);
-      jsonObject["len"] = length(globalVar);
-      jsonObject["value"] = valueOfGlobalVar(globalVar);
-      jsonObject["extra"] = descriptionOfGlobalVar(globalVar);
+      jsonObject["type"] = json::Value(); // null
+      jsonObject["len"] = r::sexp::length(globalVar);
+      jsonObject["value"] = json::Value(); // null
+      jsonObject["extra"] = json::Value(); // null
+      *pDescribe = true;
    }
    else
    {
@@ -141,6 +115,54 @@ json::Value jsonValueForGlobalVar(const std::string& name)
    return jsonObject;
 }
 
+void setDescription(const std::vector<std::string>& descriptions,
+                    std::size_t index,
+                    const char* field,
+                    json::Object* pObject)
+{
+   if (index < descriptions.size())
+      (*pObject)[field] = descriptions[index];
+}
+
+// fill in the class, value and description of global variables using a
+// single call to .rs.describeObjects (rather than three calls for each)
+void describeGlobalVars(const std::vector<std::string>& names,
+                        std::vector<json::Object*>* pObjects)
+{
+   if (names.empty())
+      return;
+
+   r::sexp::Protect rProtect;
+   SEXP descriptionsSEXP;
+   Error error = r::exec::RFunction(".rs.describeObjects", names)
+                                       .call(&descriptionsSEXP, &rProtect);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return; // leave nulls
+   }
+
+   std::vector<std::string> types, values, extra;
+   error = r::sexp::getNamedListElement(descriptionsSEXP, "types", &types);
+   if (!error)
+      error = r::sexp::getNamedListElement(descriptionsSEXP, "values", &values);
+   if (!error)
+      error = r::sexp::getNamedListElement(descriptionsSEXP, "extra", &extra);
+   if (error)
+   {
+      LOG_ERROR(error);
+      return;
+   }
+
+   for (std::size_t i = 0; i < pObjects->size(); i++)
+   {
+      json::Object* pObject = pObjects->at(i);
+      setDescription(types, i, "type", pObject);
+      setDescription(values, i, "value", pObject);
+      setDescription(extra, i, "extra", pObject);
+   }
+}
+
 void enqueRefreshEvent()
 {
    ClientEvent refreshEvent(client_events::kWorkspaceRefresh);
@@ -153,14 +175,30 @@ void enqueRemovedEvent(const r::sexp::Variable& variable)
    module_context::enqueClientEvent(removedEvent);
 }
 
-void enqueAssignedEvent(const r::sexp::Variable& variable)
-{   
-   // get object info
-   json::Value objInfo = jsonValueForGlobalVar(variable.first);
-   
-   // enque event
-   ClientEvent assignedEvent(client_events::kWorkspaceAssign, objInfo);
-   module_context::enqueClientEvent(assignedEvent);
+void enqueAssignedEvents(const std::vector<r::sexp::Variable>& variables)
+{
+   // get object info (describing all of the objects which need it at once)
+   std::vector<json::Object> objects(variables.size());
+   std::vector<std::string> describeNames;
+   std::vector<json::Object*> describeObjects;
+   for (std::size_t i = 0; i < variables.size(); i++)
+   {
+      bool describe;
+      objects[i] = jsonValueForGlobalVar(variables[i].first, &describe);
+      if (describe)
+      {
+         describeNames.push_back(variables[i].first);
+         describeObjects.push_back(&objects[i]);
+      }
+   }
+   describeGlobalVars(describeNames, &describeObjects);
+
+   // enque events
+   BOOST_FOREACH(const json::Object& objInfo, objects)
+   {
+      ClientEvent assignedEvent(client_events::kWorkspaceAssign, objInfo);
+      module_context::enqueClientEvent(assignedEvent);
+   }
 }
 
 // last save action.
@@ -217,12 +255,17 @@ void onResume(const Settings& settings)
 
 // detect changes in the environment by inspecting the list of variable
 // names as well as the SEXP pointers (a new pointer implies a mutation of
-// an object)
+// an object). the environment is only listed and compared with the previous
+// listing when its fingerprint (computed cheaply from the same names and
+// pointers) changes, so checks are inexpensive even for workspaces with
+// many thousands of objects
 class GlobalEnvironmentMonitor : boost::noncopyable
 {
 public:
    GlobalEnvironmentMonitor() 
-      : initialized_(false) 
+      : initialized_(false),
+        lastFingerprint_(0),
+        checkPending_(false)
    {
    }
    
@@ -230,10 +273,44 @@ public:
    {
       initialized_ = false;
       lastEnv_.clear();
+      checkPending_ = false;
+   }
+
+   // check for changes unless we checked very recently, in which case the
+   // check is deferred to checkPendingChanges (this coalesces the changes
+   // made by bursts of calls into a single set of events)
+   void checkForChangesThrottled()
+   {
+      using namespace boost::posix_time;
+      if (initialized_ &&
+          (microsec_clock::universal_time() - lastCheckTime_) <
+                                                      milliseconds(250))
+      {
+         checkPending_ = true;
+      }
+      else
+      {
+         checkForChanges();
+      }
+   }
+
+   void checkPendingChanges()
+   {
+      if (checkPending_)
+         checkForChanges();
    }
    
    void checkForChanges()
    {
+      checkPending_ = false;
+      lastCheckTime_ = boost::posix_time::microsec_clock::universal_time();
+
+      // nothing to do if no variables have been added, removed or assigned
+      std::size_t fingerprint = environmentFingerprint(R_GlobalEnv, false);
+      if (initialized_ && (fingerprint == lastFingerprint_))
+         return;
+      lastFingerprint_ = fingerprint;
+
       // get the current environment
       std::vector<r::sexp::Variable> currentEnv ;
       listEnvironment(&currentEnv);
@@ -265,11 +342,6 @@ public:
                                 boost::bind(
                                   &GlobalEnvironmentMonitor::compareVarName,
                                   this, _1, _2));
-                                
-            // fire removed event for deletes
-            std::for_each(removedVars.begin(), 
-                          removedVars.end(), 
-                          enqueRemovedEvent);
             
             // find adds & assigns (all variable name/value combinations in the 
             // current environment but NOT in the previous environment)
@@ -277,11 +349,23 @@ public:
             std::set_difference(currentEnv.begin(), currentEnv.end(),
                                 lastEnv_.begin(), lastEnv_.end(),
                                 std::back_inserter(addedVars));
-                                
-            // fire assigned event for adds & assigns
-            std::for_each(addedVars.begin(), 
-                          addedVars.end(), 
-                          enqueAssignedEvent);
+
+            // when many variables change at once (e.g. a script or load)
+            // a single refresh is cheaper than describing each of them
+            if ((removedVars.size() + addedVars.size()) > 100)
+            {
+               enqueRefreshEvent();
+            }
+            else
+            {
+               // fire removed event for deletes
+               std::for_each(removedVars.begin(),
+                             removedVars.end(),
+                             enqueRemovedEvent);
+
+               // fire assigned events for adds & assigns
+               enqueAssignedEvents(addedVars);
+            }
          }
       }
       
@@ -291,17 +375,18 @@ public:
       // the pointer values not the underlying R objects. if we want to be
       // able to manipulate the SEXPs directly we'll need a static protection
       // context so the objects are guaranteed to survive until the next call
-      lastEnv_ = currentEnv;
+      lastEnv_.swap(currentEnv);
    }
    
 private:
    
    void listEnvironment(std::vector<r::sexp::Variable>* pEnvironment)
    {
-      // get the variables currently in the global environment (note this list
-      // is guaranteed to be sorted based on the behavior of R_lsInternal)
-      r::sexp::Protect rProtect;
-      r::sexp::listEnvironment(R_GlobalEnv, false, &rProtect, pEnvironment);   
+      // get the variables currently in the global environment (using the
+      // values of forced promises so that reading an object which was
+      // restored lazily is seen as an assignment) sorted by name
+      r::sexp::listEnvironmentBindings(R_GlobalEnv, false, pEnvironment);
+      std::sort(pEnvironment->begin(), pEnvironment->end());
    }
    
    // helper to deterine whether two variables have the same name
@@ -313,6 +398,9 @@ private:
 private:
    std::vector<r::sexp::Variable> lastEnv_; 
    bool initialized_ ;
+   std::size_t lastFingerprint_;
+   boost::posix_time::ptime lastCheckTime_;
+   bool checkPending_;
 };
 
 // global environment monitor
@@ -330,13 +418,34 @@ void onClientInit()
  
 void onDetectChanges(module_context::ChangeSource source)
 {
-   // check global environment
-   s_globalEnvironmentMonitor.checkForChanges();
+   // check global environment (changes made by RPCs, many of which are
+   // made as the user types, are checked for at most every 250ms)
+   if (source == module_context::ChangeSourceRPC)
+      s_globalEnvironmentMonitor.checkForChangesThrottled();
+   else
+      s_globalEnvironmentMonitor.checkForChanges();
 
    // check for save action changed
    checkForSaveActionChanged();
 }
 
+void onBackgroundProcessing(bool isIdle)
+{
+   if (isIdle)
+   {
+      // report changes from checks which were throttled
+      s_globalEnvironmentMonitor.checkPendingChanges();
+
+      // read an object which was restored lazily (one per idle period so
+      // we remain responsive to the client)
+      if (session::options().restorePrefetch() &&
+          r::session::prefetchDeferredWorkspaceObject())
+      {
+         s_globalEnvironmentMonitor.checkForChanges();
+      }
+   }
+}
+
 } // anonymous namespace
  
 Error initialize()
@@ -349,6 +458,7 @@ Error initialize()
    using boost::bind;
    events().onClientInit.connect(bind(onClientInit));
    events().onDetectChanges.connect(bind(onDetectChanges, _1));
+   events().onBackgroundProcessing.connect(bind(onBackgroundProcessing, _1));
    
    // register handlers
    ExecBlock initBlock ;